@@ -63,6 +63,9 @@ CRITICAL_SECTION ldvLock;
 #define LDV_LOCK_Q EnterCriticalSection(&ldvLock);
 #define LDV_UNLOCK_Q LeaveCriticalSection(&ldvLock);
 
+// Signalled whenever a frame is queued on any handle.  Used by vldv_wait().
+HANDLE ldvEvent = NULL;
+
 class WinLdv : public VniProtocolAnalyzerControl
 {
 public:
@@ -71,6 +74,10 @@ public:
 		pSicbs = NULL;
 		bTerminating = false;
 		InitializeCriticalSection(&ldvLock);
+		if (ldvEvent == NULL)
+		{
+			ldvEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+		}
 	}
 
 	virtual void packetArrivedEx(TimeStampedPkt *pPacket, int length, int packetNumber);
@@ -100,6 +107,7 @@ void WinLdv::packetArrivedEx(TimeStampedPkt *pPacket, int length, int packetNumb
 		while (*pq != NULL) pq = &(*pq)->pNext;
 		*pq = p;
 		LDV_UNLOCK_Q;
+		SetEvent(ldvEvent);
 	}
 }
 
@@ -233,6 +241,21 @@ LDVCode vldv_write(short handle, pVoid msg_p, short len)
 	return rtn;
 }
 
+LDVCode vldv_wait(unsigned long timeout)
+{
+	LDVCode rtn = LDV_NO_MSG_AVAIL;
+
+	if (ldvEvent == NULL)
+	{
+		Sleep(timeout);
+	}
+	else if (WaitForSingleObject(ldvEvent, timeout) == WAIT_OBJECT_0)
+	{
+		rtn = LDV_OK;
+	}
+	return rtn;
+}
+
 #pragma warning (disable:4706)
 #undef STRICT
 #include <delayhlp.cpp>
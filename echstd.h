@@ -104,7 +104,7 @@ do { \
 //
 #include "EchelonStandardDefinitions.h"
 
-#ifdef WIN32
+#if defined(WIN32) || defined(__linux__)
 #define __monitor
 #define BIGADDR
 #endif
@@ -29,11 +29,16 @@
 // Any APP wishing to use LCS must do the following:
 // 1. Call LCS_Init() during initialization
 // 2. Call LCS_Service() as often as practical (e.g., once per millisecond)
+//    or, with LCS_EVENT_SCHEDULER, wait LCS_IdleTime() ms between calls
+// 3. Call LCS_PowerFail() on power failure to save pending configuration changes
+//
+// With LCS_THREAD_PER_STACK, LCS_Run() does all of this with a thread per stack.
 //
 
 #include "lcs_eia709_1.h"
 #include "lcs_custom.h"
 #include "lcs_node.h"
+#include "vldv.h"	// For WAIT_FOR_WORK
 
 // Application init functions
 extern Status AppInit(void); /* Init function for application program */
@@ -57,120 +62,354 @@ extern void NWReceive(void);
 extern void LKReceive(void);
 extern void PHYReceive(void);
 
+extern Boolean TSAPending(uint32 *remainingOut);
+
 #define LED_TIMER_VALUE      1000  /* How often to flash in ms */
 #define CHECKSUM_TIMER_VALUE 1000  /* How often to check config checksum? */
+#define CHECKSUM_SLICE         64  /* Config bytes checked each time */
+
+#if LCS_EVENT_SCHEDULER
+/* A layer runs if one of its queues was written or read since the last
+   pass, or if it still had queued items at the end of the last pass. */
+#define LAYER_READY(bit) (((ready | gp->readyMask) & (bit)) != 0)
+
+/* Returns the LCS_READY_xxx bits of the layers that have queued items. */
+static uint8 PendingLayers(void)
+{
+	uint8 pending = 0;
+
+	if (!QueueEmpty(&gp->appInQ) || !QueueEmpty(&gp->appOutQ) ||
+		!QueueEmpty(&gp->appOutPriQ) || !QueueEmpty(&gp->nvOutIndexQ) ||
+		!QueueEmpty(&gp->nvInIndexQ) || gp->manualServiceRequest ||
+		gp->callMsgFree || gp->callRespFree)
+	{
+		pending |= LCS_READY_APP;
+	}
+	if (!QueueEmpty(&gp->tsaInQ) || !QueueEmpty(&gp->tsaOutQ) ||
+		!QueueEmpty(&gp->tsaOutPriQ) || !QueueEmpty(&gp->tsaRespQ))
+	{
+		pending |= LCS_READY_TSA;
+	}
+	if (!QueueEmpty(&gp->nwInQ) || !QueueEmpty(&gp->nwOutQ) ||
+		!QueueEmpty(&gp->nwOutPriQ))
+	{
+		pending |= LCS_READY_NW;
+	}
+	if (!QueueEmpty(&gp->lkOutQ) || !QueueEmpty(&gp->lkOutPriQ))
+	{
+		pending |= LCS_READY_LK;
+	}
+	return pending;
+}
+#else
+#define LAYER_READY(bit) TRUE
+#endif
+
+/* Makes stackNum the current stack, the one that gp, eep, nmp and cp
+   point at. With LCS_THREAD_PER_STACK these are per thread. */
+void LCS_SelectStack(int stackNum)
+{
+	gp  = &protocolStackDataGbl[stackNum];
+	eep = &eeprom[stackNum];
+	nmp = &nm[stackNum];
+	cp  = &customDataGbl[stackNum];
+}
+
+/* Resets the current stack at power up and starts its application. */
+static Status InitStack(void)
+{
+    gp->resetOk = TRUE;
+    nmp->resetCause = POWER_UP_RESET;
+    NodeReset(TRUE);
+    if (!gp->resetOk)
+    {
+        return(FAILURE); /* Leave main and loop. */
+    }
+    /* Call APPInit and AppInit once before the loop. */
+    APPInit();
+    if (AppInit() == FAILURE)
+    {
+        return(FAILURE);
+    }
+    /* Compute the configCheckSum for the first time. NodeReset
+       will not verify checkSum firt time. */
+    eep->configCheckSum   = ComputeConfigCheckSum();
+
+    MsTimerSet(&gp->ledTimer, LED_TIMER_VALUE);
+	MsTimerSet(&gp->checksumTimer, CHECKSUM_TIMER_VALUE); /* Initial value */
+	return SUCCESS;
+}
 
 Status LCS_Init()
 {
-    uint8   stackNum;
+    int     stackNum;
 
     /* First init EEPROM based on custom.h, custom.c and default
        values for several variables */
     for (stackNum = 0; stackNum < NUM_STACKS; stackNum++)
     {
-        eep = &eeprom[stackNum];
-        cp  = &customDataGbl[stackNum];
-        nmp = &nm[stackNum];
+        LCS_SelectStack(stackNum);
         InitEEPROM();
     }
 
     /* Reset the node at the start */
     for (stackNum = 0; stackNum < NUM_STACKS; stackNum++)
     {
-        gp = &protocolStackDataGbl[stackNum];
-        eep = &eeprom[stackNum];
-        nmp = &nm[stackNum];
-        gp->resetOk = TRUE;
-        nmp->resetCause = POWER_UP_RESET;
-        NodeReset(TRUE);
-        if (!gp->resetOk)
-        {
-            return(FAILURE); /* Leave main and loop. */
-        }
-        /* Call APPInit and AppInit once before the loop. */
-        APPInit();
-        if (AppInit() == FAILURE)
+        LCS_SelectStack(stackNum);
+        if (InitStack() == FAILURE)
         {
             return(FAILURE);
         }
-        /* Compute the configCheckSum for the first time. NodeReset
-           will not verify checkSum firt time. */
-        eep->configCheckSum   = ComputeConfigCheckSum();
-
-	    MsTimerSet(&gp->ledTimer, LED_TIMER_VALUE);
-		MsTimerSet(&gp->checksumTimer, CHECKSUM_TIMER_VALUE); /* Initial value */
     }
 	return SUCCESS;
 }
 
-void LCS_Service()
+/* Runs the layers of the current stack once. Fails if the node could
+   not be reset. */
+static Status ServiceStack(void)
 {
-	int stackNum;
-    for (stackNum = 0; stackNum < NUM_STACKS; stackNum++)
-    {
-		gp  = &protocolStackDataGbl[stackNum];
-		eep = &eeprom[stackNum];
-		nmp = &nm[stackNum];
+#if LCS_EVENT_SCHEDULER
+	uint8  ready;
+	uint32 remaining;
+#endif
 
-		/* Check if the node needs to be reset. */
-		if (gp->resetNode)
-		{
-			gp->resetOk = TRUE;
-			NodeReset(FALSE);
-			if (!gp->resetOk)
-			{
-				return; 
-			}
-			continue; /* Easy way to do scheduler reset, */
-		}
+	/* Check if the node needs to be reset. */
+	if (gp->resetNode)
+	{
+		gp->resetOk = TRUE;
+		NodeReset(FALSE);
+		/* Easy way to do scheduler reset, */
+		return gp->resetOk ? SUCCESS : FAILURE;
+	}
 
-		/* Call the application program, if needed. */
-		if (AppPgmRuns())
-		{
-			DoApp(); /* Call the application. Let it do whatever it wants. */
-		}
+	/* Call the application program, if needed. */
+#if LCS_EVENT_SCHEDULER
+	ready = gp->readyMask | gp->backlogMask;
+	gp->readyMask = 0;
+#endif
+	if (AppPgmRuns())
+	{
+		DoApp(); /* Call the application. Let it do whatever it wants. */
+#if LCS_EVENT_SCHEDULER
+		ready |= LCS_READY_APP; /* It may have used any of the APIs */
+#endif
+	}
+#if LCS_EVENT_SCHEDULER
+	/* Transmit and receive records have timers to service. */
+	remaining = 0;
+	if (TSAPending(&remaining))
+	{
+		ready |= LCS_READY_TSA;
+	}
+#endif
 
-		/* Call all the Send functions */
+	/* Call all the Send functions */
+	if (LAYER_READY(LCS_READY_APP))
+	{
 		APPSend();
+	}
+	if (LAYER_READY(LCS_READY_TSA))
+	{
 		SNSend();
 		TPSend();
 		AuthSend();
+	}
+	if (LAYER_READY(LCS_READY_NW))
+	{
 		NWSend();
-		LKSend();
+	}
+	LKSend(); /* Always called. It also services the transceiver. */
 
-		/* Call all the Receive functions. */
-		LKReceive();
+	/* Call all the Receive functions. The link layer is always
+	   called as it polls the driver. */
+	LKReceive();
+	if (LAYER_READY(LCS_READY_NW))
+	{
 		NWReceive();
+	}
+	if (LAYER_READY(LCS_READY_TSA))
+	{
 		AuthReceive();
 		TPReceive();
 		SNReceive();
+	}
+	if (LAYER_READY(LCS_READY_APP))
+	{
 		APPReceive();
+	}
+#if LCS_EVENT_SCHEDULER
+	gp->backlogMask = PendingLayers();
+#endif
 
-		/* Flash service LED if needed. */
-		if (MsTimerExpired(&gp->ledTimer))
+	/* Flash service LED if needed. */
+	if (MsTimerExpired(&gp->ledTimer))
+	{
+		if (eep->readOnlyData.nodeState == APPL_UNCNFG)
 		{
-			if (eep->readOnlyData.nodeState == APPL_UNCNFG)
-			{
-				TOGGLE_SERVICE_LED;
-			}
-			MsTimerSet(&gp->ledTimer, LED_TIMER_VALUE); /* Reset timer */
+			TOGGLE_SERVICE_LED;
 		}
+		MsTimerSet(&gp->ledTimer, LED_TIMER_VALUE); /* Reset timer */
+	}
 
-		/* Check for integrity of config structure */
-		if (MsTimerExpired(&gp->checksumTimer))
+	/* Check for integrity of config structure */
+	if (MsTimerExpired(&gp->checksumTimer))
+	{
+		if (NodeConfigured() && !ConfigCheckSumStep(CHECKSUM_SLICE))
 		{
-			if (NodeConfigured() &&
-					eep->configCheckSum != ComputeConfigCheckSum() )
-			{
-				/* Go unconfigured and reset. */
-				eep->readOnlyData.nodeState = APPL_UNCNFG;
-				gp->appPgmMode  = ON_LINE;
-				OfflineEvent();  /* Indicate to application program. */
-				gp->resetNode = TRUE;
-				nmp->resetCause = SOFTWARE_RESET;
-				LCS_RecordError(CNFG_CS_ERROR);
-			}
-			MsTimerSet(&gp->checksumTimer, CHECKSUM_TIMER_VALUE);
+			/* Go unconfigured and reset. */
+			eep->readOnlyData.nodeState = APPL_UNCNFG;
+			gp->appPgmMode  = ON_LINE;
+			OfflineEvent();  /* Indicate to application program. */
+			gp->resetNode = TRUE;
+			nmp->resetCause = SOFTWARE_RESET;
+			LCS_RecordError(CNFG_CS_ERROR);
 		}
+		MsTimerSet(&gp->checksumTimer, CHECKSUM_TIMER_VALUE);
 	}
-}
\ No newline at end of file
+
+	/* Write configuration changes to NVM once they settle. */
+	LCS_ServiceNvm();
+	return SUCCESS;
+}
+
+void LCS_Service()
+{
+	int stackNum;
+
+    for (stackNum = 0; stackNum < NUM_STACKS; stackNum++)
+    {
+		LCS_SelectStack(stackNum);
+		if (ServiceStack() == FAILURE)
+		{
+			return;
+		}
+	}
+}
+
+void LCS_PowerFail()
+{
+	int stackNum;
+	for (stackNum = 0; stackNum < NUM_STACKS; stackNum++)
+	{
+		LCS_SelectStack(stackNum);
+		LCS_FlushNvm();
+	}
+}
+
+#if LCS_EVENT_SCHEDULER
+/* Returns how long the current stack can wait, at most idleTime ms. */
+static uint32 StackIdleTime(uint32 idleTime)
+{
+	uint32 remaining;
+
+	/* Queues were touched during the last pass so go again. */
+	if (gp->resetNode || gp->readyMask)
+	{
+		return 0;
+	}
+
+	/* The PAL programs and erases a step per pass, so keep going while it
+	   has any queued. */
+	if (LCS_NvmPending())
+	{
+		return 0;
+	}
+
+	/* Work is left over, e.g. waiting for room further along. Nothing
+	   will wake us up for it so poll as often as before. */
+	if (PendingLayers() && idleTime > 1)
+	{
+		idleTime = 1;
+	}
+
+	remaining = TMR_Remaining(&gp->ledTimer);
+	if (remaining < idleTime)
+	{
+		idleTime = remaining;
+	}
+	remaining = TMR_Remaining(&gp->checksumTimer);
+	if (remaining < idleTime)
+	{
+		idleTime = remaining;
+	}
+	if (gp->nvmDirty)
+	{
+		remaining = TMR_Remaining(&gp->nvmWriteTimer);
+		if (remaining < idleTime)
+		{
+			idleTime = remaining;
+		}
+	}
+	TSAPending(&idleTime);
+	return idleTime;
+}
+
+uint32 LCS_IdleTime()
+{
+	int    stackNum;
+	uint32 idleTime = LCS_MAX_IDLE_TIME;
+
+	for (stackNum = 0; stackNum < NUM_STACKS && idleTime; stackNum++)
+	{
+		LCS_SelectStack(stackNum);
+		idleTime = StackIdleTime(idleTime);
+	}
+	return idleTime;
+}
+#else
+/* The polling loop has no idea when there is work, so never wait. */
+uint32 LCS_IdleTime()
+{
+	return 0;
+}
+#endif
+
+#ifdef LCS_THREAD_PER_STACK
+/* Initializes one stack and services it until it fails, e.g. because
+   the node could not be reset. */
+static LCS_THREAD_PROC(StackThread, pStackNum)
+{
+	Status sts;
+
+	LCS_SelectStack((int)(size_t)pStackNum);
+	sts = InitStack();
+	while (sts == SUCCESS)
+	{
+		sts = ServiceStack();
+#if LCS_EVENT_SCHEDULER
+		WAIT_FOR_WORK(StackIdleTime(LCS_MAX_IDLE_TIME));
+#else
+		TAKE_A_BREAK;
+#endif
+	}
+	return 0;
+}
+
+Status LCS_Run()
+{
+	static LcsThread threads[NUM_STACKS];
+	int stackNum;
+
+	/* As LCS_Init() does, set up all the EEPROMs before any stack is
+	   reset. */
+	for (stackNum = 0; stackNum < NUM_STACKS; stackNum++)
+	{
+		LCS_SelectStack(stackNum);
+		InitEEPROM();
+	}
+
+	for (stackNum = 0; stackNum < NUM_STACKS; stackNum++)
+	{
+		if (!LCS_THREAD_START(threads[stackNum], StackThread, (void*)(size_t)stackNum))
+		{
+			return FAILURE;
+		}
+	}
+	/* The threads only stop when their stack fails */
+	for (stackNum = 0; stackNum < NUM_STACKS; stackNum++)
+	{
+		LCS_THREAD_JOIN(threads[stackNum]);
+	}
+	return FAILURE;
+}
+#endif
\ No newline at end of file
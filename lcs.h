@@ -30,3 +30,13 @@
 
 Status LCS_Init(void);
 void LCS_Service(void);
+// Returns how many milliseconds the caller may wait before LCS_Service() has work to do again
+uint32 LCS_IdleTime(void);
+// Writes any configuration changes not yet saved to NVM.  Call this when power is failing.
+void LCS_PowerFail(void);
+// Makes the given stack the one that the APIs act on.  LCS_Service() and the callbacks it makes select it for you.
+void LCS_SelectStack(int stackNum);
+#ifdef LCS_THREAD_PER_STACK
+// Initializes the stacks and services each one on its own thread.  Returns once no stack is running.
+Status LCS_Run(void);
+#endif
@@ -348,13 +348,14 @@ void APPReset(void)
     gp->appInQCnt     = DecodeBufferCnt((uint8)eep->readOnlyData.appInBufCnt);
     queueItemSize    = gp->appInBufSize + sizeof(APPReceiveParam);
 
-    if (QueueInit(&gp->appInQ, queueItemSize, gp->appInQCnt)
-            != SUCCESS)
+    if (QueueInitPooled(&gp->appInQ, queueItemSize, gp->appInQCnt,
+                        &gp->inPool) != SUCCESS)
     {
         ErrorMsg("APPReset: Unable to init Input Queue.\n");
         gp->resetOk = FALSE;
         return;
     }
+    QueueSetReadyBit(&gp->appInQ, &gp->readyMask, LCS_READY_APP);
 
     /* Allocate and Initialize Output Queue */
     gp->appOutBufSize =
@@ -370,6 +371,7 @@ void APPReset(void)
         gp->resetOk = FALSE;
         return;
     }
+    QueueSetReadyBit(&gp->appOutQ, &gp->readyMask, LCS_READY_APP);
 
     /* Allocate and Initialize Pri Output Queue */
     gp->appOutPriBufSize = gp->appOutBufSize;
@@ -384,6 +386,7 @@ void APPReset(void)
         gp->resetOk = FALSE;
         return;
     }
+    QueueSetReadyBit(&gp->appOutPriQ, &gp->readyMask, LCS_READY_APP);
 
     /* Allocate Queue for NV output variable scheduling */
     gp->nvOutIndexQCnt    = MAX_NV_OUT;
@@ -395,6 +398,7 @@ void APPReset(void)
         gp->resetOk = FALSE;
         return;
     }
+    QueueSetReadyBit(&gp->nvOutIndexQ, &gp->readyMask, LCS_READY_APP);
     gp->nvOutStatus      = SUCCESS; /* Propagate succeeds if all the scheduled
                                       transactions complete successfully. */
     gp->nvOutCanSchedule = TRUE;
@@ -409,6 +413,7 @@ void APPReset(void)
         gp->resetOk = FALSE;
         return;
     }
+    QueueSetReadyBit(&gp->nvInIndexQ, &gp->readyMask, LCS_READY_APP);
     gp->nvInDataStatus  = FAILURE; /* See node.h for usage */
     gp->nvInTranStatus  = SUCCESS; /* See node.h for usage */
     gp->nvInCanSchedule = TRUE;
@@ -1749,6 +1754,9 @@ int16 AddNV(NVDefinition *dp)
 
     nmp->nvTableSize += dim;
 
+    /* The new entries need indexing and the alias indices have moved. */
+    NVSelectorIndexBuild();
+
     return(nmp->nvTableSize - dim); /* Base index for arrays. */
 }
 
@@ -1821,13 +1829,13 @@ static void ProcessNVPoll(APPReceiveParam *appReceiveParamPtr,
 {
     int16          i;
     uint8          nvDirection;
-    uint16         selector, thisSelector;
+    uint16         selector;
     int16          matchingIndex;
     uint16         matchingPrimaryIndex;
     Queue         *tsaOutQPtr;
     TSASendParam  *tsaSendParamPtr;
     APDU          *apduRespPtr;
-    NVStruct      *thisNVStrPtr, *matchingNVStrPtr;
+    NVStruct      *matchingNVStrPtr;
     Boolean        authOK;
     Boolean        noData; /* Should data go out? */
 
@@ -1866,33 +1874,23 @@ static void ProcessNVPoll(APPReceiveParam *appReceiveParamPtr,
     /* We know that the node is configured at this point */
     if (AppPgmRuns())
     {
-        /* Search for matching network variable. Search both primary
-           and alias entries */
-        for (i = 0; i < nmp->nvTableSize+NV_ALIAS_TABLE_SIZE; i++)
+        /* Look up the matching network variables, both primary
+           and alias entries, in index order. */
+        for (i = NVSelectorLookup(selector, nvDirection, -1); i != -1;
+                i = NVSelectorLookup(selector, nvDirection, i))
         {
-            thisNVStrPtr     = GetNVStructPtr(i);
-            thisSelector =
-                (thisNVStrPtr->nvSelectorHi << 8) | thisNVStrPtr->nvSelectorLo;
-            if (thisNVStrPtr->nvDirection == nvDirection &&
-                    thisSelector              == selector)
+            if (matchingIndex == -1)
             {
-                if (matchingIndex == -1)
-                {
-                    matchingIndex = i; /* First match. */
-                }
-                else if (GetPrimaryIndex(matchingIndex) ==
-                         GetPrimaryIndex(i))
-                {
-                    /* We have two distinct primary variables with same
-                       selector. Ignore this message. */
-					SendNullResponse(appReceiveParamPtr->reqId);
-                    DeQueue(&gp->appInQ);
-                    return;
-                }
+                matchingIndex = i; /* First match. */
             }
-            else
+            else if (GetPrimaryIndex(matchingIndex) ==
+                     GetPrimaryIndex(i))
             {
-                continue; /* Skip this entry. Does not match. */
+                /* We have two distinct primary variables with same
+                   selector. Ignore this message. */
+				SendNullResponse(appReceiveParamPtr->reqId);
+                DeQueue(&gp->appInQ);
+                return;
             }
         }
     }
@@ -1982,13 +1980,12 @@ Comments:  The message should have > 2 bytes.
 static void ProcessNVUpdate(APPReceiveParam *appReceiveParamPtr,
                             APDU            *apduPtr)
 {
-    int16          i;
     uint16         dataLength, matchingDataLength;
     uint8          nvDirection;
-    uint16         selector, thisSelector;
+    uint16         selector;
     int16          matchingIndex;
     uint16         matchingPrimaryIndex;
-    NVStruct      *thisNVStrPtr, *matchingNVStrPtr;
+    NVStruct      *matchingNVStrPtr;
     Boolean        authOK;
     uint16         thisDim;
     int16          thisBaseIndex;
@@ -2021,24 +2018,8 @@ static void ProcessNVUpdate(APPReceiveParam *appReceiveParamPtr,
 
     dataLength = appReceiveParamPtr->pduSize - 2; /* data length in message */
 
-    /* Go through network input variables looking for a match. Once
-       a match is found, update it and break. */
-    matchingIndex = -1;
-    for (i = 0; i < nmp->nvTableSize + NV_ALIAS_TABLE_SIZE; i++)
-    {
-        thisNVStrPtr = GetNVStructPtr(i);
-        thisSelector =
-            (thisNVStrPtr->nvSelectorHi << 8) | thisNVStrPtr->nvSelectorLo;
-        if (thisNVStrPtr->nvDirection == NV_OUTPUT)
-        {
-            continue; /* Skip network output variables */
-        }
-        if (thisSelector == selector)
-        {
-            matchingIndex = i;
-            break;
-        }
-    }
+    /* Find the first network input variable with a matching selector. */
+    matchingIndex = NVSelectorLookup(selector, NV_INPUT, -1);
 
     if (matchingIndex != -1)
     {
@@ -2477,12 +2458,11 @@ static void SendVar()
     int16           baseIndexIn;    /* For input network variable */
     uint16          nvLengthIn;     /* For input network variable */
     Byte           *nvPtrIn;        /* For input network variable */
-    uint16          selectorIn;     /* For input network variable */
     Queue          *nwOutQPtr, *tsaOutQPtr;
     TSASendParam   *tsaSendParamPtr;
     NWSendParam    *nwSendParamPtr;
     APDU           *apduPtr;
-    NVStruct       *nvStrPtr, *nvStrPtrIn;
+    NVStruct       *nvStrPtr;
     uint16          addrIndex;
     AddrTableEntry *ap;
     Boolean         turnAroundOnly; /* does not mean turnaround for sure. Means that
@@ -2607,44 +2587,33 @@ static void SendVar()
     /* If the variable is flagged as turnaround, then we look for first
        network input variable with matching selector number. Once found,
        we update that input variable, and then send NVUpdateOccurs event
-       to the application program. We break as soon as first match is found. */
+       to the application program. Only the first match is updated. */
     if (nvStrPtr->nvTurnaround)
     {
-         for (i = 0; i < nmp->nvTableSize+NV_ALIAS_TABLE_SIZE; i++)
+        i = NVSelectorLookup(selector, NV_INPUT, -1);
+        if (i != -1)
         {
-            nvStrPtrIn  = GetNVStructPtr(i);
-            selectorIn  =
-                (nvStrPtrIn->nvSelectorHi << 8) | nvStrPtrIn->nvSelectorLo;
-            /* If this variable is not input or does not have matching selector,
-               then skip this entry */
-            if (nvStrPtrIn->nvDirection != NV_INPUT ||
-                    selector != selectorIn)
-            {
-                continue; /* Not a matching entry */
-            }
             /* Found a matching turnaroud entry for nvIndexIn */
             primaryIndexIn = GetPrimaryIndex(i);
             nvPtrIn        = NV_ADDRESS(primaryIndexIn);
             nvLengthIn     = NV_LENGTH(primaryIndexIn);
-            if (nvLength != nvLengthIn)
+            /* Skip it if selector matches but length does not */
+            if (nvLength == nvLengthIn)
             {
-                break; /* selector matches but length does not */
-            }
-            memcpy(nvPtrIn, nvPtr, nvLength);
-            /* Notify application if it is running */
-            if (AppPgmRuns())
-            {
-                IsArrayNV(primaryIndexIn, &dimIn, &baseIndexIn);
+                memcpy(nvPtrIn, nvPtr, nvLength);
+                /* Notify application if it is running */
+                if (AppPgmRuns())
+                {
+                    IsArrayNV(primaryIndexIn, &dimIn, &baseIndexIn);
 
-                gp->nvInAddr.format = 4; /* TURNAROUND */
-                memset(&gp->nvInAddr.srcAddr, 0, sizeof(SubnetAddress));
-                gp->nvInAddr.domain = 0; /* Not relevant */
-                gp->nvArrayIndex    = primaryIndexIn - baseIndexIn;
-                NVUpdateOccurs(baseIndexIn, gp->nvArrayIndex);
+                    gp->nvInAddr.format = 4; /* TURNAROUND */
+                    memset(&gp->nvInAddr.srcAddr, 0, sizeof(SubnetAddress));
+                    gp->nvInAddr.domain = 0; /* Not relevant */
+                    gp->nvArrayIndex    = primaryIndexIn - baseIndexIn;
+                    NVUpdateOccurs(baseIndexIn, gp->nvArrayIndex);
+                }
             }
-
-            break; /* break after first match */
-        } /* for */
+        }
     } /* if */
 
     if (turnAroundOnly)
@@ -3069,7 +3038,6 @@ static void PollVar(void)
     Queue          *indexQPtr;
     int16           nvIndex;
     int16          *indexPtr;
-    int16           i;         /* For loop. */
     int16           primaryIndex; /* For nvIndex. */
     uint16          nvLength;     /* For nvIndex. */
     uint16          dim;          /* For nvIndex, if it is array */
@@ -3079,11 +3047,10 @@ static void PollVar(void)
     int16           primaryIndexOut; /* For output network variable */
     uint16          nvLengthOut;     /* For output network variable */
     Byte           *nvPtrOut;        /* For output network variable */
-    uint16          selectorOut;     /* For output network variable */
     Queue          *tsaOutQPtr;
     TSASendParam   *tsaSendParamPtr;
     APDU           *apduPtr;
-    NVStruct       *nvStrPtr, *nvStrPtrOut;
+    NVStruct       *nvStrPtr;
     uint16          addrIndex;
     AddrTableEntry *ap;
     Boolean         turnAroundOnly; /* does not mean turnaround for sure. Means that
@@ -3182,26 +3149,7 @@ static void PollVar(void)
        to the application program. */
     if (nvStrPtr->nvTurnaround)
     {
-        matchingIndexOut = -1;
-        for (i = 0; i < nmp->nvTableSize+NV_ALIAS_TABLE_SIZE; i++)
-        {
-            nvStrPtrOut  = GetNVStructPtr(i);
-            /* Skip input network variables */
-            if (nvStrPtrOut->nvDirection == NV_INPUT)
-            {
-                continue;
-            }
-            /* It is a network output variable. Match selector */
-            selectorOut =
-                (nvStrPtrOut->nvSelectorHi << 8) | nvStrPtrOut->nvSelectorLo;
-            if (selector != selectorOut)
-            {
-                continue; /* Selector does not match */
-            }
-            /* Found a matching output variable for nvIndex */
-            matchingIndexOut = i;
-            break;
-        }
+        matchingIndexOut = NVSelectorLookup(selector, NV_OUTPUT, -1);
 
         if (matchingIndexOut != -1)
         {
@@ -3383,6 +3331,7 @@ void GoOffline(void)
 void GoUnconfigured(void)
 {
     int i, numDomains;
+    DomainStruct domain;
 
     eep->readOnlyData.nodeState = APPL_UNCNFG;
     /* Set appPgmMode to OFF_LINE so that when we configured again, the
@@ -3399,13 +3348,14 @@ void GoUnconfigured(void)
     }
 
     /* Overwrite all domain information. Destroys auth key */
+    memset(&domain, 0xFF, sizeof(domain));
+    memcpy(domain.domainId, "gmrdwf", DOMAIN_ID_LEN);
+    domain.subnet = 0;
+    domain.cloneDomain = 0;
+    domain.node = 0;
     for (i = 0; i < numDomains; i++)
     {
-	    memset(&eep->domainTable[i], 0xFF, sizeof(eep->domainTable[0]));
-        memcpy(eep->domainTable[i].domainId, "gmrdwf", DOMAIN_ID_LEN);
-        eep->domainTable[i].subnet = 0;
-        eep->domainTable[i].cloneDomain = 0;
-        eep->domainTable[i].node = 0;
+        ConfigWrite(&eep->domainTable[i], &domain, sizeof(domain), TRUE);
      }
 }
 
@@ -164,7 +164,7 @@ CustomData  customDataGbl[NUM_STACKS] =
 
 };
 
-CustomData *cp;
+LCS_THREAD_LOCAL CustomData *cp;
 
 /*------------------------------------------------------------------------------
 Section: Local Function Prototypes
@@ -61,14 +61,53 @@ even if the node is unconfigured */
 **********************************************************************/
 #define NUM_ADDR_TBL_ENTRIES    5    /* # of entries in addr tbl    */
 
+#ifndef RECEIVE_TRANS_COUNT
 #define RECEIVE_TRANS_COUNT     5    /* Can be > 16 for Ref. Impl */
+#endif
+
+    /* Size of the table maintained by the transaction control sublayer
+       that remembers the last tid used for each destination address, so
+       that we don't assign the same tid as in the last transaction to
+       that destination. One table is kept per priority. Entries are
+       found through a hash of TID_HASH_SIZE buckets, which must be a
+       power of 2. */
+#define TID_TABLE_SIZE         10
+#define TID_HASH_SIZE          16
+
+    /* Number of transmit records shared by priority and non-priority
+       acknowledged, repeated and request/response messages. Messages
+       to different destinations are in progress at the same time, up to
+       this many. Each record holds a copy of an outgoing message.
+       XMIT_PRI_RESERVE of them are kept for priority messages, so
+       that non-priority traffic can't hold up a priority message.
+       Must be less than XMIT_TRANS_COUNT. */
+#define XMIT_TRANS_COUNT        4
+#define XMIT_PRI_RESERVE        1
+
+    /* Number of buckets in the indices used to find receive records by
+       source address and by request id. Must be a power of 2. */
+#define RECEIVE_TRANS_HASH_SIZE 16
 
 #define NV_TABLE_SIZE          20    /* Check management tool for any restriction on maximum size */
 
 #define NV_ALIAS_TABLE_SIZE    10    /* Check management tool for any restriction on maximum size */
 
+    /* Number of buckets in the index used to find network variables by
+       selector. Must be a power of 2. About the number of primary and
+       alias entries keeps the chains short. */
+#define NV_SELECTOR_HASH_SIZE  32
+
 #define SNVT_SIZE             200    /* Maximum allowed storage space for SNVT structures */
 
+    /* Number of bytes CRC16 folds in per step. 1 uses one 256 entry
+       table. 4 or 8 use that many tables (slice-by-4 or 8), which
+       costs 512 bytes of ROM per table but shortens the dependency
+       chain per byte. Hosts that check a CRC per frame should use 8,
+       e.g. with -DCRC16_SLICE=8. */
+#ifndef CRC16_SLICE
+#define CRC16_SLICE             1
+#endif
+
     /*********************************************************************
     Warning!!! The following constants are encoded. So, don't use the
     actual values
@@ -79,8 +118,12 @@ even if the node is unconfigured */
 #define NW_OUT_BUF_SIZE      LCS_BUF_SIZE
 #define NW_IN_BUF_SIZE       LCS_BUF_SIZE
 
+#ifndef APP_OUT_Q_CNT
 #define APP_OUT_Q_CNT         3
+#endif
+#ifndef APP_OUT_PRI_Q_CNT
 #define APP_OUT_PRI_Q_CNT     3    /* 3 ==> 2  8 ==> 15             */
+#endif
 #define APP_IN_Q_CNT          3
 
 #define NW_OUT_Q_CNT          3
@@ -147,6 +190,34 @@ even if the node is unconfigured */
        timer value in all target nodes. */
 #define TS_RESET_DELAY_TIME 2000
 
+    /* Changes to the EEPROM image (e.g. by network management) are written
+       to NVM once no further change has been made for NVM_WRITE_DELAY ms,
+       but no later than NVM_WRITE_MAX_DELAY ms after the first change. This
+       way commissioning a node costs one NVM write rather than one per
+       message. Pending changes are also written on reset. */
+#define NVM_WRITE_DELAY      500
+#define NVM_WRITE_MAX_DELAY 5000
+
+    /* Most frames the link layer reads from each driver interface per
+       pass. Interfaces are read in turn so a burst on one medium does
+       not delay frames on the other. */
+#define LK_RX_BATCH             4
+
+    /* Frames sent on both media reach a node twice. The link layer
+       remembers the frames received in the last LK_DUP_WINDOW ms, in a
+       cache of LK_DUP_CACHE_SIZE entries (a power of 2), and drops a
+       copy that comes in on another interface. */
+#define LK_DUP_CACHE_SIZE      16
+#define LK_DUP_WINDOW         100
+
+    /* The link layer learns which interface reaches each node it hears
+       from, in a table of LK_ROUTE_COUNT entries (a power of 2), and
+       sends frames addressed to that node on that interface only. What
+       it learnt is forgotten after LK_ROUTE_TIMEOUT ms without hearing
+       from the node. */
+#define LK_ROUTE_COUNT         32
+#define LK_ROUTE_TIMEOUT    60000
+
     /*******************************************************************************
        Protocol Stack Implementation uses an array to allocate storage
        space dynamically. The size of the array used for this allocation
@@ -161,7 +232,14 @@ even if the node is unconfigured */
        If AllocateStorage function in node.c is rewritten to use malloc, then
        this constant will be of no use.
     *******************************************************************************/
-#define MALLOC_SIZE     4500
+#ifndef MALLOC_SIZE
+#if PLATFORM_IS(LINUX)
+    /* Pointers in the queues and slots are 8 bytes on 64 bit hosts. */
+#define MALLOC_SIZE     8000
+#else
+#define MALLOC_SIZE     5900
+#endif
+#endif
 
     /*******************************************************************************
     Section: Type Definitions
@@ -199,7 +277,7 @@ typedef struct
 } CustomData;
 
 extern CustomData  customDataGbl[NUM_STACKS];
-extern CustomData *cp;
+extern LCS_THREAD_LOCAL CustomData *cp;
 
 
 #endif   /* #ifndef _LCS_CUSTOM_H */
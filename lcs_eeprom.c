@@ -57,6 +57,14 @@ Section: Globals
 ------------------------------------------------------------------------------*/
 EEPROM eeprom[NUM_STACKS];
 
+/*------------------------------------------------------------------------------
+Section: Local Globals
+------------------------------------------------------------------------------*/
+#ifdef LCS_THREAD_PER_STACK
+/* The stacks share the NVM driver */
+static LcsLock nvmLock = LCS_LOCK_INIT;
+#endif
+
 /*------------------------------------------------------------------------------
 Section: Local Function Prototypes
 ------------------------------------------------------------------------------*/
@@ -69,16 +77,108 @@ Section: Function Definitions
 Function: Persist
 Returns:  void
 Purpose:  Record all data to NVM.  Note we currently use a very simple model
-that everything fits in 256 bytes.
+that everything is one block, of up to PAL_MAX_BLOCK_SIZE bytes.  The PAL
+spreads a block longer than a page over several pages and commits it whole.
+The write is queued and programmed from LCS_ServiceNvm, so the protocol does
+not wait on the flash.  With a thread per stack another stack's thread may run
+the queue while this one changes its image, so those builds write at once.
 *******************************************************************************/
 void LCS_WriteNvm(void)
 {
+	LCS_LOCK(nvmLock)
+#ifdef LCS_THREAD_PER_STACK
 	PAL_ExtWriteNvmBlockByType(eep, sizeof(*eep), PAL_BLOCK_TYPE_LCS_EEPROM);
+#else
+	if (PAL_ExtQueueNvmBlockByType(eep, sizeof(*eep), PAL_BLOCK_TYPE_LCS_EEPROM) != ECHERR_OK)
+	{
+		PAL_ExtWriteNvmBlockByType(eep, sizeof(*eep), PAL_BLOCK_TYPE_LCS_EEPROM);
+	}
+#endif
+	LCS_UNLOCK(nvmLock)
+	gp->nvmDirty = FALSE;
+	MsTimerSet(&gp->nvmWriteTimer, 0);
+	MsTimerSet(&gp->nvmMaxTimer, 0);
+}
+
+/*******************************************************************************
+Function: LCS_MarkNvmDirty
+Returns:  void
+Purpose:  Note that the EEPROM image has changed.  The write is deferred until
+no further change has been made for NVM_WRITE_DELAY ms, or until
+NVM_WRITE_MAX_DELAY ms after the first change.
+*******************************************************************************/
+void LCS_MarkNvmDirty(void)
+{
+	if (!gp->nvmDirty)
+	{
+		gp->nvmDirty = TRUE;
+		MsTimerSet(&gp->nvmMaxTimer, NVM_WRITE_MAX_DELAY);
+	}
+	MsTimerSet(&gp->nvmWriteTimer, NVM_WRITE_DELAY);
+}
+
+/*******************************************************************************
+Function: LCS_ServiceNvm
+Returns:  void
+Purpose:  Called by the scheduler to write the EEPROM image once the write
+delay has passed, and to let the PAL advance its queued writes or erase free
+pages ahead.
+*******************************************************************************/
+void LCS_ServiceNvm(void)
+{
+	if (gp->nvmDirty &&
+		(!MsTimerRunning(&gp->nvmWriteTimer) || !MsTimerRunning(&gp->nvmMaxTimer)))
+	{
+		LCS_WriteNvm();
+	}
+	LCS_LOCK(nvmLock)
+	PAL_ExtServiceNvm();
+	LCS_UNLOCK(nvmLock)
+}
+
+/*******************************************************************************
+Function: LCS_NvmPending
+Returns:  TRUE if the PAL has writes or erasing left for LCS_ServiceNvm
+Purpose:  Lets the scheduler see work that nvmDirty no longer shows once the
+image has been queued.
+*******************************************************************************/
+Boolean LCS_NvmPending(void)
+{
+	Boolean pending;
+
+	LCS_LOCK(nvmLock)
+	pending = PAL_ExtNvmWorkPending();
+	LCS_UNLOCK(nvmLock)
+	return pending;
+}
+
+/*******************************************************************************
+Function: LCS_FlushNvm
+Returns:  ECHERR_OK, or the error of a queued write that could not be done
+Purpose:  Write any pending changes now, e.g. before a reset.
+*******************************************************************************/
+EchErr LCS_FlushNvm(void)
+{
+	EchErr err;
+
+	if (gp->nvmDirty)
+	{
+		LCS_WriteNvm();
+	}
+	LCS_LOCK(nvmLock)
+	err = PAL_ExtFlushNvm();
+	LCS_UNLOCK(nvmLock)
+	return err;
 }
 
 EchErr LCS_ReadNvm(void)
 {
-	return PAL_ExtReadNvmBlockByType(eep, sizeof(*eep), PAL_BLOCK_TYPE_LCS_EEPROM);
+	EchErr err;
+
+	LCS_LOCK(nvmLock)
+	err = PAL_ExtReadNvmBlockByType(eep, sizeof(*eep), PAL_BLOCK_TYPE_LCS_EEPROM);
+	LCS_UNLOCK(nvmLock)
+	return err;
 }
 
 /*******************************End of eeprom.c *******************************/
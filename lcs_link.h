@@ -43,7 +43,7 @@ Section: Includes
 /*------------------------------------------------------------------------------
 Section: Constant Definitions
 ------------------------------------------------------------------------------*/
-/* None */
+#define NUM_VNI 2 /* Number of driver interfaces. See vni[] in lcs_link.c */
 
 /*------------------------------------------------------------------------------
 Section: Type Definitions
@@ -62,7 +62,11 @@ void LKReset(void);
 void LKSend(void);
 void LKReceive(void);
 
+uint16 CRC16Update(uint16 crcIn, const void *bufIn, uint16 sizeIn);
 void CRC16(Byte bufInOut[], uint16 sizein);
+#ifdef CRC16_BENCHMARK
+int  CRC16Benchmark(void);
+#endif
 #endif
 
 /******************************* End of link.h ********************************/
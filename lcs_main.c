@@ -50,6 +50,7 @@ Section: Includes
 #include "echstd.h"
 #include "lcs.h"
 #include "tmr.h"
+#include "vldv.h"
 
 /*------------------------------------------------------------------------------
 Section: Constant Definitions
@@ -87,6 +88,10 @@ Section: Function Definitions
 ------------------------------------------------------------------------------*/
 void main(void)
 {
+#ifdef LCS_THREAD_PER_STACK
+	/* Each stack runs its own loop */
+	LCS_Run();
+#else
 	LCS_Init();
 
     /* Loop forever. 'done' used to silence the compiler from
@@ -97,8 +102,14 @@ void main(void)
     {
 		LCS_Service();
 		
+#if LCS_EVENT_SCHEDULER
+		/* Sleep until the next deadline or until a frame arrives. */
+		WAIT_FOR_WORK(LCS_IdleTime());
+#else
 		TAKE_A_BREAK;
+#endif
     } 
+#endif
 }
 
 uint32 RandomNumber(int from, int to)
@@ -125,6 +125,35 @@ static void RecomputeChecksum(void)
     eep->configCheckSum = ComputeConfigCheckSum();
 }
 
+/*******************************************************************************
+Function:  NMChangesNvm
+Returns:   TRUE if the network management command may modify the EEPROM
+           image, FALSE if it is a query.
+Reference: None
+Purpose:   To avoid scheduling NVM writes for read-only commands.
+Comments:  Errs on the side of TRUE for anything not known to be a query.
+*******************************************************************************/
+static Boolean NMChangesNvm(Byte nmCode)
+{
+    switch (nmCode)
+    {
+    case NM_QUERY_ID:
+    case NM_RESPOND_TO_QUERY:
+    case NM_QUERY_ADDR:
+    case NM_QUERY_NV_CNFG:
+    case NM_QUERY_DOMAIN:
+    case NM_READ_MEMORY:
+    case NM_WINK:
+    case NM_MEMORY_REFRESH:
+    case NM_QUERY_SNVT:
+    case NM_NV_FETCH:
+    case NM_MANUAL_SERVICE_REQUEST:
+        return FALSE;
+    default:
+        return TRUE;
+    }
+}
+
 
 /*******************************************************************************
 Function:  ManualServiceRequestMessage
@@ -314,7 +343,6 @@ void HandleNMUpdateDomain(APPReceiveParam *appReceiveParamPtr,
     if (appReceiveParamPtr->pduSize >= 2 + sizeof(DomainStruct))
     {
         sts = UpdateDomain((DomainStruct *)&apduPtr->data[1], apduPtr->data[0], true);
-        RecomputeChecksum();
     }
     NMNDRespond(NM_MESSAGE, sts, appReceiveParamPtr, apduPtr);
 }
@@ -337,6 +365,8 @@ Comments:  None.
 void HandleNMLeaveDomain(APPReceiveParam *appReceiveParamPtr,
                          APDU            *apduPtr)
 {
+    DomainStruct domain;
+
     /* Fail if message is not 2 bytes long */
     if (appReceiveParamPtr->pduSize != 2)
     {
@@ -351,15 +381,14 @@ void HandleNMLeaveDomain(APPReceiveParam *appReceiveParamPtr,
         return;
     }
     /* Leave the domain */
-	memset(&eep->domainTable[apduPtr->data[0]], 0xFF, sizeof(eep->domainTable[0]));
-    memcpy(eep->domainTable[apduPtr->data[0]].domainId,
+	memset(&domain, 0xFF, sizeof(domain));
+    memcpy(domain.domainId,
            "gmrdwf",
            DOMAIN_ID_LEN);
-    eep->domainTable[apduPtr->data[0]].subnet      = 0;
-    eep->domainTable[apduPtr->data[0]].node        = 0;
-
-    /* Recompute the configuration checksum */
-    RecomputeChecksum();
+    domain.subnet      = 0;
+    domain.node        = 0;
+    ConfigWrite(&eep->domainTable[apduPtr->data[0]], &domain,
+                sizeof(domain), TRUE);
 
     /* If message not received on domain just left, then respond */
     if (apduPtr->data[0] != appReceiveParamPtr->srcAddr.dmn.domainIndex)
@@ -386,7 +415,8 @@ Purpose:   Handle incoming NM Update Address message.
 *******************************************************************************/
 void HandleNMUpdateKey(APPReceiveParam *appReceiveParamPtr, APDU *apduPtr)
 {
-    int i;
+    int  i;
+    Byte key[AUTH_KEY_LEN];
 
     /* Fail if message is not of correct length or domain index is bad. */
     if (appReceiveParamPtr->pduSize != 2 + AUTH_KEY_LEN)
@@ -404,10 +434,11 @@ void HandleNMUpdateKey(APPReceiveParam *appReceiveParamPtr, APDU *apduPtr)
 
     for (i = 0; i < AUTH_KEY_LEN; i++)
     {
-        eep->domainTable[apduPtr->data[0]].key[i] +=
-            apduPtr->data[i+1];
+        key[i] = (Byte)(eep->domainTable[apduPtr->data[0]].key[i] +
+                        apduPtr->data[i+1]);
     }
-    RecomputeChecksum();
+    ConfigWrite(eep->domainTable[apduPtr->data[0]].key, key, AUTH_KEY_LEN,
+                TRUE);
     NMNDRespond(NM_MESSAGE, SUCCESS, appReceiveParamPtr,apduPtr);
 }
 
@@ -422,7 +453,6 @@ void HandleNMUpdateAddr(APPReceiveParam *appReceiveParamPtr, APDU *apduPtr)
     if (appReceiveParamPtr->pduSize >= (apduPtr->data[1]==UNBOUND ? 6:7))
     {
         sts = UpdateAddress((AddrTableEntry *)&apduPtr->data[1], apduPtr->data[0]);
-        RecomputeChecksum();
     }
     NMNDRespond(NM_MESSAGE, sts, appReceiveParamPtr, apduPtr);
 }
@@ -780,7 +810,6 @@ void HandleNmeUpdateDomain(APPReceiveParam *appReceiveParamPtr,
     if (appReceiveParamPtr->pduSize >= 3 + sizeof(DomainStruct) - AUTH_KEY_LEN)
     {
         sts = UpdateDomain((DomainStruct *)&apduPtr->data[2], apduPtr->data[1], false);
-        RecomputeChecksum();
     }
     NMNDRespond(NM_MESSAGE, sts, appReceiveParamPtr, apduPtr);
 }
@@ -867,23 +896,22 @@ void HandleNmeUpdateKey(APPReceiveParam *appReceiveParamPtr,
 		for (i=0; i<2; i++)
 		{
 			int j;
-			DomainStruct *p = AccessDomain(i);
+			DomainStruct domain = *AccessDomain(i);
 			if (!increment)
 			{
-				memset(p->key, 0, sizeof(p->key));
+				memset(domain.key, 0, sizeof(domain.key));
 			}
 			for (j=0; j<AUTH_KEY_LEN; j++)
 			{
-				p->key[j] += *pKey++;
+				domain.key[j] += *pKey++;
 			}
-			sts = UpdateDomain(p, i, true);
+			sts = UpdateDomain(&domain, i, true);
 			if (sts == FAILURE)
 			{
 				// This should never happen...
 				break;
 			}
 		}
-	    RecomputeChecksum();
 	}
     NMNDRespond(NM_MESSAGE, sts, appReceiveParamPtr, apduPtr);
 }
@@ -1088,7 +1116,7 @@ void HandleNMUpdateGroupAddr(APPReceiveParam *appReceiveParamPtr,
 {
     uint16           addrIndex;
     GroupAddrMode   *groupStrPtr;
-    AddrTableEntry  *ap;
+    AddrTableEntry   entry;
 
     /* This message must be delivered with group addressing and is
        updated based on the domain in which it was received. Hence,
@@ -1125,14 +1153,14 @@ void HandleNMUpdateGroupAddr(APPReceiveParam *appReceiveParamPtr,
         NMNDRespond(NM_MESSAGE, FAILURE, appReceiveParamPtr, apduPtr);
         return;
     }
-    ap = AccessAddress(addrIndex); /* ap cannot be NULL */
+    entry = *AccessAddress(addrIndex); /* cannot be NULL */
     /* Only group size and timer values should be changed */
-    ap->groupEntry.groupSize  = groupStrPtr->groupSize;
-    ap->groupEntry.rptTimer   = groupStrPtr->rptTimer;
-    ap->groupEntry.retryCount = groupStrPtr->retryCount;
-    ap->groupEntry.rcvTimer   = groupStrPtr->rcvTimer;
-    ap->groupEntry.txTimer    = groupStrPtr->txTimer;
-    RecomputeChecksum();
+    entry.groupEntry.groupSize  = groupStrPtr->groupSize;
+    entry.groupEntry.rptTimer   = groupStrPtr->rptTimer;
+    entry.groupEntry.retryCount = groupStrPtr->retryCount;
+    entry.groupEntry.rcvTimer   = groupStrPtr->rcvTimer;
+    entry.groupEntry.txTimer    = groupStrPtr->txTimer;
+    UpdateAddress(&entry, addrIndex);
     NMNDRespond(NM_MESSAGE, SUCCESS, appReceiveParamPtr, apduPtr);
 }
 
@@ -1224,7 +1252,7 @@ void HandleNMUpdateNvConfig(APPReceiveParam *appReceiveParamPtr, APDU *apduPtr)
     {
         if (appReceiveParamPtr->pduSize >= pduSize)
         {
-            memcpy(&eep->nvConfigTable[n], np, sizeof(NVStruct));
+            UpdateNV(np, n);
         }
         else
         {
@@ -1251,7 +1279,7 @@ void HandleNMUpdateNvConfig(APPReceiveParam *appReceiveParamPtr, APDU *apduPtr)
         /* Update the nv alias table */
         if (appReceiveParamPtr->pduSize >= pduSize)
         {
-            memcpy(&eep->nvAliasTable[n], np, sizeof(AliasStruct));
+            UpdateAlias((AliasStruct *)np, n);
         }
         else
         {
@@ -1268,8 +1296,7 @@ void HandleNMUpdateNvConfig(APPReceiveParam *appReceiveParamPtr, APDU *apduPtr)
         return;
     }
 
-    /* Recompute checksum and send response */
-    RecomputeChecksum();
+    /* Send response. UpdateAlias and UpdateNV kept the checksum. */
     NMNDRespond(NM_MESSAGE, SUCCESS, appReceiveParamPtr, apduPtr);
 }
 
@@ -1579,7 +1606,20 @@ void HandleNMWriteMemory(APPReceiveParam *appReceiveParamPtr,
     /* We have to assume that pr->count is good. Max is 255 */
     /* Reference implementation has no application check sum.
        Only config checksum */
-    memcpy(memp, apduPtr->data+5, pr->count);
+    ConfigWrite(memp, apduPtr->data+5, pr->count, FALSE);
+
+    /* Keep the selector index in step if the NV tables were written. */
+    if (memp < (char *)&eep->nvAliasTable[NV_ALIAS_TABLE_SIZE] &&
+            memp + pr->count > (char *)&eep->nvConfigTable[0])
+    {
+        NVSelectorIndexBuild();
+    }
+    /* Likewise the group index if the address table was written. */
+    if (memp < (char *)&eep->addrTable[NUM_ADDR_TBL_ENTRIES] &&
+            memp + pr->count > (char *)&eep->addrTable[0])
+    {
+        GroupIndexBuild();
+    }
 
     if (pr->form & CNFG_CS_RECALC) {
         RecomputeChecksum();
@@ -1822,6 +1862,7 @@ void HandleNDClearStatus(APPReceiveParam *appReceiveParamPtr,
     memset(&nmp->stats, 0, sizeof(nmp->stats));
     nmp->resetCause                 = CLEARED;
     eep->errorLog                   = NO_ERRORS;  /* Cleared */
+    LCS_MarkNvmDirty();
 
     /* NMNDRespond will send response only if the msg is REQUEST */
     NMNDRespond(ND_MESSAGE, SUCCESS, appReceiveParamPtr, apduPtr);
@@ -2058,8 +2099,12 @@ void HandleNM(APPReceiveParam *appReceiveParamPtr,
         break;
     }
 
-	// Persist any changes to NVM
-	LCS_WriteNvm();
+	// Schedule a write of any changes to NVM.  The write is deferred so that a burst of
+	// commissioning commands results in a single write.
+	if (NMChangesNvm(apduPtr->code.nm.nmCode))
+	{
+		LCS_MarkNvmDirty();
+	}
 
     DeQueue(&gp->appInQ);
 }
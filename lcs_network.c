@@ -49,6 +49,10 @@ Section: Constants
 ------------------------------------------------------------------------------*/
 /* #define DEBUG */
 
+/* Worst case size of an NPDU header: 1 fixed byte, 2 byte source,
+   7 byte unique node id destination and 6 byte domain. */
+#define NPDU_MAX_HEADER 16
+
 /*------------------------------------------------------------------------------
 Section: Type Definitions
 ------------------------------------------------------------------------------*/
@@ -81,6 +85,10 @@ Section: Local Function Prototypes
 ------------------------------------------------------------------------------*/
 static Byte DecodeDomainLength(Byte lengthCode);
 static Status EncodeDomainLength(Byte length, Byte* pValue);
+static void NWDeliver(Queue *qInOut, void *paramIn, uint16 paramSizeIn,
+                      Byte *pduIn, uint16 pduSizeIn);
+static Boolean NWAddressMatch(NPDU *npduPtr, SourceAddress *srcAddrOut,
+                              uint8 *pduOffsetOut);
 
 /*------------------------------------------------------------------------------
 Section: Function Definitions
@@ -103,12 +111,14 @@ void   NWReset(void)
     queueItemSize     = gp->nwInBufSize + sizeof(NWReceiveParam);
 
 
-    if (QueueInit(&gp->nwInQ, queueItemSize, gp->nwInQCnt) != SUCCESS)
+    if (QueueInitPooled(&gp->nwInQ, queueItemSize, gp->nwInQCnt,
+                        &gp->inPool) != SUCCESS)
     {
         ErrorMsg("NWReset: Unable to init the input queue.\n");
         gp->resetOk = FALSE;
         return;
     }
+    QueueSetReadyBit(&gp->nwInQ, &gp->readyMask, LCS_READY_NW);
 
     /* Allocate and initialize the output queue. */
     gp->nwOutBufSize  =
@@ -123,13 +133,14 @@ void   NWReset(void)
         return;
     }
 
-    if (QueueInit(&gp->nwOutQ, queueItemSize, gp->nwOutQCnt)
-            != SUCCESS)
+    if (QueueInitPooled(&gp->nwOutQ, queueItemSize, gp->nwOutQCnt,
+                        &gp->outPool) != SUCCESS)
     {
         ErrorMsg("NWReset: Unable to init the output queue.\n");
         gp->resetOk = FALSE;
         return;
     }
+    QueueSetReadyBit(&gp->nwOutQ, &gp->readyMask, LCS_READY_NW);
 
     /* Allocate and initialize the priority output queue. */
     gp->nwOutPriBufSize = gp->nwOutBufSize;
@@ -144,13 +155,14 @@ void   NWReset(void)
         return;
     }
 
-    if (QueueInit(&gp->nwOutPriQ, queueItemSize, gp->nwOutPriQCnt)
-            != SUCCESS)
+    if (QueueInitPooled(&gp->nwOutPriQ, queueItemSize, gp->nwOutPriQCnt,
+                        &gp->outPool) != SUCCESS)
     {
         ErrorMsg("NWReset: Unable to init the priority output queue.\n");
         gp->resetOk = FALSE;
         return;
     }
+    QueueSetReadyBit(&gp->nwOutPriQ, &gp->readyMask, LCS_READY_NW);
 
     return;
 }
@@ -189,18 +201,20 @@ Purpose:   To send outgoing PDUS (APDU or SPDU or TPDU or AuthPDU)
            Network layer forms the NPDU and the parameters for
            sending the NPDU and writes to the queue for the
            link/mac layer.
-Comments:  Network buffer size is guaranteed to be at least
-           20 bytes long as the encoding table's (page 9-9
-           Technology Device Data Book Rev 3) minimum value is 20.
-           The NPDU's header's worst case size is 16. So, we are
-           OK. No need to check for space when writing headers.
+Comments:  The NPDU header is formed on the side and then put in
+           front of the PDU, over the NWSendParam, so that the buffer
+           is handed to the link layer without copying the PDU. The
+           parameters are saved before they are overwritten.
 *******************************************************************************/
 void   NWSend(void)
 {
     NWSendParam  *nwSendParamPtr; /* Param in nwOutQ or nwPriOutQ.   */
+    NWSendParam   nwSendParam;    /* Saved copy of the above.        */
     LKSendParam  *lkSendParamPtr; /* Param in lkOutQ or lkPriOutQ.   */
     APPReceiveParam *appReceiveParamPtr;
-    NPDU         *npduPtr;        /* Pointer to NPDU being formed.   */
+    NPDU         *npduPtr;        /* Pointer to NPDU header formed.  */
+    Byte          npduHeader[NPDU_MAX_HEADER];
+    Boolean       handOff;        /* TRUE => buffer goes to link.    */
     Byte         *pduPtr;         /* Pointer to PDU etc being sent.  */
     uint8         j;              /* For temporary use.              */
     uint16        npduSize;       /* Size of NPDU formed.            */
@@ -227,7 +241,6 @@ void   NWSend(void)
     }
 
     nwSendParamPtr  = QueueHead(gp->nwCurrent);
-    lkSendParamPtr  = QueueTail(gp->lkCurrent);
 
     /* For application layer messages, we need to give completion event
        using the tag given. This is for consistency with transport/session
@@ -244,8 +257,8 @@ void   NWSend(void)
     /* ptr to APDU or TPDU or SPDU or AuthPDU. */
     pduPtr  = (Byte *)(nwSendParamPtr + 1);
 
-    /* ptr to NPDU constructed. */
-    npduPtr = (NPDU *)(lkSendParamPtr + 1);
+    /* ptr to NPDU header constructed. */
+    npduPtr = (NPDU *)npduHeader;
 
     /* Write the NPDU header. */
     npduPtr->protocolVersion = PROTOCOL_VERSION; /* See eia709_1.h */
@@ -408,29 +421,63 @@ void   NWSend(void)
         return;
     }
 
-    memcpy(&npduPtr->data[j], pduPtr, nwSendParamPtr->pduSize);
     /* NPDU size is header_size + enclosed PDU size. */
     npduSize = 1 + j + nwSendParamPtr->pduSize;
+    nwSendParam = *nwSendParamPtr;
+
+    /* Put the header and the link layer's parameters in front of the
+       PDU and hand the buffer over. Copy only if that is not possible. */
+    lkSendParamPtr = (LKSendParam *)(pduPtr - 1 - j) - 1;
+    handOff = QueueCanHandOff(gp->nwCurrent, gp->lkCurrent, lkSendParamPtr);
+    if (handOff)
+    {
+        memcpy(lkSendParamPtr + 1, npduHeader, 1 + j);
+    }
+    else
+    {
+        lkSendParamPtr = QueueTail(gp->lkCurrent);
+        memcpy(lkSendParamPtr + 1, npduHeader, 1 + j);
+        memcpy((Byte *)(lkSendParamPtr + 1) + 1 + j, pduPtr,
+               nwSendParam.pduSize);
+    }
 
     /* Write the parameters for the link layer. */
-    lkSendParamPtr->deltaBL = nwSendParamPtr->deltaBL;
-    lkSendParamPtr->altPath = nwSendParamPtr->altPath;
+    lkSendParamPtr->deltaBL = nwSendParam.deltaBL;
+    lkSendParamPtr->altPath = nwSendParam.altPath;
     lkSendParamPtr->pduSize = npduSize;
+    lkSendParamPtr->domainIndex = nwSendParam.destAddr.dmn.domainIndex;
+    lkSendParamPtr->destNode.subnet = 0;
+    lkSendParamPtr->destNode.node   = 0;
+    if (nwSendParam.destAddr.addressMode == SUBNET_NODE)
+    {
+        lkSendParamPtr->destNode = nwSendParam.destAddr.addr.addr2a;
+    }
+    else if (nwSendParam.destAddr.addressMode == MULTICAST_ACK)
+    {
+        lkSendParamPtr->destNode = nwSendParam.destAddr.addr.addr2b.subnetAddr;
+    }
 
     /* Update both queues. */
-    DeQueue(gp->nwCurrent);
-    EnQueue(gp->lkCurrent);
+    if (handOff)
+    {
+        QueueHandOff(gp->nwCurrent, gp->lkCurrent, lkSendParamPtr);
+    }
+    else
+    {
+        DeQueue(gp->nwCurrent);
+        EnQueue(gp->lkCurrent);
+    }
     DebugMsg("NWSend: Sending a packet.");
 
     INCR_STATS(LcsL3Tx);
 
     /* Send completion event if it was an APDU */
-    if (nwSendParamPtr->pduType == APDU_TYPE)
+    if (nwSendParam.pduType == APDU_TYPE)
     {
         appReceiveParamPtr = QueueTail(&gp->appInQ);
         appReceiveParamPtr->indication = COMPLETION;
         appReceiveParamPtr->success    = TRUE;
-        appReceiveParamPtr->tag        = nwSendParamPtr->tag;
+        appReceiveParamPtr->tag        = nwSendParam.tag;
         EnQueue(&gp->appInQ);
     }
 
@@ -463,19 +510,13 @@ Comments:  Discard packets originated from this node itself.
 void   NWReceive(void)
 {
     NWReceiveParam      *nwReceiveParamPtr; /* Param in gp->nwInQ.   */
-    APPReceiveParam     *appReceiveParamPtr;
-    TSAReceiveParam     *tsaReceiveParamPtr;
+    APPReceiveParam      appReceiveParam;
+    TSAReceiveParam      tsaReceiveParam;
     SourceAddress        srcAddr;    /* Address of source node.      */
     NPDU                *npduPtr;    /* ptr to NPDU being received.  */
-    Byte                *pduPtr;     /* ptr to item in target queue. */
+    Byte                *pduPtr;     /* ptr to enclosed PDU.         */
     uint16               pduSize;    /* Size of enclosed PDU.        */
-    Boolean              flexDomain; /* TRUE => NPDU in flexdomain.  */
-    uint8                numDomains; /* # of domains of this node.   */
-    uint8                domainLength;  /* Domain length             */
-    Byte                 domainId[DOMAIN_ID_LEN]; /* Temp.           */
-    Byte                 uniqueNodeId[UNIQUE_NODE_ID_LEN]; /* Temp.  */
-    SubnetAddress        destAddr;   /* Temp.                        */
-    uint8                j;          /* Temp.                        */
+    uint8                j;          /* Index of enclosed PDU.       */
 
     /* First, check if we have any packets to process. */
     if (QueueEmpty(&gp->nwInQ))
@@ -492,54 +533,186 @@ void   NWReceive(void)
     nwReceiveParamPtr = QueueHead(&gp->nwInQ);
     npduPtr           = (NPDU *)(nwReceiveParamPtr + 1);
 
+    /* Determine the source address and drop the NPDU if it is the
+       wrong version or not for us. */
+    if (!NWAddressMatch(npduPtr, &srcAddr, &j))
+    {
+        DeQueue(&gp->nwInQ);
+        return;
+    }
+
+    /* We now got a packet that must be received. */
+    INCR_STATS(LcsL3Rx);
+
+    /* pduSize = npduSize - npduHeaderSize. */
+    /* j is length of the variable part header of NPDU. */
+    /* The fixed portion of NPDU header is always 1 byte. */
+	if (nwReceiveParamPtr->pduSize <= j+1)
+	{
+		// Malformed packet.  
+		DeQueue(&gp->nwInQ);
+        DebugMsg("NWReceive: Discard short packet.\n");
+		return;
+	}
+
+    pduSize = nwReceiveParamPtr->pduSize - j - 1;
+
+    /* Set the pdu pointer properly. */
+    switch (npduPtr->pduType)
+    {
+    case APDU_TYPE:
+        if (QueueFull(&gp->appInQ) ||
+                pduSize > gp->appInBufSize)
+        {
+            /* No space or insufficient space. Discard packet. */
+            if (pduSize > gp->appInBufSize)
+            {
+                LCS_RecordError(WRITE_PAST_END_OF_APPL_BUFFER);
+            }
+            INCR_STATS(LcsLost);
+            DeQueue(&gp->nwInQ);
+            DebugMsg("NWReceive: Discard packet. Insufficient space.\n");
+            return;
+        }
+        /* Queue is not full and buffer has sufficient space. */
+        pduPtr = &npduPtr->data[j];
+
+        appReceiveParam.indication = MESSAGE;
+        appReceiveParam.srcAddr    = srcAddr;
+        appReceiveParam.priority   = nwReceiveParamPtr->priority;
+        appReceiveParam.altPath    = nwReceiveParamPtr->altPath;
+        appReceiveParam.pduSize    = pduSize;
+        appReceiveParam.auth       = FALSE;
+        appReceiveParam.service    = UNACKD;
+		appReceiveParam.xcvrParams = nwReceiveParamPtr->xcvrParams;
+        NWDeliver(&gp->appInQ, &appReceiveParam, sizeof(APPReceiveParam),
+                  pduPtr, pduSize);
+        return;
+    case TPDU_TYPE: /* Fall through. */
+    case SPDU_TYPE: /* Fall through. */
+    case AUTHPDU_TYPE:
+        if (QueueFull(&gp->tsaInQ) ||
+                pduSize > gp->tsaInBufSize)
+        {
+            /* No space or insufficient space. Discard packet. */
+            if (pduSize > gp->tsaInBufSize)
+            {
+                /* Buffer sizes are based on app buf sizes. See
+                   TSAReset function. */
+                LCS_RecordError(WRITE_PAST_END_OF_APPL_BUFFER);
+            }
+            INCR_STATS(LcsLost);
+            DeQueue(&gp->nwInQ);
+            DebugMsg("NWReceive: Discard packet. Insufficient space.\n");
+            return;
+        }
+        /* Queue is not full and buffer has sufficient space. */
+        pduPtr = &npduPtr->data[j];
+
+        tsaReceiveParam.pduType   = (PDUType)npduPtr->pduType;
+        tsaReceiveParam.srcAddr   = srcAddr;
+        tsaReceiveParam.priority  = nwReceiveParamPtr->priority;
+        tsaReceiveParam.altPath   = nwReceiveParamPtr->altPath;
+        tsaReceiveParam.pduSize   = pduSize;
+		tsaReceiveParam.xcvrParams= nwReceiveParamPtr->xcvrParams;
+        NWDeliver(&gp->tsaInQ, &tsaReceiveParam, sizeof(TSAReceiveParam),
+                  pduPtr, pduSize);
+        return;
+    default:
+        ErrorMsg("NWReceive: Unknown PDU was received.\n");
+        LCS_RecordError(UNKNOWN_PDU);
+        DeQueue(&gp->nwInQ);
+        return;
+    }
+
+    /* Should not come here. */
+}
+
+/*******************************************************************************
+Function:  NWPreFilter
+Returns:   TRUE if the NPDU may be for this node, FALSE if it is not.
+Reference: None
+Purpose:   To let the link layer drop frames that NWReceive would
+           discard before they are queued.
+Comments:  Applies the same version, domain and destination address
+           checks as NWReceive, on the NPDU as it sits in the receive
+           buffer. Nothing is copied and no statistics are kept; the
+           network layer does not count the packets it discards.
+           The source address is filled in for frames that pass.
+*******************************************************************************/
+Boolean NWPreFilter(Byte *npduIn, SourceAddress *srcAddrOut)
+{
+    uint8 pduOffset;
+
+    return(NWAddressMatch((NPDU *)npduIn, srcAddrOut, &pduOffset));
+}
+
+/*******************************************************************************
+Function:  NWAddressMatch
+Returns:   TRUE if the NPDU is for this node, FALSE if it is to be discarded.
+Reference: None
+Purpose:   To decode the address part of an incoming NPDU and decide
+           whether this node should receive it.
+Comments:  Fills in the source address and the index of the enclosed PDU
+           in the NPDU's variable part. See NWReceive for the rules.
+*******************************************************************************/
+static Boolean NWAddressMatch(NPDU *npduPtr, SourceAddress *srcAddrOut,
+                              uint8 *pduOffsetOut)
+{
+    Boolean       flexDomain;   /* TRUE => NPDU in flexdomain.  */
+    uint8         numDomains;   /* # of domains of this node.   */
+    uint8         domainLength; /* Domain length                */
+    Byte          domainId[DOMAIN_ID_LEN]; /* Temp.             */
+    Byte          uniqueNodeId[UNIQUE_NODE_ID_LEN]; /* Temp.    */
+    SubnetAddress destAddr;     /* Temp.                        */
+    uint8         j;            /* Temp.                        */
+
     /* Discard NPDU if version is not PROTOCOL_VERSION */
     if (npduPtr->protocolVersion != PROTOCOL_VERSION)
     {
-        DeQueue(&gp->nwInQ);
         DebugMsg(" NWReceive: Discard packet. Wrong version.\n");
-        return;
+        return(FALSE);
     }
 
-    /* Determine the source address. */
-    memcpy(&srcAddr.subnetAddr, npduPtr->data, 2);
+    memcpy(&srcAddrOut->subnetAddr, npduPtr->data, 2);
 
     /* Determine the destination address used and set srcAddr properly. */
     /* For MULTICAST and MULTICAST_ACK address modes, the
-       group and/or member values are copied into srcAddr.group
-       or srcAddr.ackNode. For BROADCAST and SUBNET_NODE address
+       group and/or member values are copied into srcAddrOut->group
+       or srcAddrOut->ackNode. For BROADCAST and SUBNET_NODE address
        modes, destAddr is used to store subnet and/or node
        values. For UNIQUE_NODE_ID, uniqueNodeId is used & subnet is ignored */
     /* Also, set j to domain field's index. */
     switch (npduPtr->addrFmt)
     {
     case 0:
-        srcAddr.addressMode = BROADCAST;
+        srcAddrOut->addressMode = BROADCAST;
         destAddr.subnet   = npduPtr->data[2];
         j = 3;
         break;
     case 1:
-        srcAddr.addressMode = MULTICAST;
-        srcAddr.group       = npduPtr->data[2];
+        srcAddrOut->addressMode = MULTICAST;
+        srcAddrOut->group       = npduPtr->data[2];
         j = 3;
         break;
     case 2:
-        if (srcAddr.subnetAddr.selField == 1)
+        if (srcAddrOut->subnetAddr.selField == 1)
         {
-            srcAddr.addressMode = SUBNET_NODE;
+            srcAddrOut->addressMode = SUBNET_NODE;
             memcpy(&destAddr, &npduPtr->data[2], 2);
             j = 4;
         }
         else
         {
-            srcAddr.addressMode = MULTICAST_ACK;
+            srcAddrOut->addressMode = MULTICAST_ACK;
             memcpy(&destAddr, &npduPtr->data[2], 2);
-            memcpy(&srcAddr.ackNode.subnetAddr, &destAddr, 2);
-            memcpy(&srcAddr.ackNode.groupAddr, &npduPtr->data[4], 2);
+            memcpy(&srcAddrOut->ackNode.subnetAddr, &destAddr, 2);
+            memcpy(&srcAddrOut->ackNode.groupAddr, &npduPtr->data[4], 2);
             j = 6;
         }
         break;
     case 3:
-        srcAddr.addressMode = UNIQUE_NODE_ID;
+        srcAddrOut->addressMode = UNIQUE_NODE_ID;
         destAddr.subnet = npduPtr->data[2]; /* Routing Purpose */
         memcpy(uniqueNodeId, &npduPtr->data[3], UNIQUE_NODE_ID_LEN);
         j = 3 + UNIQUE_NODE_ID_LEN;
@@ -548,8 +721,7 @@ void   NWReceive(void)
         /* Discard it as the address format is wrong. */
         ErrorMsg("NWReceive: Unknown addFmt.\n");
         LCS_RecordError(BAD_ADDRESS_TYPE);
-        DeQueue(&gp->nwInQ);
-        return;
+        return(FALSE);
     }
 
     /* Determine the domain. */
@@ -560,8 +732,7 @@ void   NWReceive(void)
         ErrorMsg("NWReceive: Domain length is not valid.\n");
         LCS_RecordError(INVALID_DOMAIN);
         /* Discard the packet as the domain length is invalid. */
-        DeQueue(&gp->nwInQ);
-        return;
+        return(FALSE);
     }
 
     /* domainLength is good. Safe to use memcpy now. */
@@ -586,8 +757,8 @@ void   NWReceive(void)
     flexDomain = FALSE; /* Assume it is not flex domain. */
 
 	// Save the domain away regardless (used to only save the flex domain but always saving it is more general).
-    srcAddr.dmn.domainLen = domainLength;
-    memcpy(srcAddr.dmn.domainId, domainId, domainLength);
+    srcAddrOut->dmn.domainLen = domainLength;
+    memcpy(srcAddrOut->dmn.domainId, domainId, domainLength);
 
     if (NodeConfigured() && !eep->domainTable[0].invalid &&
             domainLength == eep->domainTable[0].len &&
@@ -595,7 +766,7 @@ void   NWReceive(void)
                    domainLength) == 0)
     {
         /* Matches domainId in index 0 */
-        srcAddr.dmn.domainIndex = 0;
+        srcAddrOut->dmn.domainIndex = 0;
     }
     else if (NodeConfigured() && numDomains == 2 &&
              !eep->domainTable[1].invalid &&
@@ -604,12 +775,12 @@ void   NWReceive(void)
                     domainLength) == 0)
     {
         /* Matches domainId in index 1 */
-        srcAddr.dmn.domainIndex = 1;
+        srcAddrOut->dmn.domainIndex = 1;
     }
     else
     {
         /* Must be a flex domain. */
-        srcAddr.dmn.domainIndex = FLEX_DOMAIN;
+        srcAddrOut->dmn.domainIndex = FLEX_DOMAIN;
         flexDomain = TRUE;
     }
 
@@ -617,75 +788,69 @@ void   NWReceive(void)
     /* We can do this check only in non-flexdomain as
        src subnet and node are 0 in flex domain. */
     if (! flexDomain &&
-            memcmp(&srcAddr.subnetAddr,
-                   &eep->domainTable[srcAddr.dmn.domainIndex].subnet, 2)
+            memcmp(&srcAddrOut->subnetAddr,
+                   &eep->domainTable[srcAddrOut->dmn.domainIndex].subnet, 2)
             == 0)
     {
         /* Not flex domain and source addr matches. */
-        DeQueue(&gp->nwInQ); /* Discard packet. */
         DebugMsg("NWReceive. Discarding Self Pck\n");
-        return;
+        return(FALSE);
     }
 
     /* Drop packet in various address modes if not for us. */
-    switch (srcAddr.addressMode)
+    switch (srcAddrOut->addressMode)
     {
     case BROADCAST:
         if (!flexDomain &&
                 destAddr.subnet != 0 && /* subnet broadcast. */
                 memcmp(&destAddr.subnet,
-                       &eep->domainTable[srcAddr.dmn.domainIndex].subnet,
+                       &eep->domainTable[srcAddrOut->dmn.domainIndex].subnet,
                        1) != 0)
         {
             /* Domain matches but destAddr does not. Not for us. */
-            DeQueue(&gp->nwInQ);
             DebugMsg("NWReceive: Discard BC pck. Not my subnet.\n");
-            return;
+            return(FALSE);
         }
-        srcAddr.broadcastSubnet = destAddr.subnet;
+        srcAddrOut->broadcastSubnet = destAddr.subnet;
         break;
     case MULTICAST:
         if (!flexDomain &&
-                !IsGroupMember(srcAddr.dmn.domainIndex,
-                               srcAddr.group, NULL) )
+                !IsGroupMember(srcAddrOut->dmn.domainIndex,
+                               srcAddrOut->group, NULL) )
         {
             /* Domain matches but group does not. Not for us. */
-            DeQueue(&gp->nwInQ);
             DebugMsg("NWReceive: Discard MC pck. Not my group.\n");
-            return;
+            return(FALSE);
         }
         break;
     case SUBNET_NODE:
         if (!flexDomain &&
                 memcmp(&destAddr,
-                       &eep->domainTable[srcAddr.dmn.domainIndex].subnet,
+                       &eep->domainTable[srcAddrOut->dmn.domainIndex].subnet,
                        2) != 0)
         {
-            DeQueue(&gp->nwInQ);
             DebugMsg("NWReceive: Discard unicast logical packet. Not my subnet (or subnode).\n");
-            return;
+            return(FALSE);
         }
         break;
     case MULTICAST_ACK:
         /* Make sure the destination subnet/node matches. */
         if (!flexDomain &&
                 memcmp(&destAddr,
-                       &eep->domainTable[srcAddr.dmn.domainIndex].subnet,
+                       &eep->domainTable[srcAddrOut->dmn.domainIndex].subnet,
                        2) != 0)
         {
-            DeQueue(&gp->nwInQ);
             DebugMsg("NWReceive: Discard multicast ack packet. Not my subnet (or subnode).\n");
-            return;
+            return(FALSE);
         }
         /* Also make sure that group matches. */
         if (!flexDomain &&
-                !IsGroupMember(srcAddr.dmn.domainIndex,
-                               srcAddr.ackNode.groupAddr.group,
+                !IsGroupMember(srcAddrOut->dmn.domainIndex,
+                               srcAddrOut->ackNode.groupAddr.group,
                                NULL) )
         {
-            DeQueue(&gp->nwInQ);
             DebugMsg("NWReceive: Discard multicast ack packet. Not my group.\n");
-            return;
+            return(FALSE);
         }
         break;
     case UNIQUE_NODE_ID:
@@ -694,30 +859,27 @@ void   NWReceive(void)
                    UNIQUE_NODE_ID_LEN) != 0)
         {
             /* Unique Node Id message but not for our id. */
-            DeQueue(&gp->nwInQ);
             DebugMsg("NWReceive: Discard Unique Node ID packet. Not my Id.\n");
-            return;
+            return(FALSE);
         }
         break;
     default:
         ; /* Null statement. */
         /* Error message has been already printed in the previous switch. */
         /* Control should not come here. But, let us play safe. */
-        DeQueue(&gp->nwInQ);
-        return;
+        return(FALSE);
     }
 
 
     /* If a node is in unconfigured state,
        only broadcast and Unique Node ID messages can be received. */
     if (NodeUnConfigured() &&
-            srcAddr.addressMode != BROADCAST &&
-            srcAddr.addressMode != UNIQUE_NODE_ID)
+            srcAddrOut->addressMode != BROADCAST &&
+            srcAddrOut->addressMode != UNIQUE_NODE_ID)
     {
         /* Drop the packet. */
-        DeQueue(&gp->nwInQ);
         DebugMsg("NWReceive: Discard packet. We are not online.\n");
-        return;
+        return(FALSE);
     }
 
     /* Drop packets received on flexDomain if the state
@@ -727,104 +889,45 @@ void   NWReceive(void)
        unless it is Unique Node ID addressed. */
     if (flexDomain &&
             NodeConfigured() &&
-            srcAddr.addressMode != UNIQUE_NODE_ID)
+            srcAddrOut->addressMode != UNIQUE_NODE_ID)
     {
         /* Drop the packet. */
-        DeQueue(&gp->nwInQ);
         DebugMsg("NWReceive: Discard packet. Flex domain & not Neu. Id.\n");
-        return;
+        return(FALSE);
     }
 
-    /* We now got a packet that must be received. */
-    INCR_STATS(LcsL3Rx);
-
-    /* pduSize = npduSize - npduHeaderSize. */
-    /* j is length of the variable part header of NPDU. */
-    /* The fixed portion of NPDU header is always 1 byte. */
-	if (nwReceiveParamPtr->pduSize <= j+1)
-	{
-		// Malformed packet.  
-		DeQueue(&gp->nwInQ);
-        DebugMsg("NWReceive: Discard short packet.\n");
-		return;
-	}
+    *pduOffsetOut = j;
+    return(TRUE);
+}
 
-    pduSize = nwReceiveParamPtr->pduSize - j - 1;
+/*******************************************************************************
+Function:  NWDeliver
+Returns:   None.
+Reference: None.
+Purpose:   To pass the PDU enclosed in the NPDU at the head of nwInQ to
+           the transport/session or application layer.
+Comments:  The parameters for the upper layer replace the NPDU header
+           in front of the PDU and the buffer is handed over. The PDU
+           is copied only if it can't be handed over.
+*******************************************************************************/
+static void NWDeliver(Queue *qInOut, void *paramIn, uint16 paramSizeIn,
+                      Byte *pduIn, uint16 pduSizeIn)
+{
+    Byte *itemPtr = pduIn - paramSizeIn;
 
-    /* Set the pdu pointer properly. */
-    switch (npduPtr->pduType)
+    if (QueueCanHandOff(&gp->nwInQ, qInOut, itemPtr))
     {
-    case APDU_TYPE:
-        if (QueueFull(&gp->appInQ) ||
-                pduSize > gp->appInBufSize)
-        {
-            /* No space or insufficient space. Discard packet. */
-            if (pduSize > gp->appInBufSize)
-            {
-                LCS_RecordError(WRITE_PAST_END_OF_APPL_BUFFER);
-            }
-            INCR_STATS(LcsLost);
-            DeQueue(&gp->nwInQ);
-            DebugMsg("NWReceive: Discard packet. Insufficient space.\n");
-            return;
-        }
-        /* Queue is not full and buffer has sufficient space. */
-        appReceiveParamPtr = QueueTail(&gp->appInQ);
-        pduPtr = (Byte *) appReceiveParamPtr +
-                 sizeof(APPReceiveParam);
-
-        appReceiveParamPtr->indication = MESSAGE;
-        appReceiveParamPtr->srcAddr    = srcAddr;
-        appReceiveParamPtr->priority   = nwReceiveParamPtr->priority;
-        appReceiveParamPtr->altPath    = nwReceiveParamPtr->altPath;
-        appReceiveParamPtr->pduSize    = pduSize;
-        appReceiveParamPtr->auth       = FALSE;
-        appReceiveParamPtr->service    = UNACKD;
-		appReceiveParamPtr->xcvrParams = nwReceiveParamPtr->xcvrParams;
-        memcpy(pduPtr, &npduPtr->data[j], pduSize);
-        EnQueue(&gp->appInQ);
-        DeQueue(&gp->nwInQ);
-        return;
-    case TPDU_TYPE: /* Fall through. */
-    case SPDU_TYPE: /* Fall through. */
-    case AUTHPDU_TYPE:
-        if (QueueFull(&gp->tsaInQ) ||
-                pduSize > gp->tsaInBufSize)
-        {
-            /* No space or insufficient space. Discard packet. */
-            if (pduSize > gp->tsaInBufSize)
-            {
-                /* Buffer sizes are based on app buf sizes. See
-                   TSAReset function. */
-                LCS_RecordError(WRITE_PAST_END_OF_APPL_BUFFER);
-            }
-            INCR_STATS(LcsLost);
-            DeQueue(&gp->nwInQ);
-            DebugMsg("NWReceive: Discard packet. Insufficient space.\n");
-            return;
-        }
-        /* Queue is not full and buffer has sufficient space. */
-        tsaReceiveParamPtr = QueueTail(&gp->tsaInQ);
-        pduPtr = (Byte *) tsaReceiveParamPtr +
-                 sizeof(TSAReceiveParam);
-        tsaReceiveParamPtr->pduType   = (PDUType)npduPtr->pduType;
-        tsaReceiveParamPtr->srcAddr   = srcAddr;
-        tsaReceiveParamPtr->priority  = nwReceiveParamPtr->priority;
-        tsaReceiveParamPtr->altPath   = nwReceiveParamPtr->altPath;
-        tsaReceiveParamPtr->pduSize   = pduSize;
-		tsaReceiveParamPtr->xcvrParams= nwReceiveParamPtr->xcvrParams;
-        memcpy(pduPtr, &npduPtr->data[j], pduSize);
-        EnQueue(&gp->tsaInQ);
-        DeQueue(&gp->nwInQ);
-        return;
-    default:
-        ErrorMsg("NWReceive: Unknown PDU was received.\n");
-        LCS_RecordError(UNKNOWN_PDU);
+        memcpy(itemPtr, paramIn, paramSizeIn);
+        QueueHandOff(&gp->nwInQ, qInOut, itemPtr);
+    }
+    else
+    {
+        itemPtr = QueueTail(qInOut);
+        memcpy(itemPtr, paramIn, paramSizeIn);
+        memcpy(itemPtr + paramSizeIn, pduIn, pduSizeIn);
+        EnQueue(qInOut);
         DeQueue(&gp->nwInQ);
-        return;
     }
-
-    /* Should not come here. */
 }
 
 /*******************************************************************************
@@ -60,6 +60,7 @@ Section: Function Prototypes
 void   NWReset(void);
 void   NWSend(void);
 void   NWReceive(void);
+Boolean NWPreFilter(Byte *npduIn, SourceAddress *srcAddrOut);
 
 #endif
 /*------------------------------End of network.h------------------------------*/
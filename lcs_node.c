@@ -69,10 +69,11 @@ Section: Type Definitions
 /*-------------------------------------------------------------------
 Section: Globals
 -------------------------------------------------------------------*/
-EEPROM            *eep; /* actual structure is in eeprom.c */
-NmMap             *nmp;
+/* The current stack, see LCS_SelectStack() */
+LCS_THREAD_LOCAL EEPROM            *eep; /* actual structure is in eeprom.c */
+LCS_THREAD_LOCAL NmMap             *nmp;
 NmMap              nm[NUM_STACKS] = {{0}};
-ProtocolStackData *gp;
+LCS_THREAD_LOCAL ProtocolStackData *gp;
 ProtocolStackData  protocolStackDataGbl[NUM_STACKS];
 
 /*-------------------------------------------------------------------
@@ -140,7 +141,7 @@ Status UpdateDomain(DomainStruct *domainInp, uint8 indexIn, Boolean includeKey)
     int nDomains = eep->readOnlyData.twoDomains ? MAX_DOMAINS : 1;
     if (indexIn < nDomains)
     {
-		memcpy(&eep->domainTable[indexIn], domainInp, includeKey ? sizeof(DomainStruct) : sizeof(DomainStruct) - AUTH_KEY_LEN);
+		ConfigWrite(&eep->domainTable[indexIn], domainInp, includeKey ? sizeof(DomainStruct) : sizeof(DomainStruct) - AUTH_KEY_LEN, TRUE);
     }
     else
     {
@@ -177,7 +178,9 @@ Status UpdateAddress(AddrTableEntry *addrEntryInp, uint16 indexIn)
     Status sts = SUCCESS;
     if (indexIn < NUM_ADDR_TBL_ENTRIES)
     {
-        eep->addrTable[indexIn] = *addrEntryInp;
+        ConfigWrite(&eep->addrTable[indexIn], addrEntryInp,
+                    sizeof(AddrTableEntry), TRUE);
+        GroupIndexBuild();
     }
     else
     {
@@ -198,21 +201,9 @@ Comments:  If groupMemberOut is NULL, then it is not used.
 Boolean IsGroupMember(Byte domainIndexIn, uint8 groupIn,
                       uint8 *groupMemberOut)
 {
-    uint16 i;
+    uint16 i = AddrTableIndex(domainIndexIn, groupIn);
 
-    for (i = 0; i < NUM_ADDR_TBL_ENTRIES; i++)
-    {
-        if (eep->addrTable[i].addrFormat >= 128)
-        {
-            /* Group Format */
-            if (eep->addrTable[i].groupEntry.groupID == groupIn &&
-                    eep->addrTable[i].groupEntry.domainIndex == domainIndexIn)
-            {
-                break;
-            }
-        }
-    }
-    if (i == NUM_ADDR_TBL_ENTRIES)
+    if (i == 0xFF)
     {
         return(FALSE); /* Not Found */
     }
@@ -230,26 +221,48 @@ Returns:   The index of the address table for the given domain
 Reference: None
 Purpose:   To get the addr table index for a given group and domain.
            If there is no such entry in the addr table, return 0xff.
-Comments:  None
+Comments:  Uses the group index rather than scanning the table.
 ******************************************************************/
 uint16 AddrTableIndex(uint8 domainIndexIn, uint8 groupIn)
 {
-    uint16 i;
+    if (domainIndexIn >= MAX_DOMAINS ||
+            !(gp->groupBitmap[domainIndexIn][groupIn >> 3] & (1 << (groupIn & 7))))
+    {
+        return(0xFF); /* Not Found */
+    }
+    return(gp->groupAddrIndex[domainIndexIn][groupIn]);
+}
+
+/*****************************************************************
+Function:  GroupIndexBuild
+Returns:   None
+Reference: None
+Purpose:   To rebuild the group membership bitmap and the group to
+           address table index from the address table.
+Comments:  Needed whenever the address table is changed other than
+           through UpdateAddress. Where a group is in the table more
+           than once the lowest index wins, as it did for the scan.
+******************************************************************/
+void GroupIndexBuild(void)
+{
+    int16 i;
+    uint8 domainIndex;
+    uint8 group;
+
+    memset(gp->groupBitmap, 0, sizeof(gp->groupBitmap));
 
-    for (i = 0; i < NUM_ADDR_TBL_ENTRIES; i++)
+    /* Going backwards leaves the lowest index for each group. */
+    for (i = NUM_ADDR_TBL_ENTRIES - 1; i >= 0; i--)
     {
         if (eep->addrTable[i].addrFormat >= 128)
         {
             /* Group Format */
-            if (eep->addrTable[i].groupEntry.groupID == groupIn &&
-                    eep->addrTable[i].groupEntry.domainIndex == domainIndexIn)
-            {
-                return(i);
-            }
+            domainIndex = eep->addrTable[i].groupEntry.domainIndex;
+            group       = eep->addrTable[i].groupEntry.groupID;
+            gp->groupBitmap[domainIndex][group >> 3] |= (uint8)(1 << (group & 7));
+            gp->groupAddrIndex[domainIndex][group]    = (uint8)i;
         }
     }
-
-    return(0xFF); /* Not Found */
 }
 
 
@@ -372,7 +385,9 @@ void UpdateNV(NVStruct *nvStructInp, uint16 indexIn)
 {
     if (nvStructInp && indexIn < nmp->nvTableSize)
     {
-        eep->nvConfigTable[indexIn] = *nvStructInp;
+        ConfigWrite(&eep->nvConfigTable[indexIn], nvStructInp,
+                    sizeof(NVStruct), TRUE);
+        NVSelectorIndexUpdate(indexIn);
         return;
     }
     if (nvStructInp)
@@ -385,6 +400,49 @@ void UpdateNV(NVStruct *nvStructInp, uint16 indexIn)
     }
 }
 
+/*****************************************************************
+Function:  AccessAlias
+Returns:   Address of NV alias table entry
+Reference: Tech Device Data Rev 1 p.9-18
+Purpose:   To Access the NV Alias Table Entry given the index
+Comments:  indexIn is the index in the alias table.
+******************************************************************/
+AliasStruct *AccessAlias(uint16 indexIn)
+{
+    if (indexIn < NV_ALIAS_TABLE_SIZE)
+    {
+        return(&eep->nvAliasTable[indexIn]);
+    }
+    ErrorMsg("AccessAlias: Invalid index.\n");
+    return(NULL);
+}
+
+/*****************************************************************
+Function:  UpdateAlias
+Returns:   None
+Reference: Tech Device Data Rev 1 p.9-18
+Purpose:   To update an entry in NV Alias Table
+Comments:  indexIn is the index in the alias table.
+******************************************************************/
+void UpdateAlias(AliasStruct *aliasStructInp, uint16 indexIn)
+{
+    if (aliasStructInp && indexIn < NV_ALIAS_TABLE_SIZE)
+    {
+        ConfigWrite(&eep->nvAliasTable[indexIn], aliasStructInp,
+                    sizeof(AliasStruct), TRUE);
+        NVSelectorIndexUpdate((int16)(nmp->nvTableSize + indexIn));
+        return;
+    }
+    if (aliasStructInp)
+    {
+        ErrorMsg("UpdateAlias: Invalid index.\n");
+    }
+    else
+    {
+        ErrorMsg("UpdateAlias: NULL aliasStructInp.\n");
+    }
+}
+
 /*****************************************************************
 Function:  NVTableIndex
 Returns:   index of NV Config Table
@@ -440,11 +498,19 @@ Purpose:   A Simple version of storage allocator similar to malloc.
            If no more space, NULL is returned.
 Comments:  There is no function similar to free. There is no need
            for such a funcion in the Reference Implementation.
+           The storage is aligned by STORAGE_ALIGN, so that the
+           structs kept there can be accessed on strict alignment
+           targets.
 ******************************************************************/
 void *AllocateStorage(uint16 sizeIn)
 {
     Byte *ptr;
 
+    while (!STORAGE_ALIGNED(gp->mallocStorage + gp->mallocUsedSize) &&
+           gp->mallocUsedSize < MALLOC_SIZE)
+    {
+        gp->mallocUsedSize++;
+    }
     if (gp->mallocUsedSize + sizeIn > MALLOC_SIZE)
     {
 	    assert(0);
@@ -458,6 +524,24 @@ void *AllocateStorage(uint16 sizeIn)
     return(ptr);
 }
 
+/*****************************************************************
+Function:  PoolReset
+Returns:   None
+Reference: None
+Purpose:   To allocate the item buffers of the queue pools.
+Comments:  Runs after the layers have initialized their queues, as
+           the buffers must fit the largest item of each pool.
+******************************************************************/
+static void PoolReset(void)
+{
+    if (QueuePoolAllocate(&gp->inPool)  != SUCCESS ||
+        QueuePoolAllocate(&gp->outPool) != SUCCESS)
+    {
+        ErrorMsg("PoolReset: Unable to allocate queue buffers.\n");
+        gp->resetOk = FALSE;
+    }
+}
+
 /*****************************************************************
 Function:  NodeReset
 Returns:   None
@@ -471,9 +555,13 @@ void NodeReset(Boolean firstReset)
     NWReset(void),  LKReset(void),  AppReset(void);
 
     void (*resetFns[])(void) =
-        {APPReset, TCSReset, TSAReset, NWReset, LKReset, AppReset};
+        {APPReset, TCSReset, TSAReset, NWReset, LKReset, PoolReset,
+         AppReset};
     uint8 fnNum, fnsCnt;
 
+    /* Don't lose configuration changes still waiting to be written. */
+    LCS_FlushNvm();
+
 #ifdef INCLUDE_PHYSICAL
     if (!firstReset)
     {
@@ -484,6 +572,8 @@ void NodeReset(Boolean firstReset)
     /* Init variables that are not in EEPROM */
     memset(&nmp->stats, 0, sizeof(StatsStruct));
     gp->prevPinState[0]  = 0;
+    gp->checksumSweep    = 0; /* The image may have been reloaded. */
+    gp->checksumPartial  = 0;
 
     /* A node in soft off-line state should go on-line state */
     if (eep->readOnlyData.nodeState == CNFG_ONLINE && gp->appPgmMode == OFF_LINE)
@@ -502,6 +592,14 @@ void NodeReset(Boolean firstReset)
        data strcutures */
     gp->mallocUsedSize = 0;
 
+    /* Received PDUs move from nwInQ to tsaInQ or appInQ with a larger
+       parameter block in front of them. Outgoing PDUs move from the
+       network layer's queues to the link layer's with a smaller one,
+       so that pool needs no headroom. */
+    QueuePoolInit(&gp->inPool,
+                  MAX(sizeof(TSAReceiveParam), sizeof(APPReceiveParam)));
+    QueuePoolInit(&gp->outPool, 0);
+
     /* Call all the Reset functions */
     fnsCnt = sizeof(resetFns)/sizeof(FnType);
     for (fnNum = 0; fnNum < fnsCnt; fnNum++)
@@ -526,6 +624,13 @@ void NodeReset(Boolean firstReset)
     {
         MsTimerSet(&gp->tsDelayTimer, TS_RESET_DELAY_TIME);
     }
+    /* The NV and address tables may have been reloaded. */
+    NVSelectorIndexBuild();
+    GroupIndexBuild();
+
+    /* Let the scheduler run every layer once after a reset. */
+    gp->readyMask        = LCS_READY_ALL;
+    gp->backlogMask      = 0;
     gp->resetNode        = FALSE;
 }
 
@@ -729,6 +834,125 @@ NVStruct *GetNVStructPtr(int16 nvIndexIn)
     return(&eep->nvAliasTable[nvIndexIn - nmp->nvTableSize].nvConfig);
 }
 
+/*****************************************************************
+Function:  NVSelectorOf
+Returns:   The 14 bit selector of a network variable structure.
+Reference: None
+Purpose:   To assemble the selector from its two fields.
+Comments:  None
+******************************************************************/
+static uint16 NVSelectorOf(NVStruct *nvStructIn)
+{
+    return (uint16)((nvStructIn->nvSelectorHi << 8) | nvStructIn->nvSelectorLo);
+}
+
+/*****************************************************************
+Function:  NVSelectorIndexBuild
+Returns:   None
+Reference: None
+Purpose:   To rebuild the selector index from the NV config and
+           alias tables.
+Comments:  Needed whenever the tables are changed other than through
+           UpdateNV or UpdateAlias, or when nvTableSize changes as
+           that moves the alias indices.
+******************************************************************/
+void NVSelectorIndexBuild(void)
+{
+    int16  i;
+    uint16 bucket;
+
+    for (i = 0; i < NV_SELECTOR_HASH_SIZE; i++)
+    {
+        gp->nvSelectorHash[i] = -1;
+    }
+
+    /* Going backwards and adding to the front keeps chains in
+       ascending order. */
+    for (i = nmp->nvTableSize + NV_ALIAS_TABLE_SIZE - 1; i >= 0; i--)
+    {
+        gp->nvSelectorKey[i]  = NVSelectorOf(GetNVStructPtr(i));
+        bucket                = gp->nvSelectorKey[i] & (NV_SELECTOR_HASH_SIZE - 1);
+        gp->nvSelectorNext[i] = gp->nvSelectorHash[bucket];
+        gp->nvSelectorHash[bucket] = i;
+    }
+}
+
+/*****************************************************************
+Function:  NVSelectorIndexUpdate
+Returns:   None
+Reference: None
+Purpose:   To move an entry of the selector index to the chain of
+           its current selector after the entry has been changed.
+Comments:  nvIndexIn can be either primary or alias.
+******************************************************************/
+void NVSelectorIndexUpdate(int16 nvIndexIn)
+{
+    int16 *linkPtr;
+
+    if (nvIndexIn < 0 || nvIndexIn >= nmp->nvTableSize + NV_ALIAS_TABLE_SIZE)
+    {
+        return;
+    }
+
+    /* Unlink from the chain of the selector it was linked under. */
+    linkPtr = &gp->nvSelectorHash[gp->nvSelectorKey[nvIndexIn] &
+                                  (NV_SELECTOR_HASH_SIZE - 1)];
+    while (*linkPtr != -1 && *linkPtr != nvIndexIn)
+    {
+        linkPtr = &gp->nvSelectorNext[*linkPtr];
+    }
+    if (*linkPtr == nvIndexIn)
+    {
+        *linkPtr = gp->nvSelectorNext[nvIndexIn];
+    }
+
+    /* Link into the chain of its current selector, in order. */
+    gp->nvSelectorKey[nvIndexIn] = NVSelectorOf(GetNVStructPtr(nvIndexIn));
+    linkPtr = &gp->nvSelectorHash[gp->nvSelectorKey[nvIndexIn] &
+                                  (NV_SELECTOR_HASH_SIZE - 1)];
+    while (*linkPtr != -1 && *linkPtr < nvIndexIn)
+    {
+        linkPtr = &gp->nvSelectorNext[*linkPtr];
+    }
+    gp->nvSelectorNext[nvIndexIn] = *linkPtr;
+    *linkPtr = nvIndexIn;
+}
+
+/*****************************************************************
+Function:  NVSelectorLookup
+Returns:   The lowest NV index (primary or alias) above afterIndexIn
+           with the given selector and direction, or -1 if none.
+Reference: None
+Purpose:   To find network variables by selector without scanning
+           the NV config and alias tables.
+Comments:  Pass -1 for afterIndexIn to get the first match. To get
+           the next match, pass the index returned by the previous
+           call.
+******************************************************************/
+int16 NVSelectorLookup(uint16 selectorIn, uint8 directionIn, int16 afterIndexIn)
+{
+    int16 i;
+
+    if (afterIndexIn == -1)
+    {
+        i = gp->nvSelectorHash[selectorIn & (NV_SELECTOR_HASH_SIZE - 1)];
+    }
+    else
+    {
+        i = gp->nvSelectorNext[afterIndexIn];
+    }
+
+    for (; i != -1; i = gp->nvSelectorNext[i])
+    {
+        if (gp->nvSelectorKey[i] == selectorIn &&
+                GetNVStructPtr(i)->nvDirection == directionIn)
+        {
+            return(i);
+        }
+    }
+    return(-1);
+}
+
 /*****************************************************************
 Function:  CheckSum4
 Returns:   4 bit checksum of a given data.
@@ -795,6 +1019,82 @@ uint8 ComputeConfigCheckSum(void)
     return(checkSum);
 }
 
+/*****************************************************************
+Function:  ConfigWrite
+Returns:   None
+Reference: None
+Purpose:   To write to the EEPROM image without having to recompute
+           the configuration checksum.
+Comments:  For each byte written in the checksummed part of the image,
+           the old value is XORed out of the checksum and the new one
+           in, if checkSumIn is TRUE. The partial checksum kept by
+           ConfigCheckSumStep is adjusted the same way, whether or not
+           checkSumIn is TRUE, as it must follow the image. Writes
+           elsewhere are plain copies.
+******************************************************************/
+void ConfigWrite(void *dstIn, const void *srcIn, uint16 lengthIn,
+                 Boolean checkSumIn)
+{
+    Byte       *dst   = dstIn;
+    const Byte *src   = srcIn;
+    Byte       *start = (Byte *)&eep->configData;
+    Byte       *end   = (Byte *)&eep->configCheckSum;
+    Byte        delta;
+    uint16      i;
+
+    for (i = 0; i < lengthIn; i++)
+    {
+        if (dst + i >= start && dst + i < end)
+        {
+            delta = (Byte)(dst[i] ^ src[i]);
+            if (checkSumIn)
+            {
+                eep->configCheckSum ^= delta;
+            }
+            if (dst + i - start < gp->checksumSweep)
+            {
+                gp->checksumPartial ^= delta;
+            }
+        }
+    }
+    memmove(dstIn, srcIn, lengthIn);
+}
+
+/*****************************************************************
+Function:  ConfigCheckSumStep
+Returns:   FALSE if the configuration does not match its checksum,
+           TRUE otherwise.
+Reference: None
+Purpose:   To verify the configuration checksum a slice at a time.
+Comments:  Each call folds the next sliceIn bytes into
+           gp->checksumPartial. The checksum is compared once the
+           whole configuration has been covered, and the next call
+           starts over. Only ConfigWrite may change the configuration
+           in between.
+******************************************************************/
+Boolean ConfigCheckSumStep(uint16 sliceIn)
+{
+    uint16  size;
+    Boolean ok = TRUE;
+
+    size = (char*)&eep->configCheckSum - (char *)&eep->configData;
+    if (sliceIn > size - gp->checksumSweep)
+    {
+        sliceIn = size - gp->checksumSweep;
+    }
+    gp->checksumPartial ^= CheckSum8((char *)&eep->configData +
+                                     gp->checksumSweep, sliceIn);
+    gp->checksumSweep += sliceIn;
+
+    if (gp->checksumSweep == size)
+    {
+        ok = gp->checksumPartial == eep->configCheckSum;
+        gp->checksumSweep   = 0;
+        gp->checksumPartial = 0;
+    }
+    return(ok);
+}
+
 /*****************************************************************
 Function:  IOChanges
 Returns:   TRUE if the state of input pin changed.
@@ -944,7 +1244,7 @@ void LCS_RecordError(LcsErrorLog err)
 	if (eep->errorLog != err)
 	{
     	eep->errorLog = err;
-		LCS_WriteNvm();
+		LCS_MarkNvmDirty();
 	}
 }
 
@@ -42,16 +42,26 @@ Section: Includes
 #include "lcs_eia709_1.h"
 #include "lcs_api.h"
 #include "lcs_queue.h"
+#include "lcs_link.h"
 
 /*-------------------------------------------------------------------
 Section: Constant Definitions
 -------------------------------------------------------------------*/
-/* Define the size of the table maintained by the transaction control
-   sublayer that keeps track of each possible destination address
-   in packets sent to make sure that we don't assign the same tid as in the
-   last transaction to that destination. This constant is needed here
-   so that we can use it in the type definition of protocol stack data. */
-#define TID_TABLE_SIZE 10
+/* Scheduler readiness bits. Each layer ties its queues to one of these
+   bits (see QueueSetReadyBit) so that LCS_Service can skip the layers
+   that have nothing to do. */
+#define LCS_READY_APP  0x01  /* Application layer queues            */
+#define LCS_READY_TSA  0x02  /* Transport, session and auth queues  */
+#define LCS_READY_NW   0x04  /* Network layer queues                */
+#define LCS_READY_LK   0x08  /* Link layer output queues            */
+#define LCS_READY_ALL  (LCS_READY_APP | LCS_READY_TSA | LCS_READY_NW | LCS_READY_LK)
+
+/* Alignment of the storage from AllocateStorage, a power of two at
+   least as large as any struct kept there needs. Queue items handed
+   between layers in place must be aligned by it too. */
+#define STORAGE_ALIGN        sizeof(StorageAlign)
+#define STORAGE_ALIGNED(p)   ((((size_t)(p)) & (STORAGE_ALIGN - 1)) == 0)
+#define STORAGE_ALIGN_UP(n)  (((n) + STORAGE_ALIGN - 1) & ~(STORAGE_ALIGN - 1))
 
 /* Given a valid primary index of a network variable, get its address */
 #define NV_ADDRESS(i) (nmp->nvFixedTable[i].nvAddress)
@@ -65,6 +75,12 @@ Section: Constant Definitions
 /*-------------------------------------------------------------------
 Section: Type Definitions
 -------------------------------------------------------------------*/
+typedef union
+{
+    long  l;
+    void *p;
+} StorageAlign;
+
 /* Reference: Tech Device Data: Page 9-6. */
 
 /* Turn off alignment by compiler to make sure that the structure sizes
@@ -374,13 +390,6 @@ typedef struct
 	XcvrParam			  xcvrParams; // Transceiver parameters
 } APPReceiveParam;
 
-/* Type Definition for Transaction Control SubLayer */
-typedef struct
-{
-    TransNum    transNum;       /* initial value = 0. Range 0..15 */
-    Boolean     inProgress;     /* Is the transaction in progress */
-} TransCtrlRecord;
-
 /* Type definition for table used while assigning new TId. */
 /* For more information, see tcs.h or tcs.c */
 typedef struct
@@ -397,8 +406,27 @@ typedef struct
     } addr;
     MsTimer                  timer;
     TransNum                 tid;    /* Last TID used for this addr */
+    Boolean                  inProgress; /* Transaction to this addr */
+    int16                    hashNext; /* Next entry in hash bucket */
+    int16                    older;    /* Neighbours in order of use */
+    int16                    newer;
 } TIDTableEntry;
 
+/* Destination to TID table. Entries are chained by hash of the
+   destination and kept in order of last use, so the entry whose timer
+   expires first is always the oldest one. Entries with a transaction
+   in progress are left out of that order. -1 terminates the chains. */
+typedef struct
+{
+    TIDTableEntry entry[TID_TABLE_SIZE];
+    int16         hash[TID_HASH_SIZE];
+    int16         oldest;
+    int16         newest;
+    uint16        size;  /* # entries currently used */
+    uint8         tidInUse[16]; /* # transactions in progress per TID */
+    Boolean       built; /* FALSE until the chains are first set up */
+} TIDTable;
+
 /* Type Definitions for transport, Session, Auth Layers */
 
 typedef enum
@@ -445,32 +473,13 @@ typedef struct
 	uint8				 altKeyValue[2][DOMAIN_ID_LEN]; // Key used when altKey is true
 } AltKey;
 
-typedef struct
-{
-    TXStatus           status;               /* Who owns it? if not free  */
-    DestinationAddress nwDestAddr;           /* Destination Address */
-    Boolean            ackReceived[MAX_GROUP_NUMBER+1];
-    /* Array[0..MAX_GROUP_NUMBER] of Boolean   */
-    uint8              destCount;            /* Number of destinations    */
-    uint8              ackCount;             /* Or respCount              */
-    TransNum           transNum;
-    uint16             xmitTimerValue;
-    MsTimer            xmitTimer;            /* Transmit Timer            */
-    uint8              retriesLeft;          /* How many left?            */
-    APDU              *apdu;                 /* APDU transmitted          */
-    uint16             apduSize;             /* Size of APDU              */
-    Boolean            auth;                 /* Does this msg need auth?  */
-	uint16			   txTimerDeltaLast;	 // Time to add to last retry timer
-	AltKey			   altKey;				 // Alternate authentication info.
-} TransmitRecord;
-
 typedef struct
 {
     RRStatus             status;         /* used? Who is using?    */
     SourceAddress        srcAddr;        /* Who sent this?         */
     TransNum             transNum;
     RequestId            reqId;          /* For matching response  */
-    MsTimer              recvTimer;      /* receive timer          */
+    TmrWheelTimer        recvTimer;      /* receive timer, on recvWheel */
     TransactionState     transState;     /* What state is it in    */
     Boolean              priority;
     Boolean              altPath;        /* Was alt path used?     */
@@ -525,6 +534,29 @@ typedef struct
 	AltKey				 altKey;	// Alternate authentication key info
 } TSASendParam;
 
+typedef struct
+{
+    TXStatus           status;               /* Who owns it? if not free  */
+    DestinationAddress nwDestAddr;           /* Destination Address */
+    Boolean            ackReceived[MAX_GROUP_NUMBER+1];
+    /* Array[0..MAX_GROUP_NUMBER] of Boolean   */
+    uint8              destCount;            /* Number of destinations    */
+    uint8              ackCount;             /* Or respCount              */
+    TransNum           transNum;
+    uint16             xmitTimerValue;
+    MsTimer            xmitTimer;            /* Transmit Timer            */
+    uint8              retriesLeft;          /* How many left?            */
+    APDU              *apdu;                 /* APDU transmitted          */
+    uint16             apduSize;             /* Size of APDU              */
+    Boolean            auth;                 /* Does this msg need auth?  */
+	uint16			   txTimerDeltaLast;	 // Time to add to last retry timer
+	AltKey			   altKey;				 // Alternate authentication info.
+    Boolean            priority;             /* Priority of the transaction */
+    int16              tidIndex;             /* From NewTrans, for TransDone */
+    TSASendParam      *sendParam;            /* Copy of the message taken off
+                                                the tsa queue. apdu follows it */
+} TransmitRecord;
+
 /********************************************************************
    TSAReceiveParam is used to receive the necessary
    information to process incoming PDU (TPDU or SPDU or AuthPDU).
@@ -547,6 +579,8 @@ typedef struct
     uint8   deltaBL;  /* What is the backlog generated by this msg? */
     Boolean altPath;  /* Should altPath be used? */
     uint16  pduSize;  /* Size of NPDU */
+    uint8   domainIndex; /* Domain of destNode */
+    SubnetAddress destNode; /* Node sent to. node 0 ==> not a single node */
 } LKSendParam;
 
 /* SNVT data structures */
@@ -616,39 +650,64 @@ typedef struct
     int16 dim;     /* The dimension of the array */
 } NVArrayTbl;
 
+/* A frame recently received by the link layer. See LKDuplicate. */
+typedef struct
+{
+    uint32  digest;       /* Hash of the LPDU                       */
+    uint32  receivedTime; /* When the first copy came in            */
+    uint16  length;       /* Of the LPDU. 0 ==> unused entry         */
+    uint8   vni;          /* Interface the first copy came in on    */
+    Boolean copyDropped;  /* TRUE ==> a copy has been dropped       */
+} LKRecentFrame;
+
+/* The interface a node was last heard on. See LKRouteHeard. */
+typedef struct
+{
+    SubnetAddress node;     /* node 0 ==> unused entry                */
+    uint8   domainIndex;    /* Domain the node was heard in           */
+    uint8   vni;            /* Interface to send to the node on       */
+    uint8   quality;        /* Packet register of the last frame heard */
+    uint32  heardTime;      /* When last heard on vni                 */
+    uint32  sentDigest;     /* Hash of the last NPDU sent to the node */
+} LKRoute;
+
 /* Type Definition for Protocol Stack Data */
 typedef struct
 {
-    /* Number of bytes used so far */
-    uint16  mallocUsedSize;
+    /* Number of bytes used so far. May pass 64K with a large
+       RECEIVE_TRANS_COUNT. */
+    uint32  mallocUsedSize;
 
     /* Array of storage space for dynamic allocation of buffers etc */
     Byte mallocStorage[MALLOC_SIZE];
 
     /* Variables for Transaction Control Sublayer */
-    TransCtrlRecord priTransCtrlRec;
-
-    TransCtrlRecord nonpriTransCtrlRec;
-
     TransNum       priTransID;
     TransNum       nonpriTransID;
 
-    TIDTableEntry priTbl[TID_TABLE_SIZE];
-    TIDTableEntry nonpriTbl[TID_TABLE_SIZE];
-    /* # entries currently used */
-    uint16        priTblSize;
-    uint16        nonpriTblSize;
+    TIDTable      priTbl;
+    TIDTable      nonpriTbl;
 
     /* Timer to delay Transport/Session layers after an external or
        power-up reset. */
     MsTimer tsDelayTimer;
 
     /* Transmit and Receive Records */
-    TransmitRecord xmitRec;
-    TransmitRecord priXmitRec;
+    TransmitRecord *xmitRec;  /* Pool of records, both priorities */
+    uint16 xmitRecCnt;        /* How many Records allocated? */
 
     ReceiveRecord  *recvRec;  /* Pool of records */
     uint16 recvRecCnt;        /* How many Records allocated? */
+    TmrWheel recvWheel;       /* The receive timers of records in use */
+
+    /* Receive record indices. Records in use are chained by source
+       address and by request id. Unused records are on the free list.
+       Chains use -1 as the terminator. */
+    int16  rrSrcHash[RECEIVE_TRANS_HASH_SIZE];
+    int16  rrReqHash[RECEIVE_TRANS_HASH_SIZE];
+    int16 *rrSrcNext;         /* Per record, also links the free list */
+    int16 *rrReqNext;         /* Per record */
+    int16  rrFree;            /* First unused record */
 
     RequestId reqId; /* Running count for request numbers */
     Byte      prevChallenge[8]; /* Used in generation of new challenge. */
@@ -737,6 +796,13 @@ typedef struct
     uint16        lkOutPriBufSize;
     uint16        lkOutPriQCnt;
 
+    /* Item buffers shared by the queues on both sides of the network
+       layer, so that a PDU is passed up or down without being copied.
+       inPool serves nwInQ, tsaInQ and appInQ. outPool serves nwOutQ,
+       nwOutPriQ, lkOutQ and lkOutPriQ. */
+    QueuePool     inPool;
+    QueuePool     outPool;
+
 #ifndef INCLUDE_PHYSICAL
     /* Output Queue For Physical Layer */
     Byte      *phyOutQ; /* Not a regular Queue unlike others */
@@ -867,6 +933,52 @@ typedef struct
 
 	MsTimer ledTimer;		/* To flash service LED */
     MsTimer checksumTimer;	/* How often to checksum */
+    uint16  checksumSweep;	/* Config bytes checked so far this pass */
+    uint8   checksumPartial;	/* Checksum of those bytes */
+
+    /* Scheduler state. readyMask collects the LCS_READY_xxx bits of
+       the queues written or read since the last pass. backlogMask has
+       the layers that were left with queued items after the last pass. */
+    uint8   readyMask;
+    uint8   backlogMask;
+
+    /* Index of the NV config and alias tables by selector. Each bucket is
+       a chain of NV indices (primary or alias) in ascending order, ending
+       with -1. nvSelectorKey has the selector each entry was linked under.
+       Maintained by UpdateNV, UpdateAlias and NVSelectorIndexBuild. */
+    int16   nvSelectorHash[NV_SELECTOR_HASH_SIZE];
+    int16   nvSelectorNext[NV_TABLE_SIZE + NV_ALIAS_TABLE_SIZE];
+    uint16  nvSelectorKey[NV_TABLE_SIZE + NV_ALIAS_TABLE_SIZE];
+
+    /* Groups this node is a member of, one bit per group in each domain,
+       and the address table index of each of those groups. Derived from
+       the address table by GroupIndexBuild. */
+    uint8   groupBitmap[MAX_DOMAINS][256 / 8];
+    uint8   groupAddrIndex[MAX_DOMAINS][256];
+
+    /* Write-behind of the EEPROM image to NVM. See lcs_eeprom.c */
+    Boolean nvmDirty;       /* TRUE ==> eeprom differs from NVM       */
+    MsTimer nvmWriteTimer;  /* Restarted on each change               */
+    MsTimer nvmMaxTimer;    /* Started on the first unwritten change  */
+
+    /* Driver interfaces of the link layer. See lcs_link.c */
+    LinkHandle vniHandle[NUM_VNI];
+    XcvrParam  vniXcvrParam[NUM_VNI]; /* Last transceiver registers    */
+    MsTimer    xcvrTimer;    /* Periodic transceiver register fetch     */
+    int        plcVni;       /* Index of the PLC interface              */
+    int        vniRxNext;    /* Interface LKReceive reads first         */
+    uint32     vniRxCount[NUM_VNI];  /* Frames read from each interface */
+    uint32     vniRxMissed[NUM_VNI]; /* Of those, lost as nwInQ was full */
+    uint32     vniRxDuplicate[NUM_VNI]; /* Copies of frames already received on another interface */
+    LKRecentFrame lkRecent[LK_DUP_CACHE_SIZE]; /* By hash of the LPDU */
+    LKRoute    lkRoute[LK_ROUTE_COUNT]; /* By hash of domain and subnet/node */
+    uint32     vniTxCount[NUM_VNI];  /* Frames written to each interface */
+    Bool       vniOpen;      /* TRUE ==> interfaces have been opened    */
+    Bool       xcvrFetch;    /* TRUE ==> retry the failed register fetch */
+    Bool       setPhase;     /* TRUE ==> phase mode must be sent        */
+
+    /* How long a proxy request has waited for an output buffer */
+    MsTimer    proxyBufferWait;
 } ProtocolStackData;
 
 #pragma pack(push, 1)
@@ -902,11 +1014,11 @@ Section: Global Variables
 -------------------------------------------------------------------*/
 /* Node Data Structures */
 extern   ProtocolStackData   protocolStackDataGbl[NUM_STACKS];
-extern   ProtocolStackData  *gp; /* Pointer to current Structure */
+extern   LCS_THREAD_LOCAL ProtocolStackData  *gp; /* Pointer to current Structure */
 extern   EEPROM              eeprom[NUM_STACKS];
-extern   EEPROM             *eep; /* Pointer to current eeprom str */
+extern   LCS_THREAD_LOCAL EEPROM             *eep; /* Pointer to current eeprom str */
 extern   NmMap               nm[NUM_STACKS];
-extern   NmMap              *nmp;
+extern   LCS_THREAD_LOCAL NmMap              *nmp;
 
 /*-------------------------------------------------------------------
 Section: Function Prototypes
@@ -916,6 +1028,7 @@ Status  UpdateDomain(DomainStruct *domainInp, uint8 indexIn, Boolean includeKey)
 AddrTableEntry *AccessAddress(uint16 indexIn);
 Status  UpdateAddress(AddrTableEntry *addrEntryInp, uint16 indexIn);
 uint16  AddrTableIndex(Byte domainIndexIn, uint8 groupIn);
+void    GroupIndexBuild(void);
 Boolean IsGroupMember(Byte domainIndex, uint8 groupIn,
                       uint8 *groupMemberOut);
 uint16  DecodeBufferSize(uint8 bufSizeIn);
@@ -936,8 +1049,14 @@ Boolean IOChanges(uint8 pinNumberIn);
 uint8   CheckSum4(void *data, uint16 lengthIn);
 uint8   CheckSum8(void *data, uint16 lengthIn);
 uint8   ComputeConfigCheckSum(void);
+void    ConfigWrite(void *dstIn, const void *srcIn, uint16 lengthIn,
+                    Boolean checkSumIn);
+Boolean ConfigCheckSumStep(uint16 sliceIn);
 int16   GetPrimaryIndex(int16 nvIndexIn);
 NVStruct *GetNVStructPtr(int16 nvIndexIn);
+void    NVSelectorIndexBuild(void);
+void    NVSelectorIndexUpdate(int16 nvIndexIn);
+int16   NVSelectorLookup(uint16 selectorIn, uint8 directionIn, int16 afterIndexIn);
 Boolean IsTagBound(uint8 tagin);
 Boolean IsNVBound(int16 nvIndexIn);
 Boolean AppPgmRuns(void);
@@ -947,6 +1066,10 @@ Boolean NodeUnConfigured(void);
 // APIs that follow the AREA_<Name> convention:
 void	LCS_RecordError(LcsErrorLog err);
 void	LCS_WriteNvm(void);
+void	LCS_MarkNvmDirty(void);
+void	LCS_ServiceNvm(void);
+Boolean	LCS_NvmPending(void);
+EchErr	LCS_FlushNvm(void);
 EchErr	LCS_ReadNvm(void);
 
 #ifdef _DEBUG_LCS
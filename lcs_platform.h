@@ -63,11 +63,14 @@ typedef unsigned char		BitField;
 // Turn on packing so that structures are packed on byte boundaries.  This should be done globally via a compiler switch.  Otherwise, try using
 // a pragma such as #pragma pack
 
-// Number of stacks on this platform
+// Number of stacks on this platform.  Simulations with many nodes on the virtual channel (LDV_VIRTUAL_CHANNEL, see
+// vldv_vlon.c) set it on the command line, e.g. -DNUM_STACKS=200.
+#ifndef NUM_STACKS
 #define NUM_STACKS 1
+#endif
 
 // Define code to toggle the service LED
-#ifdef WIN32
+#if defined(WIN32) || defined(__linux__)
 #define TOGGLE_SERVICE_LED
 #else
 #define TOGGLE_SERVICE_LED            gp->ioOutputPin1 = 1 - gp->ioOutputPin1; /* Toggle. */
@@ -90,9 +93,60 @@ typedef unsigned char		BitField;
 #ifdef WIN32
 #include "windows.h"
 #define TAKE_A_BREAK Sleep(1);
+#elif defined(__linux__)
+#include <unistd.h>
+#define TAKE_A_BREAK usleep(1000);
 #else
 #include "smip_ldv.h"
 #define TAKE_A_BREAK SMP_Service();
 #endif
 
+// With LCS_EVENT_SCHEDULER set, LCS_Service() only runs the layers with pending work and the main loop blocks until
+// the next timer deadline or a driver wakeup rather than polling with TAKE_A_BREAK.  Build with
+// -DLCS_EVENT_SCHEDULER=0 for the polling loop.
+#ifndef LCS_EVENT_SCHEDULER
+#define LCS_EVENT_SCHEDULER 1
+#endif
+
+// Longest time (ms) the main loop blocks when the stack is idle.  Bounds how long DoApp() goes without being called.
+#define LCS_MAX_IDLE_TIME 20
+
+// Specify a way to wait for up to the given number of milliseconds or until the driver has received a frame
+#if defined(WIN32) || defined(__linux__)
+#define WAIT_FOR_WORK(ms) vldv_wait(ms);
+#else
+#define WAIT_FOR_WORK(ms) SMP_Service();
+#endif
+
+// Define LCS_THREAD_PER_STACK (e.g. -DLCS_THREAD_PER_STACK) to have LCS_Run() service each stack on its own thread.  The
+// current stack (gp, eep, nmp and cp) is then a thread local and resources the stacks share are locked.
+#ifdef LCS_THREAD_PER_STACK
+#ifdef WIN32
+#define LCS_THREAD_LOCAL					__declspec(thread)
+typedef HANDLE LcsThread;
+#define LCS_THREAD_PROC(name, arg)			DWORD WINAPI name(LPVOID arg)
+#define LCS_THREAD_START(t, proc, arg)		(((t) = CreateThread(NULL, 0, proc, arg, 0, NULL)) != NULL)
+#define LCS_THREAD_JOIN(t)					WaitForSingleObject(t, INFINITE)
+typedef SRWLOCK LcsLock;
+#define LCS_LOCK_INIT						SRWLOCK_INIT
+#define LCS_LOCK(l)							AcquireSRWLockExclusive(&(l));
+#define LCS_UNLOCK(l)						ReleaseSRWLockExclusive(&(l));
+#else
+#include <pthread.h>
+#define LCS_THREAD_LOCAL					__thread
+typedef pthread_t LcsThread;
+#define LCS_THREAD_PROC(name, arg)			void* name(void* arg)
+#define LCS_THREAD_START(t, proc, arg)		(pthread_create(&(t), NULL, proc, arg) == 0)
+#define LCS_THREAD_JOIN(t)					pthread_join(t, NULL)
+typedef pthread_mutex_t LcsLock;
+#define LCS_LOCK_INIT						PTHREAD_MUTEX_INITIALIZER
+#define LCS_LOCK(l)							pthread_mutex_lock(&(l));
+#define LCS_UNLOCK(l)						pthread_mutex_unlock(&(l));
+#endif
+#else
+#define LCS_THREAD_LOCAL
+#define LCS_LOCK(l)
+#define LCS_UNLOCK(l)
+#endif
+
 #endif   /* _PLATFORM_H */
\ No newline at end of file
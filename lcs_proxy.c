@@ -133,7 +133,6 @@ Status ProcessLTEP(APPReceiveParam *appReceiveParamPtr, APDU *apduPtr)
 	APDU		   *apduSendPtr;
 	Boolean			altKey = FALSE;
 	Boolean			longTimer = FALSE;
-	static TmrTimer proxyBufferWait;
 
     ph = *(ProxyHeader*)pData;
     uniform = ph.uniform_by_src || ph.uniform_by_dest;
@@ -180,20 +179,20 @@ Status ProcessLTEP(APPReceiveParam *appReceiveParamPtr, APDU *apduPtr)
 		// On the Neuron, this can't occur because completion events are sent in the output buffer, not a new input buffer.
 		// LCS should probably be implemented more like the Neuron.  In the meantime, let's just have a timeout where
 		// we fail the proxy if we can't get an output buffer.
-		if (TMR_Expired(&proxyBufferWait))
+		if (TMR_Expired(&gp->proxyBufferWait))
 		{
 			ProcessLtepCompletion(appReceiveParamPtr, apduPtr, FAILURE);
 			return SUCCESS;
 		}
-		else if (!TMR_Running(&proxyBufferWait))
+		else if (!TMR_Running(&gp->proxyBufferWait))
 		{
-			TMR_Start(&proxyBufferWait, 1000);
+			TMR_Start(&gp->proxyBufferWait, 1000);
 		}
         return FAILURE;
     }
 	else
 	{
-		TMR_Stop(&proxyBufferWait);
+		TMR_Stop(&gp->proxyBufferWait);
 	}
 
     tsaSendParamPtr					= QueueTail(tsaOutQPtr);
@@ -60,11 +60,48 @@ Section: Globals
 /*-------------------------------------------------------------------
 Section: Local Function Prototypes
 -------------------------------------------------------------------*/
-/* None */
+static uint16 QueueStride(Queue *qInp);
+static Byte  *QueuePosition(Queue *qInp, uint16 indexIn);
 
 /*-------------------------------------------------------------------
 Section: Function Definitions
 -------------------------------------------------------------------*/
+/*****************************************************************
+Function:  QueueStride
+Returns:   The number of bytes between two items in the data array.
+Reference: None
+Purpose:   To step head and tail through the data array.
+Comments:  The data array of a pooled queue holds slots, not items.
+******************************************************************/
+static uint16 QueueStride(Queue *qInp)
+{
+    if (qInp->pool != NULL)
+    {
+        return(sizeof(QueueSlot));
+    }
+    return(qInp->itemSize);
+}
+
+/*****************************************************************
+Function:  QueuePosition
+Returns:   The entry of the data array indexIn places behind head.
+Reference: None
+Purpose:   To reach items behind the head.
+Comments:  The entry is a slot for a pooled queue.
+******************************************************************/
+static Byte *QueuePosition(Queue *qInp, uint16 indexIn)
+{
+    uint16 stride = QueueStride(qInp);
+    uint16 pos;
+
+    pos = (uint16)((qInp->head - qInp->data) / stride + indexIn);
+    if (pos >= qInp->queueCnt)
+    {
+        pos -= qInp->queueCnt;
+    }
+    return(qInp->data + stride * pos);
+}
+
 /*****************************************************************
 Function:  QueueSize
 Returns:   The current size (# of items) of the queue.
@@ -132,20 +169,33 @@ Returns:   None
 Reference: None
 Purpose:   To remove an item from the queue.
 Comments:  If the queue is empty, an error message is printed and
-           nothing is done on the queue.
+           nothing is done on the queue. The slot of a pooled queue
+           gets its item reset to the start of a new item.
 ******************************************************************/
 void DeQueue(Queue *qInOut)
 {
+    uint16 stride;
+
     if (qInOut->queueSize == 0)
     {
         ErrorMsg("DeQueue: Queue is empty.\n");
         return;
     }
     qInOut->queueSize--;
-    qInOut->head = qInOut->head + qInOut->itemSize;
+    if (qInOut->readyMask != NULL)
+    {
+        *qInOut->readyMask |= qInOut->readyBit;
+    }
+    if (qInOut->pool != NULL)
+    {
+        QueueSlot *slot = (QueueSlot *)qInOut->head;
+        slot->item = slot->buf + qInOut->pool->headroom;
+    }
+    stride = QueueStride(qInOut);
+    qInOut->head = qInOut->head + stride;
     /* Wrap around if the ptr goes past the array */
     if (qInOut->head ==
-            (qInOut->data + qInOut->itemSize * qInOut->queueCnt))
+            (qInOut->data + stride * qInOut->queueCnt))
     {
         qInOut->head = qInOut->data;
     }
@@ -163,16 +213,23 @@ Comments:  The item added is directly placed in queue before calling
 ******************************************************************/
 void EnQueue(Queue *qInOut)
 {
+    uint16 stride;
+
     if (qInOut->queueSize == qInOut->queueCnt)
     {
         ErrorMsg("EnQueue: Queue is full.\n");
         return;
     }
     qInOut->queueSize++;
-    qInOut->tail = qInOut->tail + qInOut->itemSize;
+    if (qInOut->readyMask != NULL)
+    {
+        *qInOut->readyMask |= qInOut->readyBit;
+    }
+    stride = QueueStride(qInOut);
+    qInOut->tail = qInOut->tail + stride;
     /* Wrap around if the ptr goes past the array. */
     if (qInOut->tail ==
-            (qInOut->data + qInOut->itemSize * qInOut->queueCnt))
+            (qInOut->data + stride * qInOut->queueCnt))
     {
         qInOut->tail = qInOut->data;
     }
@@ -189,6 +246,10 @@ Comments:  None
 ******************************************************************/
 void *QueueHead(Queue *qInp)
 {
+    if (qInp->pool != NULL)
+    {
+        return(((QueueSlot *)qInp->head)->item);
+    }
     return(qInp->head);
 }
 
@@ -204,9 +265,69 @@ Comments:  None
 ******************************************************************/
 void *QueueTail(Queue *qInp)
 {
+    if (qInp->pool != NULL)
+    {
+        return(((QueueSlot *)qInp->tail)->item);
+    }
     return(qInp->tail);
 }
 
+/*****************************************************************
+Function:  QueueItem
+Returns:   The ptr to the item indexIn places behind the head.
+Reference: None
+Purpose:   To examine an item waiting behind the head without
+           removing it.
+Comments:  indexIn must be less than the queue size.
+******************************************************************/
+void *QueueItem(Queue *qInp, uint16 indexIn)
+{
+    Byte *entry = QueuePosition(qInp, indexIn);
+
+    if (qInp->pool != NULL)
+    {
+        return(((QueueSlot *)entry)->item);
+    }
+    return(entry);
+}
+
+/*****************************************************************
+Function:  QueueToHead
+Returns:   None
+Reference: None
+Purpose:   To let an item overtake the ones ahead of it, e.g. when
+           they have to wait and it doesn't.
+Comments:  The item is swapped forward one place at a time, so the
+           items it passes keep their order. A pooled queue swaps
+           slots, so each item keeps its buffer.
+******************************************************************/
+void QueueToHead(Queue *qInOut, uint16 indexIn)
+{
+    uint16 stride = QueueStride(qInOut);
+    Byte  *ahead;
+    Byte  *behind;
+    Byte   b;
+    uint16 i;
+    uint16 j;
+
+    if (indexIn >= qInOut->queueSize)
+    {
+        ErrorMsg("QueueToHead: No such item.\n");
+        return;
+    }
+    for (i = indexIn; i > 0; i--)
+    {
+        ahead  = QueuePosition(qInOut, (uint16)(i - 1));
+        behind = QueuePosition(qInOut, i);
+        for (j = 0; j < stride; j++)
+        {
+            b         = ahead[j];
+            ahead[j]  = behind[j];
+            behind[j] = b;
+        }
+    }
+}
+
 /*****************************************************************
 Function:  QueueInit
 Returns:   Status the operation: SUCCESS or FAILURE
@@ -230,8 +351,185 @@ Status QueueInit(Queue *qOut, uint16 itemSizeIn, uint16 qCntIn)
     qOut->head      = qOut->data;
     qOut->tail      = qOut->data;
     qOut->queueSize = 0;
+    qOut->readyMask = NULL;
+    qOut->readyBit  = 0;
+    qOut->pool      = NULL;
+
+    return(SUCCESS);
+}
+
+/*****************************************************************
+Function:  QueueSetReadyBit
+Returns:   None
+Reference: None
+Purpose:   To tie a queue to a bit of the scheduler's readiness
+           mask. Every EnQueue or DeQueue on the queue then sets
+           the bit so that the owning layer is run on the next pass.
+Comments:  Must be called after QueueInit, which clears the bit.
+******************************************************************/
+void QueueSetReadyBit(Queue *qInOut, uint8 *readyMaskIn, uint8 readyBitIn)
+{
+    qInOut->readyMask = readyMaskIn;
+    qInOut->readyBit  = readyBitIn;
+}
+
+/*****************************************************************
+Function:  QueuePoolInit
+Returns:   None
+Reference: None
+Purpose:   To empty a pool before its queues are initialized.
+Comments:  headroomIn bytes are kept in front of each new item so
+           that an item handed over with a larger header in front
+           of its PDU still fits in the buffer.
+******************************************************************/
+void QueuePoolInit(QueuePool *poolOut, uint16 headroomIn)
+{
+    /* Keep new items aligned */
+    poolOut->headroom  = (uint16)STORAGE_ALIGN_UP(headroomIn);
+    poolOut->bufSize   = poolOut->headroom;
+    poolOut->memberCnt = 0;
+}
+
+/*****************************************************************
+Function:  QueueInitPooled
+Returns:   Status the operation: SUCCESS or FAILURE
+Reference: None
+Purpose:   To initialize a queue whose items live in pool buffers.
+Comments:  Only the slots are allocated here. The queue can't be
+           used until QueuePoolAllocate has given the slots their
+           buffers.
+******************************************************************/
+Status QueueInitPooled(Queue *qOut, uint16 itemSizeIn, uint16 qCntIn,
+                       QueuePool *poolInOut)
+{
+    uint16 i;
+
+    if (poolInOut->memberCnt == QUEUE_POOL_MEMBERS)
+    {
+        ErrorMsg("QueueInitPooled: Too many queues in pool.\n");
+        return(FAILURE);
+    }
+
+    qOut->itemSize  = itemSizeIn;
+    qOut->queueCnt  = qCntIn;
+
+    qOut->data = AllocateStorage((uint16)(sizeof(QueueSlot) * qCntIn));
+    if (qOut->data == NULL)
+    {
+        return(FAILURE);
+    }
+    for (i = 0; i < qCntIn; i++)
+    {
+        ((QueueSlot *)qOut->data)[i].buf  = NULL;
+        ((QueueSlot *)qOut->data)[i].item = NULL;
+    }
+
+    qOut->head      = qOut->data;
+    qOut->tail      = qOut->data;
+    qOut->queueSize = 0;
+    qOut->readyMask = NULL;
+    qOut->readyBit  = 0;
+    qOut->pool      = poolInOut;
+
+    poolInOut->member[poolInOut->memberCnt++] = qOut;
+    QueuePoolReserve(poolInOut, itemSizeIn);
+    return(SUCCESS);
+}
+
+/*****************************************************************
+Function:  QueuePoolAllocate
+Returns:   Status the operation: SUCCESS or FAILURE
+Reference: None
+Purpose:   To allocate a buffer for every slot of every queue of
+           the pool.
+Comments:  Buffers move between the queues of the pool, so they
+           are all of the pool's largest size.
+******************************************************************/
+Status QueuePoolAllocate(QueuePool *poolInOut)
+{
+    uint8      m;
+    uint16     i;
+    QueueSlot *slot;
 
+    for (m = 0; m < poolInOut->memberCnt; m++)
+    {
+        slot = (QueueSlot *)poolInOut->member[m]->data;
+        for (i = 0; i < poolInOut->member[m]->queueCnt; i++)
+        {
+            slot[i].buf = AllocateStorage(poolInOut->bufSize);
+            if (slot[i].buf == NULL)
+            {
+                return(FAILURE);
+            }
+            slot[i].item = slot[i].buf + poolInOut->headroom;
+        }
+    }
     return(SUCCESS);
 }
 
+/*****************************************************************
+Function:  QueuePoolReserve
+Returns:   None
+Reference: None
+Purpose:   To make room for a producer that forms more than an item
+           in place, such as a whole link layer frame around an NPDU.
+Comments:  Must be called before QueuePoolAllocate.
+******************************************************************/
+void QueuePoolReserve(QueuePool *poolInOut, uint16 itemRoomIn)
+{
+    if (poolInOut->headroom + itemRoomIn > poolInOut->bufSize)
+    {
+        poolInOut->bufSize = poolInOut->headroom + itemRoomIn;
+    }
+}
+
+/*****************************************************************
+Function:  QueueCanHandOff
+Returns:   TRUE if the head item of fromIn can be handed to toIn.
+Reference: None
+Purpose:   To check that a head item can be passed on in place.
+Comments:  The new item must fit in the head item's buffer, and be
+           aligned for its parameter struct. Where the PDU lies puts
+           the parameters in front of it at an unaligned address, the
+           caller has to copy instead.
+******************************************************************/
+Boolean QueueCanHandOff(Queue *fromIn, Queue *toIn, void *itemIn)
+{
+    Byte *buf;
+
+    if (fromIn->pool == NULL || fromIn->pool != toIn->pool ||
+            fromIn->queueSize == 0 || toIn->queueSize == toIn->queueCnt ||
+            !STORAGE_ALIGNED(itemIn))
+    {
+        return(FALSE);
+    }
+    buf = ((QueueSlot *)fromIn->head)->buf;
+    return((Byte *)itemIn >= buf &&
+           (Byte *)itemIn + toIn->itemSize <= buf + fromIn->pool->bufSize);
+}
+
+/*****************************************************************
+Function:  QueueHandOff
+Returns:   None
+Reference: None
+Purpose:   To move the head item of one queue to the tail of
+           another queue of the same pool without copying it.
+Comments:  The two slots trade buffers. The caller has formed the
+           item for toInOut at itemIn, usually by replacing the
+           header in front of the PDU.
+******************************************************************/
+void QueueHandOff(Queue *fromInOut, Queue *toInOut, void *itemIn)
+{
+    QueueSlot *fromSlot = (QueueSlot *)fromInOut->head;
+    QueueSlot *toSlot   = (QueueSlot *)toInOut->tail;
+    Byte      *freeBuf  = toSlot->buf;
+
+    toSlot->buf    = fromSlot->buf;
+    toSlot->item   = itemIn;
+    fromSlot->buf  = freeBuf;
+
+    DeQueue(fromInOut);
+    EnQueue(toInOut);
+}
+
 /*************************End of queue.c***************************/
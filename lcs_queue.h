@@ -47,11 +47,13 @@ Section: Includes
 /*-------------------------------------------------------------------
 Section: Constant Definitions
 -------------------------------------------------------------------*/
-/* None */
+#define QUEUE_POOL_MEMBERS 4 /* Max number of queues sharing a pool */
 
 /*-------------------------------------------------------------------
 Section: Type Definitions
 -------------------------------------------------------------------*/
+typedef struct QueuePool QueuePool;
+
 typedef struct
 {
     uint16 queueCnt;   /* Max number of items in queue. i.e capacity */
@@ -60,8 +62,34 @@ typedef struct
     Byte *head;        /* Pointer to the head item of the queue      */
     Byte *tail;        /* Pointer to the tail item of the queue      */
     Byte *data;        /* Array of items -- Allocated during Init    */
+    uint8 *readyMask;  /* Scheduler mask updated on EnQueue/DeQueue  */
+    uint8  readyBit;   /* Bit to set in readyMask                    */
+    QueuePool *pool;   /* Pool of item buffers. NULL if none.        */
 } Queue;
 
+/* Items of a pooled queue are not stored in the queue itself. Each
+   slot of the queue owns a buffer from the pool and points to the
+   item in it. A new item starts headroom bytes into the buffer. An
+   item handed over by another queue of the pool can start anywhere
+   in the buffer, so that a layer can strip or prepend a header in
+   place. */
+typedef struct
+{
+    Byte *buf;         /* Buffer owned by this slot                  */
+    Byte *item;        /* Start of the item in buf                   */
+} QueueSlot;
+
+/* Queues on both sides of a layer boundary share a pool so that an
+   item can be handed from one to the other by trading buffers
+   instead of copying the PDU. */
+struct QueuePool
+{
+    uint16 headroom;   /* Bytes in front of a new item               */
+    uint16 bufSize;    /* Bytes in each buffer of the pool           */
+    uint8  memberCnt;  /* Number of queues in the pool               */
+    Queue *member[QUEUE_POOL_MEMBERS];
+};
+
 /*-------------------------------------------------------------------
 Section: Globals
 -------------------------------------------------------------------*/
@@ -102,8 +130,55 @@ void     *QueueHead(Queue *qInp);
    Queue is not Full before filling an item. */
 void     *QueueTail(Queue *qInp);
 
+/* QueueItem returns the pointer to the item indexIn places behind
+   the head, so that items waiting behind the head can be examined.
+   indexIn must be less than the queue size. */
+void     *QueueItem(Queue *qInp, uint16 indexIn);
+
+/* QueueToHead moves the item indexIn places behind the head to the
+   head, keeping the order of the items that were ahead of it, so
+   that it can be removed with DeQueue. */
+void      QueueToHead(Queue *qInOut, uint16 indexIn);
+
 /* QueueInit is used to initialize a queue. Client specifies the
    size of each item in queue and the count (capacity) of queue. */
 Status    QueueInit(Queue *qOut, uint16 itemSize, uint16 qCnt);
 
+/* QueueSetReadyBit makes EnQueue and DeQueue set readyBitIn in
+   *readyMaskIn so that the scheduler knows which layer has work. */
+void      QueueSetReadyBit(Queue *qInOut, uint8 *readyMaskIn, uint8 readyBitIn);
+
+/* QueuePoolInit empties a pool. headroomIn is the number of bytes kept
+   in front of each new item for a larger header to be put in place. */
+void      QueuePoolInit(QueuePool *poolOut, uint16 headroomIn);
+
+/* QueueInitPooled is QueueInit for a queue whose item buffers come
+   from a pool. The buffers are allocated by QueuePoolAllocate, once
+   every queue of the pool is known, and are all as large as the
+   largest item of the pool. */
+Status    QueueInitPooled(Queue *qOut, uint16 itemSize, uint16 qCnt,
+                          QueuePool *poolInOut);
+
+/* QueuePoolAllocate allocates the buffers of every queue in a pool. */
+Status    QueuePoolAllocate(QueuePool *poolInOut);
+
+/* QueuePoolReserve makes the buffers of a pool hold at least
+   itemRoomIn bytes from the start of a new item, for a producer that
+   forms more than an item in place. */
+void      QueuePoolReserve(QueuePool *poolInOut, uint16 itemRoomIn);
+
+/* QueueCanHandOff returns TRUE if the head item of fromIn can be handed
+   to toIn as an item starting at itemIn, which is inside the head
+   item's buffer. Both queues must share a pool, toIn must not be full
+   and itemIn must be aligned by STORAGE_ALIGN, as the item is read
+   through a cast to its parameter struct. Otherwise the caller copies
+   the item. */
+Boolean   QueueCanHandOff(Queue *fromIn, Queue *toIn, void *itemIn);
+
+/* QueueHandOff removes the head item of fromInOut and adds the item
+   at itemIn, in the same buffer, to toInOut without copying. The free
+   buffer of toInOut's tail goes to fromInOut in exchange. Use only if
+   QueueCanHandOff returned TRUE. */
+void      QueueHandOff(Queue *fromInOut, Queue *toInOut, void *itemIn);
+
 #endif  // _LCS_QUEUE_H
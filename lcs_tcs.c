@@ -45,6 +45,9 @@
                        remained more than 24 seconds. If there is no
                        such entry, then we fail to allocate the new
                        transaction ID. The table size is configurable.
+                       Entries are found by a hash of the destination
+                       and kept in order of use, so the entry to
+                       replace is always the oldest one.
 
          To Do:        None
 *********************************************************************/
@@ -95,6 +98,15 @@ Section: Globals
 /*-------------------------------------------------------------------
 Section: Function Prototypes
 -------------------------------------------------------------------*/
+static void    TIDTableInit(TIDTable *tblIn);
+static void    TIDTableRelease(TIDTable *tblIn);
+static Boolean TIDMakeKey(DestinationAddress *addrIn, TIDTableEntry *keyOut);
+static uint16  TIDHash(TIDTableEntry *keyIn);
+static int16   TIDLookup(TIDTable *tblIn, TIDTableEntry *keyIn);
+static void    TIDUnlinkUse(TIDTable *tblIn, int16 indexIn);
+static void    TIDLinkNewest(TIDTable *tblIn, int16 indexIn);
+static void    TIDUnlinkHash(TIDTable *tblIn, int16 indexIn);
+
 /*****************************************************************
 Function:  TCSReset
 Returns:   None
@@ -106,8 +118,6 @@ void TCSReset(void)
 {
     gp->priTransID    = 0; /* On node reset, transaction id 0 is used. */
     gp->nonpriTransID = 0;
-    gp->priTransCtrlRec.inProgress    = FALSE;
-    gp->nonpriTransCtrlRec.inProgress = FALSE;
     /* Reset the tables that keep track of (destination address
        transaction id) pairs only duing powerup or external reset.
        When resetCause is software reset or cleared, we keep this
@@ -120,8 +130,256 @@ void TCSReset(void)
        node may throw away messages sent after a reset as duplicates. */
     if (nmp->resetCause == POWER_UP_RESET || nmp->resetCause == EXTERNAL_RESET)
     {
-        gp->priTblSize       = 0;
-        gp->nonpriTblSize    = 0;
+        TIDTableInit(&gp->priTbl);
+        TIDTableInit(&gp->nonpriTbl);
+    }
+    else
+    {
+        /* The transmit records are reset too, so no transaction is
+           in progress any more. A table that has never been set up
+           has no history to keep. */
+        if (!gp->priTbl.built)
+        {
+            TIDTableInit(&gp->priTbl);
+        }
+        if (!gp->nonpriTbl.built)
+        {
+            TIDTableInit(&gp->nonpriTbl);
+        }
+        TIDTableRelease(&gp->priTbl);
+        TIDTableRelease(&gp->nonpriTbl);
+    }
+}
+
+/*****************************************************************
+Function:  TIDTableInit
+Returns:   None
+Reference: None
+Purpose:   To empty a TID table.
+Comments:  None
+******************************************************************/
+static void TIDTableInit(TIDTable *tblIn)
+{
+    uint16 i;
+
+    for (i = 0; i < TID_HASH_SIZE; i++)
+    {
+        tblIn->hash[i] = -1;
+    }
+    tblIn->oldest = -1;
+    tblIn->newest = -1;
+    tblIn->size   = 0;
+    tblIn->built  = TRUE;
+    memset(tblIn->tidInUse, 0, sizeof(tblIn->tidInUse));
+}
+
+/*****************************************************************
+Function:  TIDTableRelease
+Returns:   None
+Reference: None
+Purpose:   To end all transactions in progress in a TID table while
+           keeping the last tid used for each destination.
+Comments:  None
+******************************************************************/
+static void TIDTableRelease(TIDTable *tblIn)
+{
+    int16 i;
+
+    for (i = 0; i < (int16)tblIn->size; i++)
+    {
+        if (tblIn->entry[i].inProgress)
+        {
+            tblIn->entry[i].inProgress = FALSE;
+            MsTimerSet(&tblIn->entry[i].timer, (uint16)(MIN_TABLE_TIME * 1000));
+            TIDLinkNewest(tblIn, i);
+        }
+    }
+    memset(tblIn->tidInUse, 0, sizeof(tblIn->tidInUse));
+}
+
+/*****************************************************************
+Function:  TIDMakeKey
+Returns:   TRUE if the destination can be looked up in the table.
+           FALSE if it refers to an invalid domain table entry.
+Reference: None
+Purpose:   To fill in the domain and address fields of a table entry
+           from a destination address.
+Comments:  Unused bytes of the key are zeroed so that keys can be
+           hashed and compared bytewise.
+******************************************************************/
+static Boolean TIDMakeKey(DestinationAddress *addrIn, TIDTableEntry *keyOut)
+{
+    Boolean valid = TRUE;
+
+    memset(keyOut, 0, sizeof(TIDTableEntry));
+
+    /* Store the domain len and domain id. */
+    if (addrIn->dmn.domainIndex == FLEX_DOMAIN)
+    {
+        keyOut->len = addrIn->dmn.domainLen;
+        memcpy(keyOut->domainId, addrIn->dmn.domainId, keyOut->len);
+    }
+    else
+    {
+        /* A destination in an invalid domain never matches an entry. */
+        valid = !eep->domainTable[addrIn->dmn.domainIndex].invalid;
+        keyOut->len = eep->domainTable[addrIn->dmn.domainIndex].len;
+        memcpy(keyOut->domainId,
+               eep->domainTable[addrIn->dmn.domainIndex].domainId,
+               keyOut->len);
+    }
+
+    keyOut->addressMode = addrIn->addressMode;
+    if (addrIn->addressMode == MULTICAST)
+    {
+        keyOut->addr.group = addrIn->addr.addr1;
+    }
+    else if (addrIn->addressMode == SUBNET_NODE)
+    {
+        keyOut->addr.subnetNode = addrIn->addr.addr2a;
+    }
+    else if (addrIn->addressMode == UNIQUE_NODE_ID)
+    {
+        memcpy(keyOut->addr.uniqueNodeId,
+               addrIn->addr.addr3.uniqueId,
+               UNIQUE_NODE_ID_LEN);
+    }
+    else if (addrIn->addressMode == BROADCAST)
+    {
+        keyOut->addr.subnet = addrIn->addr.addr0;
+    }
+    else
+    {
+        /* Note: addrIn.addressMode can never be MULTICAST_ACK
+                 for transactions initiated by a node. */
+        ErrorMsg("NewTrans: Unexpected addressMode.\n");
+        valid = FALSE;
+    }
+    return(valid);
+}
+
+/*****************************************************************
+Function:  TIDHash
+Returns:   Hash bucket of a key.
+Reference: None
+Purpose:   To hash the domain and address of a key.
+Comments:  None
+******************************************************************/
+static uint16 TIDHash(TIDTableEntry *keyIn)
+{
+    uint16 h;
+    uint16 i;
+    Byte  *p;
+
+    h = (uint16)(keyIn->len * 31 + keyIn->addressMode);
+    for (i = 0; i < keyIn->len; i++)
+    {
+        h = (uint16)(h * 31 + keyIn->domainId[i]);
+    }
+    p = (Byte *)&keyIn->addr;
+    for (i = 0; i < sizeof(keyIn->addr); i++)
+    {
+        h = (uint16)(h * 31 + p[i]);
+    }
+    h ^= h >> 8;
+    return(h & (TID_HASH_SIZE - 1));
+}
+
+/*****************************************************************
+Function:  TIDLookup
+Returns:   Index of the table entry for the key or -1 if none.
+Reference: None
+Purpose:   To find the entry for a destination.
+Comments:  None
+******************************************************************/
+static int16 TIDLookup(TIDTable *tblIn, TIDTableEntry *keyIn)
+{
+    int16 i;
+
+    for (i = tblIn->hash[TIDHash(keyIn)]; i != -1; i = tblIn->entry[i].hashNext)
+    {
+        if (tblIn->entry[i].len         == keyIn->len         &&
+            tblIn->entry[i].addressMode == keyIn->addressMode &&
+            memcmp(tblIn->entry[i].domainId, keyIn->domainId, keyIn->len) == 0 &&
+            memcmp(&tblIn->entry[i].addr, &keyIn->addr, sizeof(keyIn->addr)) == 0)
+        {
+            break;
+        }
+    }
+    return(i);
+}
+
+/*****************************************************************
+Function:  TIDUnlinkUse
+Returns:   None
+Reference: None
+Purpose:   To take an entry out of the order of use.
+Comments:  None
+******************************************************************/
+static void TIDUnlinkUse(TIDTable *tblIn, int16 indexIn)
+{
+    TIDTableEntry *e = &tblIn->entry[indexIn];
+
+    if (e->older != -1)
+    {
+        tblIn->entry[e->older].newer = e->newer;
+    }
+    else
+    {
+        tblIn->oldest = e->newer;
+    }
+    if (e->newer != -1)
+    {
+        tblIn->entry[e->newer].older = e->older;
+    }
+    else
+    {
+        tblIn->newest = e->older;
+    }
+}
+
+/*****************************************************************
+Function:  TIDLinkNewest
+Returns:   None
+Reference: None
+Purpose:   To make an entry the most recently used one.
+Comments:  None
+******************************************************************/
+static void TIDLinkNewest(TIDTable *tblIn, int16 indexIn)
+{
+    TIDTableEntry *e = &tblIn->entry[indexIn];
+
+    e->older = tblIn->newest;
+    e->newer = -1;
+    if (tblIn->newest != -1)
+    {
+        tblIn->entry[tblIn->newest].newer = indexIn;
+    }
+    else
+    {
+        tblIn->oldest = indexIn;
+    }
+    tblIn->newest = indexIn;
+}
+
+/*****************************************************************
+Function:  TIDUnlinkHash
+Returns:   None
+Reference: None
+Purpose:   To remove an entry from its hash bucket.
+Comments:  None
+******************************************************************/
+static void TIDUnlinkHash(TIDTable *tblIn, int16 indexIn)
+{
+    int16 *linkPtr = &tblIn->hash[TIDHash(&tblIn->entry[indexIn])];
+
+    while (*linkPtr != -1 && *linkPtr != indexIn)
+    {
+        linkPtr = &tblIn->entry[*linkPtr].hashNext;
+    }
+    if (*linkPtr == indexIn)
+    {
+        *linkPtr = tblIn->entry[indexIn].hashNext;
     }
 }
 
@@ -132,13 +390,15 @@ Returns:   SUCCESS if a transaction id can be assigned.
 Purpose:   To get a new transaction id.
 Comments:  This function implements a new algorithm to assign the
            transaction id. It does not use the one in protocol specification.
+           *tidIndexOut identifies the transaction to TransDone and
+           OverrideTrans.
 Alg Idea:  For each of the following categories, we have an
            entry in the table.
            1. Subnet/Node
            2. group
            3. broadcast (domainwide or subnet)
            4. unique node id
-           When a new id is requested, we increment the tid from
+           When a new id is requested, we take the next tid from
            the single space. We then search the table for this
            entry. If a matching entry is found, then we check
            if that tid was used last time for the same destination.
@@ -148,211 +408,113 @@ Alg Idea:  For each of the following categories, we have an
            If there is no space for the new entry, we release one
            that has remained more than MIN_TABLE_TIME seconds.
            If no such entry, then we fail to assign a tid.
+           Several transactions can be in progress, but only one per
+           destination, and never two with the same tid, so that acks
+           and responses can be matched by tid. A destination with a
+           transaction in progress makes NewTrans fail until TransDone.
 ******************************************************************/
 Status NewTrans(Boolean   priorityIn, DestinationAddress addrIn,
-                TransNum *transNumOut)
+                TransNum *transNumOut, int16 *tidIndexOut)
 {
-    uint16           i;
-    TransCtrlRecord *transRecPtr;
+    int16            i;
+    uint8            tries;
     TransNum        *transNumPtr;
-    TIDTableEntry   *tbl;
-    uint16          *tblSize;
-    Boolean          found;
+    TransNum         tid;
+    TIDTable        *tbl;
+    TIDTableEntry    key;
+    Boolean          valid;
 
-    /* Point to the appropriate control record & table. */
+    /* Point to the appropriate tid space & table. */
     if (priorityIn)
     {
-        transRecPtr = &gp->priTransCtrlRec;
         transNumPtr = &gp->priTransID;
-        tbl         = gp->priTbl;
-        tblSize     = &gp->priTblSize;
+        tbl         = &gp->priTbl;
     }
     else
     {
-        transRecPtr = &gp->nonpriTransCtrlRec;
         transNumPtr = &gp->nonpriTransID;
-        tbl         = gp->nonpriTbl;
-        tblSize     = &gp->nonpriTblSize;
+        tbl         = &gp->nonpriTbl;
     }
 
-    /* Check if transaction already in progress. */
-    if (transRecPtr->inProgress)
+    valid = TIDMakeKey(&addrIn, &key);
+    i = valid ? TIDLookup(tbl, &key) : -1;
+
+    if (i != -1 && tbl->entry[i].inProgress)
     {
-        /* We can't allow a new transaction. Return failure. */
+        /* Only one transaction per destination. Try later. */
         return(FAILURE);
     }
 
-    /* We can allow the transaction. Allocate a new TID. */
-    transRecPtr->transNum = *transNumPtr;
-
-    /* Make sure that this dest did not use this TID last time.
-       If it did, increment the TID. */
-    /* Note: addrIn.addressMode can never be MULTICAST_ACK
-             for transactions initiated by a node. */
-    found = FALSE;
-    for (i = 0; i < *tblSize; i++)
-    {
-        /* If domainId does not match, skip entry. */
-        if (addrIn.dmn.domainIndex != FLEX_DOMAIN &&
-                (eep->domainTable[addrIn.dmn.domainIndex].invalid ||
-                 tbl[i].len != eep->domainTable[addrIn.dmn.domainIndex].len ||
-                 memcmp(eep->domainTable[addrIn.dmn.domainIndex].domainId,
-                        tbl[i].domainId,
-                        eep->domainTable[addrIn.dmn.domainIndex].len) != 0)
-           )
-        {
-            continue; /* Not flex domain but domain mismatch. */
-        }
-
-        if (addrIn.dmn.domainIndex == FLEX_DOMAIN &&
-                (tbl[i].len != addrIn.dmn.domainLen ||
-                 memcmp(addrIn.dmn.domainId,
-                        tbl[i].domainId,
-                        addrIn.dmn.domainLen) != 0)
-           )
-        {
-            continue; /* Flex domain but domain mismatch. */
-        }
-
-        switch (addrIn.addressMode)
+    /* Make sure that this dest did not use this TID last time and
+       that no transaction in progress uses it. If so, increment the
+       TID. */
+    tid = *transNumPtr;
+    for (tries = 0; tries < 16; tries++)
+    {
+        if (tbl->tidInUse[tid] == 0 &&
+            (i == -1 || tbl->entry[i].tid != tid))
         {
-        case SUBNET_NODE:
-            if (tbl[i].addressMode == SUBNET_NODE &&
-                    memcmp(&tbl[i].addr.subnetNode, &addrIn.addr.addr2a,
-                           sizeof(SubnetAddress)) == 0)
-            {
-                found = TRUE;
-            }
-            break;
-        case UNIQUE_NODE_ID:
-            if (tbl[i].addressMode == UNIQUE_NODE_ID &&
-                    memcmp(tbl[i].addr.uniqueNodeId,
-                           addrIn.addr.addr3.uniqueId,
-                           UNIQUE_NODE_ID_LEN) == 0)
-            {
-                found = TRUE;
-            }
-            break;
-        case MULTICAST:
-            if (tbl[i].addressMode == MULTICAST &&
-                    tbl[i].addr.group  == addrIn.addr.addr1)
-            {
-                found = TRUE;
-            }
-            break;
-        case BROADCAST:
-            if (tbl[i].addressMode == BROADCAST &&
-                    tbl[i].addr.subnet == addrIn.addr.addr0)
-            {
-                found = TRUE;
-            }
             break;
-        default:
-            ErrorMsg("NewTrans: Unexpected addressMode.\n");
-            /* Should not come here. */
         }
-        if (found)
+        tid++;
+        if (tid == 16)
         {
-            break; /* Need to leave for loop with matched i value. */
+            tid = 1; /* Wrap around. */
         }
     }
-
-    if (found)
+    if (tries == 16)
     {
-        /* Found a match. Check if last TID is same or not. */
-        /* We can reuse this entry and reinitialize timer.  */
-        if (tbl[i].tid == *transNumPtr)
-        {
-            /* Increment TID. */
-            (*transNumPtr)++;
-            if (*transNumPtr == 16)
-            {
-                *transNumPtr = 1; /* Wrap around. */
-            }
-            transRecPtr->transNum = *transNumPtr;
-        }
-        tbl[i].tid   = *transNumPtr;
-        MsTimerSet(&tbl[i].timer,
-                   (uint16)(MIN_TABLE_TIME * 1000));
-        *transNumOut = *transNumPtr;
-        transRecPtr->inProgress = TRUE;
-        return(SUCCESS);
+        return(FAILURE); /* All tids are taken. */
     }
 
-    /* No match. Make a new entry. If no space. get a space. */
-    /* All the timers must have been updated in the for loop above. */
-    if (*tblSize == TID_TABLE_SIZE)
+    if (i == -1)
     {
-        /* Table is full. See if any entry can be replaced. */
-        found = FALSE;
-        for (i = 0; i < *tblSize; i++)
+        /* No match. Make a new entry. If no space. get a space. */
+        if (tbl->size == TID_TABLE_SIZE)
         {
-            if (MsTimerExpired(&tbl[i].timer))
+            /* Table is full. Every entry gets the same timer value when
+               its transaction is done, so only the oldest one can have
+               expired. Entries in use are not in the order of use. */
+            i = tbl->oldest;
+            if (i == -1 || MsTimerRunning(&tbl->entry[i].timer))
             {
-                found = TRUE;
-                break;
+                /* Unable to find an entry. */
+                return(FAILURE);
             }
-        }
-        if (found)
-        {
-            /* Replace this entry with last entry of table. */
-            (*tblSize)--;
-            tbl[i] = tbl[*tblSize];
-            /* Fall through to code below. */
+            TIDUnlinkUse(tbl, i);
+            TIDUnlinkHash(tbl, i);
         }
         else
         {
-            /* Unable to find an entry. */
-            return(FAILURE);
+            i = (int16)tbl->size++;
         }
-    }
 
-    /* Now we have space for an entry. Add new entry. */
-    /* Store the domain len and domain id in table */
-    if (addrIn.dmn.domainIndex == FLEX_DOMAIN)
-    {
-        memcpy(tbl[*tblSize].domainId,
-               addrIn.dmn.domainId,
-               addrIn.dmn.domainLen);
-        tbl[i].len = addrIn.dmn.domainLen;
+        /* Now we have space for an entry. Add new entry. */
+        key.hashNext = -1;
+        if (valid)
+        {
+            key.hashNext             = tbl->hash[TIDHash(&key)];
+            tbl->hash[TIDHash(&key)] = i;
+        }
+        tbl->entry[i] = key;
     }
     else
     {
-        memcpy(tbl[*tblSize].domainId,
-               eep->domainTable[addrIn.dmn.domainIndex].domainId,
-               eep->domainTable[addrIn.dmn.domainIndex].len);
-        tbl[i].len = eep->domainTable[addrIn.dmn.domainIndex].len;
+        TIDUnlinkUse(tbl, i);
     }
 
-    tbl[*tblSize].addressMode = addrIn.addressMode;
-    if (addrIn.addressMode == MULTICAST)
-    {
-        tbl[*tblSize].addr.group = addrIn.addr.addr1;
-    }
-    else if (addrIn.addressMode == SUBNET_NODE)
-    {
-        tbl[*tblSize].addr.subnetNode = addrIn.addr.addr2a;
-    }
-    else if (addrIn.addressMode == UNIQUE_NODE_ID)
-    {
-        memcpy(tbl[*tblSize].addr.uniqueNodeId,
-               addrIn.addr.addr3.uniqueId,
-               UNIQUE_NODE_ID_LEN);
-    }
-    else if (addrIn.addressMode == BROADCAST)
-    {
-        tbl[*tblSize].addr.subnet = addrIn.addr.addr0;
-    }
-    else
+    /* The next transaction starts with the following tid. */
+    *transNumPtr = tid + 1;
+    if (*transNumPtr == 16)
     {
-        /* Should not come here as addressMode was checked before too. */
-        ErrorMsg("NewTrans: Invalid addressMode at unexpected place\n");
+        *transNumPtr = 1; /* Wrap Around to 1. */
     }
-    MsTimerSet(&tbl[*tblSize].timer, (uint16)(MIN_TABLE_TIME * 1000));
-    tbl[*tblSize].tid = *transNumPtr;
-    *transNumOut      = *transNumPtr;
-    (*tblSize)++;
-    transRecPtr->inProgress = TRUE;
+
+    tbl->entry[i].tid        = tid;
+    tbl->entry[i].inProgress = TRUE;
+    tbl->tidInUse[tid]++;
+    *transNumOut = tid;
+    *tidIndexOut = i;
     return(SUCCESS);
 }
 
@@ -363,18 +525,47 @@ Reference:
 Purpose:   Override the TX# chosen by NewTrans.
 Comments:  None
 ******************************************************************/
-void OverrideTrans(Boolean   priorityIn, TransNum num)
+void OverrideTrans(Boolean   priorityIn, int16 tidIndexIn, TransNum num)
 {
+    TIDTable *tbl;
+
     if (priorityIn)
     {
 	    gp->priTransID = num;
-		gp->priTransCtrlRec.transNum = num;
+		tbl = &gp->priTbl;
     }
     else
     {
 	    gp->nonpriTransID = num;
-		gp->nonpriTransCtrlRec.transNum = num;
+		tbl = &gp->nonpriTbl;
+    }
+	tbl->tidInUse[tbl->entry[tidIndexIn].tid]--;
+	tbl->entry[tidIndexIn].tid = num;
+	tbl->tidInUse[num]++;
+}
+
+/*****************************************************************
+Function:  TransInProgress
+Returns:   TRUE if the destination has a transaction in progress.
+Reference: None
+Purpose:   To tell whether a message to the destination has to wait
+           before NewTrans is tried for it.
+Comments:  Nothing is changed, so messages can be looked over
+           without starting a transaction.
+******************************************************************/
+Boolean TransInProgress(Boolean priorityIn, DestinationAddress *addrIn)
+{
+    TIDTable     *tbl;
+    TIDTableEntry key;
+    int16         i;
+
+    tbl = priorityIn ? &gp->priTbl : &gp->nonpriTbl;
+    if (!TIDMakeKey(addrIn, &key))
+    {
+        return(FALSE);
     }
+    i = TIDLookup(tbl, &key);
+    return(i != -1 && tbl->entry[i].inProgress);
 }
 
 /*****************************************************************
@@ -382,39 +573,33 @@ Function:  TransDone
 Returns:   None
 Reference: Section 7 Protocol Spec.
 Purpose:   To release the transaction record for future assignments.
-Comments:  None
+Comments:  The destination's entry becomes the newest one in the
+           table and may be replaced MIN_TABLE_TIME seconds from now.
 ******************************************************************/
-void TransDone(Boolean  priorityIn)
+void TransDone(Boolean  priorityIn, int16 tidIndexIn)
 {
-    TransCtrlRecord *transRecPtr;
-    TransNum        *transNumPtr;
+    TIDTable      *tbl;
+    TIDTableEntry *e;
 
-    /* Point to the appropriate control record & table. */
-    if (priorityIn)
-    {
-        transRecPtr = &gp->priTransCtrlRec;
-        transNumPtr = &gp->priTransID;
-    }
-    else
+    /* Point to the appropriate table. */
+    tbl = priorityIn ? &gp->priTbl : &gp->nonpriTbl;
+    e   = &tbl->entry[tidIndexIn];
+
+    if (!e->inProgress)
     {
-        transRecPtr = &gp->nonpriTransCtrlRec;
-        transNumPtr = &gp->nonpriTransID;
+        return;
     }
 
     /* Mark transaction as available. */
-    transRecPtr->inProgress = FALSE;
-
-    /* Increment the corresponding transaction id. */
-    (*transNumPtr)++;
-    if (*transNumPtr == 16)
-    {
-        *transNumPtr = 1; /* Wrap Around to 1. */
-    }
+    e->inProgress = FALSE;
+    tbl->tidInUse[e->tid]--;
+    MsTimerSet(&e->timer, (uint16)(MIN_TABLE_TIME * 1000));
+    TIDLinkNewest(tbl, tidIndexIn);
 }
 
 /*****************************************************************
 Function:  ValidateTrans
-Returns:   TRANS_CURRENT if the transNumIn matches transaction
+Returns:   TRANS_CURRENT if the transNumIn matches a transaction
            in progress.
            TRANS_NOT_CURRENT othewise.
 Reference: Section 7, Protocol Specification.
@@ -424,20 +609,12 @@ Comments:  None
 TransStatus ValidateTrans(Boolean  priorityIn,
                           TransNum transNumIn)
 {
-    TransCtrlRecord *transRecPtr;
+    TIDTable *tbl;
 
-    /* Point to the appropriate control record & table. */
-    if (priorityIn)
-    {
-        transRecPtr = &gp->priTransCtrlRec;
-    }
-    else
-    {
-        transRecPtr = &gp->nonpriTransCtrlRec;
-    }
+    /* Point to the appropriate table. */
+    tbl = priorityIn ? &gp->priTbl : &gp->nonpriTbl;
 
-    if (transRecPtr->inProgress &&
-            transRecPtr->transNum == transNumIn)
+    if (transNumIn < 16 && tbl->tidInUse[transNumIn] != 0)
     {
         return(TRANS_CURRENT);
     }
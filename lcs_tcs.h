@@ -44,7 +44,7 @@
                        dest addr, we get rid of one which has
                        remained more than 24 sec. If no such entry,
                        then we fail to allocate the new trans ID.
-                       The table size is configurable.
+                       The table size is configurable (TID_TABLE_SIZE).
 
          To Do:        None
 
@@ -78,12 +78,16 @@ Section: Function Prototypes
 -------------------------------------------------------------------*/
 void TCSReset(void);
 
-void   TransDone(Boolean  priorityIn);
-void OverrideTrans(Boolean   priorityIn, TransNum num);
+void   TransDone(Boolean  priorityIn, int16 tidIndexIn);
+void OverrideTrans(Boolean   priorityIn, int16 tidIndexIn, TransNum num);
 
 /* Return Values:      SUCCESS or FAILURE  */
 Status NewTrans(Boolean   priorityIn, DestinationAddress addrIn,
-                TransNum *transNumOut);
+                TransNum *transNumOut, int16 *tidIndexOut);
+
+/* Return Values: TRUE if NewTrans would fail for a transaction in
+   progress to the destination */
+Boolean TransInProgress(Boolean priorityIn, DestinationAddress *addrIn);
 
 /* Return Values: TRAN_CURRENT or TRAN_NOT_CURRENT */
 TransStatus ValidateTrans(Boolean  priorityIn, TransNum transNumIn);
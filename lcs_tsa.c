@@ -34,6 +34,7 @@
 /*------------------------------------------------------------------------------
 Section: Includes
 ------------------------------------------------------------------------------*/
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -56,6 +57,10 @@ Section: Constant Definitions.
    Thus actual # of messages sent on alternate path is ALT_PATH_COUNT + 1 */
 #define ALT_PATH_COUNT 1
 
+/* Link value of a receive record that is on neither an index chain nor
+   the free list. */
+#define RR_UNLINKED (-2)
+
 /*-------------------------------------------------------------------
 Section: Type Definitions.
 -------------------------------------------------------------------*/
@@ -157,9 +162,17 @@ static void SNSendResponse(uint16 rrIndexIn, Boolean nullResponse, Boolean flexR
 static void SNReceiveResponse(void);
 
 /* Functions that are common to both transport and session layers. */
-static void XmitTimerExpiration(Layer layerIn, Boolean priorityIn);
-static void TerminateTrans(Boolean priorityIn);
-static void SendNewMsg(Layer layerIn, Boolean priorityIn);
+static void XmitTimerExpiration(Layer layerIn, TransmitRecord *xmitRecPtr);
+static void TerminateTrans(TransmitRecord *xmitRecPtr);
+static Boolean SendNewMsg(Layer layerIn, Boolean priorityIn);
+static Boolean NewMsgDest(TSASendParam *tsaSendParamPtr,
+                          DestinationAddress *nwDestAddrOut);
+static Boolean NewMsgWaits(TSASendParam *tsaSendParamPtr, Boolean priorityIn);
+static void ServiceXmitRecs(Layer layerIn);
+static TransmitRecord *AllocateXmitRec(Boolean priorityIn);
+static TransmitRecord *FindXmitRec(Boolean priorityIn, TransNum transNumIn,
+                                   TXStatus statusIn, SourceAddress *srcAddrIn);
+static Boolean PostCompletion(TSASendParam *tsaSendParamPtr, Boolean success);
 static void ReceiveNewMsg(Layer layerIn);
 static void ReceiveRem(Layer layerIn);
 static void Deliver(uint16 rrIndexIn);
@@ -167,6 +180,10 @@ static void Deliver(uint16 rrIndexIn);
 static int16 AllocateRR(void);
 static Bool FindRR(RequestId id, uint16 *pIndex);
 static int16 RetrieveRR(SourceAddress srcAddrIn, Boolean priorityIn);
+static void BindRR(int16 rrIndexIn);
+static void UnbindRR(int16 rrIndexIn);
+static void ReleaseRR(int16 rrIndexIn);
+static void RecvTimerExpired(TmrWheelTimer *timerIn, void *contextIn);
 
 static uint16 ComputeRecvTimerValue(AddrMode      addrModeIn,
                                     MulticastAddress group);
@@ -186,26 +203,42 @@ Boolean AuthOma(void)
 	return eep->domainTable[0].authType == AUTH_OMA;
 }
 
+/*****************************************************************
+Function: PostCompletion
+Returns:  TRUE if the completion event was queued.
+Purpose:  Send a completion event up to the app for the given message.
+******************************************************************/
+static Boolean PostCompletion(TSASendParam *tsaSendParamPtr, Boolean success)
+{
+    APPReceiveParam *appReceiveParamPtr;
+
+    if (QueueFull(&gp->appInQ))
+    {
+        return FALSE;
+    }
+    appReceiveParamPtr = QueueTail(&gp->appInQ);
+    appReceiveParamPtr->indication		= COMPLETION;
+    appReceiveParamPtr->success			= success;
+    appReceiveParamPtr->tag				= tsaSendParamPtr->tag;
+	appReceiveParamPtr->proxy			= tsaSendParamPtr->proxy;
+	appReceiveParamPtr->proxyCount		= tsaSendParamPtr->proxyCount;
+	appReceiveParamPtr->proxyDone       = tsaSendParamPtr->proxyDone;
+    EnQueue(&gp->appInQ);
+    return TRUE;
+}
+
 /*****************************************************************
 Function: SendCompletion
-Purpose:  Send a completiont even up to the app
+Purpose:  Send a completiont even up to the app for the message at
+          the head of its tsa queue.
 ******************************************************************/
 void SendCompletion(TSASendParam *tsaSendParamPtr, Boolean success)
 {
 	// If there is no room for the completion event then we just don't dequeue the outgoing message and the 
 	// caller will try again later.
-    if (!QueueFull(&gp->appInQ))
-    {
-	    Queue *tsaQPtr                      = tsaSendParamPtr->priority ? &gp->tsaOutPriQ : &gp->tsaOutQ;     /* Pointer to source queue */
-        APPReceiveParam *appReceiveParamPtr = QueueTail(&gp->appInQ);
-        appReceiveParamPtr->indication		= COMPLETION;
-        appReceiveParamPtr->success			= success;
-        appReceiveParamPtr->tag				= tsaSendParamPtr->tag;
-		appReceiveParamPtr->proxy			= tsaSendParamPtr->proxy;
-		appReceiveParamPtr->proxyCount		= tsaSendParamPtr->proxyCount;
-		appReceiveParamPtr->proxyDone       = tsaSendParamPtr->proxyDone;
-        EnQueue(&gp->appInQ);
-        DeQueue(tsaQPtr);
+    if (PostCompletion(tsaSendParamPtr, success))
+    {
+        DeQueue(tsaSendParamPtr->priority ? &gp->tsaOutPriQ : &gp->tsaOutQ);
     }
 }
 
@@ -218,6 +251,47 @@ Boolean SendBlocked(void)
     return MsTimerRunning(&gp->tsDelayTimer);
 }
 
+/*****************************************************************
+Function:  TSAPending
+Returns:   TRUE if a transmit or receive record is in use.
+Reference: None
+Purpose:   Lets the scheduler know that the transport, session and
+           authentication layers have to run even though their
+           queues are empty, because a record timer is running.
+Comments:  *remainingOut is lowered to the time left on the earliest
+           of those timers.
+******************************************************************/
+Boolean TSAPending(uint32 *remainingOut)
+{
+    Boolean  pending = FALSE;
+    uint32   remaining;
+    uint16   i;
+
+    for (i = 0; i < gp->xmitRecCnt; i++)
+    {
+        if (gp->xmitRec[i].status != UNUSED_TX)
+        {
+            pending   = TRUE;
+            remaining = TMR_Remaining(&gp->xmitRec[i].xmitTimer);
+            if (remaining < *remainingOut)
+            {
+                *remainingOut = remaining;
+            }
+        }
+    }
+    /* Every receive record in use has its timer on the wheel. */
+    if (gp->recvWheel.count)
+    {
+        pending   = TRUE;
+        remaining = TMR_NextDeadline(&gp->recvWheel);
+        if (remaining < *remainingOut)
+        {
+            *remainingOut = remaining;
+        }
+    }
+    return pending;
+}
+
 /*****************************************************************
 Function:  TSAReset
 Returns:   None
@@ -242,13 +316,14 @@ void TSAReset(void)
     gp->tsaInQCnt    = DecodeBufferCnt((uint8)eep->readOnlyData.appInBufCnt);
     queueItemSize    = gp->tsaInBufSize + sizeof(TSAReceiveParam);
 
-    if (QueueInit(&gp->tsaInQ, queueItemSize, gp->tsaInQCnt)
-            != SUCCESS)
+    if (QueueInitPooled(&gp->tsaInQ, queueItemSize, gp->tsaInQCnt,
+                        &gp->inPool) != SUCCESS)
     {
         ErrorMsg("TSAReset: Unable to initialize the input queue.");
         gp->resetOk = FALSE;
         return;
     }
+    QueueSetReadyBit(&gp->tsaInQ, &gp->readyMask, LCS_READY_TSA);
 
     /* Allocate and initialize the output queue. */
     gp->tsaOutBufSize =
@@ -265,6 +340,7 @@ void TSAReset(void)
         gp->resetOk = FALSE;
         return;
     }
+    QueueSetReadyBit(&gp->tsaOutQ, &gp->readyMask, LCS_READY_TSA);
 
     /* Allocate and initialize the priority output queue. */
     gp->tsaOutPriBufSize = gp->tsaOutBufSize;
@@ -279,6 +355,7 @@ void TSAReset(void)
         gp->resetOk = FALSE;
         return;
     }
+    QueueSetReadyBit(&gp->tsaOutPriQ, &gp->readyMask, LCS_READY_TSA);
 
     /* Allocate and initialize the responses queue. */
     gp->tsaRespBufSize = gp->tsaOutBufSize;
@@ -292,10 +369,33 @@ void TSAReset(void)
         gp->resetOk = FALSE;
         return;
     }
+    QueueSetReadyBit(&gp->tsaRespQ, &gp->readyMask, LCS_READY_TSA);
 
-    /* Initialize the transmit records. */
-    gp->xmitRec.status    = UNUSED_TX;
-    gp->priXmitRec.status = UNUSED_TX;
+    /* Initialize the transmit records. Each one keeps its own copy
+       of the message being sent, so the tsa queues are free to move on
+       to the next message. */
+    gp->xmitRecCnt = XMIT_TRANS_COUNT;
+    gp->xmitRec    = AllocateStorage((uint16)(gp->xmitRecCnt *
+                                     sizeof(TransmitRecord)));
+    if (gp->xmitRec == NULL)
+    {
+        ErrorMsg("TSAReset: Insufficient space for allocating transmit records.");
+        gp->resetOk = FALSE;
+        return;
+    }
+    for (i = 0; i < gp->xmitRecCnt; i++)
+    {
+        gp->xmitRec[i].sendParam =
+            AllocateStorage((uint16)(gp->tsaOutBufSize + sizeof(TSASendParam)));
+        if (gp->xmitRec[i].sendParam == NULL)
+        {
+            ErrorMsg("TSAReset: Insufficient space for transmit record message.");
+            gp->resetOk = FALSE;
+            return;
+        }
+        gp->xmitRec[i].apdu   = (APDU *)(gp->xmitRec[i].sendParam + 1);
+        gp->xmitRec[i].status = UNUSED_TX;
+    }
 
     /* Initialize the receive records. */
     gp->recvRecCnt = RECEIVE_TRANS_COUNT;
@@ -322,7 +422,31 @@ void TSAReset(void)
             return;
         }
         gp->recvRec[i].status = UNUSED_RR;
+        memset(&gp->recvRec[i].recvTimer, 0, sizeof(gp->recvRec[i].recvTimer));
+    }
+    TMR_WheelInit(&gp->recvWheel);
+
+    /* Initialize the receive record indices. All records start out on
+       the free list, lowest index first. */
+    gp->rrSrcNext = AllocateStorage((uint16)(gp->recvRecCnt * sizeof(int16)));
+    gp->rrReqNext = AllocateStorage((uint16)(gp->recvRecCnt * sizeof(int16)));
+    if (gp->rrSrcNext == NULL || gp->rrReqNext == NULL)
+    {
+        ErrorMsg("TSAReset: Insufficient space for receive record index.");
+        gp->resetOk = FALSE;
+        return;
     }
+    for (i = 0; i < RECEIVE_TRANS_HASH_SIZE; i++)
+    {
+        gp->rrSrcHash[i] = -1;
+        gp->rrReqHash[i] = -1;
+    }
+    for (i = 0; i < gp->recvRecCnt; i++)
+    {
+        gp->rrSrcNext[i] = (i + 1 < gp->recvRecCnt) ? (int16)(i + 1) : -1;
+        gp->rrReqNext[i] = RR_UNLINKED;
+    }
+    gp->rrFree = (gp->recvRecCnt > 0) ? 0 : -1;
 
     /* Initialize the running count for request id assignment. */
     gp->reqId = 0;
@@ -339,20 +463,7 @@ Purpose:   To implement send algorithm for transport layer.
            If there is anything to be sent by transport layer,
            it processes that message and calls the right function
            that sends it.
-Comments:  Update the priority transaction timer, if it exists.
-           Update the non-priority transaction timer, if it exists.
-           If the priority transaction timer expired then
-              process this event.
-           else if there is a priority message to be sent and there is space
-                in priority queue of the network layer then
-              process the priority message.
-           else if non-priority transaction timer expired then
-              process that event.
-           else if there is a non-priority message to be sent and there
-                is space in the non-priority queue of the network layer then
-              process the non-priority message.
-           else
-                there is nothing to do. return.
+Comments:  See ServiceXmitRecs.
 Note:
 ******************************************************************/
 void TPSend(void)
@@ -363,48 +474,150 @@ void TPSend(void)
         return; /* Do nothing */
     }
 
+    ServiceXmitRecs(TRANSPORT);
+}
+
+/*****************************************************************
+Function:  ServiceXmitRecs
+Returns:   None
+Reference: None
+Purpose:   To run the transmit records of the transport or session
+           layer and to start new transactions.
+Comments:  For each record of this layer whose transaction timer
+              expired, process that event.
+           Then, if there is a priority message to be sent, a free
+                transmit record and space in priority queue of the
+                network layer then
+              process the priority message.
+           if no priority message was processed and there is a
+                non-priority message to be sent, a free transmit
+                record that is not kept for priority messages and
+                space in the non-priority queue of the network layer
+                then
+              process the non-priority message.
+           A new message is taken off its queue once its transaction
+           has started, so transactions to different destinations
+           overlap. A message to a destination that already has a
+           transaction in progress waits in its queue while messages
+           to other destinations behind it go ahead.
+******************************************************************/
+static void ServiceXmitRecs(Layer layerIn)
+{
+    TXStatus status = (layerIn == TRANSPORT) ? TRANSPORT_TX : SESSION_TX;
+    uint16   i;
+
     /***************************************************
-      Priority transaction timer expired event.
+      Transaction timer expired events.
      **************************************************/
-    if (gp->priXmitRec.status == TRANSPORT_TX && !MsTimerRunning(&gp->priXmitRec.xmitTimer))
+    for (i = 0; i < gp->xmitRecCnt; i++)
     {
-        XmitTimerExpiration(TRANSPORT, TRUE);
-        return;
+        if (gp->xmitRec[i].status == status &&
+            !MsTimerRunning(&gp->xmitRec[i].xmitTimer))
+        {
+            XmitTimerExpiration(layerIn, &gp->xmitRec[i]);
+        }
     }
+
     /***************************************************
       Send a new priority message event.
      **************************************************/
-    else if (gp->priXmitRec.status == UNUSED_TX &&
-             ! QueueEmpty(&gp->tsaOutPriQ)      &&
-             ! QueueFull(&gp->nwOutPriQ) )
+    if (! QueueEmpty(&gp->tsaOutPriQ) &&
+        ! QueueFull(&gp->nwOutPriQ) &&
+        AllocateXmitRec(TRUE) != NULL &&
+        SendNewMsg(layerIn, TRUE))
     {
-        SendNewMsg(TRANSPORT, TRUE);
         return;
     }
-    /***************************************************
-      Non-priority transaction timer expired event.
-      *************************************************/
-    else if (gp->xmitRec.status == TRANSPORT_TX && !MsTimerRunning(&gp->xmitRec.xmitTimer))
-    {
-        XmitTimerExpiration(TRANSPORT, FALSE);
-    }
     /***************************************************
       Send a new non-priority message.
      **************************************************/
-    else if (gp->xmitRec.status == UNUSED_TX &&
-             ! QueueEmpty(&gp->tsaOutQ)      &&
-             ! QueueFull(&gp->nwOutQ) )
+    if (! QueueEmpty(&gp->tsaOutQ) &&
+        ! QueueFull(&gp->nwOutQ) &&
+        AllocateXmitRec(FALSE) != NULL)
     {
-        SendNewMsg(TRANSPORT, FALSE);
+        SendNewMsg(layerIn, FALSE);
     }
-    else
+    /* Otherwise either there is no work, no space or no record. */
+}
+
+/*****************************************************************
+Function:  AllocateXmitRec
+Returns:   A transmit record that is not in use or NULL if none.
+Reference: None
+Purpose:   To find a free transmit record.
+Comments:  The record stays free until its status is set. The last
+           XMIT_PRI_RESERVE free records are only given to priority
+           messages.
+******************************************************************/
+static TransmitRecord *AllocateXmitRec(Boolean priorityIn)
+{
+    TransmitRecord *xmitRecPtr = NULL;
+    uint16          freeCnt    = 0;
+    uint16          i;
+
+    for (i = 0; i < gp->xmitRecCnt; i++)
     {
-        /* Either there is no work or there is no space. */
-        return;
+        if (gp->xmitRec[i].status == UNUSED_TX)
+        {
+            if (xmitRecPtr == NULL)
+            {
+                xmitRecPtr = &gp->xmitRec[i];
+            }
+            freeCnt++;
+        }
+    }
+    if (!priorityIn && freeCnt <= XMIT_PRI_RESERVE)
+    {
+        return(NULL);
     }
+    return(xmitRecPtr);
+}
 
-    return;
+/*****************************************************************
+Function:  FindXmitRec
+Returns:   The transmit record that an ack, response or challenge
+           with the given transaction number belongs to, or NULL.
+Reference: None
+Purpose:   To match an incoming message to one of the transactions
+           in progress.
+Comments:  statusIn of UNUSED_TX matches a record of either layer.
+           Transaction numbers of the records in progress normally
+           differ, but a proxy may inherit one, so a record whose
+           destination agrees with the source address is preferred.
+******************************************************************/
+static TransmitRecord *FindXmitRec(Boolean priorityIn, TransNum transNumIn,
+                                   TXStatus statusIn, SourceAddress *srcAddrIn)
+{
+    TransmitRecord *xmitRecPtr;
+    TransmitRecord *candidatePtr = NULL;
+    uint16          i;
 
+    for (i = 0; i < gp->xmitRecCnt; i++)
+    {
+        xmitRecPtr = &gp->xmitRec[i];
+        if (xmitRecPtr->status == UNUSED_TX ||
+            (statusIn != UNUSED_TX && xmitRecPtr->status != statusIn) ||
+            xmitRecPtr->priority != priorityIn ||
+            xmitRecPtr->transNum != transNumIn)
+        {
+            continue;
+        }
+        if (xmitRecPtr->nwDestAddr.dmn.domainIndex == srcAddrIn->dmn.domainIndex &&
+            (xmitRecPtr->nwDestAddr.addressMode != SUBNET_NODE ||
+             (xmitRecPtr->nwDestAddr.addr.addr2a.subnet == srcAddrIn->subnetAddr.subnet &&
+              xmitRecPtr->nwDestAddr.addr.addr2a.node   == srcAddrIn->subnetAddr.node)) &&
+            (xmitRecPtr->nwDestAddr.addressMode != MULTICAST ||
+             srcAddrIn->addressMode != MULTICAST_ACK ||
+             xmitRecPtr->nwDestAddr.addr.addr1 == srcAddrIn->ackNode.groupAddr.group))
+        {
+            return(xmitRecPtr);
+        }
+        if (candidatePtr == NULL)
+        {
+            candidatePtr = xmitRecPtr;
+        }
+    }
+    return(candidatePtr);
 }
 
 /*****************************************************************
@@ -415,13 +628,12 @@ Purpose:   To terminate a transaction for transport or session
            layer and send the completion indication to application
            layer. If the application layer's input queue is full,
            we don't terminate the transaction.
-Comments:  layerIn is not passed as it is not needed.
+Comments:  layerIn is not passed as it is not needed. The message
+           was taken off its queue when the transaction started.
 ******************************************************************/
-static void TerminateTrans(Boolean priorityIn)
+static void TerminateTrans(TransmitRecord *xmitRecPtr)
 {
-    Queue           *tsaQPtr;     /* Pointer to source queue */
     TSASendParam    *tsaSendParamPtr;
-    TransmitRecord  *xmitRecPtr;  /* Ptr to xmit rec (pri or nonpri)*/
     Boolean          success;
 
     if (QueueFull(&gp->appInQ))
@@ -429,18 +641,7 @@ static void TerminateTrans(Boolean priorityIn)
         return; /* Can't send the indication. Come back later. */
     }
 
-    if (priorityIn)
-    {
-        tsaQPtr         = &gp->tsaOutPriQ;
-        tsaSendParamPtr = QueueHead(tsaQPtr);
-        xmitRecPtr      = &gp->priXmitRec;
-    }
-    else
-    {
-        tsaQPtr         = &gp->tsaOutQ;
-        tsaSendParamPtr = QueueHead(tsaQPtr);
-        xmitRecPtr      = &gp->xmitRec;
-    }
+    tsaSendParamPtr = xmitRecPtr->sendParam;
 
     if (tsaSendParamPtr->service == UNACK_RPT ||
             xmitRecPtr->destCount == xmitRecPtr->ackCount ||
@@ -457,7 +658,7 @@ static void TerminateTrans(Boolean priorityIn)
         success = FALSE; /* REQUEST or ACK and did not get all acks. */
     }
 
-    TransDone(priorityIn); /* Call to TCS. */
+    TransDone(xmitRecPtr->priority, xmitRecPtr->tidIndex); /* Call to TCS. */
     xmitRecPtr->status = UNUSED_TX;
 	if (success)
 	{
@@ -467,7 +668,7 @@ static void TerminateTrans(Boolean priorityIn)
 	{
 		DebugMsg("TermTran: Terminated the transaction. Fail.");
 	}
-	SendCompletion(tsaSendParamPtr, success);
+	PostCompletion(tsaSendParamPtr, success);
     return;
 }
 
@@ -483,12 +684,10 @@ Purpose:   To process the XmitTimer expiration event (pri or nonpri).
            lost.
 Comments:  None
 ******************************************************************/
-static void XmitTimerExpiration(Layer layerIn, Boolean priorityIn)
+static void XmitTimerExpiration(Layer layerIn, TransmitRecord *xmitRecPtr)
 {
-    TSASendParam *tsaSendParamPtr;/* Param in tsaQ (Pri or nonPri).   */
+    TSASendParam *tsaSendParamPtr;/* Message of the transaction.      */
     NWSendParam  *nwSendParamPtr; /* Param in nwQ (Pri or nonPri).    */
-    TransmitRecord  *xmitRecPtr;  /* Ptr to xmit rec (pri or nonpri). */
-    Queue        *tsaQPtr;        /* Pointer to source queue.         */
     Queue        *nwQPtr;         /* Pointer to target queue.         */
     TSPDUPtr      pduPtr;         /* Pointer to TSPDU being formed.   */
     uint8         deltaBL;
@@ -497,22 +696,16 @@ static void XmitTimerExpiration(Layer layerIn, Boolean priorityIn)
     uint8         length; /* For length of reminder in bytes. */
     uint16        queueSpace;
 
-    if (priorityIn)
+    tsaSendParamPtr = xmitRecPtr->sendParam;
+    if (xmitRecPtr->priority)
     {
-        tsaQPtr         = &gp->tsaOutPriQ;
-        tsaSendParamPtr = QueueHead(tsaQPtr);
         nwQPtr          = &gp->nwOutPriQ;
-        nwSendParamPtr  = QueueTail(nwQPtr);
-        xmitRecPtr      = &gp->priXmitRec;
     }
     else
     {
-        tsaQPtr         = &gp->tsaOutQ;
-        tsaSendParamPtr = QueueHead(tsaQPtr);
         nwQPtr          = &gp->nwOutQ;
-        nwSendParamPtr  = QueueTail(nwQPtr);
-        xmitRecPtr      = &gp->xmitRec;
     }
+    nwSendParamPtr  = QueueTail(nwQPtr);
 
     /* First, check if we really need to retry the message. */
     if (xmitRecPtr->retriesLeft == 0 ||
@@ -524,7 +717,7 @@ static void XmitTimerExpiration(Layer layerIn, Boolean priorityIn)
         /* No More retries left or all acks have been received.
            Terminate the transaction. Send indication to the application
            layer. */
-        TerminateTrans(priorityIn);
+        TerminateTrans(xmitRecPtr);
         return;
     }
 
@@ -829,16 +1022,106 @@ static void XmitTimerExpiration(Layer layerIn, Boolean priorityIn)
     return;
 }
 
+/*****************************************************************
+Function:  NewMsgDest
+Returns:   FALSE if the message has no valid destination.
+Reference: None
+Purpose:   To compute the network layer destination of a message in
+           the tsa output queue.
+Comments:  The message is not changed, so that messages waiting
+           behind the head can be looked at too.
+******************************************************************/
+static Boolean NewMsgDest(TSASendParam *tsaSendParamPtr,
+                          DestinationAddress *nwDestAddrOut)
+{
+    /* First, initialize domainIndex. Only if it is COMPUTE_DOMAIN_INDEX,
+       we need to recompute it based on destAddr field value. */
+    nwDestAddrOut->dmn = tsaSendParamPtr->dmn;
+	if (tsaSendParamPtr->dmn.domainIndex == COMPUTE_DOMAIN_INDEX)
+	{
+		nwDestAddrOut->dmn.domainIndex =
+			tsaSendParamPtr->destAddr.snode.domainIndex;
+	}
+
+	// Check for group format
+    if (tsaSendParamPtr->destAddr.group.groupFlag)
+    {
+	    nwDestAddrOut->addressMode = MULTICAST;
+		nwDestAddrOut->addr.addr1 =
+			tsaSendParamPtr->destAddr.group.groupID;
+		return(TRUE);
+	}
+
+	switch (tsaSendParamPtr->destAddr.snode.addrMode)
+	{
+	case SUBNET_NODE:
+		nwDestAddrOut->addressMode = SUBNET_NODE;
+		nwDestAddrOut->addr.addr2a.subnet =
+			tsaSendParamPtr->destAddr.snode.subnetID;
+		nwDestAddrOut->addr.addr2a.selField = 1; /* always 1 */
+		nwDestAddrOut->addr.addr2a.node   =
+			tsaSendParamPtr->destAddr.snode.node;
+		break;
+	case UNIQUE_NODE_ID:
+		nwDestAddrOut->addressMode = UNIQUE_NODE_ID;
+		nwDestAddrOut->addr.addr3.subnet =
+			tsaSendParamPtr->destAddr.uniqueNodeId.subnetID;
+		memcpy(nwDestAddrOut->addr.addr3.uniqueId,
+			   tsaSendParamPtr->destAddr.uniqueNodeId.uniqueId,
+			   UNIQUE_NODE_ID_LEN);
+		break;
+	case BROADCAST:
+		nwDestAddrOut->addressMode = BROADCAST;
+		nwDestAddrOut->addr.addr0 =
+			tsaSendParamPtr->destAddr.bcast.subnetID;
+		break;
+	default:
+		/* Not in use, turnaround format or some invalid value. */
+		return(FALSE);
+	} /* switch */
+	return(TRUE);
+}
+
+/*****************************************************************
+Function:  NewMsgWaits
+Returns:   TRUE if the message has to wait for the transaction in
+           progress to its destination.
+Reference: None
+Purpose:   To find the messages that SendNewMsg can pass over.
+Comments:  Any other message stops the search, in particular the
+           end of an NV update, which must not overtake its
+           messages, and one that is to be failed.
+******************************************************************/
+static Boolean NewMsgWaits(TSASendParam *tsaSendParamPtr, Boolean priorityIn)
+{
+    DestinationAddress nwDestAddr;
+
+    if ((tsaSendParamPtr->service != ACKD &&
+         tsaSendParamPtr->service != UNACK_RPT &&
+         tsaSendParamPtr->service != REQUEST) ||
+        NV_LAST_TAG(tsaSendParamPtr->tag) ||
+        !NewMsgDest(tsaSendParamPtr, &nwDestAddr))
+    {
+        return(FALSE);
+    }
+    return(TransInProgress(priorityIn, &nwDestAddr));
+}
+
 /*****************************************************************
 Function:  SendNewMsg
-Returns:   None
+Returns:   FALSE if every message in the queue waits for a
+           transaction in progress to its destination.
 Reference: None
 Purpose:   To process a new request from the application layer that
            is in the tsa output queue (pri or nonpri). Request or ACKD.
 Comments:  This fn is called only if there is space in the
-           corresponding queue of the network layer.
+           corresponding queue of the network layer and a free
+           transmit record.
+           The first message that doesn't wait is moved to the head
+           and processed there. Messages to one destination all wait
+           together, so they stay in order.
 ******************************************************************/
-static void SendNewMsg(Layer layerIn, Boolean priorityIn)
+static Boolean SendNewMsg(Layer layerIn, Boolean priorityIn)
 {
     Queue          *tsaQPtr;        /* Pointer to the source queue.    */
     TSASendParam   *tsaSendParamPtr;/* Param in tsaQ (Pri or non-pri). */
@@ -854,26 +1137,46 @@ static void SendNewMsg(Layer layerIn, Boolean priorityIn)
     uint8           deltaBL;
     uint16          nwBufSize;
     int8            i;
+    uint16          item;
 	uint16			rrIndex;
 
     if (priorityIn)
     {
         tsaQPtr         = &gp->tsaOutPriQ;
-        tsaSendParamPtr = QueueHead(tsaQPtr);
         nwQPtr          = &gp->nwOutPriQ;
         nwSendParamPtr  = QueueTail(nwQPtr);
         nwBufSize       = gp->nwOutPriBufSize;
-        xmitRecPtr      = &gp->priXmitRec;
     }
     else
     {
         tsaQPtr         = &gp->tsaOutQ;
-        tsaSendParamPtr = QueueHead(tsaQPtr);
         nwQPtr          = &gp->nwOutQ;
         nwSendParamPtr  = QueueTail(nwQPtr);
         nwBufSize       = gp->nwOutBufSize;
-        xmitRecPtr      = &gp->xmitRec;
     }
+    xmitRecPtr = AllocateXmitRec(priorityIn);
+    if (xmitRecPtr == NULL)
+    {
+        return(TRUE); /* Checked by the caller. */
+    }
+
+    /* Pass over the messages to destinations that are busy. */
+    for (item = 0; item < QueueSize(tsaQPtr); item++)
+    {
+        if (!NewMsgWaits(QueueItem(tsaQPtr, item), priorityIn))
+        {
+            break;
+        }
+    }
+    if (item == QueueSize(tsaQPtr))
+    {
+        return(FALSE);
+    }
+    if (item != 0)
+    {
+        QueueToHead(tsaQPtr, item);
+    }
+    tsaSendParamPtr = QueueHead(tsaQPtr);
 
     /* If processing a new message, make sure that it is for this
        layer. If not, we are done. */
@@ -882,19 +1185,29 @@ static void SendNewMsg(Layer layerIn, Boolean priorityIn)
             tsaSendParamPtr->service != ACKD &&
             tsaSendParamPtr->service != UNACK_RPT)
     {
-        return;
+        return(TRUE);
     }
 
     if (layerIn == TRANSPORT && NV_LAST_TAG(tsaSendParamPtr->tag))
     {
+        /* The end of an NV update completes only after the transactions
+           started ahead of it. */
+        for (i = 0; i < (int8)gp->xmitRecCnt; i++)
+        {
+            if (gp->xmitRec[i].status != UNUSED_TX &&
+                gp->xmitRec[i].priority == priorityIn)
+            {
+                return(TRUE);
+            }
+        }
 		SendCompletion(tsaSendParamPtr, TRUE);
-        return;
+        return(TRUE);
     }
 
     if (layerIn == SESSION && tsaSendParamPtr->service != REQUEST)
     {
         /* Responses are placed in the response queue. */
-        return;
+        return(TRUE);
     }
 
     /* Make sure that large group size is not used for ack
@@ -906,7 +1219,7 @@ static void SendNewMsg(Layer layerIn, Boolean priorityIn)
         /* Large groups can only use unack or unack_rpt services. */
         /* Indicate failure of this message to application layer. */
 		SendCompletion(tsaSendParamPtr, FALSE);
-        return;
+        return(TRUE);
     }
     /* Make sure that groupSize is in the proper range. */
 #ifdef GROUP_SIZE_COMPATIBILITY
@@ -919,7 +1232,7 @@ static void SendNewMsg(Layer layerIn, Boolean priorityIn)
 #endif
     {
 		SendCompletion(tsaSendParamPtr, FALSE);
-        return;
+        return(TRUE);
     }
 
     /* Make sure there is space in network buffer. If not, we fail. */
@@ -931,82 +1244,52 @@ static void SendNewMsg(Layer layerIn, Boolean priorityIn)
         /* Right now, we haven't allocated any transmit record. */
         /* So, we directly give the indication to application. */
 		SendCompletion(tsaSendParamPtr, FALSE);
-        return;
+        return(TRUE);
     }
 
-    /* First, compute nwDestAddr from destAddr. */
-    /* First, initialize domainIndex. Only if it is COMPUTE_DOMAIN_INDEX,
-       we need to recompute it based on destAddr field value. */
-    nwDestAddr.dmn = tsaSendParamPtr->dmn;
-
 	// Do some stuff common to all address types
     txTimer = DecodeTxTimer((uint8)tsaSendParamPtr->destAddr.snode.txTimer, (Boolean)tsaSendParamPtr->destAddr.snode.longTimer);
     rptTimer = DecodeRptTimer((uint8)tsaSendParamPtr->destAddr.snode.rptTimer);
     retryCount = tsaSendParamPtr->destAddr.snode.retryCount;
-	if (tsaSendParamPtr->dmn.domainIndex == COMPUTE_DOMAIN_INDEX)
-	{
-		nwDestAddr.dmn.domainIndex =
-			tsaSendParamPtr->destAddr.snode.domainIndex;
-	}
 
-	// Check for group format
-    if (tsaSendParamPtr->destAddr.group.groupFlag)
+    /* First, compute nwDestAddr from destAddr. */
+    if (!NewMsgDest(tsaSendParamPtr, &nwDestAddr))
     {
-	    nwDestAddr.addressMode = MULTICAST;
-		nwDestAddr.addr.addr1 =
-			tsaSendParamPtr->destAddr.group.groupID;
-	}
-	else
-	{
-		switch (tsaSendParamPtr->destAddr.snode.addrMode)
-		{
-		case UNBOUND:
-			/* Not in use or turnaround format. */
-			SendCompletion(tsaSendParamPtr, FALSE);
-			return;
-		case SUBNET_NODE:
-			nwDestAddr.addressMode = SUBNET_NODE;
-			nwDestAddr.addr.addr2a.subnet =
-				tsaSendParamPtr->destAddr.snode.subnetID;
-			nwDestAddr.addr.addr2a.selField = 1; /* always 1 */
-			nwDestAddr.addr.addr2a.node   =
-				tsaSendParamPtr->destAddr.snode.node;
-			break;
-		case UNIQUE_NODE_ID:
-			nwDestAddr.addressMode = UNIQUE_NODE_ID;
-			nwDestAddr.addr.addr3.subnet =
-				tsaSendParamPtr->destAddr.uniqueNodeId.subnetID;
-			memcpy(nwDestAddr.addr.addr3.uniqueId,
-				   tsaSendParamPtr->destAddr.uniqueNodeId.uniqueId,
-				   UNIQUE_NODE_ID_LEN);
-			break;
-		case BROADCAST:
-			if (!tsaSendParamPtr->destAddr.bcast.broadcastGroup)
-			{
-				tsaSendParamPtr->destAddr.bcast.maxResponses = 1;
-			}
-			/* Broadcast group addressing is optional.  It can not be assumed that all devices
-			 * support this form of addressing. */
-			nwDestAddr.addr.addr0 =
-				tsaSendParamPtr->destAddr.bcast.subnetID;
-			break;
-		default:
-			/* It must be some invalid value. Let us fail. */
-			LCS_RecordError(BAD_ADDRESS_TYPE);
-			SendCompletion(tsaSendParamPtr, FALSE);
-			return;
-		} /* switch */
-	}
+        if (tsaSendParamPtr->destAddr.snode.addrMode != UNBOUND)
+        {
+            /* It must be some invalid value. Let us fail. */
+            LCS_RecordError(BAD_ADDRESS_TYPE);
+        }
+        /* Not in use or turnaround format. */
+        SendCompletion(tsaSendParamPtr, FALSE);
+        return(TRUE);
+    }
+    if (nwDestAddr.addressMode == BROADCAST &&
+        !tsaSendParamPtr->destAddr.bcast.broadcastGroup)
+    {
+        /* Broadcast group addressing is optional.  It can not be assumed that all devices
+         * support this form of addressing. */
+        tsaSendParamPtr->destAddr.bcast.maxResponses = 1;
+    }
 
     /* Get transaction number using nwDestAddr. */
-    status = NewTrans(priorityIn, nwDestAddr, &xmitRecPtr->transNum);
+    status = NewTrans(priorityIn, nwDestAddr, &xmitRecPtr->transNum,
+                      &xmitRecPtr->tidIndex);
     if (status == FAILURE)
     {
         /* Unable to get the transaction number. Give up. Try later. */
-        return;
+        return(TRUE);
     }
 
+    /* The transaction has started. Take the message off the queue and
+       keep it in the xmit record until the transaction is done. */
+    memcpy(xmitRecPtr->sendParam, tsaSendParamPtr,
+           sizeof(TSASendParam) + tsaSendParamPtr->apduSize);
+    DeQueue(tsaQPtr);
+    tsaSendParamPtr = xmitRecPtr->sendParam;
+
     /* Initialize the xmit record. */
+    xmitRecPtr->priority = priorityIn;
     if (layerIn == TRANSPORT)
     {
         xmitRecPtr->status = TRANSPORT_TX;
@@ -1027,7 +1310,7 @@ static void SendNewMsg(Layer layerIn, Boolean priorityIn)
 		  	// OK, we take advantage of the fact that the tag for a proxy request is the same as the receive TX index
 		  	// for the incoming message.
 	  		xmitRecPtr->transNum = gp->recvRec[rrIndex].transNum;
-			OverrideTrans(priorityIn, xmitRecPtr->transNum);
+			OverrideTrans(priorityIn, xmitRecPtr->tidIndex, xmitRecPtr->transNum);
 		}
 		xmitRecPtr->txTimerDeltaLast = tsaSendParamPtr->txTimerDeltaLast;
 		memcpy(&xmitRecPtr->altKey, &tsaSendParamPtr->altKey, sizeof(xmitRecPtr->altKey));
@@ -1178,7 +1461,7 @@ static void SendNewMsg(Layer layerIn, Boolean priorityIn)
     /* Start the transmit timer. */
     MsTimerSet(&xmitRecPtr->xmitTimer, xmitRecPtr->xmitTimerValue);
 
-    return;
+    return(TRUE);
 }
 
 
@@ -1194,21 +1477,9 @@ void TPReceive(void)
 {
     TSAReceiveParam *tsaReceiveParamPtr;/* Param in tsaQ. */
     TSPDUPtr          pduInPtr;         /* Pointer to TPDU received. */
-    int16           i;
 
-    /* Update all the receive timers, if they do exist */
-    for (i = 0; i < gp->recvRecCnt; i++)
-    {
-        if (gp->recvRec[i].status == TRANSPORT_RR)
-        {
-            if (MsTimerExpired(&gp->recvRec[i].recvTimer))
-            {
-                /* Timer expired. See if RR can be released. */
-                DebugMsg("TPReceive: Receive timer expired.");
-                gp->recvRec[i].status = UNUSED_RR; /* Release the RR */
-            }
-        }
-    }
+    /* Release the receive records whose timers expired. */
+    TMR_WheelDispatch(&gp->recvWheel, RecvTimerExpired, NULL);
 
     /* Check if there is TPDU to be processed. */
     if (QueueEmpty(&gp->tsaInQ))
@@ -1276,16 +1547,6 @@ static void TPReceiveAck(void)
     tsaReceiveParamPtr = QueueHead(&gp->tsaInQ);
     pduPtr             = (TSPDUPtr) (tsaReceiveParamPtr + 1);
 
-    /* Set the corresponding transmit pointer. */
-    if (tsaReceiveParamPtr->priority)
-    {
-        xmitRecPtr = &gp->priXmitRec;
-    }
-    else
-    {
-        xmitRecPtr = &gp->xmitRec;
-    }
-
     if (ValidateTrans(tsaReceiveParamPtr->priority, pduPtr->transNum)
             == TRANS_NOT_CURRENT)
     {
@@ -1296,8 +1557,12 @@ static void TPReceiveAck(void)
         return;
     }
 
+    /* Find the corresponding transmit record. */
+    xmitRecPtr = FindXmitRec(tsaReceiveParamPtr->priority, pduPtr->transNum,
+                             TRANSPORT_TX, &tsaReceiveParamPtr->srcAddr);
+
     /* Check if the ACK really corresponds to the transaction in progress. */
-    if (xmitRecPtr->status != TRANSPORT_TX ||
+    if (xmitRecPtr == NULL ||
             xmitRecPtr->nwDestAddr.dmn.domainIndex !=
             tsaReceiveParamPtr->srcAddr.dmn.domainIndex)
     {
@@ -1364,7 +1629,7 @@ static void TPReceiveAck(void)
            harm in doing this. Also, there is no harm in increment
            ackCount as XmitTimerExpiration checks for ackCount >= 1. */
         xmitRecPtr->ackCount++; /* Got one more ack. */
-        TerminateTrans(tsaReceiveParamPtr->priority);
+        TerminateTrans(xmitRecPtr);
         break;
     case MULTICAST:
         /* Group acknowledgement. */
@@ -1391,7 +1656,7 @@ static void TPReceiveAck(void)
         }
         if (xmitRecPtr->destCount == xmitRecPtr->ackCount)
         {
-            TerminateTrans(tsaReceiveParamPtr->priority);
+            TerminateTrans(xmitRecPtr);
         }
         break;
     default:
@@ -1433,18 +1698,6 @@ static void SNReceiveResponse(void)
     tsaReceiveParamPtr = QueueHead(&gp->tsaInQ);
     pduPtr             = (TSPDUPtr) (tsaReceiveParamPtr + 1);
 
-    /* Set the corresponding transmit pointer. */
-    if (tsaReceiveParamPtr->priority)
-    {
-        xmitRecPtr      = &gp->priXmitRec;
-        tsaSendParamPtr = QueueHead(&gp->tsaOutPriQ);
-    }
-    else
-    {
-        xmitRecPtr      = &gp->xmitRec;
-        tsaSendParamPtr = QueueHead(&gp->tsaOutQ);
-    }
-
     if (ValidateTrans(tsaReceiveParamPtr->priority, pduPtr->transNum)
             == TRANS_NOT_CURRENT)
     {
@@ -1455,9 +1708,13 @@ static void SNReceiveResponse(void)
         return;
     }
 
+    /* Find the corresponding transmit record. */
+    xmitRecPtr = FindXmitRec(tsaReceiveParamPtr->priority, pduPtr->transNum,
+                             SESSION_TX, &tsaReceiveParamPtr->srcAddr);
+
     /* Check if possible if the Response really corresponds to the
        transaction in progress. */
-    if (xmitRecPtr->status != SESSION_TX ||
+    if (xmitRecPtr == NULL ||
             xmitRecPtr->nwDestAddr.dmn.domainIndex !=
             tsaReceiveParamPtr->srcAddr.dmn.domainIndex)
     {
@@ -1511,6 +1768,7 @@ static void SNReceiveResponse(void)
         return; /* Can't give the response yet. Come back later. */
     }
 	
+    tsaSendParamPtr    = xmitRecPtr->sendParam;
     appReceiveParamPtr = QueueTail(&gp->appInQ);
     apduPtr            = (APDU *)(appReceiveParamPtr + 1);
 
@@ -1558,7 +1816,7 @@ static void SNReceiveResponse(void)
             if (xmitRecPtr->ackCount ==
                     tsaSendParamPtr->destAddr.bcast.maxResponses)
             {
-                TerminateTrans(tsaReceiveParamPtr->priority);
+                TerminateTrans(xmitRecPtr);
             }
         }
         /* else, we don't want this response. Ignore it. */
@@ -1569,7 +1827,7 @@ static void SNReceiveResponse(void)
         {
             EnQueue(&gp->appInQ);
            xmitRecPtr->ackCount++; /* First response. */
-            TerminateTrans(tsaReceiveParamPtr->priority);
+            TerminateTrans(xmitRecPtr);
         }
         /* else, it is a duplicate response. Ignore it. */
         break;
@@ -1605,7 +1863,7 @@ static void SNReceiveResponse(void)
         }
         if (xmitRecPtr->destCount == xmitRecPtr->ackCount)
         {
-            TerminateTrans(tsaReceiveParamPtr->priority);
+            TerminateTrans(xmitRecPtr);
         }
         break;
     default:
@@ -1697,6 +1955,8 @@ static void ReceiveNewMsg(Layer layerIn)
            request. If it is a request and response comes later,
            it won't match this record anyway due to reqid. */
         initRR = TRUE;
+        /* The key and request id are about to change. */
+        UnbindRR(i);
         /* If the old message was not deliverd, increment lost msg stat */
         if (gp->recvRec[i].transState != DELIVERED &&
                 gp->recvRec[i].transState != DONE      &&
@@ -1754,6 +2014,7 @@ static void ReceiveNewMsg(Layer layerIn)
             }
             gp->recvRec[i].reqId           = gp->reqId++;
         }
+        BindRR(i);
         gp->recvRec[i].apduSize = tsaReceiveParamPtr->pduSize - 1;
         memcpy(gp->recvRec[i].apdu,
                pduPtr->data,
@@ -1762,7 +2023,7 @@ static void ReceiveNewMsg(Layer layerIn)
         recvTimerValue = ComputeRecvTimerValue(
                              tsaReceiveParamPtr->srcAddr.addressMode,
                              tsaReceiveParamPtr->srcAddr.group);
-        MsTimerSet(&gp->recvRec[i].recvTimer, recvTimerValue);
+        TMR_WheelStart(&gp->recvWheel, &gp->recvRec[i].recvTimer, recvTimerValue);
     }
 
     DeQueue(&gp->tsaInQ); /* Remove item from queue. */
@@ -1902,7 +2163,7 @@ static void ReceiveRem(Layer layerIn)
         {
             /* Reuse this receive record. We will free this record and allocate
                a new one. */
-            gp->recvRec[i].status = UNUSED_RR;
+            ReleaseRR(i);
             i = -1;
         }
         else
@@ -2067,6 +2328,7 @@ static void ReceiveRem(Layer layerIn)
         }
         gp->recvRec[i].reqId           = gp->reqId++;
     }
+    BindRR(i);
     gp->recvRec[i].apduSize = apduSize;
     memcpy(gp->recvRec[i].apdu, apduPtr, apduSize);
     /* Compute the recvTimer value to be used. */
@@ -2077,7 +2339,7 @@ static void ReceiveRem(Layer layerIn)
         );
     DeQueue(&gp->tsaInQ); /* Remove the item from queue. */
 
-    MsTimerSet(&gp->recvRec[i].recvTimer, recvTimerValue);
+    TMR_WheelStart(&gp->recvWheel, &gp->recvRec[i].recvTimer, recvTimerValue);
 
 	gp->recvRec[i].needAuth = pduPtr->auth;
 
@@ -2379,6 +2641,49 @@ static void Deliver(uint16 rrIndexIn)
     DebugMsg("Deliver: Packet has been delivered to the application layer.");
 }
 
+/*****************************************************************
+Function:  RRSrcHash
+Returns:   Bucket of the source address index for the given key.
+Reference: None
+Purpose:   To hash the fields that RetrieveRR matches on.
+Comments:  Group and broadcast subnet only take part for the address
+           modes in which RetrieveRR compares them.
+******************************************************************/
+static uint16 RRSrcHash(SourceAddress *srcAddrIn, Boolean priorityIn)
+{
+    Byte   subnetNode[sizeof(SubnetAddress)];
+    uint16 h;
+
+    memcpy(subnetNode, &srcAddrIn->subnetAddr, sizeof(SubnetAddress));
+    h = (uint16)((subnetNode[0] << 8) ^ subnetNode[1]);
+    h = (uint16)(h * 31 + srcAddrIn->dmn.domainIndex);
+    h = (uint16)(h * 31 + srcAddrIn->addressMode);
+    h = (uint16)(h * 31 + (priorityIn ? 1 : 0));
+    if (srcAddrIn->addressMode == BROADCAST)
+    {
+        h = (uint16)(h * 31 + srcAddrIn->broadcastSubnet);
+    }
+    else if (srcAddrIn->addressMode == MULTICAST)
+    {
+        h = (uint16)(h * 31 + srcAddrIn->group);
+    }
+    h ^= h >> 7;
+    return(h & (RECEIVE_TRANS_HASH_SIZE - 1));
+}
+
+/*****************************************************************
+Function:  RRReqHash
+Returns:   Bucket of the request id index for the given id.
+Reference: None
+Purpose:   To hash a request id.
+Comments:  Request ids are assigned sequentially, so the low bits
+           spread them well.
+******************************************************************/
+static uint16 RRReqHash(RequestId reqIdIn)
+{
+    return(reqIdIn & (RECEIVE_TRANS_HASH_SIZE - 1));
+}
+
 /*****************************************************************
 Function:  RetrieveRR
 Returns:   Index of RR Table that matches given input parameters.
@@ -2389,16 +2694,18 @@ Purpose:   To retrieve the receive record from the RR table
            we use priority, domainIndex, addressMode, and source address.
            We also match subnet if the message is broadcast
            or group if the message is multicast.
-Comments:  None
+Comments:  Only records in use are indexed. Chains are kept in index
+           order, so the lowest matching index is returned.
 ******************************************************************/
 static int16 RetrieveRR(SourceAddress srcAddrIn,
                         Boolean priorityIn)
 {
     int16 i;
 
-    /* Search through all the receive records for a match. */
-
-    for (i = 0; i < gp->recvRecCnt; i++)
+    /* Search through the receive records with this key's hash. */
+    for (i = gp->rrSrcHash[RRSrcHash(&srcAddrIn, priorityIn)];
+         i != -1;
+         i = gp->rrSrcNext[i])
     {
         if (
             priorityIn == gp->recvRec[i].priority
@@ -2423,16 +2730,11 @@ static int16 RetrieveRR(SourceAddress srcAddrIn,
         )
 
         {
-            break;
+            return(i); /* Found matching RR. */
         }
     }
 
-    if (i == gp->recvRecCnt)
-    {
-        return(-1); /* Matching RR was not found. */
-    }
-
-    return(i); /* Found matching RR. */
+    return(-1); /* Matching RR was not found. */
 }
 
 
@@ -2441,22 +2743,22 @@ Function:  AllocateRR
 Returns:   Index of RR table that can be used for a new msg.
 Reference: None
 Purpose:   To find an index in the RR table that is UNUSED.
-Comments:  None
+Comments:  The record is taken off the free list. The caller fills
+           in the record and then calls BindRR.
 ******************************************************************/
 static int16 AllocateRR(void)
 {
     int16 i;
 
-    /* First search for one which is unused. */
-    for (i = 0; i < gp->recvRecCnt; i++)
+    i = gp->rrFree;
+    if (i != -1)
     {
-        if (gp->recvRec[i].status == UNUSED_RR)
-        {
-            return(i); /* Found one that is unused. */
-        }
+        gp->rrFree       = gp->rrSrcNext[i];
+        gp->rrSrcNext[i] = RR_UNLINKED;
+        gp->rrReqNext[i] = RR_UNLINKED;
     }
 
-    return(-1);
+    return(i);
 }
 
 
@@ -2469,8 +2771,8 @@ Comments:  None
 static Bool FindRR(RequestId id, uint16 *pIndex)
 {
     Bool result = true;
-    uint16 i;
-	for (i = 0; i < gp->recvRecCnt; i++)
+    int16 i;
+	for (i = gp->rrReqHash[RRReqHash(id)]; i != -1; i = gp->rrReqNext[i])
 	{
 		if (gp->recvRec[i].status == SESSION_RR &&
 			gp->recvRec[i].reqId == id)
@@ -2478,6 +2780,10 @@ static Bool FindRR(RequestId id, uint16 *pIndex)
 			break;
 		}
 	}
+	if (i == -1)
+	{
+		i = gp->recvRecCnt;
+	}
 	if (i == gp->recvRecCnt ||
 			gp->recvRec[i].serviceType != REQUEST ||
 			gp->recvRec[i].transState != DELIVERED)
@@ -2489,6 +2795,130 @@ static Bool FindRR(RequestId id, uint16 *pIndex)
 }
 
 
+/*****************************************************************
+Function:  LinkRR
+Returns:   None
+Reference: None
+Purpose:   To insert a record into an index chain, keeping the
+           chain in index order.
+Comments:  None
+******************************************************************/
+static void LinkRR(int16 *headIn, int16 *nextIn, int16 rrIndexIn)
+{
+    int16 *linkPtr = headIn;
+
+    while (*linkPtr != -1 && *linkPtr < rrIndexIn)
+    {
+        linkPtr = &nextIn[*linkPtr];
+    }
+    nextIn[rrIndexIn] = *linkPtr;
+    *linkPtr          = rrIndexIn;
+}
+
+/*****************************************************************
+Function:  UnlinkRR
+Returns:   None
+Reference: None
+Purpose:   To remove a record from an index chain.
+Comments:  None
+******************************************************************/
+static void UnlinkRR(int16 *headIn, int16 *nextIn, int16 rrIndexIn)
+{
+    int16 *linkPtr = headIn;
+
+    while (*linkPtr != -1 && *linkPtr != rrIndexIn)
+    {
+        linkPtr = &nextIn[*linkPtr];
+    }
+    if (*linkPtr == rrIndexIn)
+    {
+        *linkPtr = nextIn[rrIndexIn];
+    }
+    nextIn[rrIndexIn] = RR_UNLINKED;
+}
+
+/*****************************************************************
+Function:  BindRR
+Returns:   None
+Reference: None
+Purpose:   To index a record that has just been (re)initialized by
+           its source address and, for session records, its reqId.
+Comments:  The record must not be indexed already. Call UnbindRR
+           before changing the key of a record in use.
+******************************************************************/
+static void BindRR(int16 rrIndexIn)
+{
+    ReceiveRecord *rrPtr = &gp->recvRec[rrIndexIn];
+
+    LinkRR(&gp->rrSrcHash[RRSrcHash(&rrPtr->srcAddr, rrPtr->priority)],
+           gp->rrSrcNext, rrIndexIn);
+    if (rrPtr->status == SESSION_RR && rrPtr->reqId != 0)
+    {
+        LinkRR(&gp->rrReqHash[RRReqHash(rrPtr->reqId)],
+               gp->rrReqNext, rrIndexIn);
+    }
+}
+
+/*****************************************************************
+Function:  UnbindRR
+Returns:   None
+Reference: None
+Purpose:   To remove a record from the source address and reqId
+           indices.
+Comments:  Uses the key currently in the record.
+******************************************************************/
+static void UnbindRR(int16 rrIndexIn)
+{
+    ReceiveRecord *rrPtr = &gp->recvRec[rrIndexIn];
+
+    if (gp->rrSrcNext[rrIndexIn] != RR_UNLINKED)
+    {
+        UnlinkRR(&gp->rrSrcHash[RRSrcHash(&rrPtr->srcAddr, rrPtr->priority)],
+                 gp->rrSrcNext, rrIndexIn);
+    }
+    if (gp->rrReqNext[rrIndexIn] != RR_UNLINKED)
+    {
+        UnlinkRR(&gp->rrReqHash[RRReqHash(rrPtr->reqId)],
+                 gp->rrReqNext, rrIndexIn);
+    }
+}
+
+/*****************************************************************
+Function:  ReleaseRR
+Returns:   None
+Reference: None
+Purpose:   To mark a record UNUSED and return it to the free list.
+Comments:  None
+******************************************************************/
+static void ReleaseRR(int16 rrIndexIn)
+{
+    gp->recvRec[rrIndexIn].status = UNUSED_RR;
+    TMR_WheelStop(&gp->recvWheel, &gp->recvRec[rrIndexIn].recvTimer);
+    UnbindRR(rrIndexIn);
+    gp->rrSrcNext[rrIndexIn] = gp->rrFree;
+    gp->rrFree               = rrIndexIn;
+}
+
+/*****************************************************************
+Function:  RecvTimerExpired
+Returns:   None
+Reference: None
+Purpose:   Called from the receive timer wheel for each receive
+           record whose timer has expired. Releases the record.
+Comments:  Both layers dispatch the wheel, so a session record can
+           be released by TPReceive and a transport record by
+           SNReceive.
+******************************************************************/
+static void RecvTimerExpired(TmrWheelTimer *timerIn, void *contextIn)
+{
+    ReceiveRecord *rrPtr = (ReceiveRecord *)((Byte *)timerIn -
+                           offsetof(ReceiveRecord, recvTimer));
+
+    DebugMsg("Receive timer expired.");
+    ReleaseRR((int16)(rrPtr - gp->recvRec));
+}
+
+
 /*****************************************************************
 Function:  ComputeRecvTimerValue
 Returns:   Receive Timer value in milli seconds.
@@ -2545,20 +2975,8 @@ Purpose:   To implement Send algorithm for the session layer.
            If there is any ongoing message, it might need some
            processing such as retry, timer expiry etc. This
            function will process such events too.
-Comments:  Update the priority transmit timer, if it exists.
-           Update the non-priority transmit timer, if it exists.
-           If the priority transmit timer expired then
-              process this event.
-           else if there is priority message to be sent and there is space
-                in priority queue of the network layer then
-              process the priority message.
-           else if the non-priority transmit timer expired then
-              process that event.
-           else if there is non-priority message to be sent and there is space
-                in non-priority queue of network layer then
-              process the non-priority message.
-           else
-                nothing to do. return.
+Comments:  Send a pending response, if any. Otherwise see
+           ServiceXmitRecs.
 Note:
 ******************************************************************/
 void SNSend(void)
@@ -2617,48 +3035,7 @@ void SNSend(void)
         return;
     }
 
-    /***************************************************
-      Priority transmit timer expired event.
-     **************************************************/
-    if (gp->priXmitRec.status == SESSION_TX && !MsTimerRunning(&gp->priXmitRec.xmitTimer))
-    {
-        XmitTimerExpiration(SESSION, TRUE);
-        return;
-    }
-    /***************************************************
-      Send a new priority message event.
-     **************************************************/
-    else if (gp->priXmitRec.status == UNUSED_TX &&
-             ! QueueEmpty(&gp->tsaOutPriQ)      &&
-             ! QueueFull(&gp->nwOutPriQ) )
-    {
-        SendNewMsg(SESSION, TRUE);
-        return;
-    }
-    /***************************************************
-      Non-priority timer expired event.
-      *************************************************/
-    else if (gp->xmitRec.status == SESSION_TX && !MsTimerRunning(&gp->xmitRec.xmitTimer))
-    {
-        XmitTimerExpiration(SESSION, FALSE);
-    }
-    /***************************************************
-      Send a new non-priority message.
-     **************************************************/
-    else if (gp->xmitRec.status == UNUSED_TX &&
-             ! QueueEmpty(&gp->tsaOutQ)      &&
-             ! QueueFull(&gp->nwOutQ) )
-    {
-        SendNewMsg(SESSION, FALSE);
-    }
-    else
-    {
-        /* Either there is no work or there is no space. */
-        return;
-    }
-
-    return;
-
+    ServiceXmitRecs(SESSION);
 }
 
 /*****************************************************************
@@ -2672,21 +3049,9 @@ void SNReceive(void)
 {
     TSAReceiveParam *tsaReceiveParamPtr;/* Param in tsa input queue.  */
     TSPDUPtr         spduInPtr;         /* Pointer to SPDU received. */
-    int16            i;
 
-    /* Update Receive Timers, if they do exist */
-    for (i = 0; i < gp->recvRecCnt; i++)
-    {
-        if (gp->recvRec[i].status == SESSION_RR)
-        {
-            if (MsTimerExpired(&gp->recvRec[i].recvTimer))
-            {
-                /* Timer expired. Release the receive record. */
-                DebugMsg("SNReceive: Receive timer expired.");
-                gp->recvRec[i].status = UNUSED_RR; /* Release the RR */
-            }
-        }
-    }
+    /* Release the receive records whose timers expired. */
+    TMR_WheelDispatch(&gp->recvWheel, RecvTimerExpired, NULL);
 	
     /* Check if there is SPDU to be processed. */
     if (QueueEmpty(&gp->tsaInQ))
@@ -3025,13 +3390,13 @@ static void SendReplyToChallenge(Boolean useOma)
     if (tsaReceiveParamPtr->priority)
     {
         nwQueuePtr = &gp->nwOutPriQ;
-        xmitRecPtr = &gp->priXmitRec;
     }
     else
     {
         nwQueuePtr = &gp->nwOutQ;
-        xmitRecPtr = &gp->xmitRec;
     }
+    xmitRecPtr = FindXmitRec(tsaReceiveParamPtr->priority, pduInPtr->transNum,
+                             UNUSED_TX, &tsaReceiveParamPtr->srcAddr);
 
 
     /* Make sure that this challenge for current transaction
@@ -3040,7 +3405,7 @@ static void SendReplyToChallenge(Boolean useOma)
        the group value in challenge msg, if present,
        does not match the one in transmit record. */
     if (
-        xmitRecPtr->status == UNUSED_TX ||
+        xmitRecPtr == NULL ||
         ! xmitRecPtr->auth ||
         pduInPtr->transNum != xmitRecPtr->transNum ||
         addrFmtToMode[pduInPtr->fmt] != xmitRecPtr->nwDestAddr.addressMode ||
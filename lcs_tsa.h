@@ -68,5 +68,7 @@ void SNReceive(void);
 void AuthSend(void);
 void AuthReceive(void);
 
+Boolean TSAPending(uint32 *remainingOut);
+
 #endif
 /*------------------------End of tsa.h------------------------*/
@@ -57,14 +57,21 @@
 #define PLATFORM_ID_EXP430	1  // EXP430 board
 #define PLATFORM_ID_IEM		2  // Our IEM board
 #define PLATFORM_ID_SIM		3  // Windows simulator
+#define PLATFORM_ID_LINUX	4  // Linux host process
 
+// May be set on the compiler command line, e.g. -DPLATFORM_ID=PLATFORM_ID_LINUX
+#ifndef PLATFORM_ID
 #define PLATFORM_ID PLATFORM_ID_SIM
+#endif
+
+// Platforms that run as a process on a host OS: no MSP430 peripherals, OS time and file backed flash
+#define PLATFORM_IS_HOST (PLATFORM_IS(SIM) || PLATFORM_IS(LINUX))
 
 #define PROCESSOR_ID_F5438	1  // EXP board processor
 #define PROCESSOR_ID_F5437	2  // Our initial IEM board processor
 #define PROCESSOR_ID_F5437A	3  // Our next rev processor (production)
 
-#if !defined(PROCESSOR_ID) && !PLATFORM_IS(SIM)		// Allow processor to be undefined for the simulator
+#if !defined(PROCESSOR_ID) && !PLATFORM_IS_HOST		// Allow processor to be undefined for the host platforms
 #error You must define PROCESSOR_ID
 #endif		
 
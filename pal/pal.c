@@ -28,7 +28,7 @@
 #include "pal.h"
 #include "pal_internal.h"
 #include "boot_util.h"
-#if !PLATFORM_IS(SIM)
+#if !PLATFORM_IS_HOST
 #include "MSP430.h"
 #endif
 
@@ -38,6 +38,65 @@ PalTypeCurPageEntry palCurPageTable[PAL_CUR_PAGE_TABLE_MAX_ENTRIES];
 
 PalNvmPageNum lastDynamicPageUsed = 0;
 
+// One bit per page of the dynamic area, set while the page holds the current
+// copy of some block type, is in the erased pool or is a summary page.
+// Superseded pages are free for reuse.
+#define PAL_DYN_AREA_NUM_PAGES (PAL_PART_LAST_PAGE - PAL_PART_DYN_AREA_START_PAGE + 1)
+static UInt8 palPageUsedMap[(PAL_DYN_AREA_NUM_PAGES + 7) / 8];
+
+// Pages written after the newest summary: the erased pool when it was written, the
+// pages written before the next summary and a refilled pool, plus the in-use pages skipped over
+#define PAL_SUMMARY_TAIL_PAGES (PAL_ERASED_POOL_SIZE + PAL_SUMMARY_INTERVAL + PAL_ERASED_POOL_SIZE + \
+								PAL_CUR_PAGE_TABLE_MAX_ENTRIES * PAL_MAX_BLOCK_PAGES + PAL_SUMMARY_NUM_PAGES)
+
+static PalNvmPageNum palSummaryPage = 0;
+static PalPageSeqNum palSummarySeqNum = PAL_SEQ_NUM_INVALID;
+static UInt16 palWritesSinceSummary = 0;
+static UInt8 palSummaryTries = 0;
+
+// Oldest first, which is also the order they come up in the dynamic area
+static PalErasedPage palErasedPool[PAL_ERASED_POOL_SIZE];
+static UInt8 palErasedPoolCount = 0;
+
+// Piece of the current page compared at a time when looking for an unchanged block
+#define PAL_COMPARE_CHUNK_SIZE 32
+
+// Writes queued by PAL_ExtQueueNvmBlockByType(), oldest first, and the one under way.
+// A queued write that fails is tried again up to PAL_WRITE_MAX_TRIES times in all, and the
+// error of one that is given up is kept for PAL_ExtFlushNvm().
+#define PAL_NVM_DONE_TIMEOUT 100	// ms
+#define PAL_WRITE_MAX_TRIES 3
+static PalQueuedWrite palWriteQueue[PAL_WRITE_QUEUE_SIZE];
+static UInt8 palWriteQueueCount = 0;
+static PalBlockWrite palCurWrite;
+static EchErr palWriteError = ECHERR_OK;
+
+static PalBlockStream palStream;
+
+static void PAL_ClearPageUsedMap(void);
+static Bool PAL_TakeErasedPage(PalNvmPageNum *pPageNum, UInt16 *pEraseCount);
+static UInt16 PAL_ExtReadEraseCount(const PalNvmPageNum page);
+static EchErr PAL_ExtStartBlockWrite(const PalQueuedWrite *pBlock);
+static EchErr PAL_ExtContinueBlockWrite(void);
+static void PAL_ExtFinishBlockWrite(void);
+static void PAL_ExtAdvanceWrites(void);
+static void PAL_ExtRetryWrite(const PalQueuedWrite *pBlock, const EchErr err);
+static Bool PAL_ExtBlockUnchanged(const PalQueuedWrite *pBlock, const PalTypeCurPageEntry *pEntry);
+static void PAL_ExtDropQueuedWrite(const PalBlockType blockType);
+static void PAL_ExtWaitForCurWrite(void);
+static EchErr PAL_ExtWriteLongBlock(const PalQueuedWrite *pBlock);
+static EchErr PAL_ExtTakeWritablePage(PalNvmPageNum *pPageNum, UInt16 *pEraseCount);
+static void PAL_ExtReleaseStreamPages(void);
+static void PAL_ExtMarkBlockPages(const PalTypeCurPageEntry *pEntry, const Bool inUse);
+static UInt8 PAL_ExtHeadNumPages(const PalPageHdr *pPageHdr, const PalNvmPageNum page);
+static UInt8 PAL_ExtBlockDataPos(const UInt8 numPages, const UInt16 blockOffset, UInt16 *pPageOffset, UInt16 *pRoom);
+static EchErr PAL_ExtLoadSummary(void);
+static void PAL_ExtWriteDueSummary(void);
+static EchErr PAL_ExtInvalidateSummaries(void);
+static EchErr PAL_ExtScanPageRange(PalNvmPageNum page, UInt16 numPages, PalNvmPageNum *pLastTaken);
+static void PAL_ExtMarkCurrentPages(void);
+static UInt16 PAL_ComputeCrc(const void *pData, UInt16 len);
+
 const PalPartitionTable palPartitionTable =
 {
 	PAL_PART_LOG_AREA_START_PAGE,
@@ -53,7 +112,7 @@ EchErr PAL_Init(void)
 {
 	EchErr sts = ECHERR_OK;
 	
-#if !PLATFORM_IS(SIM)
+#if !PLATFORM_IS_HOST
 // FB: DEBUG: send MCLK to pin 25 (TP28)
 //P2SEL |= (BIT0);	// config as clock
 //P2DIR |= (BIT0);	// send MCLK
@@ -64,7 +123,7 @@ P2OUT &= ~(BIT0);	// set bit to zero
 //P2OUT |= (BIT0);	// set bit to one
 #endif
 
-#if PLATFORM_IS(SIM)
+#if PLATFORM_IS_HOST
 	PAL_SimInit();
 #else
 	PAL_SpiInit();
@@ -78,72 +137,733 @@ P2OUT &= ~(BIT0);	// set bit to zero
 // Used for periodic refresh
 void PAL_IoRefresh(void)
 {
-#if !PLATFORM_IS(SIM)
+#if !PLATFORM_IS_HOST
 	PAL_SpiInit();
 #endif
 }
 
-EchErr PAL_ExtWriteNvmBlockByType(const void *pBlockData, const UInt16 len, const PalBlockType blockType)
-{
+// Write a block and wait for it. Any queued write of the same type is older, so it is dropped.
+EchErr PAL_ExtWriteNvmBlockByType(const void *pBlockData, const UInt16 len, const PalBlockType blockType)
+{
+	EchErr sts = ECHERR_OK;
+	PalQueuedWrite block;
+
+	block.pBlockData = pBlockData;
+	block.len = len;
+	block.blockType = blockType;
+	block.tries = 0;
+
+	if ((len > PAL_MAX_BLOCK_SIZE) || (len == 0))
+	{
+		sts = ECHERR_INVALID_PARAM;
+	}
+	else if (len > PAL_EXT_BLOCK_SIZE)
+	{
+		sts = PAL_ExtWriteLongBlock(&block);
+	}
+	else if (palStream.isOpen)
+	{
+		sts = ECHERR_ALREADY_OPEN;
+	}
+	else
+	{
+		PAL_ExtDropQueuedWrite(blockType);
+		PAL_ExtWaitForCurWrite();
+
+		sts = PAL_ExtStartBlockWrite(&block);
+		if ((sts == ECHERR_OK) && (palCurWrite.state == PAL_WRITE_DATA))
+		{
+			sts = PAL_ExtContinueBlockWrite();
+		}
+		if (sts == ECHERR_OK)
+		{
+			PAL_ExtFinishBlockWrite();
+
+			if (palWritesSinceSummary >= PAL_SUMMARY_INTERVAL)
+			{
+				PAL_ExtWriteDueSummary();
+			}
+		}
+	}
+	return sts;
+}
+
+static void PAL_ExtDropQueuedWrite(const PalBlockType blockType)
+{
+	UInt8 i;
+
+	for (i = 0; (i < palWriteQueueCount) && (palWriteQueue[i].blockType != blockType); i++)
+	{
+	}
+	if (i < palWriteQueueCount)
+	{
+		palWriteQueueCount--;
+		for (; i < palWriteQueueCount; i++)
+		{
+			palWriteQueue[i] = palWriteQueue[i + 1];
+		}
+	}
+}
+
+static void PAL_ExtWaitForCurWrite(void)
+{
+	while (palCurWrite.state != PAL_WRITE_IDLE)
+	{
+		PAL_ExtWaitForNvmDone(PAL_NVM_DONE_TIMEOUT);
+		PAL_ExtAdvanceWrites();
+	}
+}
+
+// Write a block longer than a page in one go
+static EchErr PAL_ExtWriteLongBlock(const PalQueuedWrite *pBlock)
+{
+	EchErr sts;
+
+	sts = PAL_ExtOpenNvmBlockWrite(pBlock->len, pBlock->blockType);
+	if (sts == ECHERR_OK)
+	{
+		sts = PAL_ExtWriteNvmBlockData(pBlock->pBlockData, pBlock->len);
+	}
+	if (sts == ECHERR_OK)
+	{
+		sts = PAL_ExtCloseNvmBlockWrite();
+	}
+	return sts;
+}
+
+// Start writing a block of up to PAL_MAX_BLOCK_SIZE bytes, which is then supplied in pieces by
+// PAL_ExtWriteNvmBlockData(). The pages are taken and the other pages' headers written here.
+// Until PAL_ExtCloseNvmBlockWrite() the old copy of the block stays current.
+EchErr PAL_ExtOpenNvmBlockWrite(const UInt16 len, const PalBlockType blockType)
+{
+	EchErr sts = ECHERR_OK;
+	PalBlockStream *pStream;
+	PalPageHdr pageHdr;
+	UInt16 eraseCount;
+	UInt8 i;
+
+	pStream = &palStream;
+	if (pStream->isOpen)
+	{
+		sts = ECHERR_ALREADY_OPEN;
+	}
+	else if ((len > PAL_MAX_BLOCK_SIZE) || (len == 0))
+	{
+		sts = ECHERR_INVALID_PARAM;
+	}
+	else
+	{
+		PAL_ExtDropQueuedWrite(blockType);
+		PAL_ExtWaitForCurWrite();
+		sts = PAL_ExtFindCreateBlockTypeEntry(blockType, &pStream->pEntry);
+	}
+
+	if (sts == ECHERR_OK)
+	{
+		pStream->isOpen = TRUE;
+		pStream->len = len;
+		pStream->offset = 0;
+		pStream->list.numPages = 0;
+		pStream->list.reserved = 0xFF;
+		pageHdr.blockType = blockType;
+		pageHdr.flags = (UInt8)~PAL_PAGE_HDR_FLAG_HEAD;
+		pageHdr.seqNum = PAL_IncrementSeqNum(pStream->pEntry->seqNum);
+		pStream->headHdr = pageHdr;
+		pStream->headHdr.flags = 0xFF;
+
+		sts = PAL_ExtTakeWritablePage(&pStream->headPage, &pStream->headHdr.eraseCount);
+		if ((sts == ECHERR_OK) && (len > PAL_EXT_BLOCK_SIZE))
+		{
+			pStream->headHdr.flags = (UInt8)~PAL_PAGE_HDR_FLAG_SINGLE;
+			pStream->list.numPages = 1;
+			i = 2 + (len - PAL_EXT_HEAD_DATA_SIZE - 1) / PAL_EXT_BLOCK_SIZE;
+			while ((sts == ECHERR_OK) && (pStream->list.numPages < i))
+			{
+				sts = PAL_ExtTakeWritablePage(&pStream->list.pages[pStream->list.numPages - 1], &eraseCount);
+				if (sts == ECHERR_OK)
+				{
+					pageHdr.eraseCount = eraseCount;
+					PAL_FillHeaderCrc(&pageHdr);
+					pStream->list.numPages++;
+					sts = PAL_ExtWritePageMasked(&pageHdr, 0, sizeof(PalPageHdr), pStream->list.pages[pStream->list.numPages - 2]);
+				}
+			}
+			for (i = pStream->list.numPages - 1; i < PAL_MAX_BLOCK_PAGES - 1; i++)
+			{
+				pStream->list.pages[i] = 0xFFFF;
+			}
+			if (sts == ECHERR_OK)
+			{
+				sts = PAL_ExtWritePageMasked(&pStream->list, sizeof(PalPageHdr), sizeof(PalBlockPageList), pStream->headPage);
+			}
+		}
+		else if (sts == ECHERR_OK)
+		{
+			pStream->list.numPages = 1;
+		}
+		if (sts != ECHERR_OK)
+		{
+			PAL_ExtReleaseStreamPages();
+		}
+	}
+	return sts;
+}
+
+// Supply the next piece of the block data
+EchErr PAL_ExtWriteNvmBlockData(const void *pData, const UInt16 len)
+{
+	EchErr sts = ECHERR_OK;
+	PalBlockStream *pStream;
+	const UInt8 *pByte;
+	UInt16 left;
+	UInt16 pageOffset;
+	UInt16 room;
+	UInt8 index;
+
+	pStream = &palStream;
+	pByte = (const UInt8 *)pData;
+	left = len;
+	if (!pStream->isOpen)
+	{
+		sts = ECHERR_NOT_OPEN;
+	}
+	else if (left > pStream->len - pStream->offset)
+	{
+		sts = ECHERR_INVALID_LENGTH;
+	}
+	while ((sts == ECHERR_OK) && (left != 0))
+	{
+		index = PAL_ExtBlockDataPos(pStream->list.numPages, pStream->offset, &pageOffset, &room);
+		if (room > left)
+		{
+			room = left;
+		}
+		sts = PAL_ExtWritePageMasked(pByte, pageOffset, room,
+									 (index == 0) ? pStream->headPage : pStream->list.pages[index - 1]);
+		pByte += room;
+		left -= room;
+		pStream->offset += room;
+	}
+	if ((sts != ECHERR_OK) && pStream->isOpen)
+	{
+		PAL_ExtReleaseStreamPages();
+	}
+	return sts;
+}
+
+// Commit the block by writing its first page's header, once all the data has been written
+EchErr PAL_ExtCloseNvmBlockWrite(void)
+{
+	EchErr sts = ECHERR_OK;
+	PalBlockStream *pStream;
+	PalTypeCurPageEntry *pEntry;
+
+	pStream = &palStream;
+	if (!pStream->isOpen)
+	{
+		sts = ECHERR_NOT_OPEN;
+	}
+	else if (pStream->offset != pStream->len)
+	{
+		sts = ECHERR_UNDERFLOW;
+	}
+	else
+	{
+		PAL_FillHeaderCrc(&pStream->headHdr);
+		sts = PAL_ExtWritePageMasked(&pStream->headHdr, 0, sizeof(PalPageHdr), pStream->headPage);
+		if (sts != ECHERR_OK)
+		{
+			PAL_ExtReleaseStreamPages();
+		}
+		else
+		{
+			// The new pages are already marked in use
+			pEntry = pStream->pEntry;
+			if (pEntry->seqNum != PAL_SEQ_NUM_INVALID)
+			{
+				PAL_ExtMarkBlockPages(pEntry, FALSE);
+			}
+			pEntry->curPageNum = pStream->headPage;
+			pEntry->seqNum = pStream->headHdr.seqNum;
+			pEntry->numPages = pStream->list.numPages;
+			pStream->isOpen = FALSE;
+
+			palWritesSinceSummary += pStream->list.numPages;
+			if (palWritesSinceSummary >= PAL_SUMMARY_INTERVAL)
+			{
+				PAL_ExtWriteDueSummary();
+			}
+		}
+	}
+	return sts;
+}
+
+// Give back the pages of a block write that won't be committed
+static void PAL_ExtReleaseStreamPages(void)
+{
+	UInt8 i;
+
+	if (palStream.list.numPages != 0)
+	{
+		PAL_MarkPageInUse(palStream.headPage, FALSE);
+		for (i = 0; i < palStream.list.numPages - 1; i++)
+		{
+			PAL_MarkPageInUse(palStream.list.pages[i], FALSE);
+		}
+	}
+	palStream.isOpen = FALSE;
+}
+
+// A page ready to program, from the erased pool or else erased now
+static EchErr PAL_ExtTakeWritablePage(PalNvmPageNum *pPageNum, UInt16 *pEraseCount)
+{
+	EchErr sts = ECHERR_OK;
+
+	if (!PAL_TakeErasedPage(pPageNum, pEraseCount))
+	{
+		*pPageNum = PAL_GetNextFreePageNum();
+		*pEraseCount = PAL_ExtReadEraseCount(*pPageNum);
+		sts = PAL_ExtErasePage(*pPageNum);
+		if (sts == ECHERR_OK)
+		{
+			PAL_MarkPageInUse(*pPageNum, TRUE);
+		}
+	}
+	return sts;
+}
+
+// Where a byte of a block is: returns the index of its page within the block, and gives its
+// offset in that page and how many bytes of the block follow it there
+static UInt8 PAL_ExtBlockDataPos(const UInt8 numPages, const UInt16 blockOffset, UInt16 *pPageOffset, UInt16 *pRoom)
+{
+	UInt8 index;
+	UInt16 offset;
+
+	if (numPages <= 1)
+	{
+		index = 0;
+		*pPageOffset = sizeof(PalPageHdr) + blockOffset;
+		*pRoom = PAL_EXT_BLOCK_SIZE - blockOffset;
+	}
+	else if (blockOffset < PAL_EXT_HEAD_DATA_SIZE)
+	{
+		index = 0;
+		*pPageOffset = sizeof(PalPageHdr) + sizeof(PalBlockPageList) + blockOffset;
+		*pRoom = PAL_EXT_HEAD_DATA_SIZE - blockOffset;
+	}
+	else
+	{
+		offset = blockOffset - PAL_EXT_HEAD_DATA_SIZE;
+		index = 1 + offset / PAL_EXT_BLOCK_SIZE;
+		*pPageOffset = sizeof(PalPageHdr) + offset % PAL_EXT_BLOCK_SIZE;
+		*pRoom = PAL_EXT_BLOCK_SIZE - offset % PAL_EXT_BLOCK_SIZE;
+	}
+	return index;
+}
+
+// Mark the pages of the current copy of a block
+static void PAL_ExtMarkBlockPages(const PalTypeCurPageEntry *pEntry, const Bool inUse)
+{
+	PalBlockPageList list;
+	UInt8 i;
+
+	PAL_MarkPageInUse(pEntry->curPageNum, inUse);
+	if ((pEntry->numPages > 1) &&
+		(PAL_ExtReadPageMasked(&list, sizeof(PalPageHdr), sizeof(list), pEntry->curPageNum) == ECHERR_OK))
+	{
+		for (i = 0; (i < list.numPages - 1) && (i < PAL_MAX_BLOCK_PAGES - 1); i++)
+		{
+			PAL_MarkPageInUse(list.pages[i], inUse);
+		}
+	}
+}
+
+// Pages of the block whose first page this is
+static UInt8 PAL_ExtHeadNumPages(const PalPageHdr *pPageHdr, const PalNvmPageNum page)
+{
+	PalBlockPageList list;
+	UInt8 numPages = 1;
+
+	if (!(pPageHdr->flags & PAL_PAGE_HDR_FLAG_SINGLE) &&
+		(PAL_ExtReadPageMasked(&list, sizeof(PalPageHdr), sizeof(list), page) == ECHERR_OK) &&
+		(list.numPages <= PAL_MAX_BLOCK_PAGES))
+	{
+		numPages = list.numPages;
+	}
+	return numPages;
+}
+
+// Queue a block write and return at once. The data must stay valid until the write is done;
+// it is read when the write starts, so a later change to it is picked up until then and a
+// second write of the same type replaces the first. PAL_ExtServiceNvm() does the work.
+EchErr PAL_ExtQueueNvmBlockByType(const void *pBlockData, const UInt16 len, const PalBlockType blockType)
+{
+	EchErr sts = ECHERR_OK;
+	UInt8 i;
+
+	if ((len > PAL_MAX_BLOCK_SIZE) || (len == 0))
+	{
+		sts = ECHERR_INVALID_PARAM;
+	}
+	else
+	{
+		for (i = 0; (i < palWriteQueueCount) && (palWriteQueue[i].blockType != blockType); i++)
+		{
+		}
+		if (i < palWriteQueueCount)
+		{
+			palWriteQueue[i].pBlockData = pBlockData;
+			palWriteQueue[i].len = len;
+		}
+		else if (palWriteQueueCount >= PAL_WRITE_QUEUE_SIZE)
+		{
+			sts = ECHERR_OVERFLOW;
+		}
+		else
+		{
+			palWriteQueue[palWriteQueueCount].pBlockData = pBlockData;
+			palWriteQueue[palWriteQueueCount].len = len;
+			palWriteQueue[palWriteQueueCount].blockType = blockType;
+			palWriteQueue[palWriteQueueCount].tries = 0;
+			palWriteQueueCount++;
+		}
+	}
+	return sts;
+}
+
+// Call from the scheduler. Starts at most one flash operation, and never waits on the flash.
+// When there is nothing queued, free pages are erased ahead.
+void PAL_ExtServiceNvm(void)
+{
+	if (!palStream.isOpen && !PAL_ExtIsNvmBusy())
+	{
+		PAL_ExtAdvanceWrites();
+	}
+}
+
+// True while PAL_ExtServiceNvm() has flash work to do: a write queued or in progress, or free
+// pages still to be erased ahead. An open stream holds the work back, so it isn't counted.
+Bool PAL_ExtNvmWorkPending(void)
+{
+	return !palStream.isOpen &&
+		((palCurWrite.state != PAL_WRITE_IDLE) || (palWriteQueueCount != 0) ||
+		 (palWritesSinceSummary >= PAL_SUMMARY_INTERVAL) || (palErasedPoolCount < PAL_ERASED_POOL_SIZE));
+}
+
+// Complete all queued writes, e.g. before a reset. Returns the error of any queued write
+// that had to be given up since the last flush.
+EchErr PAL_ExtFlushNvm(void)
+{
+	EchErr sts = ECHERR_OK;
+
+	while ((sts == ECHERR_OK) && ((palCurWrite.state != PAL_WRITE_IDLE) || (palWriteQueueCount != 0)))
+	{
+		sts = PAL_ExtWaitForNvmDone(PAL_NVM_DONE_TIMEOUT);
+		PAL_ExtAdvanceWrites();
+	}
+	if (sts == ECHERR_OK)
+	{
+		sts = palWriteError;
+	}
+	palWriteError = ECHERR_OK;
+	return sts;
+}
+
+// Queue a failed write again, unless a newer image has been queued meanwhile. A write that
+// can't succeed, or has failed too often, is dropped.
+static void PAL_ExtRetryWrite(const PalQueuedWrite *pBlock, const EchErr err)
+{
+	UInt8 i;
+
+	for (i = 0; (i < palWriteQueueCount) && (palWriteQueue[i].blockType != pBlock->blockType); i++)
+	{
+	}
+	if (i < palWriteQueueCount)
+	{
+		// The newer image replaces this one
+	}
+	else if ((err == ECHERR_OVERFLOW) || (err == ECHERR_INVALID_PARAM) ||
+			 (pBlock->tries + 1 >= PAL_WRITE_MAX_TRIES) || (palWriteQueueCount >= PAL_WRITE_QUEUE_SIZE))
+	{
+		palWriteError = err;
+	}
+	else
+	{
+		palWriteQueue[palWriteQueueCount] = *pBlock;
+		palWriteQueue[palWriteQueueCount].tries++;
+		palWriteQueueCount++;
+	}
+}
+
+// Take the next step of the queued writes. The flash must not be busy.
+static void PAL_ExtAdvanceWrites(void)
+{
+	PalQueuedWrite block;
+	EchErr sts;
+	UInt8 i;
+
+	switch (palCurWrite.state)
+	{
+	case PAL_WRITE_DATA:
+		sts = PAL_ExtContinueBlockWrite();
+		if (sts != ECHERR_OK)
+		{
+			PAL_ExtRetryWrite(&palCurWrite.block, sts);
+		}
+		break;
+
+	case PAL_WRITE_PAGE:
+		PAL_ExtFinishBlockWrite();
+		break;
+
+	case PAL_WRITE_IDLE:
+	default:
+		if (palWritesSinceSummary >= PAL_SUMMARY_INTERVAL)
+		{
+			PAL_ExtWriteDueSummary();
+		}
+		else if (palWriteQueueCount != 0)
+		{
+			block = palWriteQueue[0];
+			palWriteQueueCount--;
+			for (i = 0; i < palWriteQueueCount; i++)
+			{
+				palWriteQueue[i] = palWriteQueue[i + 1];
+			}
+			// A block longer than a page is written in one go, so that its data can't change
+			// part way through
+			sts = (block.len > PAL_EXT_BLOCK_SIZE) ? PAL_ExtWriteLongBlock(&block) : PAL_ExtStartBlockWrite(&block);
+			if (sts != ECHERR_OK)
+			{
+				PAL_ExtRetryWrite(&block, sts);
+			}
+		}
+		else
+		{
+			PAL_ExtReclaimStep();
+		}
+		break;
+	}
+}
+
+// Start programming a block into a new page. This is the only step that reads the block data.
+static EchErr PAL_ExtStartBlockWrite(const PalQueuedWrite *pBlock)
+{
+	EchErr sts = ECHERR_OK;
+	PalPageHdr *pPageHdr;
+
+	sts = PAL_ExtFindCreateBlockTypeEntry(pBlock->blockType, &palCurWrite.pEntry);
+
+	if (sts == ECHERR_OK)
+	{
+		palCurWrite.block = *pBlock;
+		pPageHdr = &palCurWrite.pageHdr;
+		pPageHdr->blockType = pBlock->blockType;
+		pPageHdr->flags = 0xFF;
+		pPageHdr->seqNum = PAL_IncrementSeqNum(palCurWrite.pEntry->seqNum);
+
+		if (PAL_ExtBlockUnchanged(pBlock, palCurWrite.pEntry))
+		{
+			// Nothing to program; the current page stays current
+			palCurWrite.page = palCurWrite.pEntry->curPageNum;
+			palCurWrite.state = PAL_WRITE_PAGE;
+		}
+		else
+		{
+			// Erased ahead if possible, so this is only a program. Either way the header goes
+			// last, so a torn write leaves no valid page.
+			sts = PAL_ExtTakeWritablePage(&palCurWrite.page, &pPageHdr->eraseCount);
+			if (sts == ECHERR_OK)
+			{
+				PAL_FillHeaderCrc(pPageHdr);
+				sts = PAL_ExtWritePageMasked(pBlock->pBlockData, sizeof(PalPageHdr), pBlock->len, palCurWrite.page);
+				if (sts == ECHERR_OK)
+				{
+					palCurWrite.state = PAL_WRITE_DATA;
+				}
+				else
+				{
+					// Let the reclaimer have it again
+					PAL_MarkPageInUse(palCurWrite.page, FALSE);
+				}
+			}
+		}
+	}
+	return sts;
+}
+
+// True when the current page already holds this data, so the write can be skipped.
+// A changed block always goes to a new page and is committed by its header there: the
+// current copy is never programmed again, since a torn program of it could not be detected.
+static Bool PAL_ExtBlockUnchanged(const PalQueuedWrite *pBlock, const PalTypeCurPageEntry *pEntry)
+{
+	EchErr sts = ECHERR_OK;
+	UInt8 oldData[PAL_COMPARE_CHUNK_SIZE];
+	const UInt8 *pNewData;
+	UInt16 offset;
+	UInt16 chunkLen;
+	UInt16 i;
+
+	if ((pEntry->seqNum == PAL_SEQ_NUM_INVALID) || (pEntry->numPages > 1))
+	{
+		return FALSE;
+	}
+
+	pNewData = (const UInt8 *)pBlock->pBlockData;
+	for (offset = 0; (sts == ECHERR_OK) && (offset < pBlock->len); offset += chunkLen)
+	{
+		chunkLen = pBlock->len - offset;
+		if (chunkLen > PAL_COMPARE_CHUNK_SIZE)
+		{
+			chunkLen = PAL_COMPARE_CHUNK_SIZE;
+		}
+		sts = PAL_ExtReadPageMasked(oldData, sizeof(PalPageHdr) + offset, chunkLen, pEntry->curPageNum);
+		for (i = 0; (sts == ECHERR_OK) && (i < chunkLen); i++)
+		{
+			if (pNewData[offset + i] != oldData[i])
+			{
+				sts = ECHERR_NOT_FOUND;
+			}
+		}
+	}
+	return (sts == ECHERR_OK);
+}
+
+// Program the header after the data
+static EchErr PAL_ExtContinueBlockWrite(void)
+{
+	EchErr sts;
+
+	sts = PAL_ExtWritePageMasked(&palCurWrite.pageHdr, 0, sizeof(PalPageHdr), palCurWrite.page);
+	if (sts == ECHERR_OK)
+	{
+		palCurWrite.state = PAL_WRITE_PAGE;
+	}
+	else
+	{
+		PAL_MarkPageInUse(palCurWrite.page, FALSE);
+		palCurWrite.state = PAL_WRITE_IDLE;
+	}
+	return sts;
+}
+
+// Make the new page the current one
+static void PAL_ExtFinishBlockWrite(void)
+{
+	PalTypeCurPageEntry *pEntry;
+
+	pEntry = palCurWrite.pEntry;
+	palCurWrite.state = PAL_WRITE_IDLE;
+
+	// Nothing moves when the data was unchanged
+	if ((pEntry->seqNum != PAL_SEQ_NUM_INVALID) && (pEntry->curPageNum == palCurWrite.page))
+	{
+		return;
+	}
+
+	// The old copy stays valid on the flash until the new one is written
+	if (pEntry->seqNum != PAL_SEQ_NUM_INVALID)
+	{
+		PAL_ExtMarkBlockPages(pEntry, FALSE);
+	}
+	PAL_MarkPageInUse(palCurWrite.page, TRUE);
+	pEntry->curPageNum = palCurWrite.page;
+	pEntry->seqNum = palCurWrite.pageHdr.seqNum;
+	pEntry->numPages = 1;
+	palWritesSinceSummary++;
+}
+
+EchErr PAL_ExtReadNvmBlockByType(void *pBlockData, const UInt16 len, const PalBlockType blockType)
+{		
 	EchErr sts = ECHERR_OK;
-	PalPageHdr pageHdr;
-	PalNvmPageNum nextPageNum;
 	PalTypeCurPageEntry *pEntry;
+	PalPageHdr pageHdr;
 
-	if ((len > PAL_EXT_BLOCK_SIZE) || (len == 0))
+	if ((len > PAL_MAX_BLOCK_SIZE) || (len == 0))
 	{
 		sts = ECHERR_INVALID_PARAM;
 	}
 	else
 	{
-		sts = PAL_ExtFindCreateBlockTypeEntry(blockType, &pEntry);
+		sts = PAL_ExtFindBlockTypeEntry(blockType, &pEntry);
 
-		if (sts == ECHERR_OK)
+		if ((sts == ECHERR_OK) && ((pEntry->numPages > 1) || (len > PAL_EXT_BLOCK_SIZE)))
 		{
-			pageHdr.blockType = blockType;
-			pageHdr.flags = 0xFF;
-			nextPageNum = PAL_GetNextFreePageNum();
-			pageHdr.seqNum = PAL_IncrementSeqNum(pEntry->seqNum);
-			pageHdr.reserved = 0xFFFF;
-
-			PAL_FillHeaderCrc(&pageHdr);
-
-			sts = PAL_ExtWritePageSplit(&pageHdr, pBlockData, len, nextPageNum, 0);
+			sts = PAL_ExtReadNvmBlockAt(pBlockData, 0, len, blockType);
+		}
+		else if (sts == ECHERR_OK)
+		{
+			sts = PAL_ExtReadPageSplit(&pageHdr, pBlockData, len, pEntry->curPageNum);
 			if (sts == ECHERR_OK)
 			{
-				pEntry->curPageNum = nextPageNum;
-				pEntry->seqNum = pageHdr.seqNum;
+				if (!PAL_ValidateHdrCrc(&pageHdr) || (pageHdr.blockType != blockType))
+				{
+					sts = ECHERR_DATA_INTEGRITY;
+					// FB: Do we try to recover from this at all?
+				}
 			}
 		}
 	}
 	return sts;
 }
 
-EchErr PAL_ExtReadNvmBlockByType(void *pBlockData, const UInt16 len, const PalBlockType blockType)
-{		
+// Read part of a block, which may be spread over several pages
+EchErr PAL_ExtReadNvmBlockAt(void *pData, const UInt16 offset, const UInt16 len, const PalBlockType blockType)
+{
 	EchErr sts = ECHERR_OK;
 	PalTypeCurPageEntry *pEntry;
 	PalPageHdr pageHdr;
+	PalBlockPageList list;
+	UInt8 *pByte;
+	UInt16 blockOffset;
+	UInt16 left;
+	UInt16 pageOffset;
+	UInt16 room;
+	UInt8 index;
 
-	if ((len > PAL_EXT_BLOCK_SIZE) || (len == 0))
+	if ((len == 0) || (offset + (UInt32)len > PAL_MAX_BLOCK_SIZE))
 	{
 		sts = ECHERR_INVALID_PARAM;
 	}
 	else
 	{
 		sts = PAL_ExtFindBlockTypeEntry(blockType, &pEntry);
+	}
+	if (sts == ECHERR_OK)
+	{
+		sts = PAL_ExtReadPageHdr(&pageHdr, pEntry->curPageNum);
+		if ((sts == ECHERR_OK) && (!PAL_ValidateHdrCrc(&pageHdr) || (pageHdr.blockType != blockType)))
+		{
+			sts = ECHERR_DATA_INTEGRITY;
+		}
+	}
+	if ((sts == ECHERR_OK) && (pEntry->numPages > 1))
+	{
+		sts = PAL_ExtReadPageMasked(&list, sizeof(PalPageHdr), sizeof(list), pEntry->curPageNum);
+	}
 
-		if (sts == ECHERR_OK)
+	pByte = (UInt8 *)pData;
+	blockOffset = offset;
+	left = len;
+	while ((sts == ECHERR_OK) && (left != 0))
+	{
+		index = PAL_ExtBlockDataPos(pEntry->numPages, blockOffset, &pageOffset, &room);
+		if ((index >= PAL_MAX_BLOCK_PAGES) || ((index != 0) && (index >= list.numPages)))
 		{
-			sts = PAL_ExtReadPageSplit(&pageHdr, pBlockData, len, pEntry->curPageNum);
-			if (sts == ECHERR_OK)
+			// Past the end of the block
+			sts = ECHERR_OUT_OF_RANGE;
+		}
+		else
+		{
+			if (room > left)
 			{
-				if (!PAL_ValidateHdrCrc(&pageHdr))
-				{
-					sts = ECHERR_DATA_INTEGRITY;
-					// FB: Do we try to recover from this at all?
-				}
+				room = left;
 			}
+			sts = PAL_ExtReadPageMasked(pByte, pageOffset, room,
+										(index == 0) ? pEntry->curPageNum : list.pages[index - 1]);
+			pByte += room;
+			blockOffset += room;
+			left -= room;
 		}
 	}
 	return sts;
@@ -156,15 +876,66 @@ EchErr PAL_ExtScanForCurrentPages(void)
 	EchErr sts = ECHERR_OK;
 	PalNvmPageNum page;
 	PalNvmPageNum maxPage;
-	PalPageHdr pageHdr;
-	PalTypeCurPageEntry *pEntry;
+	PalNvmPageNum lastTaken;
+	PalNvmPageNum highestCurPage;
 
 	maxPage = palPartitionTable.lastPage;
+	highestCurPage = 0;
+	palWritesSinceSummary = 0;
+	PAL_ClearPageUsedMap();
+
+	if (PAL_ExtLoadSummary() == ECHERR_OK)
+	{
+		// Only the pages written since the summary can hold newer copies
+		sts = PAL_ExtScanPageRange(lastDynamicPageUsed + 1,
+								   (PAL_SUMMARY_TAIL_PAGES < PAL_DYN_AREA_NUM_PAGES) ? PAL_SUMMARY_TAIL_PAGES : PAL_DYN_AREA_NUM_PAGES,
+								   &lastTaken);
+		PAL_ExtMarkCurrentPages();
+		if (lastTaken != 0)
+		{
+			lastDynamicPageUsed = lastTaken;
+		}
+	}
+	else
+	{
+		sts = PAL_ExtScanPageRange(palPartitionTable.dynamicAreaStartPage, PAL_DYN_AREA_NUM_PAGES, &lastTaken);
+		PAL_ExtMarkCurrentPages();
+
+		// Resume the allocation after the last current page rather than at the start
+		// of the area, so that a reset does not keep wearing the same low pages.
+		for (page = palPartitionTable.dynamicAreaStartPage; page <= maxPage; page++)
+		{
+			if (PAL_PageInUse(page))
+			{
+				highestCurPage = page;
+			}
+		}
+		lastDynamicPageUsed = highestCurPage;
+	}
+
+	return sts;
+}
+
+// Take each page in the range that holds a newer copy of its block type as the current page.
+// The range wraps at the end of the dynamic area.
+static EchErr PAL_ExtScanPageRange(PalNvmPageNum page, UInt16 numPages, PalNvmPageNum *pLastTaken)
+{
+	EchErr sts = ECHERR_OK;
+	PalPageHdr pageHdr;
+	PalTypeCurPageEntry *pEntry;
 
-	for (page = palPartitionTable.dynamicAreaStartPage; page <= maxPage; page++)
+	*pLastTaken = 0;
+	for (; numPages > 0; numPages--, page++)
 	{
+		if (page > palPartitionTable.lastPage)
+		{
+			page = palPartitionTable.dynamicAreaStartPage;
+		}
 		PAL_ExtReadPageHdr(&pageHdr, page);
-		if ((pageHdr.blockType != PAL_BLOCK_TYPE_NONE) && (pageHdr.blockType != PAL_BLOCK_TYPE_ERASED))
+		// The other pages of a block are found through its first page
+		if ((pageHdr.blockType != PAL_BLOCK_TYPE_NONE) && (pageHdr.blockType != PAL_BLOCK_TYPE_ERASED) &&
+			(pageHdr.blockType != PAL_BLOCK_TYPE_SUMMARY) && (pageHdr.flags & PAL_PAGE_HDR_FLAG_HEAD) &&
+			PAL_ValidateHdrCrc(&pageHdr))
 		{
 			sts = PAL_ExtFindCreateBlockTypeEntry(pageHdr.blockType, &pEntry);
 			
@@ -175,6 +946,8 @@ EchErr PAL_ExtScanForCurrentPages(void)
 				{
 					pEntry->curPageNum = page;
 					pEntry->seqNum = pageHdr.seqNum;
+					pEntry->numPages = PAL_ExtHeadNumPages(&pageHdr, page);
+					*pLastTaken = page;
 				}
 			}
 		}
@@ -182,6 +955,221 @@ EchErr PAL_ExtScanForCurrentPages(void)
 	return sts;
 }
 
+// Mark the pages of every current block once the scan is done. Marking while scanning
+// could free a page through the list of a stale copy that now belongs to another block.
+static void PAL_ExtMarkCurrentPages(void)
+{
+	int i;
+
+	for (i = 0; (i < PAL_CUR_PAGE_TABLE_MAX_ENTRIES) && (palCurPageTable[i].blockType != PAL_BLOCK_TYPE_NONE); i++)
+	{
+		if (palCurPageTable[i].seqNum != PAL_SEQ_NUM_INVALID)
+		{
+			PAL_ExtMarkBlockPages(&palCurPageTable[i], TRUE);
+		}
+	}
+}
+
+// Fill the current page table from the newest valid summary
+static EchErr PAL_ExtLoadSummary(void)
+{
+	EchErr sts = ECHERR_NOT_FOUND;
+	PalPageHdr pageHdr;
+	PalSummary summary;
+	PalTypeCurPageEntry *pEntry;
+	PalNvmPageNum page;
+	UInt8 i;
+
+	palSummaryPage = 0;
+	palSummarySeqNum = PAL_SEQ_NUM_INVALID;
+	for (i = 0; i < PAL_SUMMARY_NUM_PAGES; i++)
+	{
+		page = palPartitionTable.dynamicAreaStartPage + i;
+		PAL_ExtReadPageHdr(&pageHdr, page);
+		if ((pageHdr.blockType == PAL_BLOCK_TYPE_SUMMARY) && (pageHdr.flags & PAL_PAGE_HDR_FLAG_VALID) &&
+			PAL_ValidateHdrCrc(&pageHdr) && (palSummarySeqNum < pageHdr.seqNum))
+		{
+			// Even if its data is bad, the next summary must be newer than this one
+			palSummaryPage = page;
+			palSummarySeqNum = pageHdr.seqNum;
+		}
+	}
+
+	if (palSummarySeqNum != PAL_SEQ_NUM_INVALID)
+	{
+		sts = PAL_ExtReadPageSplit(&pageHdr, &summary, sizeof(summary), palSummaryPage);
+		if ((sts == ECHERR_OK) &&
+			((summary.crc != PAL_ComputeCrc(&summary, sizeof(summary) - sizeof(summary.crc))) ||
+			 (summary.numEntries > PAL_CUR_PAGE_TABLE_MAX_ENTRIES)))
+		{
+			sts = ECHERR_DATA_INTEGRITY;
+		}
+		for (i = 0; (sts == ECHERR_OK) && (i < summary.numEntries); i++)
+		{
+			// The page may have been reused since the summary was written, so it must
+			// still hold the copy the summary names
+			page = summary.entries[i].curPageNum;
+			if ((page < palPartitionTable.dynamicAreaStartPage) || (page > palPartitionTable.lastPage))
+			{
+				sts = ECHERR_DATA_INTEGRITY;
+			}
+			else
+			{
+				sts = PAL_ExtReadPageHdr(&pageHdr, page);
+			}
+			if ((sts == ECHERR_OK) &&
+				(!PAL_ValidateHdrCrc(&pageHdr) || !(pageHdr.flags & PAL_PAGE_HDR_FLAG_HEAD) ||
+				 (pageHdr.blockType != summary.entries[i].blockType) || (pageHdr.seqNum != summary.entries[i].seqNum) ||
+				 (PAL_ExtHeadNumPages(&pageHdr, page) != ((summary.entries[i].numPages > 1) ? summary.entries[i].numPages : 1))))
+			{
+				sts = ECHERR_DATA_INTEGRITY;
+			}
+			if (sts == ECHERR_OK)
+			{
+				sts = PAL_ExtFindCreateBlockTypeEntry(summary.entries[i].blockType, &pEntry);
+			}
+			if (sts == ECHERR_OK)
+			{
+				pEntry->curPageNum = summary.entries[i].curPageNum;
+				pEntry->seqNum = summary.entries[i].seqNum;
+				pEntry->numPages = summary.entries[i].numPages;
+			}
+		}
+		if (sts == ECHERR_OK)
+		{
+			lastDynamicPageUsed = summary.lastPageUsed;
+		}
+		else
+		{
+			// Start over with a full scan
+			PAL_ClearExtCurPageTable();
+		}
+	}
+	return sts;
+}
+
+// Write a summary that is due. The startup only scans a limited number of pages past the
+// newest summary, so if a new one can't be written the old ones are marked invalid and the
+// startup does a full scan. Until one or the other works the summary stays due.
+static void PAL_ExtWriteDueSummary(void)
+{
+	EchErr sts;
+
+	sts = PAL_ExtWriteSummary();
+	if (sts != ECHERR_OK)
+	{
+		sts = PAL_ExtInvalidateSummaries();
+		if (sts == ECHERR_OK)
+		{
+			palWritesSinceSummary = 0;
+		}
+		else if (++palSummaryTries >= PAL_WRITE_MAX_TRIES)
+		{
+			// The flash is failing. Don't hold up the queued writes for ever.
+			palWriteError = sts;
+			palWritesSinceSummary = 0;
+		}
+	}
+	if (sts == ECHERR_OK)
+	{
+		palSummaryTries = 0;
+	}
+}
+
+// Clear the valid flag of every summary page, without erasing
+static EchErr PAL_ExtInvalidateSummaries(void)
+{
+	EchErr sts = ECHERR_OK;
+	PalPageHdr pageHdr;
+	PalNvmPageNum page;
+
+	for (page = palPartitionTable.dynamicAreaStartPage;
+		 (sts == ECHERR_OK) && (page < palPartitionTable.dynamicAreaStartPage + PAL_SUMMARY_NUM_PAGES); page++)
+	{
+		sts = PAL_ExtReadPageHdr(&pageHdr, page);
+		if ((sts == ECHERR_OK) && (pageHdr.blockType == PAL_BLOCK_TYPE_SUMMARY) &&
+			(pageHdr.flags & PAL_PAGE_HDR_FLAG_VALID))
+		{
+			pageHdr.flags &= ~PAL_PAGE_HDR_FLAG_VALID;
+			sts = PAL_ExtWritePageMasked(&pageHdr, 0, sizeof(PalPageHdr), page);
+		}
+	}
+	return sts;
+}
+
+// Write the current page table to the next summary page
+EchErr PAL_ExtWriteSummary(void)
+{
+	EchErr sts = ECHERR_OK;
+	PalPageHdr pageHdr;
+	PalSummary summary;
+	PalNvmPageNum page;
+	UInt8 *pByte;
+	int i;
+	int j;
+
+	// Pick the next summary page, passing over any that still holds a block
+	// written before the summary pages were reserved
+	page = palSummaryPage;
+	for (i = 0; i < PAL_SUMMARY_NUM_PAGES; i++)
+	{
+		if ((++page < palPartitionTable.dynamicAreaStartPage) ||
+			(page >= palPartitionTable.dynamicAreaStartPage + PAL_SUMMARY_NUM_PAGES))
+		{
+			page = palPartitionTable.dynamicAreaStartPage;
+		}
+		for (j = 0; (j < PAL_CUR_PAGE_TABLE_MAX_ENTRIES) &&
+					(palCurPageTable[j].blockType != PAL_BLOCK_TYPE_NONE) &&
+					(palCurPageTable[j].curPageNum != page); j++)
+		{
+		}
+		if ((j >= PAL_CUR_PAGE_TABLE_MAX_ENTRIES) || (palCurPageTable[j].blockType == PAL_BLOCK_TYPE_NONE))
+		{
+			break;
+		}
+	}
+	if (i >= PAL_SUMMARY_NUM_PAGES)
+	{
+		sts = ECHERR_NOT_FOUND;
+	}
+	else
+	{
+		// Don't use CLIB function! Zero the padding too, as it is covered by the CRC.
+		pByte = (UInt8 *)&summary;
+		for (i = 0; i < sizeof(summary); i++)
+		{
+			*pByte++ = 0;
+		}
+		// Pool pages taken after this will come before the allocation point
+		summary.lastPageUsed = (palErasedPoolCount != 0) ? (palErasedPool[0].page - 1) : lastDynamicPageUsed;
+		for (i = 0; (i < PAL_CUR_PAGE_TABLE_MAX_ENTRIES) &&
+					(palCurPageTable[i].blockType != PAL_BLOCK_TYPE_NONE); i++)
+		{
+			summary.entries[i].blockType = palCurPageTable[i].blockType;
+			summary.entries[i].curPageNum = palCurPageTable[i].curPageNum;
+			summary.entries[i].seqNum = palCurPageTable[i].seqNum;
+			summary.entries[i].numPages = palCurPageTable[i].numPages;
+		}
+		summary.numEntries = i;
+		summary.crc = PAL_ComputeCrc(&summary, sizeof(summary) - sizeof(summary.crc));
+
+		pageHdr.blockType = PAL_BLOCK_TYPE_SUMMARY;
+		pageHdr.flags = 0xFF;
+		pageHdr.seqNum = PAL_IncrementSeqNum(palSummarySeqNum);
+		pageHdr.eraseCount = PAL_ERASE_COUNT_UNKNOWN;
+		PAL_FillHeaderCrc(&pageHdr);
+
+		sts = PAL_ExtWritePageSplit(&pageHdr, &summary, sizeof(summary), page, 0);
+		if (sts == ECHERR_OK)
+		{
+			palSummaryPage = page;
+			palSummarySeqNum = pageHdr.seqNum;
+			palWritesSinceSummary = 0;
+		}
+	}
+	return sts;
+}
+
 //****************************
 // API Functions for MCU Flash
 
@@ -189,7 +1177,7 @@ EchErr PAL_ExtScanForCurrentPages(void)
 EchErr PAL_McuReadMainFlashSeg(void *pSegData, const UInt16 len, const PalMcuMainSegNum segNum)
 {
 	EchErr sts = ECHERR_OK;
-#if !PLATFORM_IS(SIM)
+#if !PLATFORM_IS_HOST
 	int i;	// Could save on stack by using 'len' directly
 	UInt8 __data20 *pFlash;	
 	UInt8 *pData;	// Will be in RAM (__data16)	
@@ -212,7 +1200,7 @@ EchErr PAL_McuReadMainFlashSeg(void *pSegData, const UInt16 len, const PalMcuMai
 EchErr PAL_McuWriteMainFlashSeg(const void *pSegData, const UInt16 len, const PalMcuMainSegNum segNum)
 {
 	EchErr sts = ECHERR_OK;
-#if !PLATFORM_IS(SIM)
+#if !PLATFORM_IS_HOST
 	int i;	// Could save on stack by using 'len' directly
 	UInt8 __data20 *pFlash;
 	UInt8 *pData;	// Will be in RAM (__data16)	
@@ -243,7 +1231,7 @@ EchErr PAL_McuWriteMainFlashSeg(const void *pSegData, const UInt16 len, const Pa
 EchErr PAL_McuEraseMainFlashSeg(const PalMcuMainSegNum segNum)
 {
 	EchErr sts = ECHERR_OK;
-#if !PLATFORM_IS(SIM)
+#if !PLATFORM_IS_HOST
 	UInt8 __data20 *segAddr;
 	
 	segAddr = (UInt8 __data20 *)(PAL_MCU_MAIN_START_ADDR + (segNum * (unsigned long)PAL_MCU_MAIN_SEG_SIZE));
@@ -263,7 +1251,7 @@ EchErr PAL_McuEraseMainFlashSeg(const PalMcuMainSegNum segNum)
 EchErr PAL_McuEraseMainFlashBank(const PalMcuMainSegNum bankNum)
 {
 	EchErr sts = ECHERR_OK;
-#if !PLATFORM_IS(SIM)
+#if !PLATFORM_IS_HOST
 	UInt8 __data20 *bankAddr;
 	
 	bankAddr = (UInt8 __data20 *)(PAL_MCU_MAIN_START_ADDR + (bankNum * (unsigned long)PAL_MCU_MAIN_BANK_SIZE));
@@ -284,7 +1272,7 @@ EchErr PAL_McuEraseMainFlashBank(const PalMcuMainSegNum bankNum)
 EchErr PAL_McuReadInfoFlashSeg(void *pSegData, const UInt16 len, const PalMcuInfoSegNum segNum)
 {
 	EchErr sts = ECHERR_OK;
-#if !PLATFORM_IS(SIM)
+#if !PLATFORM_IS_HOST
 	int i;	// Could save on stack by using 'len' directly
 	UInt8 *pFlash;	// Info flash is alway in __data16 space
 	UInt8 *pData;
@@ -308,7 +1296,7 @@ EchErr PAL_McuReadInfoFlashSeg(void *pSegData, const UInt16 len, const PalMcuInf
 EchErr PAL_McuWriteInfoFlashSeg(const void *pSegData, const UInt16 len, const PalMcuInfoSegNum segNum)
 {
 	EchErr sts = ECHERR_OK;
-#if !PLATFORM_IS(SIM)
+#if !PLATFORM_IS_HOST
 	int i;	// Could save on stack by using 'len' directly
 	UInt8 *pFlash;	// Info flash is alway in __data16 space
 	const UInt8 *pData;
@@ -339,7 +1327,7 @@ EchErr PAL_McuWriteInfoFlashSeg(const void *pSegData, const UInt16 len, const Pa
 EchErr PAL_McuEraseInfoFlashSeg(const PalMcuInfoSegNum segNum)
 {
 	EchErr sts = ECHERR_OK;
-#if !PLATFORM_IS(SIM)
+#if !PLATFORM_IS_HOST
 	UInt8 *segAddr;	// Info flash is alway in __data16 space
 		
 	// Note that the Info segments actually progress toward lower memory
@@ -482,6 +1470,7 @@ EchErr PAL_ExtFindCreateBlockTypeEntry(const PalBlockType blockType, PalTypeCurP
 		(*ppEntry)->blockType = blockType;
 		(*ppEntry)->curPageNum = 0;
 		(*ppEntry)->seqNum = PAL_SEQ_NUM_INVALID;
+		(*ppEntry)->numPages = 0;
 		sts = ECHERR_OK;
 	}
 	return sts;
@@ -497,75 +1486,191 @@ PalPageSeqNum PAL_IncrementSeqNum(PalPageSeqNum seqNum)
 	return seqNum;
 }
 
+// Pages outside the dynamic area never hold a block
 Bool PAL_PageInUse(const PalNvmPageNum pageNum)
 {
-	Bool inUse = FALSE;
-	int i;
+	UInt16 bit;
+
+	if ((pageNum < palPartitionTable.dynamicAreaStartPage) || (pageNum > palPartitionTable.lastPage))
+	{
+		return FALSE;
+	}
+	bit = pageNum - palPartitionTable.dynamicAreaStartPage;
+	return ((palPageUsedMap[bit >> 3] & (1 << (bit & 7))) != 0);
+}
+
+// The summary pages stay marked for good
+void PAL_MarkPageInUse(const PalNvmPageNum pageNum, const Bool inUse)
+{
+	UInt16 bit;
 
-	for (i = 0; ((i < PAL_CUR_PAGE_TABLE_MAX_ENTRIES) &&
-				(palCurPageTable[i].blockType != PAL_BLOCK_TYPE_NONE));
-				i++)
+	if ((pageNum >= palPartitionTable.dynamicAreaStartPage + PAL_SUMMARY_NUM_PAGES) &&
+		(pageNum <= palPartitionTable.lastPage))
 	{
-		if (pageNum == palCurPageTable[i].curPageNum)
+		bit = pageNum - palPartitionTable.dynamicAreaStartPage;
+		if (inUse)
 		{
-			inUse = TRUE;
-			break;
+			palPageUsedMap[bit >> 3] |= (1 << (bit & 7));
+		}
+		else
+		{
+			palPageUsedMap[bit >> 3] &= ~(1 << (bit & 7));
 		}
 	}
-	return inUse;
 }
 
-PalNvmPageNum PAL_GetNextFreePageNum(void)
+static void PAL_ClearPageUsedMap(void)
 {
-	PalNvmPageNum pageNum;
+	int i;
 
-	// Self initialize the starting page number
-	if (lastDynamicPageUsed == 0)
+	// Don't use CLIB function!
+	for (i = 0; i < sizeof(palPageUsedMap); i++)
 	{
-		// TBD: random function, not from cLib?
-		lastDynamicPageUsed	= palPartitionTable.dynamicAreaStartPage;
+		palPageUsedMap[i] = 0;
 	}
 
-	// Find a page that is not in use
-	pageNum = lastDynamicPageUsed;
-	do
+	// Keep the allocator off the summary pages
+	for (i = 0; i < PAL_SUMMARY_NUM_PAGES; i++)
 	{
-		// TBD: algorithm to pick next page? Just use sequential for now
-		pageNum++;
+		palPageUsedMap[i >> 3] |= (1 << (i & 7));
+	}
+	palErasedPoolCount = 0;
+}
 
-	} while (PAL_PageInUse(pageNum));
+// The erase count the page will have once erased again
+static UInt16 PAL_ExtReadEraseCount(const PalNvmPageNum page)
+{
+	PalPageHdr pageHdr;
+	UInt16 eraseCount = 0;
 
-	return pageNum;
+	// Counts are lost when a page is erased but not written before a reset
+	PAL_ExtReadPageHdr(&pageHdr, page);
+	if ((pageHdr.blockType != PAL_BLOCK_TYPE_ERASED) && PAL_ValidateHdrCrc(&pageHdr) &&
+		(pageHdr.eraseCount < PAL_ERASE_COUNT_UNKNOWN - 1))
+	{
+		eraseCount = pageHdr.eraseCount;
+	}
+	return eraseCount + 1;
 }
 
-void PAL_FillHeaderCrc(PalPageHdr *pPageHdr)
+// Take the least worn page from the erased pool
+static Bool PAL_TakeErasedPage(PalNvmPageNum *pPageNum, UInt16 *pEraseCount)
 {
-	if (PLATFORM_IS(SIM))
+	UInt8 i;
+	UInt8 least;
+
+	if (palErasedPoolCount == 0)
 	{
-		// We currently ignore the CRC for the Simulator
-		pPageHdr->crc = 0;
+		return FALSE;
 	}
-	else
+	least = 0;
+	for (i = 1; i < palErasedPoolCount; i++)
+	{
+		if (palErasedPool[i].eraseCount < palErasedPool[least].eraseCount)
+		{
+			least = i;
+		}
+	}
+	*pPageNum = palErasedPool[least].page;
+	*pEraseCount = palErasedPool[least].eraseCount;
+
+	// Keep the rest in order
+	palErasedPoolCount--;
+	for (i = least; i < palErasedPoolCount; i++)
 	{
-		pPageHdr->crc = BOOT_Crc16CcittLen(pPageHdr, (sizeof(PalPageHdr) - sizeof(pPageHdr->crc)));
+		palErasedPool[i] = palErasedPool[i + 1];
 	}
+	return TRUE;
 }
 
-Bool PAL_ValidateHdrCrc(PalPageHdr *pPageHdr)
+// Erase the next free page into the pool, unless the pool is full or the NVM is busy.
+// Call this when the system is idle; it does not wait on the flash.
+void PAL_ExtReclaimStep(void)
 {
-	if (PLATFORM_IS(SIM))
+	PalNvmPageNum page;
+	UInt16 eraseCount;
+
+	if ((palErasedPoolCount < PAL_ERASED_POOL_SIZE) && !PAL_ExtIsNvmBusy())
 	{
-		// We currently ignore the CRC for the Simulator
-		return TRUE;
+		page = PAL_GetNextFreePageNum();
+		eraseCount = PAL_ExtReadEraseCount(page);
+		if (PAL_ExtErasePage(page) == ECHERR_OK)
+		{
+			PAL_MarkPageInUse(page, TRUE);
+			palErasedPool[palErasedPoolCount].page = page;
+			palErasedPool[palErasedPoolCount].eraseCount = eraseCount;
+			palErasedPoolCount++;
+		}
 	}
-	else
+}
+
+// Pages are handed out round robin through the dynamic area so that the wear is
+// spread evenly. At most PAL_CUR_PAGE_TABLE_MAX_ENTRIES pages are ever in use, so
+// the page after the last one used is almost always free; a run of used pages is
+// skipped a byte of the map at a time.
+PalNvmPageNum PAL_GetNextFreePageNum(void)
+{
+	PalNvmPageNum pageNum;
+	UInt16 bit;
+	UInt16 checked;
+
+	// Self initialize the starting page number
+	if ((lastDynamicPageUsed < palPartitionTable.dynamicAreaStartPage) ||
+		(lastDynamicPageUsed > palPartitionTable.lastPage))
 	{
-		UInt16 crc;
-		
-		crc = BOOT_Crc16CcittLen(pPageHdr, (sizeof(PalPageHdr) - sizeof(pPageHdr->crc)));
-		
-		return (pPageHdr->crc == crc);
+		lastDynamicPageUsed	= palPartitionTable.dynamicAreaStartPage;
+	}
+
+	bit = lastDynamicPageUsed - palPartitionTable.dynamicAreaStartPage;
+	for (checked = 0; checked < PAL_DYN_AREA_NUM_PAGES; checked++)
+	{
+		if (++bit >= PAL_DYN_AREA_NUM_PAGES)
+		{
+			bit = 0;
+		}
+		if (((bit & 7) == 0) && (palPageUsedMap[bit >> 3] == 0xFF) && (bit + 8 <= PAL_DYN_AREA_NUM_PAGES))
+		{
+			// Whole byte in use
+			bit += 7;
+			checked += 7;
+		}
+		else if ((palPageUsedMap[bit >> 3] & (1 << (bit & 7))) == 0)
+		{
+			break;
+		}
 	}
+
+	// The area can't be full as there are far more pages than block types
+	pageNum = palPartitionTable.dynamicAreaStartPage + bit;
+	lastDynamicPageUsed = pageNum;
+
+	return pageNum;
+}
+
+// Header and summary CRC. The host platforms have no boot library, so they use the stack's
+// table driven CRC16 kernel (CCITT, preset 0xFFFF).
+static UInt16 PAL_ComputeCrc(const void *pData, UInt16 len)
+{
+#if PLATFORM_IS_HOST
+	return CRC16Update(0xFFFF, pData, len);
+#else
+	return BOOT_Crc16CcittLen(pData, len);
+#endif
+}
+
+static UInt16 PAL_ComputeHdrCrc(PalPageHdr *pPageHdr)
+{
+	return PAL_ComputeCrc(pPageHdr, (sizeof(PalPageHdr) - sizeof(pPageHdr->crc)));
+}
+
+void PAL_FillHeaderCrc(PalPageHdr *pPageHdr)
+{
+	pPageHdr->crc = PAL_ComputeHdrCrc(pPageHdr);
+}
+
+Bool PAL_ValidateHdrCrc(PalPageHdr *pPageHdr)
+{
+	return (pPageHdr->crc == PAL_ComputeHdrCrc(pPageHdr));
 }
 
 EchErr PAL_ExtReadPageHdr(PalPageHdr *pPageHdr, const PalNvmPageNum page)
@@ -593,6 +1698,7 @@ void PAL_ClearExtCurPageTable()
 	{
 		*pData++ = 0;
 	}
+	PAL_ClearPageUsedMap();
 }
 
 
@@ -109,10 +109,20 @@ EchErr PAL_Init(void);
 void PAL_IoRefresh(void);
 EchErr PAL_ExtWriteNvmBlockByType(const void *pBlockData, const UInt16 len, const PalBlockType blockType);
 EchErr PAL_ExtReadNvmBlockByType(void *pBlockData, const UInt16 len, const PalBlockType blockType);
+EchErr PAL_ExtQueueNvmBlockByType(const void *pBlockData, const UInt16 len, const PalBlockType blockType);
+EchErr PAL_ExtReadNvmBlockAt(void *pData, const UInt16 offset, const UInt16 len, const PalBlockType blockType);
+EchErr PAL_ExtOpenNvmBlockWrite(const UInt16 len, const PalBlockType blockType);
+EchErr PAL_ExtWriteNvmBlockData(const void *pData, const UInt16 len);
+EchErr PAL_ExtCloseNvmBlockWrite(void);
+void PAL_ExtServiceNvm(void);
+Bool PAL_ExtNvmWorkPending(void);
+EchErr PAL_ExtFlushNvm(void);
 EchErr PAL_ExtWritePageSplit(const void *pPageHdr, const void *pPageData, const UInt16 len, const PalNvmPageNum page, UInt8 fillVal);
 EchErr PAL_ExtWritePageMasked(const void *pPageData, const UInt16 offset, const UInt16 len, const PalNvmPageNum page);
+EchErr PAL_ExtReadPageMasked(void *pPageData, const UInt16 offset, const UInt16 len, const PalNvmPageNum page);
 EchErr PAL_ConvertImageOffset(UInt32 imageOffset, PalNvmPageNum *pPage, UInt16 *pBlockOffset);
 EchErr PAL_ExtErasePage(const PalNvmPageNum page);
+void PAL_ExtReclaimStep(void);
 
 // MCU flash functions
 
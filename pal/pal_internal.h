@@ -53,11 +53,18 @@ typedef struct
 	PalBlockType blockType;
 	PalNvmPageNum curPageNum;
 	PalPageSeqNum seqNum;
-	// TBD: implement block deletion, obsolete block detection and elimination
+	UInt8 numPages;		// Pages the block is spread over, 0 or 1 for a single page
+	// TBD: implement block deletion. Obsolete blocks are erased by PAL_ExtReclaimStep().
 	UInt8			deleted : 1;	// block type has been deleted, but block(s) still exist
-	UInt8			multiple : 1;	// obsolute blocks still exist
 } PalTypeCurPageEntry;
 
+// A free page that has been erased ahead of need
+typedef struct
+{
+	PalNvmPageNum	page;
+	UInt16			eraseCount;
+} PalErasedPage;
+
 
 // The actual number of types defined via separate product header must be validated against this value,
 // to protect against the below table overflowing.
@@ -75,7 +82,7 @@ typedef struct
 	PalBlockType	blockType;
 	UInt8			flags;
 	PalPageSeqNum	seqNum;
-	UInt16			reserved;
+	UInt16			eraseCount;	// Times the page has been erased, as far as is known
 	UInt16			crc;	// This must come at the end of the fixed header data.
 							// If a user data CRC were added, it should take this slot, moving the header CRC up.
 } PalPageHdr;
@@ -83,14 +90,92 @@ typedef struct
 COMPILE_TIME_DEF_ASSERT(sizeof(PalPageHdr) == 8);
 
 #define PAL_PAGE_HDR_FLAG_VALID 0x01	// Default bit value should be 1, to allow invalidating page without erasing
+#define PAL_PAGE_HDR_FLAG_SINGLE 0x02	// Cleared in the first page of a block spread over several pages
+#define PAL_PAGE_HDR_FLAG_HEAD 0x04		// Cleared in the other pages of such a block
+#define PAL_ERASE_COUNT_UNKNOWN 0xFFFF
+
+// Start of the data in the first page of a block spread over several pages. The block
+// is committed when the header of this page is written, after all the other pages.
+typedef struct
+{
+	UInt8			numPages;
+	UInt8			reserved;
+	PalNvmPageNum	pages[PAL_MAX_BLOCK_PAGES - 1];	// The pages after the first, in order
+} PalBlockPageList;
+COMPILE_TIME_DEF_ASSERT(sizeof(PalBlockPageList) == 2 * PAL_MAX_BLOCK_PAGES);
+
+#define PAL_EXT_HEAD_DATA_SIZE (PAL_EXT_BLOCK_SIZE - sizeof(PalBlockPageList))
+
+// A block being written by PAL_ExtWriteNvmBlockData()
+typedef struct
+{
+	Bool				isOpen;
+	PalTypeCurPageEntry	*pEntry;
+	UInt16				len;
+	UInt16				offset;			// Data written so far
+	PalPageHdr			headHdr;
+	PalBlockPageList	list;
+	PalNvmPageNum		headPage;
+} PalBlockStream;
+
+// A block write waiting in the queue. The data is read when the write starts.
+typedef struct
+{
+	const void		*pBlockData;
+	UInt16			len;
+	PalBlockType	blockType;
+	UInt8			tries;		// Failed attempts so far
+} PalQueuedWrite;
+
+// The block write under way, which takes up to two program operations
+typedef enum
+{
+	PAL_WRITE_IDLE,
+	PAL_WRITE_DATA,		// Data programmed into an erased page, header to follow
+	PAL_WRITE_PAGE,		// Whole page programmed, table to be updated
+} PalWriteState;
+
+typedef struct
+{
+	PalQueuedWrite			block;
+	PalTypeCurPageEntry		*pEntry;
+	PalNvmPageNum			page;
+	PalPageHdr				pageHdr;
+	UInt8					state;	// PalWriteState
+} PalBlockWrite;
+
+// Summary of the current page table, kept in its own pages at the start of the dynamic area
+#define PAL_BLOCK_TYPE_SUMMARY (PalBlockType)(~1)
+
+typedef struct
+{
+	PalBlockType	blockType;
+	UInt8			numPages;
+	PalNvmPageNum	curPageNum;
+	PalPageSeqNum	seqNum;
+} PalSummaryEntry;
+
+typedef struct
+{
+	PalNvmPageNum	lastPageUsed;	// Allocation point when the summary was written
+	UInt8			numEntries;
+	PalSummaryEntry	entries[PAL_CUR_PAGE_TABLE_MAX_ENTRIES];
+	UInt16			crc;			// Of the preceding bytes. This must come at the end.
+} PalSummary;
+COMPILE_TIME_DEF_ASSERT(sizeof(PalSummary) <= PAL_EXT_BLOCK_SIZE);
 
 
-#if PLATFORM_IS(SIM)
+#if PLATFORM_IS_HOST
 void PAL_SimInit(void);
+void PAL_SimFlushFile(void);
+UInt16 CRC16Update(UInt16 crcIn, const void *bufIn, UInt16 sizeIn);	// lcs_link.c
 #endif
 
 EchErr PAL_ExtScanForCurrentPages(void);
+EchErr PAL_ExtWriteSummary(void);
 PalNvmPageNum PAL_GetNextFreePageNum(void);
+Bool PAL_PageInUse(const PalNvmPageNum pageNum);
+void PAL_MarkPageInUse(const PalNvmPageNum pageNum, const Bool inUse);
 PalPageSeqNum PAL_IncrementSeqNum(PalPageSeqNum seqNum);
 void PAL_FillHeaderCrc(PalPageHdr *pPageHdr);
 EchErr PAL_ExtFindBlockTypeEntry(const PalBlockType blockType, PalTypeCurPageEntry **ppEntry);
@@ -27,23 +27,37 @@
 
 #include "pal.h"
 
-#if PLATFORM_IS(SIM)
+#if PLATFORM_IS_HOST
 
 #define PAL_PART_LOG_AREA_START_PAGE 600	// FB: bogus? - allows one 150K image
 #define PAL_PART_DYN_AREA_START_PAGE 700	// FB: bogus
-#define PAL_PART_LAST_PAGE (100 - 1)
+#define PAL_PART_LAST_PAGE (PAL_PART_DYN_AREA_START_PAGE + 100 - 1)
 
-#else // !PLATFORM_IS(SIM)
+#else // !PLATFORM_IS_HOST
 
 #define PAL_PART_LOG_AREA_START_PAGE 600	// FB: bogus? - allows one 150K image
 #define PAL_PART_DYN_AREA_START_PAGE 700	// FB: bogus
 #define PAL_PART_LAST_PAGE (PAL_EXT_NUM_PAGES - 1)	
 
-#endif // PLATFORM_IS(SIM)
+#endif // PLATFORM_IS_HOST
 
 // TBD: this should be tuned for the final product
 #define PAL_CUR_PAGE_TABLE_MAX_ENTRIES 20
 
+// The first pages of the dynamic area hold a rotating summary of the current page table,
+// rewritten after every PAL_SUMMARY_INTERVAL block writes. Startup reads the newest summary
+// and only the pages written after it, instead of every page header in the area.
+#define PAL_SUMMARY_NUM_PAGES 4
+#define PAL_SUMMARY_INTERVAL 32
+
+// Free pages kept erased ahead of need, so that a block write is only a program
+#define PAL_ERASED_POOL_SIZE 4
+
+// A block longer than PAL_EXT_BLOCK_SIZE is spread over up to PAL_MAX_BLOCK_PAGES pages.
+// Its first page also lists the others, which takes 2 bytes per page.
+#define PAL_MAX_BLOCK_PAGES 8
+#define PAL_MAX_BLOCK_SIZE (PAL_MAX_BLOCK_PAGES * PAL_EXT_BLOCK_SIZE - 2 * PAL_MAX_BLOCK_PAGES)
+
 // External NVM block types
 typedef enum
 {
@@ -52,5 +66,8 @@ typedef enum
 	PAL_BLOCK_TYPE_END			// Reserved, used to calculate the number of types
 } PalSlbBlockTypes;
 
+// Queued writes are collapsed by type, so one slot per type is enough
+#define PAL_WRITE_QUEUE_SIZE (PAL_BLOCK_TYPE_END - PAL_BLOCK_TYPE_BEGIN)
+
 
 #endif // PAL_PLATFORM_H
\ No newline at end of file
@@ -23,10 +23,19 @@
  *
  */
 
+#include "echstd.h"
+#if PLATFORM_IS(SIM)
 #include "windows.h"
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 #include "stdio.h"
 #include "memory.h"
-#include "echstd.h"
 #include "pal.h"
 #include "pal_internal.h"
 #ifdef _DEBUG_PAL
@@ -49,16 +58,47 @@ typedef struct
 #endif
 				UInt8 hdrBytes[8];
 			};
-			byte userData[PAL_EXT_BLOCK_SIZE];
+			Byte userData[PAL_EXT_BLOCK_SIZE];
 		};
-		byte rawPageData[PAL_EXT_PAGE_SIZE];
+		Byte rawPageData[PAL_EXT_PAGE_SIZE];
 	};
 } PalExtSimPage;
-PalExtSimPage palExtSimFlash[PAL_EXT_NUM_PAGES];
+// RAM image of the flash. The POSIX build maps the backing file instead, and only
+// falls back to the image if the mapping fails.
+static PalExtSimPage palExtSimImage[PAL_EXT_NUM_PAGES];
+PalExtSimPage *palExtSimFlash = palExtSimImage;
+#define PAL_SIM_FLASH_SIZE (PAL_EXT_NUM_PAGES * sizeof(PalExtSimPage))
 
 const char *palSimFlashFileName = "pal_sim_flash.dat";
 
+// Simulated page erase and program times in microseconds, zero for none. Set them to the
+// datasheet figures (about 15000 and 3000 for the AT45 parts) to reproduce the real timing.
+#ifndef PAL_SIM_ERASE_USEC
+#define PAL_SIM_ERASE_USEC 0
+#endif
+#ifndef PAL_SIM_PROGRAM_USEC
+#define PAL_SIM_PROGRAM_USEC 0
+#endif
+UInt32 palSimEraseUsec = PAL_SIM_ERASE_USEC;
+UInt32 palSimProgramUsec = PAL_SIM_PROGRAM_USEC;
+
+// Like the real part, the simulated flash takes no command until the last one is done
+#define PAL_SIM_READY_TIMEOUT 1000	// ms
+static UInt64 palSimBusyUntil = 0;
+
+// Simulated power cut, for testing recovery. When palSimPowerCutAfter is non-zero, the power fails
+// during that erase or program operation from now on: only the first palSimPowerCutBytes bytes it
+// would program reach the flash, and if that is zero a cut erase leaves the page as it was. Then
+// palSimPowerOff is set and the flash takes no more commands until PAL_SimInit().
+UInt32 palSimPowerCutAfter = 0;
+UInt16 palSimPowerCutBytes = 0;
+Bool palSimPowerOff = FALSE;
+
+static void PAL_SimPageWritten(const PalNvmPageNum page);
+static Bool PAL_SimPowerCut(UInt16 *pLen);
 
+
+#if PLATFORM_IS(SIM)
 void PAL_SimFlushFile()
 {
 	DWORD nWritten;
@@ -80,7 +120,7 @@ void PAL_SimFlushFile()
 	}
 	else
 	{
-		if (!WriteFile(handle, palExtSimFlash, sizeof(palExtSimFlash), &nWritten, NULL))
+		if (!WriteFile(handle, palExtSimFlash, PAL_SIM_FLASH_SIZE, &nWritten, NULL))
 		{
 			printf("Failed to write simulated flash file!\007\n");
 		}
@@ -88,6 +128,15 @@ void PAL_SimFlushFile()
 	}
 }
 
+static void PAL_SimPageWritten(const PalNvmPageNum page)
+{
+	PAL_SimFlushFile();
+}
+
+static void PAL_SimMarkAllDirty(void)
+{
+}
+
 void PAL_SimInit()
 {
 	DWORD nWritten;
@@ -121,19 +170,163 @@ void PAL_SimInit()
 		else
 		{
 			CloseHandle(handle);
-			memset(palExtSimFlash, 0xFF, sizeof(palExtSimFlash));
+			memset(palExtSimFlash, 0xFF, PAL_SIM_FLASH_SIZE);
 			PAL_SimFlushFile();
 		}
 	}
 	else
 	{
-		if (!ReadFile(handle, palExtSimFlash, sizeof(palExtSimFlash), &nWritten, NULL))
+		if (!ReadFile(handle, palExtSimFlash, PAL_SIM_FLASH_SIZE, &nWritten, NULL))
 		{
 			printf("Failed to read simulated flash file!\007\n");
 		}
 		CloseHandle(handle);
 	}
 
+#else // !PLATFORM_IS(SIM)
+// The backing file is mapped shared, so a write reaches the page cache as soon as it is made
+// and the kernel writes it back in its own time. Writes mark their page dirty, and
+// PAL_SimFlushFile() is the barrier that syncs just the dirty pages to the disk.
+// Define PAL_SIM_WRITE_THROUGH to sync every page write, as the Windows build does.
+static UInt8 palSimDirtyMap[(PAL_EXT_NUM_PAGES + 7) / 8];
+static Bool palSimMapped = FALSE;
+
+// msync() wants an address on a system page boundary
+static void PAL_SimSyncPages(const PalNvmPageNum firstPage, const UInt16 numPages)
+{
+	uintptr_t start;
+	uintptr_t end;
+	uintptr_t sysPageSize;
+
+	sysPageSize = (uintptr_t)sysconf(_SC_PAGESIZE);
+	start = (uintptr_t)&palExtSimFlash[firstPage] & ~(sysPageSize - 1);
+	end = (uintptr_t)&palExtSimFlash[firstPage + numPages];
+	if (msync((void *)start, end - start, MS_SYNC) != 0)
+	{
+		printf("Failed to write simulated flash file!\007\n");
+	}
+}
+
+void PAL_SimFlushFile()
+{
+	int fd;
+	PalNvmPageNum page;
+	PalNvmPageNum firstPage;
+
+	if (palSimMapped)
+	{
+		// One sync per run of dirty pages
+		page = 0;
+		while (page < PAL_EXT_NUM_PAGES)
+		{
+			firstPage = page;
+			while ((page < PAL_EXT_NUM_PAGES) && (palSimDirtyMap[page >> 3] & (1 << (page & 7))))
+			{
+				palSimDirtyMap[page >> 3] &= ~(1 << (page & 7));
+				page++;
+			}
+			if (page > firstPage)
+			{
+				PAL_SimSyncPages(firstPage, page - firstPage);
+			}
+			else
+			{
+				page++;
+			}
+		}
+	}
+	else
+	{
+		// Not mapped, so write the whole image, with fsync() standing in for FILE_FLAG_WRITE_THROUGH
+		fd = open(palSimFlashFileName, O_WRONLY);
+		if (fd < 0)
+		{
+			printf("Failed to open simulated flash file!\007\n");
+		}
+		else
+		{
+			if (write(fd, palExtSimFlash, PAL_SIM_FLASH_SIZE) != PAL_SIM_FLASH_SIZE || fsync(fd) != 0)
+			{
+				printf("Failed to write simulated flash file!\007\n");
+			}
+			close(fd);
+		}
+	}
+}
+
+static void PAL_SimPageWritten(const PalNvmPageNum page)
+{
+	if (palSimMapped)
+	{
+#ifdef PAL_SIM_WRITE_THROUGH
+		PAL_SimSyncPages(page, 1);
+#else
+		palSimDirtyMap[page >> 3] |= (1 << (page & 7));
+#endif
+	}
+	else
+	{
+		PAL_SimFlushFile();
+	}
+}
+
+static void PAL_SimMarkAllDirty(void)
+{
+	memset(palSimDirtyMap, 0xFF, sizeof(palSimDirtyMap));
+}
+
+void PAL_SimInit()
+{
+	int fd;
+	struct stat fileStat;
+	void *pMap;
+	Bool fresh;
+
+	if (palSimMapped)
+	{
+		// Init again: start over from the file
+		PAL_SimFlushFile();
+		munmap(palExtSimFlash, PAL_SIM_FLASH_SIZE);
+		palExtSimFlash = palExtSimImage;
+		palSimMapped = FALSE;
+	}
+
+	fd = open(palSimFlashFileName, O_RDWR|O_CREAT, 0644);
+	if (fd < 0)
+	{
+		printf("Failed to open/create simulated flash file!\007\n");
+	}
+	else
+	{
+		fresh = (fstat(fd, &fileStat) != 0) || (fileStat.st_size == 0);
+		if ((fileStat.st_size != PAL_SIM_FLASH_SIZE) && (ftruncate(fd, PAL_SIM_FLASH_SIZE) != 0))
+		{
+			printf("Failed to size simulated flash file!\007\n");
+		}
+		pMap = mmap(NULL, PAL_SIM_FLASH_SIZE, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+		if (pMap != MAP_FAILED)
+		{
+			palExtSimFlash = (PalExtSimPage *)pMap;
+			palSimMapped = TRUE;
+		}
+		else if (!fresh && (read(fd, palExtSimFlash, PAL_SIM_FLASH_SIZE) != PAL_SIM_FLASH_SIZE))
+		{
+			printf("Failed to read simulated flash file!\007\n");
+		}
+		close(fd);	// The mapping holds its own reference
+
+		if (fresh)
+		{
+			memset(palExtSimFlash, 0xFF, PAL_SIM_FLASH_SIZE);
+			PAL_SimMarkAllDirty();
+			PAL_SimFlushFile();
+		}
+	}
+#endif // PLATFORM_IS(SIM)
+
+	// Power is back on
+	palSimPowerOff = FALSE;
+
 	// Product specific init
 	if (PRODUCT_IS(SLB))
 	{
@@ -144,18 +337,107 @@ void PAL_SimInit()
 
 }
 
+// Count an erase or program operation towards a simulated power cut. Returns TRUE if the power fails
+// during it, and cuts *pLen down to the bytes that are still programmed.
+static Bool PAL_SimPowerCut(UInt16 *pLen)
+{
+	Bool cut = palSimPowerOff;
+
+	if (!cut && (palSimPowerCutAfter != 0) && (--palSimPowerCutAfter == 0))
+	{
+		cut = TRUE;
+		palSimPowerOff = TRUE;
+		if (*pLen > palSimPowerCutBytes)
+		{
+			*pLen = palSimPowerCutBytes;
+		}
+	}
+	else if (cut)
+	{
+		*pLen = 0;
+	}
+	return cut;
+}
+
+static UInt64 PAL_SimNowUsec(void)
+{
+#if PLATFORM_IS(SIM)
+	return (UInt64)GetTickCount() * 1000;
+#else
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (UInt64)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+#endif
+}
+
+static void PAL_SimSleepUsec(UInt64 usec)
+{
+#if PLATFORM_IS(SIM)
+	Sleep((DWORD)((usec + 999) / 1000));
+#else
+	usleep((useconds_t)usec);
+#endif
+}
+
+// Start a simulated erase or program operation
+static void PAL_SimSetBusy(UInt32 usec)
+{
+	palSimBusyUntil = (usec != 0) ? PAL_SimNowUsec() + usec : 0;
+}
+
+Bool PAL_ExtIsNvmBusy(void)
+{
+	return (palSimBusyUntil != 0) && (PAL_SimNowUsec() < palSimBusyUntil);
+}
+
+EchErr PAL_ExtWaitForNvmDone(UInt16 msecTimeout)
+{
+	EchErr sts = ECHERR_OK;
+	UInt64 now;
+
+	if (PAL_ExtIsNvmBusy())
+	{
+		now = PAL_SimNowUsec();
+		if (palSimBusyUntil - now > (UInt64)msecTimeout * 1000)
+		{
+			PAL_SimSleepUsec((UInt64)msecTimeout * 1000);
+			sts = ECHERR_TIMEOUT;
+		}
+		else
+		{
+			PAL_SimSleepUsec(palSimBusyUntil - now);
+		}
+	}
+	return sts;
+}
+
 EchErr PAL_SimExtEraseChip()
 {
-	memset(palExtSimFlash, 0xFF, sizeof(palExtSimFlash));
+	PAL_ExtWaitForNvmDone(PAL_SIM_READY_TIMEOUT);
+	memset(palExtSimFlash, 0xFF, PAL_SIM_FLASH_SIZE);
+	PAL_SimMarkAllDirty();
 	PAL_SimFlushFile();
 	return ECHERR_OK;
 }
 
 EchErr PAL_ExtErasePage(const PalNvmPageNum page)
 {
-	memset(&palExtSimFlash[page], 0xFF, PAL_EXT_PAGE_SIZE);
-	PAL_SimFlushFile();
-	return ECHERR_OK;
+	EchErr sts = ECHERR_OK;
+	UInt16 len = PAL_EXT_PAGE_SIZE;
+
+	PAL_ExtWaitForNvmDone(PAL_SIM_READY_TIMEOUT);
+	if (PAL_SimPowerCut(&len))
+	{
+		sts = ECHERR_TIMEOUT;
+	}
+	if (len != 0)
+	{
+		memset(&palExtSimFlash[page], 0xFF, PAL_EXT_PAGE_SIZE);
+		PAL_SimPageWritten(page);
+		PAL_SimSetBusy(palSimEraseUsec);
+	}
+	return sts;
 }
 
 // Write a full page, with up to a full block of data, but supply the header and data separately
@@ -163,7 +445,8 @@ EchErr PAL_ExtErasePage(const PalNvmPageNum page)
 EchErr PAL_ExtWritePageSplit(const void *pPageHdr, const void *pPageData, const UInt16 len, const PalNvmPageNum page, UInt8 fillVal)
 {
 	EchErr sts = ECHERR_OK;
-	PalExtSimPage *pPage;
+	PalExtSimPage newPage;
+	UInt16 progLen = PAL_EXT_PAGE_SIZE;
 
 	if ((len > PAL_EXT_BLOCK_SIZE) || (len == 0))
 	{
@@ -171,18 +454,29 @@ EchErr PAL_ExtWritePageSplit(const void *pPageHdr, const void *pPageData, const
 	}
 	else
 	{
-		PAL_ExtErasePage(page);	
-		pPage = &palExtSimFlash[page];
-		memcpy(&pPage->hdrBytes, pPageHdr, sizeof(PalPageHdr));
-		memcpy(&pPage->userData, pPageData, len);
+		// Erase and program are one operation on the part
+		PAL_ExtWaitForNvmDone(PAL_SIM_READY_TIMEOUT);
+		memset(&newPage, 0xFF, PAL_EXT_PAGE_SIZE);
+		memcpy(&newPage.hdrBytes, pPageHdr, sizeof(PalPageHdr));
+		memcpy(&newPage.userData, pPageData, len);
 		if (len < PAL_EXT_BLOCK_SIZE)
 		{
 			// Fill unwriten bytes with fillValue (0 for user data, 0xFF for upgrade data)
-			memset(&pPage->userData[len], fillVal, (PAL_EXT_BLOCK_SIZE-len));
+			memset(&newPage.userData[len], fillVal, (PAL_EXT_BLOCK_SIZE-len));
 		}
 
-		// Flush the sim flash to disk
-		PAL_SimFlushFile();
+		if (PAL_SimPowerCut(&progLen))
+		{
+			sts = ECHERR_TIMEOUT;
+		}
+		if (progLen != 0)
+		{
+			// A cut write still erased the page first, and the page is programmed from its start
+			memset(&palExtSimFlash[page], 0xFF, PAL_EXT_PAGE_SIZE);
+			memcpy(&palExtSimFlash[page], &newPage, progLen);
+			PAL_SimPageWritten(page);
+			PAL_SimSetBusy(palSimEraseUsec + palSimProgramUsec);
+		}
 	}
 
 	return sts;
@@ -195,6 +489,7 @@ EchErr PAL_ExtWritePageMasked(const void *pPageData, const UInt16 offset, const
 {
 	EchErr sts = ECHERR_OK;
 	PalExtSimPage *pPage;
+	UInt16 progLen = len;
 
 	if ((offset + len > PAL_EXT_PAGE_SIZE) || (len == 0))
 	{
@@ -203,11 +498,18 @@ EchErr PAL_ExtWritePageMasked(const void *pPageData, const UInt16 offset, const
 	else
 	{
 		// No actual masking needed for the simulation
-		pPage = &palExtSimFlash[page];
-		memcpy(&pPage->rawPageData[offset], pPageData, len);
-
-		// Flush the sim flash to disk
-		PAL_SimFlushFile();
+		PAL_ExtWaitForNvmDone(PAL_SIM_READY_TIMEOUT);
+		if (PAL_SimPowerCut(&progLen))
+		{
+			sts = ECHERR_TIMEOUT;
+		}
+		if (progLen != 0)
+		{
+			pPage = &palExtSimFlash[page];
+			memcpy(&pPage->rawPageData[offset], pPageData, progLen);
+			PAL_SimPageWritten(page);
+			PAL_SimSetBusy(palSimProgramUsec);
+		}
 	}
 
 	return sts;
@@ -239,6 +541,7 @@ EchErr PAL_ExtReadPageSplit(PalPageHdr *pPageHdr, void *pPageData, const UInt16
 	}
 	else
 	{
+		PAL_ExtWaitForNvmDone(PAL_SIM_READY_TIMEOUT);
 		pPage = &palExtSimFlash[page];
 		memcpy(pPageHdr, &pPage->palHdr, sizeof(PalPageHdr));
 		if (pPageData != NULL)
@@ -249,6 +552,24 @@ EchErr PAL_ExtReadPageSplit(PalPageHdr *pPageHdr, void *pPageData, const UInt16
 	return sts;
 }
 
+// Read some page data, potentially in the middle of the page.
+// The offset is from the beginning of the page, not from the header.
+EchErr PAL_ExtReadPageMasked(void *pPageData, const UInt16 offset, const UInt16 len, const PalNvmPageNum page)
+{
+	EchErr sts = ECHERR_OK;
+
+	if ((offset + len > PAL_EXT_PAGE_SIZE) || (len == 0))
+	{
+		sts = ECHERR_INVALID_PARAM;
+	}
+	else
+	{
+		PAL_ExtWaitForNvmDone(PAL_SIM_READY_TIMEOUT);
+		memcpy(pPageData, &palExtSimFlash[page].rawPageData[offset], len);
+	}
+	return sts;
+}
+
 // A utility function for various test/debug actions
 void PAL_DebugFunc(int cmd)
 {
@@ -0,0 +1,65 @@
+//
+// check_app.c
+//
+// Copyright (C) 2022 Dialog Semiconductor
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in 
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// The application the stack checks in this directory link with.  It does nothing; each check drives the stack
+// functions it covers directly from its own main().
+//
+
+#include "lcs.h"
+
+Status AppInit(void)
+{
+	return SUCCESS;
+}
+
+void AppReset(void)
+{
+}
+
+void DoApp(void)
+{
+}
+
+void MsgCompletes(Status stat, MsgTag tag)
+{
+}
+
+void NVUpdateCompletes(Status stat, int16 nvIndex, int16 nvArrayIndex)
+{
+}
+
+void NVUpdateOccurs(int16 nvIndex, int16 nvArrayIndex)
+{
+}
+
+void Wink(void)
+{
+}
+
+void OfflineEvent(void)
+{
+}
+
+void OnlineEvent(void)
+{
+}
@@ -0,0 +1,151 @@
+//
+// checksum_check.c
+//
+// Copyright (C) 2022 Dialog Semiconductor
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in 
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Checks that the incremental configuration checksum follows the configuration.  Random writes go through
+// ConfigWrite() and the table update functions, interleaved with ConfigCheckSumStep() slices of random size.  The
+// stored checksum must always equal a full recompute and no pass may fail, and a write that bypasses the checksum
+// must fail the first pass that ends after it.
+//
+
+/*
+ * Build and run from the repository root:
+ *   gcc -I. -Ipal -Itest -DPLATFORM_ID=PLATFORM_ID_LINUX -DLDV_VIRTUAL_CHANNEL \
+ *       test/checksum_check.c test/check_app.c $(ls lcs*.c | grep -v lcs_main.c) \
+ *       tmr.c tmr_platform.c vldv_host.c vldv_vlon.c vldv_linux.c pal/pal.c pal/pal_sim_driver.c \
+ *       -lpthread -o checksum_check
+ *   ./checksum_check
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lcs.h"
+#include "lcs_node.h"
+
+#define NUM_STEPS   20000
+
+static void RandomBytes(void *bufOut, uint16 lengthIn)
+{
+    uint16 i;
+
+    for (i = 0; i < lengthIn; i++)
+    {
+        ((Byte *)bufOut)[i] = (Byte)rand();
+    }
+}
+
+int main(void)
+{
+    AddrTableEntry entry;
+    DomainStruct   domain;
+    NVStruct       nv;
+    Byte    buf[16];
+    Byte   *base;
+    Byte    b;
+    uint16  size;
+    uint16  offset;
+    uint16  length;
+    uint16  sweep;
+    Boolean caught;
+    int     passes = 0;
+    int     step;
+    int     failures = 0;
+
+    srand(1);
+    LCS_Init();
+    base = (Byte *)&eep->configData;
+    size = (Byte *)&eep->configCheckSum - base;
+
+    for (step = 0; step < NUM_STEPS; step++)
+    {
+        switch (rand() % 8)
+        {
+        case 0:
+        case 1:
+            offset = rand() % size;
+            length = 1 + rand() % sizeof(buf);
+            if (offset + length > size)
+            {
+                length = size - offset;
+            }
+            RandomBytes(buf, length);
+            ConfigWrite(base + offset, buf, length, TRUE);
+            break;
+        case 2:
+            RandomBytes(&domain, sizeof(domain));
+            UpdateDomain(&domain, 0, rand() % 2);
+            RandomBytes(&entry, sizeof(entry));
+            UpdateAddress(&entry, rand() % NUM_ADDR_TBL_ENTRIES);
+            if (nmp->nvTableSize > 0)
+            {
+                RandomBytes(&nv, sizeof(nv));
+                UpdateNV(&nv, rand() % nmp->nvTableSize);
+            }
+            break;
+        default:
+            sweep = gp->checksumSweep;
+            if (!ConfigCheckSumStep(1 + rand() % 40))
+            {
+                printf("FAIL: step %d pass failed\n", step);
+                failures++;
+            }
+            if (gp->checksumSweep < sweep || gp->checksumSweep == 0)
+            {
+                passes++;
+            }
+            break;
+        }
+        if (eep->configCheckSum != ComputeConfigCheckSum())
+        {
+            printf("FAIL: step %d checksum 0x%02X expected 0x%02X\n", step, eep->configCheckSum,
+                   ComputeConfigCheckSum());
+            failures++;
+        }
+        if (failures > 10)
+        {
+            break;
+        }
+    }
+
+    /* A write that leaves the checksum alone must be caught by the end of the next pass */
+    b = base[3] ^ 0x5A;
+    ConfigWrite(base + 3, &b, 1, FALSE);
+    caught = FALSE;
+    for (step = 0; step <= size && !caught; step++)
+    {
+        caught = !ConfigCheckSumStep(7);
+        if (gp->checksumSweep == 0 && !caught)
+        {
+            break;
+        }
+    }
+    if (!caught)
+    {
+        printf("FAIL: bad checksum not caught\n");
+        failures++;
+    }
+
+    printf("size %d passes %d failures %d\n", size, passes, failures);
+    return failures != 0;
+}
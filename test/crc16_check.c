@@ -0,0 +1,85 @@
+//
+// crc16_check.c
+//
+// Copyright (C) 2022 Dialog Semiconductor
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in 
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Checks the table driven and slice-by-N CRC16 variants in lcs_link.c against the bitwise reference, for every start
+// alignment, every length up to a frame and a chained CRC register, and checks CRC16() against the standard check
+// value.  Then times the variants with CRC16Benchmark().
+//
+
+/*
+ * Build and run from the repository root (lcs_link.c is included, so it is left out of the sources):
+ *   gcc -I. -Ipal -Itest -DPLATFORM_ID=PLATFORM_ID_LINUX -DLDV_VIRTUAL_CHANNEL -DCRC16_BENCHMARK \
+ *       test/crc16_check.c test/check_app.c $(ls lcs*.c | grep -v -e lcs_main.c -e lcs_link.c) \
+ *       tmr.c tmr_platform.c vldv_host.c vldv_vlon.c vldv_linux.c pal/pal.c pal/pal_sim_driver.c \
+ *       -lpthread -o crc16_check
+ *   ./crc16_check
+ */
+
+#include "lcs_link.c"
+
+int main(void)
+{
+    static const Byte check[] = "123456789";
+    Byte    buf[MAX_PDU_SIZE + 8 + 2];
+    uint16  offset;
+    uint16  len;
+    uint16  seed;
+    uint16  ref;
+    uint16  i;
+    int     failures = 0;
+
+    srand(1);
+    for (i = 0; i < sizeof(buf); i++)
+    {
+        buf[i] = (Byte)rand();
+    }
+
+    for (offset = 0; offset < 8; offset++)
+    {
+        for (len = 0; len <= MAX_PDU_SIZE; len++)
+        {
+            seed = (uint16)rand();
+            ref  = CRC16Bitwise(seed, &buf[offset], len);
+            if (CRC16Table(seed, &buf[offset], len) != ref ||
+                CRC16Slice4(seed, &buf[offset], len) != ref ||
+                CRC16Slice8(seed, &buf[offset], len) != ref)
+            {
+                printf("FAIL: offset %d length %d seed 0x%04X\n", offset, len, seed);
+                failures++;
+            }
+        }
+    }
+
+    /* CRC-16/GENIBUS: 0xFFFF in, 0xFFFF out, stored high byte first. */
+    memcpy(buf, check, 9);
+    CRC16(buf, 9);
+    if (buf[9] != 0xD6 || buf[10] != 0x4E)
+    {
+        printf("FAIL: check value 0x%02X%02X\n", buf[9], buf[10]);
+        failures++;
+    }
+
+    failures += CRC16Benchmark();
+    printf("failures %d\n", failures);
+    return failures != 0;
+}
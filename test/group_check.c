@@ -0,0 +1,116 @@
+//
+// group_check.c
+//
+// Copyright (C) 2022 Dialog Semiconductor
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in 
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Checks the group membership bitmap against a scan of the address table.  Address table entries are rewritten at
+// random through UpdateAddress(), with groups drawn from a few values, and IsGroupMember() and AddrTableIndex() must
+// agree with the first group entry for the domain and group in the table.
+//
+
+/*
+ * Build and run from the repository root:
+ *   gcc -I. -Ipal -Itest -DPLATFORM_ID=PLATFORM_ID_LINUX -DLDV_VIRTUAL_CHANNEL \
+ *       test/group_check.c test/check_app.c $(ls lcs*.c | grep -v lcs_main.c) \
+ *       tmr.c tmr_platform.c vldv_host.c vldv_vlon.c vldv_linux.c pal/pal.c pal/pal_sim_driver.c \
+ *       -lpthread -o group_check
+ *   ./group_check
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "lcs.h"
+#include "lcs_node.h"
+
+#define NUM_STEPS   100000
+
+/* The address table index of the group the old way, or 0xFF */
+static uint16 ScanGroup(uint8 domainIndexIn, uint8 groupIn)
+{
+    uint16 i;
+
+    for (i = 0; i < NUM_ADDR_TBL_ENTRIES; i++)
+    {
+        if (eep->addrTable[i].addrFormat >= 128 &&
+            eep->addrTable[i].groupEntry.groupID == groupIn &&
+            eep->addrTable[i].groupEntry.domainIndex == domainIndexIn)
+        {
+            return(i);
+        }
+    }
+    return(0xFF);
+}
+
+int main(void)
+{
+    AddrTableEntry entry;
+    uint16  i;
+    uint16  expected;
+    uint8   domainIndex;
+    uint8   group;
+    uint8   member;
+    Boolean isMember;
+    int     step;
+    int     k;
+    int     failures = 0;
+
+    srand(1);
+    LCS_Init();
+
+    for (step = 0; step < NUM_STEPS && failures <= 10; step++)
+    {
+        for (i = 0; i < sizeof(entry); i++)
+        {
+            ((Byte *)&entry)[i] = (Byte)rand();
+        }
+        if (rand() % 2)
+        {
+            entry.groupEntry.groupID = rand() % 4;
+        }
+        if (rand() % 3 == 0)
+        {
+            /* Not a group entry */
+            entry.addrFormat = rand() % 4;
+        }
+        UpdateAddress(&entry, rand() % NUM_ADDR_TBL_ENTRIES);
+
+        for (k = 0; k < 8; k++)
+        {
+            domainIndex = rand() % 3;
+            group       = rand() % 2 ? rand() % 4 : (uint8)rand();
+            member      = 0xEE;
+            isMember    = IsGroupMember(domainIndex, group, &member);
+            expected    = ScanGroup(domainIndex, group);
+            if (AddrTableIndex(domainIndex, group) != expected ||
+                isMember != (expected != 0xFF) ||
+                (isMember && member != eep->addrTable[expected].groupEntry.member))
+            {
+                printf("FAIL: step %d domain %d group %d index %d expected %d\n", step, domainIndex, group,
+                       AddrTableIndex(domainIndex, group), expected);
+                failures++;
+            }
+        }
+    }
+
+    printf("failures %d\n", failures);
+    return failures != 0;
+}
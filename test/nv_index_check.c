@@ -0,0 +1,164 @@
+//
+// nv_index_check.c
+//
+// Copyright (C) 2022 Dialog Semiconductor
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in 
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Checks the NV selector index against a scan of the NV config and alias tables.  NVs are added, and primary and
+// alias entries are rewritten at random with selectors drawn from a few values that share hash buckets.  Every
+// selector and direction must find the same NV indices, in the same order, as the scan.
+//
+
+/*
+ * Build and run from the repository root:
+ *   gcc -I. -Ipal -Itest -DPLATFORM_ID=PLATFORM_ID_LINUX -DLDV_VIRTUAL_CHANNEL \
+ *       test/nv_index_check.c test/check_app.c $(ls lcs*.c | grep -v lcs_main.c) \
+ *       tmr.c tmr_platform.c vldv_host.c vldv_vlon.c vldv_linux.c pal/pal.c pal/pal_sim_driver.c \
+ *       -lpthread -o nv_index_check
+ *   ./nv_index_check
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lcs.h"
+#include "lcs_node.h"
+
+#define NUM_STEPS   20000
+
+static uint16 RandomSelector(void)
+{
+    /* A few selectors, two to a hash bucket, and the odd one anywhere. */
+    if (rand() % 8 == 0)
+    {
+        return (uint16)(rand() & 0x3FFF);
+    }
+    return (uint16)(0x3F00 + (rand() % 4) + (rand() % 2) * NV_SELECTOR_HASH_SIZE);
+}
+
+static void RandomNV(NVStruct *nvOut)
+{
+    uint16 selector = RandomSelector();
+    uint16 i;
+
+    for (i = 0; i < sizeof(*nvOut); i++)
+    {
+        ((Byte *)nvOut)[i] = (Byte)rand();
+    }
+    nvOut->nvSelectorHi = selector >> 8;
+    nvOut->nvSelectorLo = selector & 0xFF;
+}
+
+/* The lowest index above afterIndexIn with the selector and direction, found the old way */
+static int16 ScanLookup(uint16 selectorIn, uint8 directionIn, int16 afterIndexIn)
+{
+    NVStruct *nvPtr;
+    int16     i;
+
+    for (i = afterIndexIn + 1; i < nmp->nvTableSize + NV_ALIAS_TABLE_SIZE; i++)
+    {
+        nvPtr = GetNVStructPtr(i);
+        if (((nvPtr->nvSelectorHi << 8) | nvPtr->nvSelectorLo) == selectorIn &&
+                nvPtr->nvDirection == directionIn)
+        {
+            return(i);
+        }
+    }
+    return(-1);
+}
+
+static int CheckSelector(uint16 selectorIn, uint8 directionIn)
+{
+    int16 expected = -1;
+    int16 found    = -1;
+
+    do
+    {
+        expected = ScanLookup(selectorIn, directionIn, expected);
+        found    = NVSelectorLookup(selectorIn, directionIn, found);
+        if (found != expected)
+        {
+            printf("FAIL: selector 0x%04X direction %d found %d expected %d\n",
+                   selectorIn, directionIn, found, expected);
+            return 1;
+        }
+    } while (found != -1);
+    return 0;
+}
+
+int main(void)
+{
+    static Byte  values[NV_TABLE_SIZE];
+    NVDefinition def;
+    NVStruct     nv;
+    AliasStruct  alias;
+    int          step;
+    int          failures = 0;
+
+    srand(1);
+    LCS_Init();
+
+    memset(&def, 0, sizeof(def));
+    def.nvName   = "nvCheck";
+    def.nvLength = 1;
+    def.varAddr  = values;
+
+    for (step = 0; step < NUM_STEPS; step++)
+    {
+        switch (rand() % 8)
+        {
+        case 0:
+            /* Adding an NV moves the alias indices up. */
+            if (nmp->nvTableSize < NV_TABLE_SIZE && rand() % 50 == 0)
+            {
+                def.direction = rand() % 2;
+                def.bind      = rand() % 2;
+                def.selector  = RandomSelector();
+                AddNV(&def);
+            }
+            break;
+        case 1:
+        case 2:
+        case 3:
+            if (nmp->nvTableSize > 0)
+            {
+                RandomNV(&nv);
+                UpdateNV(&nv, rand() % nmp->nvTableSize);
+            }
+            break;
+        default:
+            RandomNV(&alias.nvConfig);
+            alias.primary     = (uint8)rand();
+            alias.hostPrimary = (uint16)rand();
+            UpdateAlias(&alias, rand() % NV_ALIAS_TABLE_SIZE);
+            break;
+        }
+
+        failures += CheckSelector(RandomSelector(), rand() % 2);
+        if (failures > 10)
+        {
+            break;
+        }
+    }
+
+    printf("nvs %d failures %d\n", nmp->nvTableSize, failures);
+    return failures != 0;
+}
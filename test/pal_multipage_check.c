@@ -0,0 +1,302 @@
+//
+// pal_multipage_check.c
+//
+// Copyright (C) 2022 Dialog Semiconductor
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in 
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Checks blocks spread over several pages.  Blocks of random length up to PAL_MAX_BLOCK_SIZE are written whole,
+// queued, or streamed in random pieces, and read back whole and in random parts.  While a stream is open the old
+// copy must stay readable and other writes must be refused, closing it early must fail without losing it, and
+// supplying too much data must abandon it.  Every page in use must be a page of a current block or in the erased
+// pool, also after the PAL is restarted, from the summary or from a full scan.
+//
+
+/*
+ * Build and run from the repository root:
+ *   gcc -I. -Ipal -Itest -DPLATFORM_ID=PLATFORM_ID_LINUX -DLDV_VIRTUAL_CHANNEL \
+ *       test/pal_multipage_check.c test/check_app.c $(ls lcs*.c | grep -v lcs_main.c) \
+ *       tmr.c tmr_platform.c vldv_host.c vldv_vlon.c vldv_linux.c pal/pal.c pal/pal_sim_driver.c \
+ *       -lpthread -o pal_multipage_check
+ *   ./pal_multipage_check
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "echstd.h"
+#include "pal.h"
+#include "pal_internal.h"
+
+#define FLASH_FILE		"pal_multipage_check.dat"
+#define NUM_STEPS		3000
+#define NUM_TYPES		4		// Block types 1 to 3 are used, and type 1 may be queued
+#define RESTART_EVERY	100
+
+// Block pages start after the summary pages
+#define FIRST_PAGE		(PAL_PART_DYN_AREA_START_PAGE + PAL_SUMMARY_NUM_PAGES)
+
+typedef enum
+{
+	WRITE_WHOLE,
+	WRITE_QUEUED,
+	WRITE_STREAMED,
+	WRITE_ABANDONED,	// Streamed, then given too much data
+	WRITE_KINDS
+} WriteKind;
+
+extern PalNvmPageNum lastDynamicPageUsed;
+extern UInt32 palSimEraseUsec;
+extern UInt32 palSimProgramUsec;
+extern const char *palSimFlashFileName;
+
+static UInt8 blocks[NUM_TYPES][PAL_MAX_BLOCK_SIZE];
+static UInt16 blockLen[NUM_TYPES];
+static int failures = 0;
+
+static void Fail(const char *what, int step, PalBlockType blockType)
+{
+	if (failures++ < 10)
+	{
+		printf("FAIL: %s (step %d, type %u)\n", what, step, blockType);
+	}
+}
+
+static UInt8 BlockPages(UInt16 len)
+{
+	return (len <= PAL_EXT_BLOCK_SIZE) ? 1 : 2 + (len - PAL_EXT_HEAD_DATA_SIZE - 1) / PAL_EXT_BLOCK_SIZE;
+}
+
+// Read the block back whole and a random part of it
+static void CheckBlock(int step, PalBlockType blockType)
+{
+	UInt8 data[PAL_MAX_BLOCK_SIZE];
+	PalTypeCurPageEntry *pEntry;
+	UInt16 len = blockLen[blockType];
+	UInt16 offset;
+	UInt16 partLen;
+
+	if (len == 0)
+	{
+		return;
+	}
+	if ((PAL_ExtReadNvmBlockByType(data, len, blockType) != ECHERR_OK) || (memcmp(data, blocks[blockType], len) != 0))
+	{
+		Fail("block did not read back", step, blockType);
+	}
+	offset = rand() % len;
+	partLen = 1 + rand() % (len - offset);
+	if ((PAL_ExtReadNvmBlockAt(data, offset, partLen, blockType) != ECHERR_OK) ||
+		(memcmp(data, &blocks[blockType][offset], partLen) != 0))
+	{
+		Fail("part of the block did not read back", step, blockType);
+	}
+	if ((PAL_ExtFindBlockTypeEntry(blockType, &pEntry) != ECHERR_OK) ||
+		(((pEntry->numPages > 1) ? pEntry->numPages : 1) != BlockPages(len)))
+	{
+		Fail("block has the wrong number of pages", step, blockType);
+	}
+}
+
+// Every page in use must be a current block page or an erased page in the pool
+static void CheckPagesInUse(int step)
+{
+	PalPageHdr pageHdr;
+	PalBlockType blockType;
+	PalNvmPageNum page;
+	UInt16 expected = 0;
+	UInt16 inUse = 0;
+
+	for (blockType = 1; blockType < NUM_TYPES; blockType++)
+	{
+		expected += (blockLen[blockType] != 0) ? BlockPages(blockLen[blockType]) : 0;
+	}
+	for (page = FIRST_PAGE; page <= PAL_PART_LAST_PAGE; page++)
+	{
+		if (PAL_PageInUse(page))
+		{
+			PAL_ExtReadPageHdr(&pageHdr, page);
+			if (pageHdr.blockType == PAL_BLOCK_TYPE_ERASED)
+			{
+				expected++;
+			}
+			inUse++;
+		}
+	}
+	if (inUse != expected)
+	{
+		Fail("pages in use that are neither block pages nor in the pool", step, 0);
+	}
+}
+
+// Stream the block in random pieces, trying what must be refused while it is open
+static EchErr Stream(int step, PalBlockType blockType, UInt16 len, const UInt8 *pData, Bool abandon)
+{
+	UInt8 small[PAL_EXT_BLOCK_SIZE] = { 0 };
+	UInt16 offset;
+	UInt16 piece;
+	EchErr sts;
+
+	sts = PAL_ExtOpenNvmBlockWrite(len, blockType);
+	for (offset = 0; (sts == ECHERR_OK) && (offset < len); offset += piece)
+	{
+		piece = 1 + rand() % 300;
+		if (piece > len - offset)
+		{
+			piece = len - offset;
+		}
+		sts = PAL_ExtWriteNvmBlockData(&pData[offset], piece);
+
+		if ((sts == ECHERR_OK) && (rand() % 4 == 0))
+		{
+			if ((PAL_ExtOpenNvmBlockWrite(len, blockType) != ECHERR_ALREADY_OPEN) ||
+				(PAL_ExtWriteNvmBlockByType(small, sizeof(small), 1 + rand() % (NUM_TYPES - 1)) != ECHERR_ALREADY_OPEN))
+			{
+				Fail("write allowed while a stream is open", step, blockType);
+			}
+			if ((offset + piece < len) && (PAL_ExtCloseNvmBlockWrite() != ECHERR_UNDERFLOW))
+			{
+				Fail("stream closed before all its data", step, blockType);
+			}
+			CheckBlock(step, blockType);
+		}
+	}
+	if ((sts == ECHERR_OK) && abandon)
+	{
+		if (PAL_ExtWriteNvmBlockData(pData, 1) != ECHERR_INVALID_LENGTH)
+		{
+			Fail("stream took more data than its length", step, blockType);
+		}
+		if (PAL_ExtCloseNvmBlockWrite() != ECHERR_NOT_OPEN)
+		{
+			Fail("stream still open after too much data", step, blockType);
+		}
+		sts = ECHERR_INVALID_LENGTH;
+	}
+	else if (sts == ECHERR_OK)
+	{
+		sts = PAL_ExtCloseNvmBlockWrite();
+	}
+	return sts;
+}
+
+int main(void)
+{
+	UInt8 data[PAL_MAX_BLOCK_SIZE];
+	PalBlockType blockType;
+	WriteKind kind;
+	UInt16 len;
+	UInt16 i;
+	EchErr sts;
+	int restarts = 0;
+	int step;
+
+	palSimFlashFileName = FLASH_FILE;
+	palSimEraseUsec = 0;
+	palSimProgramUsec = 0;
+	remove(FLASH_FILE);
+	PAL_Init();
+
+	if ((PAL_ExtOpenNvmBlockWrite(0, 1) != ECHERR_INVALID_PARAM) ||
+		(PAL_ExtOpenNvmBlockWrite(PAL_MAX_BLOCK_SIZE + 1, 1) != ECHERR_INVALID_PARAM) ||
+		(PAL_ExtWriteNvmBlockData(data, 1) != ECHERR_NOT_OPEN) ||
+		(PAL_ExtCloseNvmBlockWrite() != ECHERR_NOT_OPEN))
+	{
+		Fail("bad stream call accepted", -1, 1);
+	}
+
+	for (step = 0; step < NUM_STEPS; step++)
+	{
+		blockType = 1 + rand() % (NUM_TYPES - 1);
+		len = (rand() % 3 == 0) ? 1 + rand() % PAL_EXT_BLOCK_SIZE : 1 + rand() % PAL_MAX_BLOCK_SIZE;
+		for (i = 0; i < len; i++)
+		{
+			data[i] = (UInt8)rand();
+		}
+		kind = (WriteKind)(rand() % WRITE_KINDS);
+		if ((kind == WRITE_QUEUED) && (blockType != 1))
+		{
+			kind = WRITE_WHOLE;
+		}
+
+		switch (kind)
+		{
+		case WRITE_WHOLE:
+			sts = PAL_ExtWriteNvmBlockByType(data, len, blockType);
+			break;
+		case WRITE_QUEUED:
+			// The data is read when the write starts
+			memcpy(blocks[blockType], data, len);
+			sts = PAL_ExtQueueNvmBlockByType(blocks[blockType], len, blockType);
+			if (sts == ECHERR_OK)
+			{
+				sts = PAL_ExtFlushNvm();
+			}
+			break;
+		default:
+			sts = Stream(step, blockType, len, data, kind == WRITE_ABANDONED);
+			break;
+		}
+
+		if (kind == WRITE_ABANDONED)
+		{
+			if (sts != ECHERR_INVALID_LENGTH)
+			{
+				Fail("abandoned stream", step, blockType);
+			}
+		}
+		else if (sts != ECHERR_OK)
+		{
+			Fail("write failed", step, blockType);
+		}
+		else
+		{
+			memcpy(blocks[blockType], data, len);
+			blockLen[blockType] = len;
+		}
+
+		if (rand() & 1)
+		{
+			PAL_ExtReclaimStep();
+		}
+		if (step % RESTART_EVERY == RESTART_EVERY - 1)
+		{
+			if (restarts++ & 1)
+			{
+				for (i = 0; i < PAL_SUMMARY_NUM_PAGES; i++)
+				{
+					PAL_ExtErasePage(PAL_PART_DYN_AREA_START_PAGE + i);
+				}
+			}
+			PAL_ClearExtCurPageTable();
+			lastDynamicPageUsed = 0;
+			PAL_Init();
+		}
+		for (blockType = 1; blockType < NUM_TYPES; blockType++)
+		{
+			CheckBlock(step, blockType);
+		}
+		CheckPagesInUse(step);
+	}
+	remove(FLASH_FILE);
+
+	printf("writes %d restarts %d failures %d\n", NUM_STEPS, restarts, failures);
+	return failures != 0;
+}
@@ -0,0 +1,361 @@
+//
+// pal_power_cut_check.c
+//
+// Copyright (C) 2022 Dialog Semiconductor
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in 
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Checks that the external NVM blocks survive a power cut at any point.  Each trial starts from erased flash and
+// runs a fixed workload of synchronous, queued, streamed and multi-page block writes, unchanged rewrites and
+// reclaim steps, with the simulated flash losing power during its Nth erase or program operation, leaving none,
+// part or most of that operation's bytes behind.  The flash is then restarted, once from the summary and once
+// from a full scan, and every block must read back whole, at least as new as the last write that completed and
+// no newer than the last one started.  New writes after the restart must not disturb the other blocks.
+// Each trial runs in its own processes, so that nothing but the flash carries over a restart.
+//
+
+/*
+ * Build and run from the repository root:
+ *   gcc -I. -Ipal -Itest -DPLATFORM_ID=PLATFORM_ID_LINUX -DLDV_VIRTUAL_CHANNEL \
+ *       test/pal_power_cut_check.c test/check_app.c $(ls lcs*.c | grep -v lcs_main.c) \
+ *       tmr.c tmr_platform.c vldv_host.c vldv_vlon.c vldv_linux.c pal/pal.c pal/pal_sim_driver.c \
+ *       -lpthread -o pal_power_cut_check
+ *   ./pal_power_cut_check
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "echstd.h"
+#include "pal.h"
+#include "pal_internal.h"
+
+#define FLASH_FILE		"pal_power_cut_check.dat"
+#define NUM_STEPS		120
+#define NUM_TYPES		4		// Block types 1 to 3 are used
+#define RESTART_TIMEOUT	10		// Seconds before a hung child is failed
+
+// Type 1 is queued, type 2 written synchronously and type 3 spread over several pages
+static const UInt16 blockLen[NUM_TYPES] = { 0, 200, 100, 1000 };
+
+// Bytes of the cut operation that reach the flash
+static const UInt16 cutBytes[] = { 0, 5, 20, 60 };
+
+// What the workload got done before the power failed, shared with the parent
+typedef struct
+{
+	UInt16	started[NUM_TYPES];		// Newest version handed to the PAL
+	UInt16	completed[NUM_TYPES];	// Newest version whose write returned success
+	Bool	powerCut;
+} Progress;
+
+static Progress *pProgress;
+
+extern UInt32 palSimPowerCutAfter;
+extern UInt16 palSimPowerCutBytes;
+extern Bool palSimPowerOff;
+extern UInt32 palSimEraseUsec;
+extern UInt32 palSimProgramUsec;
+extern const char *palSimFlashFileName;
+
+static UInt8 flashCopy[PAL_EXT_NUM_PAGES * PAL_EXT_PAGE_SIZE];
+
+// The contents of a version of a block. Queued writes keep a buffer per version, as the data
+// is read when the write starts.
+static void FillBlock(UInt8 *pData, PalBlockType blockType, UInt16 version)
+{
+	UInt16 i;
+
+	pData[0] = (UInt8)version;
+	pData[1] = (UInt8)(version >> 8);
+	for (i = 2; i < blockLen[blockType]; i++)
+	{
+		pData[i] = (UInt8)(i * 13 + version * 7 + blockType);
+	}
+}
+
+// Returns the version in the block, or 0 if it is not a whole version
+static UInt16 BlockVersion(const UInt8 *pData, PalBlockType blockType)
+{
+	UInt8 expected[PAL_MAX_BLOCK_SIZE];
+	UInt16 version = pData[0] | (pData[1] << 8);
+
+	FillBlock(expected, blockType, version);
+	if (memcmp(pData, expected, blockLen[blockType]) != 0)
+	{
+		version = 0;
+	}
+	return version;
+}
+
+static void Started(PalBlockType blockType, UInt16 version)
+{
+	pProgress->started[blockType] = version;
+}
+
+static void Completed(PalBlockType blockType, EchErr sts)
+{
+	if (sts == ECHERR_OK)
+	{
+		pProgress->completed[blockType] = pProgress->started[blockType];
+	}
+}
+
+// Runs the workload until it ends or the power fails
+static void Workload(void)
+{
+	static UInt8 queued[4][PAL_MAX_BLOCK_SIZE];
+	UInt8 data[PAL_MAX_BLOCK_SIZE];
+	UInt16 version[NUM_TYPES] = { 0 };
+	UInt16 step;
+	UInt16 offset;
+	UInt16 len;
+	UInt8 *pQueued;
+	EchErr sts;
+
+	PAL_Init();
+	for (step = 0; (step < NUM_STEPS) && !palSimPowerOff; step++)
+	{
+		switch (step % 4)
+		{
+		case 0:
+			// Every third write of type 2 is unchanged, and skipped
+			if ((step % 12 != 8) || (version[2] == 0))
+			{
+				version[2]++;
+			}
+			FillBlock(data, 2, version[2]);
+			Started(2, version[2]);
+			Completed(2, PAL_ExtWriteNvmBlockByType(data, blockLen[2], 2));
+			break;
+		case 1:
+			pQueued = queued[++version[1] % 4];
+			FillBlock(pQueued, 1, version[1]);
+			Started(1, version[1]);
+			if (PAL_ExtQueueNvmBlockByType(pQueued, blockLen[1], 1) == ECHERR_OK)
+			{
+				PAL_ExtServiceNvm();
+				if (step % 8 == 5)
+				{
+					Completed(1, PAL_ExtFlushNvm());
+				}
+			}
+			break;
+		case 2:
+			FillBlock(data, 3, ++version[3]);
+			Started(3, version[3]);
+			if (step % 8 == 2)
+			{
+				sts = PAL_ExtWriteNvmBlockByType(data, blockLen[3], 3);
+			}
+			else
+			{
+				// Streamed in uneven pieces
+				sts = PAL_ExtOpenNvmBlockWrite(blockLen[3], 3);
+				for (offset = 0; (offset < blockLen[3]) && (sts == ECHERR_OK); offset += len)
+				{
+					len = (blockLen[3] - offset < 37) ? blockLen[3] - offset : 37;
+					sts = PAL_ExtWriteNvmBlockData(&data[offset], len);
+				}
+				if (sts == ECHERR_OK)
+				{
+					sts = PAL_ExtCloseNvmBlockWrite();
+				}
+			}
+			Completed(3, sts);
+			break;
+		default:
+			PAL_ExtReclaimStep();
+			PAL_ExtServiceNvm();
+			break;
+		}
+	}
+	if (!palSimPowerOff)
+	{
+		Completed(1, PAL_ExtFlushNvm());
+	}
+	pProgress->powerCut = palSimPowerOff;
+}
+
+// Reads every block after a restart and checks its version. Returns the number of failures.
+static int CheckBlocks(const UInt16 *pOldest, const UInt16 *pNewest, const char *when)
+{
+	UInt8 data[PAL_MAX_BLOCK_SIZE];
+	PalBlockType blockType;
+	UInt16 version;
+	EchErr sts;
+	int failures = 0;
+
+	for (blockType = 1; blockType < NUM_TYPES; blockType++)
+	{
+		memset(data, 0, sizeof(data));
+		sts = PAL_ExtReadNvmBlockByType(data, blockLen[blockType], blockType);
+		version = (sts == ECHERR_OK) ? BlockVersion(data, blockType) : 0;
+		if ((sts != ECHERR_OK) && (pOldest[blockType] == 0))
+		{
+			// Never written as far as anyone knows
+		}
+		else if ((version == 0) || (version < pOldest[blockType]) || (version > pNewest[blockType]))
+		{
+			printf("FAIL: %s, type %u read status %d version %u, expected %u to %u\n", when, blockType,
+				(int)sts, version, pOldest[blockType], pNewest[blockType]);
+			failures++;
+		}
+	}
+	return failures;
+}
+
+// Restarts the PAL from the flash and checks the blocks, then writes each one again.
+// Returns the number of failures.
+static int Restart(Bool fromScan)
+{
+	UInt8 data[PAL_MAX_BLOCK_SIZE];
+	UInt16 version[NUM_TYPES];
+	PalBlockType blockType;
+	UInt16 page;
+	UInt16 round;
+	int failures;
+
+	if (fromScan)
+	{
+		// Without a summary the restart reads every page header
+		PAL_SimInit();
+		for (page = 0; page < PAL_SUMMARY_NUM_PAGES; page++)
+		{
+			PAL_ExtErasePage(PAL_PART_DYN_AREA_START_PAGE + page);
+		}
+	}
+	PAL_Init();
+	failures = CheckBlocks(pProgress->completed, pProgress->started, fromScan ? "scan" : "summary");
+
+	memcpy(version, pProgress->started, sizeof(version));
+	for (round = 0; (round < 3) && (failures == 0); round++)
+	{
+		for (blockType = 1; blockType < NUM_TYPES; blockType++)
+		{
+			FillBlock(data, blockType, ++version[blockType]);
+			if (PAL_ExtWriteNvmBlockByType(data, blockLen[blockType], blockType) != ECHERR_OK)
+			{
+				printf("FAIL: write of type %u after restart\n", blockType);
+				failures++;
+			}
+			PAL_ExtReclaimStep();
+		}
+		failures += CheckBlocks(version, version, "after restart");
+	}
+	return failures;
+}
+
+// Runs fn in a child process and returns its exit status
+static int RunChild(int (*fn)(Bool), Bool arg)
+{
+	pid_t pid;
+	int status = -1;
+
+	fflush(stdout);
+	pid = fork();
+	if (pid == 0)
+	{
+		alarm(RESTART_TIMEOUT);
+		exit(fn(arg) != 0);
+	}
+	if ((pid < 0) || (waitpid(pid, &status, 0) != pid) || !WIFEXITED(status))
+	{
+		return -1;
+	}
+	return WEXITSTATUS(status);
+}
+
+static int RunWorkload(Bool unused)
+{
+	(void)unused;
+	Workload();
+	return 0;
+}
+
+static Bool CopyFlash(Bool save)
+{
+	FILE *pFile = fopen(FLASH_FILE, save ? "rb" : "r+b");
+	Bool ok = (pFile != NULL);
+
+	if (ok)
+	{
+		ok = save ? (fread(flashCopy, sizeof(flashCopy), 1, pFile) == 1)
+				  : (fwrite(flashCopy, sizeof(flashCopy), 1, pFile) == 1);
+		fclose(pFile);
+	}
+	return ok;
+}
+
+int main(void)
+{
+	UInt32 cutAfter;
+	UInt16 i;
+	int status;
+	int trials = 0;
+	int failures = 0;
+	Bool done = FALSE;
+
+	pProgress = mmap(NULL, sizeof(Progress), PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+	if (pProgress == MAP_FAILED)
+	{
+		printf("FAIL: no shared memory\n");
+		return 1;
+	}
+	palSimFlashFileName = FLASH_FILE;
+	palSimEraseUsec = 0;
+	palSimProgramUsec = 0;
+
+	for (cutAfter = 1; !done && (failures < 10); cutAfter++)
+	{
+		for (i = 0; !done && (i < sizeof(cutBytes) / sizeof(cutBytes[0])); i++)
+		{
+			remove(FLASH_FILE);
+			memset(pProgress, 0, sizeof(Progress));
+			palSimPowerCutAfter = cutAfter;
+			palSimPowerCutBytes = cutBytes[i];
+			status = RunChild(RunWorkload, FALSE);
+			palSimPowerCutAfter = 0;
+			if (!pProgress->powerCut)
+			{
+				// The workload finished before the cut: every point has been tried
+				done = TRUE;
+			}
+			if ((status != 0) || !CopyFlash(TRUE))
+			{
+				printf("FAIL: workload, cut after %u\n", (unsigned)cutAfter);
+				failures++;
+			}
+			else if ((RunChild(Restart, FALSE) != 0) || !CopyFlash(FALSE) || (RunChild(Restart, TRUE) != 0))
+			{
+				printf("  (cut during operation %u leaving %u bytes)\n", (unsigned)cutAfter, cutBytes[i]);
+				failures++;
+			}
+			trials++;
+		}
+	}
+	remove(FLASH_FILE);
+
+	printf("trials %d operations %u failures %d\n", trials, (unsigned)(cutAfter - 1), failures);
+	return failures != 0;
+}
@@ -0,0 +1,247 @@
+//
+// pal_reclaim_check.c
+//
+// Copyright (C) 2022 Dialog Semiconductor
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in 
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Checks the erased page pool and the erase counts.  Blocks of one, two and three pages are written at random, with
+// a random number of reclaim steps before each write, so the pool is sometimes full and sometimes empty.  The page
+// headers of the block area are compared before and after each write: while the pool holds enough pages for the
+// block, the write may only program erased pages, and every new header must carry one more than the erase count
+// its page last had.  The reclaim steps must fill the pool and no further, and no page may be left in use that is
+// not a current block page or in the pool.
+//
+
+/*
+ * Build and run from the repository root:
+ *   gcc -I. -Ipal -Itest -DPLATFORM_ID=PLATFORM_ID_LINUX -DLDV_VIRTUAL_CHANNEL \
+ *       test/pal_reclaim_check.c test/check_app.c $(ls lcs*.c | grep -v lcs_main.c) \
+ *       tmr.c tmr_platform.c vldv_host.c vldv_vlon.c vldv_linux.c pal/pal.c pal/pal_sim_driver.c \
+ *       -lpthread -o pal_reclaim_check
+ *   ./pal_reclaim_check
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "echstd.h"
+#include "pal.h"
+#include "pal_internal.h"
+
+#define FLASH_FILE		"pal_reclaim_check.dat"
+#define NUM_STEPS		4000
+#define NUM_TYPES		4		// Block types 1 to 3 are used
+
+// Block pages start after the summary pages
+#define FIRST_PAGE		(PAL_PART_DYN_AREA_START_PAGE + PAL_SUMMARY_NUM_PAGES)
+#define NUM_PAGES		(PAL_PART_LAST_PAGE + 1 - FIRST_PAGE)
+
+static const UInt16 blockLen[NUM_TYPES] = { 0, 100, 250, 600 };
+
+extern UInt32 palSimEraseUsec;
+extern UInt32 palSimProgramUsec;
+extern const char *palSimFlashFileName;
+
+static PalPageHdr pageHdrs[NUM_PAGES];
+static UInt16 eraseCounts[NUM_PAGES];	// As last seen in a valid header, 0 if none yet
+static int failures = 0;
+
+static void Fail(const char *what, int step, PalNvmPageNum page)
+{
+	if (failures++ < 10)
+	{
+		printf("FAIL: %s (step %d, page %u)\n", what, step, page);
+	}
+}
+
+static Bool IsErased(const PalPageHdr *pPageHdr)
+{
+	static const UInt8 erased[sizeof(PalPageHdr)] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+
+	return memcmp(pPageHdr, erased, sizeof(PalPageHdr)) == 0;
+}
+
+static UInt8 BlockPages(UInt16 len)
+{
+	return (len <= PAL_EXT_BLOCK_SIZE) ? 1 : 2 + (len - PAL_EXT_HEAD_DATA_SIZE - 1) / PAL_EXT_BLOCK_SIZE;
+}
+
+static void ReadHeaders(PalPageHdr *pHdrs)
+{
+	UInt16 i;
+
+	for (i = 0; i < NUM_PAGES; i++)
+	{
+		PAL_ExtReadPageHdr(&pHdrs[i], FIRST_PAGE + i);
+	}
+}
+
+// Erased pages held in the pool
+static UInt16 PoolPages(void)
+{
+	UInt16 count = 0;
+	UInt16 i;
+
+	for (i = 0; i < NUM_PAGES; i++)
+	{
+		if (PAL_PageInUse(FIRST_PAGE + i) && IsErased(&pageHdrs[i]))
+		{
+			count++;
+		}
+	}
+	return count;
+}
+
+// Compare the headers with those from before a write
+static void CheckWrite(int step, Bool poolEnough)
+{
+	PalPageHdr after[NUM_PAGES];
+	UInt16 i;
+
+	ReadHeaders(after);
+	for (i = 0; i < NUM_PAGES; i++)
+	{
+		if (memcmp(&after[i], &pageHdrs[i], sizeof(PalPageHdr)) == 0)
+		{
+			continue;
+		}
+		if (poolEnough && !IsErased(&pageHdrs[i]))
+		{
+			Fail("page erased by a write while the pool had pages", step, FIRST_PAGE + i);
+		}
+		if (!IsErased(&after[i]))
+		{
+			if (!PAL_ValidateHdrCrc(&after[i]) || (after[i].eraseCount != eraseCounts[i] + 1))
+			{
+				Fail("wrong erase count in a new header", step, FIRST_PAGE + i);
+			}
+			eraseCounts[i] = after[i].eraseCount;
+		}
+	}
+	memcpy(pageHdrs, after, sizeof(pageHdrs));
+}
+
+// Every page in use must be a current block page or in the pool
+static void CheckPagesInUse(int step)
+{
+	PalTypeCurPageEntry *pEntry;
+	PalBlockType blockType;
+	UInt16 blockPages = 0;
+	UInt16 inUse = 0;
+	UInt16 i;
+
+	for (blockType = 1; blockType < NUM_TYPES; blockType++)
+	{
+		if (PAL_ExtFindBlockTypeEntry(blockType, &pEntry) == ECHERR_OK)
+		{
+			blockPages += pEntry->numPages;
+		}
+	}
+	for (i = 0; i < NUM_PAGES; i++)
+	{
+		inUse += PAL_PageInUse(FIRST_PAGE + i);
+	}
+	if (inUse != blockPages + PoolPages())
+	{
+		Fail("pages in use that are neither block pages nor in the pool", step, inUse);
+	}
+}
+
+static void CheckBlocks(int step, const UInt8 *pSeeds)
+{
+	UInt8 data[PAL_MAX_BLOCK_SIZE];
+	PalBlockType blockType;
+	UInt16 i;
+
+	for (blockType = 1; blockType < NUM_TYPES; blockType++)
+	{
+		if ((PAL_ExtReadNvmBlockByType(data, blockLen[blockType], blockType) != ECHERR_OK) && (pSeeds[blockType] != 0))
+		{
+			Fail("block did not read back", step, blockType);
+			continue;
+		}
+		for (i = 0; (i < blockLen[blockType]) && (pSeeds[blockType] != 0); i++)
+		{
+			if (data[i] != (UInt8)(i * 7 + pSeeds[blockType]))
+			{
+				Fail("block data wrong", step, blockType);
+				break;
+			}
+		}
+	}
+}
+
+int main(void)
+{
+	UInt8 data[PAL_MAX_BLOCK_SIZE];
+	UInt8 seeds[NUM_TYPES] = { 0 };
+	PalBlockType blockType;
+	UInt16 pool;
+	UInt16 i;
+	int steps;
+	int step;
+	int fromPool = 0;
+
+	palSimFlashFileName = FLASH_FILE;
+	palSimEraseUsec = 0;
+	palSimProgramUsec = 0;
+	remove(FLASH_FILE);
+	PAL_Init();
+	ReadHeaders(pageHdrs);
+
+	for (step = 0; step < NUM_STEPS; step++)
+	{
+		// Reclaim steps, which may only erase free pages into the pool
+		for (steps = rand() % (PAL_ERASED_POOL_SIZE + 3); steps > 0; steps--)
+		{
+			pool = PoolPages();
+			PAL_ExtReclaimStep();
+			ReadHeaders(pageHdrs);
+			if (PoolPages() != ((pool < PAL_ERASED_POOL_SIZE) ? pool + 1 : pool))
+			{
+				Fail("reclaim step did not add one page to the pool", step, pool);
+			}
+		}
+
+		blockType = 1 + rand() % (NUM_TYPES - 1);
+		seeds[blockType] = (UInt8)(1 + rand() % 255);
+		for (i = 0; i < blockLen[blockType]; i++)
+		{
+			data[i] = (UInt8)(i * 7 + seeds[blockType]);
+		}
+		pool = PoolPages();
+		if (pool >= BlockPages(blockLen[blockType]))
+		{
+			fromPool++;
+		}
+		if (PAL_ExtWriteNvmBlockByType(data, blockLen[blockType], blockType) != ECHERR_OK)
+		{
+			Fail("write failed", step, blockType);
+		}
+		CheckWrite(step, pool >= BlockPages(blockLen[blockType]));
+		CheckPagesInUse(step);
+		CheckBlocks(step, seeds);
+	}
+	remove(FLASH_FILE);
+
+	printf("writes %d from the pool %d failures %d\n", NUM_STEPS, fromPool, failures);
+	return failures != 0;
+}
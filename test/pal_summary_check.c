@@ -0,0 +1,239 @@
+//
+// pal_summary_check.c
+//
+// Copyright (C) 2022 Dialog Semiconductor
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in 
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Checks that a restart from the summary gives the same current page table as a full scan.  Random blocks of up
+// to PAL_MAX_BLOCK_SIZE bytes are written, with reclaim steps in between, and every so often the PAL is restarted
+// from the summary and the table compared with the one it had before.  Every other time the summary pages are
+// erased and it is restarted again from a full scan, which must give the same table.  All blocks must read back
+// after each restart, and most restarts must have had a summary to start from.
+//
+
+/*
+ * Build and run from the repository root:
+ *   gcc -I. -Ipal -Itest -DPLATFORM_ID=PLATFORM_ID_LINUX -DLDV_VIRTUAL_CHANNEL \
+ *       test/pal_summary_check.c test/check_app.c $(ls lcs*.c | grep -v lcs_main.c) \
+ *       tmr.c tmr_platform.c vldv_host.c vldv_vlon.c vldv_linux.c pal/pal.c pal/pal_sim_driver.c \
+ *       -lpthread -o pal_summary_check
+ *   ./pal_summary_check
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "echstd.h"
+#include "pal.h"
+#include "pal_internal.h"
+
+#define FLASH_FILE		"pal_summary_check.dat"
+#define NUM_STEPS		4000
+#define NUM_TYPES		7		// Block types 1 to 6 are used
+#define RESTART_EVERY	40
+
+typedef struct
+{
+	Bool			found;
+	PalNvmPageNum	curPageNum;
+	PalPageSeqNum	seqNum;
+	UInt8			numPages;
+} TableEntry;
+
+extern PalNvmPageNum lastDynamicPageUsed;
+extern UInt32 palSimEraseUsec;
+extern UInt32 palSimProgramUsec;
+extern const char *palSimFlashFileName;
+
+static UInt16 blockLen[NUM_TYPES];
+static UInt8 blockSeed[NUM_TYPES];
+static int failures = 0;
+
+static void Fail(const char *what, int step, PalBlockType blockType)
+{
+	if (failures++ < 10)
+	{
+		printf("FAIL: %s (step %d, type %u)\n", what, step, blockType);
+	}
+}
+
+static void FillBlock(UInt8 *pData, UInt16 len, UInt8 seed)
+{
+	UInt16 i;
+
+	for (i = 0; i < len; i++)
+	{
+		pData[i] = (UInt8)(i * 7 + seed);
+	}
+}
+
+// Start over as after a reset, optionally without a summary
+static void Restart(Bool fromScan)
+{
+	UInt16 page;
+
+	if (fromScan)
+	{
+		for (page = 0; page < PAL_SUMMARY_NUM_PAGES; page++)
+		{
+			PAL_ExtErasePage(PAL_PART_DYN_AREA_START_PAGE + page);
+		}
+	}
+	PAL_ClearExtCurPageTable();
+	lastDynamicPageUsed = 0;
+	PAL_Init();
+}
+
+static void GetTable(TableEntry *pTable)
+{
+	PalTypeCurPageEntry *pEntry;
+	PalBlockType blockType;
+
+	memset(pTable, 0, NUM_TYPES * sizeof(TableEntry));
+	for (blockType = 1; blockType < NUM_TYPES; blockType++)
+	{
+		if (PAL_ExtFindBlockTypeEntry(blockType, &pEntry) == ECHERR_OK)
+		{
+			pTable[blockType].found = TRUE;
+			pTable[blockType].curPageNum = pEntry->curPageNum;
+			pTable[blockType].seqNum = pEntry->seqNum;
+			pTable[blockType].numPages = pEntry->numPages;
+		}
+	}
+}
+
+static void CompareTable(const TableEntry *pBefore, const char *what, int step)
+{
+	TableEntry after[NUM_TYPES];
+	PalBlockType blockType;
+
+	GetTable(after);
+	for (blockType = 1; blockType < NUM_TYPES; blockType++)
+	{
+		if (memcmp(&pBefore[blockType], &after[blockType], sizeof(TableEntry)) != 0)
+		{
+			Fail(what, step, blockType);
+		}
+	}
+}
+
+static void CheckBlocks(int step)
+{
+	UInt8 expected[PAL_MAX_BLOCK_SIZE];
+	UInt8 data[PAL_MAX_BLOCK_SIZE];
+	PalBlockType blockType;
+
+	for (blockType = 1; blockType < NUM_TYPES; blockType++)
+	{
+		if (blockLen[blockType] != 0)
+		{
+			FillBlock(expected, blockLen[blockType], blockSeed[blockType]);
+			if ((PAL_ExtReadNvmBlockByType(data, blockLen[blockType], blockType) != ECHERR_OK) ||
+				(memcmp(data, expected, blockLen[blockType]) != 0))
+			{
+				Fail("block did not read back", step, blockType);
+			}
+		}
+	}
+}
+
+// True if one of the summary pages holds a valid summary
+static Bool HaveSummary(void)
+{
+	PalPageHdr pageHdr;
+	UInt16 page;
+	Bool found = FALSE;
+
+	for (page = 0; page < PAL_SUMMARY_NUM_PAGES; page++)
+	{
+		PAL_ExtReadPageHdr(&pageHdr, PAL_PART_DYN_AREA_START_PAGE + page);
+		if ((pageHdr.blockType == PAL_BLOCK_TYPE_SUMMARY) && (pageHdr.flags & PAL_PAGE_HDR_FLAG_VALID) &&
+			PAL_ValidateHdrCrc(&pageHdr))
+		{
+			found = TRUE;
+		}
+	}
+	return found;
+}
+
+int main(void)
+{
+	UInt8 data[PAL_MAX_BLOCK_SIZE];
+	TableEntry table[NUM_TYPES];
+	PalBlockType blockType;
+	UInt16 len;
+	int step;
+	int steps;
+	int restarts = 0;
+	int fromSummary = 0;
+
+	palSimFlashFileName = FLASH_FILE;
+	palSimEraseUsec = 0;
+	palSimProgramUsec = 0;
+	remove(FLASH_FILE);
+	PAL_Init();
+
+	for (step = 0; step < NUM_STEPS; step++)
+	{
+		blockType = 1 + rand() % (NUM_TYPES - 1);
+		len = (rand() % 5 != 0) ? 1 + rand() % PAL_EXT_BLOCK_SIZE : 1 + rand() % PAL_MAX_BLOCK_SIZE;
+		blockSeed[blockType] = (UInt8)rand();
+		FillBlock(data, len, blockSeed[blockType]);
+		if (PAL_ExtWriteNvmBlockByType(data, len, blockType) == ECHERR_OK)
+		{
+			blockLen[blockType] = len;
+		}
+		else
+		{
+			Fail("write failed", step, blockType);
+		}
+
+		for (steps = (rand() % 3 == 0) ? rand() % 5 : 0; steps > 0; steps--)
+		{
+			PAL_ExtReclaimStep();
+		}
+
+		if (step % RESTART_EVERY == RESTART_EVERY - 1)
+		{
+			if (HaveSummary())
+			{
+				fromSummary++;
+			}
+			GetTable(table);
+			Restart(FALSE);
+			CompareTable(table, "table differs after a restart from the summary", step);
+			if (restarts++ & 1)
+			{
+				Restart(TRUE);
+				CompareTable(table, "table differs after a restart from a full scan", step);
+			}
+			CheckBlocks(step);
+		}
+	}
+	remove(FLASH_FILE);
+
+	if (fromSummary * 2 < restarts)
+	{
+		Fail("too few restarts had a summary", step, 0);
+	}
+	printf("restarts %d from summary %d failures %d\n", restarts, fromSummary, failures);
+	return failures != 0;
+}
@@ -0,0 +1,233 @@
+//
+// pal_unchanged_check.c
+//
+// Copyright (C) 2022 Dialog Semiconductor
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in 
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Checks that rewriting a block with the same data is skipped and that a changed block always moves to a new page.
+// Blocks are rewritten at random unchanged, with a bit cleared or with a bit set, through both the synchronous and
+// the queued write.  An unchanged single page block must cost no flash operation at all, which the simulated flash's
+// power cut checks by failing the first one.  Any other write must give the block a new page and sequence number, and leave every byte of the old copy as it was.
+// The PAL is restarted from time to time.
+//
+
+/*
+ * Build and run from the repository root:
+ *   gcc -I. -Ipal -Itest -DPLATFORM_ID=PLATFORM_ID_LINUX -DLDV_VIRTUAL_CHANNEL \
+ *       test/pal_unchanged_check.c test/check_app.c $(ls lcs*.c | grep -v lcs_main.c) \
+ *       tmr.c tmr_platform.c vldv_host.c vldv_vlon.c vldv_linux.c pal/pal.c pal/pal_sim_driver.c \
+ *       -lpthread -o pal_unchanged_check
+ *   ./pal_unchanged_check
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "echstd.h"
+#include "pal.h"
+#include "pal_internal.h"
+
+#define FLASH_FILE		"pal_unchanged_check.dat"
+#define NUM_STEPS		4000
+#define NUM_TYPES		4		// Block types 1 to 3 are used
+#define RESTART_EVERY	500
+
+// Type 1 is also queued, and type 3 is spread over several pages, so it is never skipped
+static const UInt16 blockLen[NUM_TYPES] = { 0, 64, PAL_EXT_BLOCK_SIZE, 700 };
+
+typedef enum
+{
+	REWRITE_SAME,
+	REWRITE_CLEAR_BIT,
+	REWRITE_SET_BIT,
+	REWRITE_KINDS
+} RewriteKind;
+
+extern PalNvmPageNum lastDynamicPageUsed;
+extern UInt32 palSimPowerCutAfter;
+extern Bool palSimPowerOff;
+extern UInt32 palSimEraseUsec;
+extern UInt32 palSimProgramUsec;
+extern const char *palSimFlashFileName;
+
+static UInt8 blocks[NUM_TYPES][PAL_MAX_BLOCK_SIZE];
+static UInt8 pagesBefore[PAL_MAX_BLOCK_PAGES][PAL_EXT_PAGE_SIZE];
+static int failures = 0;
+
+static void Fail(const char *what, int step, PalBlockType blockType)
+{
+	if (failures++ < 10)
+	{
+		printf("FAIL: %s (step %d, type %u)\n", what, step, blockType);
+	}
+}
+
+// The pages of the current copy of a block, head first. Returns how many.
+static UInt8 BlockPages(const PalTypeCurPageEntry *pEntry, PalNvmPageNum *pPages)
+{
+	PalBlockPageList list;
+	UInt8 i;
+
+	pPages[0] = pEntry->curPageNum;
+	if (pEntry->numPages > 1)
+	{
+		PAL_ExtReadPageMasked(&list, sizeof(PalPageHdr), sizeof(list), pEntry->curPageNum);
+		for (i = 1; i < pEntry->numPages; i++)
+		{
+			pPages[i] = list.pages[i - 1];
+		}
+	}
+	return (pEntry->numPages > 1) ? pEntry->numPages : 1;
+}
+
+static EchErr Write(PalBlockType blockType, Bool queued)
+{
+	EchErr sts;
+
+	if (queued)
+	{
+		sts = PAL_ExtQueueNvmBlockByType(blocks[blockType], blockLen[blockType], blockType);
+		if (sts == ECHERR_OK)
+		{
+			sts = PAL_ExtFlushNvm();
+		}
+	}
+	else
+	{
+		sts = PAL_ExtWriteNvmBlockByType(blocks[blockType], blockLen[blockType], blockType);
+	}
+	return sts;
+}
+
+// Rewrite a block that has been written before, and check what happened on the flash
+static void Rewrite(int step, PalBlockType blockType, RewriteKind kind, Bool queued)
+{
+	UInt8 data[PAL_MAX_BLOCK_SIZE];
+	PalNvmPageNum pages[PAL_MAX_BLOCK_PAGES];
+	PalTypeCurPageEntry *pEntry;
+	PalTypeCurPageEntry before;
+	UInt16 offset;
+	UInt8 bit;
+	UInt8 numPages;
+	UInt8 i;
+	Bool skip;
+
+	offset = rand() % blockLen[blockType];
+	bit = (UInt8)(1 << (rand() % 8));
+	if (kind == REWRITE_CLEAR_BIT)
+	{
+		blocks[blockType][offset] &= (UInt8)~bit;
+	}
+	else if (kind == REWRITE_SET_BIT)
+	{
+		blocks[blockType][offset] |= bit;
+	}
+
+	PAL_ExtFindBlockTypeEntry(blockType, &pEntry);
+	before = *pEntry;
+	numPages = BlockPages(pEntry, pages);
+	for (i = 0; i < numPages; i++)
+	{
+		PAL_ExtReadPageMasked(pagesBefore[i], 0, PAL_EXT_PAGE_SIZE, pages[i]);
+	}
+	PAL_ExtReadNvmBlockByType(data, blockLen[blockType], blockType);
+	skip = (numPages == 1) && (memcmp(data, blocks[blockType], blockLen[blockType]) == 0);
+
+	// Any flash operation cuts the power, so none may happen when the write is skipped
+	palSimPowerCutAfter = skip ? 1 : 0;
+	if (Write(blockType, queued) != ECHERR_OK)
+	{
+		Fail("write failed", step, blockType);
+	}
+	palSimPowerCutAfter = 0;
+	if (palSimPowerOff)
+	{
+		Fail("unchanged block was programmed", step, blockType);
+		PAL_SimInit();
+	}
+
+	if (skip && ((pEntry->curPageNum != before.curPageNum) || (pEntry->seqNum != before.seqNum)))
+	{
+		Fail("unchanged block moved", step, blockType);
+	}
+	if (!skip && ((pEntry->curPageNum == before.curPageNum) || (pEntry->seqNum == before.seqNum)))
+	{
+		Fail("changed block did not move to a new page", step, blockType);
+	}
+	for (i = 0; i < numPages; i++)
+	{
+		PAL_ExtReadPageMasked(data, 0, PAL_EXT_PAGE_SIZE, pages[i]);
+		if (memcmp(data, pagesBefore[i], PAL_EXT_PAGE_SIZE) != 0)
+		{
+			Fail("old copy of the block was programmed", step, blockType);
+		}
+	}
+	if ((PAL_ExtReadNvmBlockByType(data, blockLen[blockType], blockType) != ECHERR_OK) ||
+		(memcmp(data, blocks[blockType], blockLen[blockType]) != 0))
+	{
+		Fail("block did not read back", step, blockType);
+	}
+}
+
+int main(void)
+{
+	PalBlockType blockType;
+	UInt16 i;
+	int step;
+
+	palSimFlashFileName = FLASH_FILE;
+	palSimEraseUsec = 0;
+	palSimProgramUsec = 0;
+	remove(FLASH_FILE);
+	PAL_Init();
+
+	for (blockType = 1; blockType < NUM_TYPES; blockType++)
+	{
+		for (i = 0; i < blockLen[blockType]; i++)
+		{
+			blocks[blockType][i] = (UInt8)rand();
+		}
+		if (Write(blockType, FALSE) != ECHERR_OK)
+		{
+			Fail("first write failed", -1, blockType);
+		}
+	}
+
+	for (step = 0; step < NUM_STEPS; step++)
+	{
+		blockType = 1 + rand() % (NUM_TYPES - 1);
+		Rewrite(step, blockType, (RewriteKind)(rand() % REWRITE_KINDS), (blockType == 1) && (rand() & 1));
+		if (rand() & 1)
+		{
+			PAL_ExtReclaimStep();
+		}
+		if (step % RESTART_EVERY == RESTART_EVERY - 1)
+		{
+			PAL_ClearExtCurPageTable();
+			lastDynamicPageUsed = 0;
+			PAL_Init();
+		}
+	}
+	remove(FLASH_FILE);
+
+	printf("rewrites %d failures %d\n", NUM_STEPS, failures);
+	return failures != 0;
+}
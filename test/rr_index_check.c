@@ -0,0 +1,321 @@
+//
+// rr_index_check.c
+//
+//
+// Copyright (C) 2022 Dialog Semiconductor
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in 
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Checks the receive record indexes in lcs_tsa.c against a scan of the records.  A few hundred records are
+// allocated, rekeyed and released at random, in phases that fill the pool up and drain it again, with source
+// addresses and request ids drawn from small sets so that many records share a key and every bucket holds a long
+// chain.  RetrieveRR() must return the lowest record in use with a matching source, FindRR() the lowest session
+// record in use with the request id, every chain must hold exactly the records in use for its bucket in index
+// order, and every record must be either in use or on the free list.
+//
+
+/*
+ * Build and run from the repository root (lcs_tsa.c is included, so it is left out of the sources):
+ *   gcc -I. -Ipal -Itest -DPLATFORM_ID=PLATFORM_ID_LINUX -DLDV_VIRTUAL_CHANNEL \
+ *       -DRECEIVE_TRANS_COUNT=300 -DMALLOC_SIZE=100000 \
+ *       test/rr_index_check.c test/check_app.c $(ls lcs*.c | grep -v -e lcs_main.c -e lcs_tsa.c) \
+ *       tmr.c tmr_platform.c vldv_host.c vldv_vlon.c vldv_linux.c pal/pal.c pal/pal_sim_driver.c \
+ *       -lpthread -o rr_index_check
+ *   ./rr_index_check
+ */
+
+#include "lcs.h"
+#include "lcs_tsa.c"
+
+#if RECEIVE_TRANS_COUNT < 200
+#error "Build with -DRECEIVE_TRANS_COUNT=300 -DMALLOC_SIZE=100000 so the chains grow long"
+#endif
+
+#define NUM_STEPS   100000
+#define PHASE_STEPS 2500    /* Steps spent filling the pool, then draining it */
+
+static void RandomSource(SourceAddress *srcAddrOut, Boolean *priorityOut)
+{
+    static const AddrMode mode[] = { SUBNET_NODE, BROADCAST, MULTICAST, MULTICAST_ACK };
+
+    memset(srcAddrOut, 0, sizeof(*srcAddrOut));
+    srcAddrOut->subnetAddr.subnet   = rand() % 2 + 1;
+    srcAddrOut->subnetAddr.node     = rand() % 4 + 1;
+    srcAddrOut->subnetAddr.selField = 1;
+    srcAddrOut->addressMode         = mode[rand() % 4];
+    srcAddrOut->dmn.domainIndex     = rand() % 2;
+    srcAddrOut->group               = rand() % 2;
+    srcAddrOut->broadcastSubnet     = rand() % 2;
+    *priorityOut                    = rand() % 2;
+}
+
+/* Fill in a record the way TPReceive and SNReceive do before binding it */
+static void RandomRecord(int16 rrIndexIn)
+{
+    ReceiveRecord *rrPtr = &gp->recvRec[rrIndexIn];
+
+    RandomSource(&rrPtr->srcAddr, &rrPtr->priority);
+    rrPtr->status      = rand() % 2 ? SESSION_RR : TRANSPORT_RR;
+    rrPtr->reqId       = rand() % 40;
+    rrPtr->serviceType = rand() % 2 ? REQUEST : ACKD;
+    rrPtr->transState  = rand() % 2 ? DELIVERED : JUST_RECEIVED;
+}
+
+static int16 ScanRetrieve(SourceAddress *srcAddrIn, Boolean priorityIn)
+{
+    ReceiveRecord *rrPtr;
+    int16          i;
+
+    for (i = 0; i < gp->recvRecCnt; i++)
+    {
+        rrPtr = &gp->recvRec[i];
+        if (rrPtr->status != UNUSED_RR &&
+            rrPtr->priority == priorityIn &&
+            rrPtr->srcAddr.dmn.domainIndex == srcAddrIn->dmn.domainIndex &&
+            rrPtr->srcAddr.addressMode == srcAddrIn->addressMode &&
+            memcmp(&rrPtr->srcAddr.subnetAddr, &srcAddrIn->subnetAddr, sizeof(SubnetAddress)) == 0 &&
+            (srcAddrIn->addressMode != BROADCAST ||
+             rrPtr->srcAddr.broadcastSubnet == srcAddrIn->broadcastSubnet) &&
+            (srcAddrIn->addressMode != MULTICAST ||
+             rrPtr->srcAddr.group == srcAddrIn->group))
+        {
+            return(i);
+        }
+    }
+    return(-1);
+}
+
+static uint16 ScanFind(RequestId idIn)
+{
+    uint16 i;
+
+    for (i = 0; i < gp->recvRecCnt; i++)
+    {
+        if (gp->recvRec[i].status == SESSION_RR && gp->recvRec[i].reqId == idIn)
+        {
+            break;
+        }
+    }
+    return(i);
+}
+
+/* Walk one index, marking the records found on it. Returns the longest
+   chain, or -1 if a chain is out of order or holds a record that does
+   not belong in its bucket. */
+static int CheckChains(int16 *hashIn, int16 *nextIn, Boolean reqIndexIn, Byte *seenOut)
+{
+    ReceiveRecord *rrPtr;
+    uint16         bucket;
+    int16          i;
+    int            length;
+    int            longest = 0;
+
+    memset(seenOut, 0, gp->recvRecCnt);
+    for (bucket = 0; bucket < RECEIVE_TRANS_HASH_SIZE; bucket++)
+    {
+        length = 0;
+        for (i = hashIn[bucket]; i != -1; i = nextIn[i])
+        {
+            if (i < 0 || i >= gp->recvRecCnt)
+            {
+                return -1;
+            }
+            rrPtr = &gp->recvRec[i];
+            if (seenOut[i] || (nextIn[i] != -1 && nextIn[i] <= i) ||
+                rrPtr->status == UNUSED_RR ||
+                (reqIndexIn ? RRReqHash(rrPtr->reqId) : RRSrcHash(&rrPtr->srcAddr, rrPtr->priority)) != bucket)
+            {
+                return -1;
+            }
+            seenOut[i] = 1;
+            length++;
+        }
+        if (length > longest)
+        {
+            longest = length;
+        }
+    }
+    return longest;
+}
+
+/* Every record in use must be on the source index once, and a session
+   record with a request id on the request id index once. */
+static int CheckIndices(int *longestOut)
+{
+    static Byte srcSeen[RECEIVE_TRANS_COUNT];
+    static Byte reqSeen[RECEIVE_TRANS_COUNT];
+    ReceiveRecord *rrPtr;
+    int            srcLongest;
+    int            reqLongest;
+    int16          i;
+
+    srcLongest = CheckChains(gp->rrSrcHash, gp->rrSrcNext, FALSE, srcSeen);
+    reqLongest = CheckChains(gp->rrReqHash, gp->rrReqNext, TRUE, reqSeen);
+    if (srcLongest < 0 || reqLongest < 0)
+    {
+        return 1;
+    }
+    for (i = 0; i < gp->recvRecCnt; i++)
+    {
+        rrPtr = &gp->recvRec[i];
+        if (srcSeen[i] != (rrPtr->status != UNUSED_RR) ||
+            reqSeen[i] != (rrPtr->status == SESSION_RR && rrPtr->reqId != 0))
+        {
+            return 1;
+        }
+    }
+    if (srcLongest > *longestOut)
+    {
+        *longestOut = srcLongest;
+    }
+    if (reqLongest > *longestOut)
+    {
+        *longestOut = reqLongest;
+    }
+    return 0;
+}
+
+static int CheckFreeList(void)
+{
+    int16 i;
+    int   count = 0;
+
+    for (i = gp->rrFree; i != -1 && count <= gp->recvRecCnt; i = gp->rrSrcNext[i])
+    {
+        if (gp->recvRec[i].status != UNUSED_RR)
+        {
+            return 1;
+        }
+        count++;
+    }
+    for (i = 0; i < gp->recvRecCnt; i++)
+    {
+        if (gp->recvRec[i].status == UNUSED_RR)
+        {
+            count--;
+        }
+    }
+    return count != 0;
+}
+
+int main(void)
+{
+    SourceAddress srcAddr;
+    Boolean       priority;
+    RequestId     id;
+    uint16        found;
+    int16         i;
+    int           step;
+    int           op;
+    int           inUse = 0;
+    int           mostInUse = 0;
+    int           longest = 0;
+    int           failures = 0;
+
+    srand(1);
+    LCS_Init();
+
+    for (step = 0; step < NUM_STEPS && failures <= 10; step++)
+    {
+        i = rand() % gp->recvRecCnt;
+        op = rand() % 8;
+        if ((step / PHASE_STEPS) % 2)
+        {
+            /* Draining: mostly releases */
+            op = (op == 0) ? 0 : (op < 3) ? 1 : 2;
+        }
+        else
+        {
+            /* Filling: mostly allocations */
+            op = (op < 5) ? 0 : (op < 7) ? 1 : 2;
+        }
+        switch (op)
+        {
+        case 0:
+            i = AllocateRR();
+            if (i != -1)
+            {
+                RandomRecord(i);
+                BindRR(i);
+                inUse++;
+            }
+            else if (inUse != gp->recvRecCnt)
+            {
+                printf("FAIL: step %d AllocateRR failed with %d in use\n", step, inUse);
+                failures++;
+            }
+            break;
+        case 1:
+            /* A record in use being reinitialized for a new message */
+            if (gp->recvRec[i].status != UNUSED_RR)
+            {
+                UnbindRR(i);
+                RandomRecord(i);
+                BindRR(i);
+            }
+            break;
+        default:
+            if (gp->recvRec[i].status != UNUSED_RR)
+            {
+                ReleaseRR(i);
+                inUse--;
+            }
+            break;
+        }
+        if (inUse > mostInUse)
+        {
+            mostInUse = inUse;
+        }
+
+        RandomSource(&srcAddr, &priority);
+        if (RetrieveRR(srcAddr, priority) != ScanRetrieve(&srcAddr, priority))
+        {
+            printf("FAIL: step %d RetrieveRR %d expected %d\n", step,
+                   RetrieveRR(srcAddr, priority), ScanRetrieve(&srcAddr, priority));
+            failures++;
+        }
+
+        id = rand() % 39 + 1;
+        FindRR(id, &found);
+        if (found != ScanFind(id))
+        {
+            printf("FAIL: step %d FindRR(%d) %d expected %d\n", step, id, found, ScanFind(id));
+            failures++;
+        }
+
+        if (CheckFreeList())
+        {
+            printf("FAIL: step %d free list\n", step);
+            failures++;
+        }
+        if (CheckIndices(&longest))
+        {
+            printf("FAIL: step %d index chains\n", step);
+            failures++;
+        }
+    }
+
+    if (mostInUse != gp->recvRecCnt)
+    {
+        printf("FAIL: the pool was never full\n");
+        failures++;
+    }
+    printf("records %d longest chain %d failures %d\n", gp->recvRecCnt, longest, failures);
+    return failures != 0;
+}
@@ -0,0 +1,274 @@
+//
+// tid_check.c
+//
+// Copyright (C) 2022 Dialog Semiconductor
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in 
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Checks the TID table in lcs_tcs.c against a model of the transaction ids used per destination.  Transactions are
+// started and ended at random to more destinations than the table holds, on a simulated clock, with software and
+// power-up resets in between.  A new transaction must never get the tid last used for its destination while the
+// table remembers it, nor a tid in use, and NewTrans() may only fail when the destination has a transaction in
+// progress or when the table is full and its oldest entry has not been kept for MIN_TABLE_TIME yet.  The history
+// must survive a software reset and be cleared by a power-up reset.
+//
+
+/*
+ * Build and run from the repository root (the check supplies the clock, so tmr_platform.c is left out):
+ *   gcc -I. -Ipal -Itest -DPLATFORM_ID=PLATFORM_ID_LINUX -DLDV_VIRTUAL_CHANNEL \
+ *       test/tid_check.c test/check_app.c $(ls lcs*.c | grep -v lcs_main.c) \
+ *       tmr.c vldv_host.c vldv_vlon.c vldv_linux.c pal/pal.c pal/pal_sim_driver.c \
+ *       -lpthread -o tid_check
+ *   ./tid_check
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lcs.h"
+#include "lcs_node.h"
+#include "lcs_tcs.h"
+
+#define NUM_STEPS       200000
+#define NUM_DEST        (TID_TABLE_SIZE + 6)
+#define TABLE_TIME      24000   /* MIN_TABLE_TIME in ms */
+
+typedef struct
+{
+    Boolean  known;         /* The table has an entry for it */
+    Boolean  inProgress;
+    TransNum tid;           /* Last tid used */
+    int16    tidIndex;
+    uint32   doneTime;      /* When its last transaction ended */
+    uint32   doneOrder;     /* Order in which transactions ended */
+} DestModel;
+
+static uint32    simTime = 1000;
+static uint32    doneCount;
+static DestModel model[2][NUM_DEST];
+static int       failures;
+
+void TMR_Init(void)
+{
+}
+
+TmrDuration TMR_GetCurrentTime(void)
+{
+    return simTime;
+}
+
+static void Fail(const char *whatIn, int priorityIn, int destIn)
+{
+    if (failures++ < 10)
+    {
+        printf("FAIL: %s (priority %d destination %d time %u)\n", whatIn, priorityIn, destIn,
+               (unsigned)simTime);
+    }
+}
+
+static void MakeDest(int destIn, DestinationAddress *addrOut)
+{
+    memset(addrOut, 0, sizeof(*addrOut));
+    addrOut->dmn.domainIndex = 0;
+    if (destIn % 4 == 3)
+    {
+        addrOut->addressMode = MULTICAST;
+        addrOut->addr.addr1  = (MulticastAddress)destIn;
+    }
+    else
+    {
+        addrOut->addressMode          = SUBNET_NODE;
+        addrOut->addr.addr2a.subnet   = 1 + destIn % 2;
+        addrOut->addr.addr2a.node     = destIn;
+        addrOut->addr.addr2a.selField = 1;
+    }
+}
+
+static void Done(int priorityIn, int destIn)
+{
+    DestModel *d = &model[priorityIn][destIn];
+
+    d->inProgress = FALSE;
+    d->doneTime   = simTime;
+    d->doneOrder  = doneCount++;
+}
+
+static void Start(int priorityIn, int destIn)
+{
+    DestinationAddress addr;
+    DestModel *d = &model[priorityIn][destIn];
+    DestModel *oldest = NULL;
+    TransNum   tid;
+    int16      tidIndex;
+    int        known = 0;
+    int        k;
+
+    for (k = 0; k < NUM_DEST; k++)
+    {
+        if (model[priorityIn][k].known)
+        {
+            known++;
+            if (!model[priorityIn][k].inProgress &&
+                (oldest == NULL || model[priorityIn][k].doneOrder < oldest->doneOrder))
+            {
+                oldest = &model[priorityIn][k];
+            }
+        }
+    }
+
+    MakeDest(destIn, &addr);
+    if (NewTrans(priorityIn, addr, &tid, &tidIndex) != SUCCESS)
+    {
+        if (!d->inProgress &&
+            (d->known || known < TID_TABLE_SIZE ||
+             (oldest != NULL && simTime - oldest->doneTime >= TABLE_TIME)))
+        {
+            Fail("NewTrans failed", priorityIn, destIn);
+        }
+        return;
+    }
+
+    if (d->inProgress)
+    {
+        Fail("second transaction to a destination", priorityIn, destIn);
+        return;
+    }
+    if (d->known && tid == d->tid)
+    {
+        Fail("tid reused for a destination", priorityIn, destIn);
+    }
+    if (ValidateTrans(priorityIn, tid) == TRANS_CURRENT)
+    {
+        /* ValidateTrans now sees this one too, so look for another holder */
+        for (k = 0; k < NUM_DEST; k++)
+        {
+            if (model[priorityIn][k].inProgress && model[priorityIn][k].tid == tid)
+            {
+                Fail("tid in use", priorityIn, destIn);
+            }
+        }
+    }
+    if (!d->known && known == TID_TABLE_SIZE)
+    {
+        /* The oldest entry made way for this one */
+        oldest->known = FALSE;
+    }
+
+    d->known      = TRUE;
+    d->inProgress = TRUE;
+    d->tid        = tid;
+    d->tidIndex   = tidIndex;
+}
+
+static void Reset(ResetCause causeIn)
+{
+    int16 i;
+    int   priority;
+    int   k;
+
+    nmp->resetCause = causeIn;
+    TCSReset();
+
+    for (priority = 0; priority < 2; priority++)
+    {
+        if (causeIn == POWER_UP_RESET)
+        {
+            memset(model[priority], 0, sizeof(model[priority]));
+            continue;
+        }
+        /* Transactions in progress end in table order */
+        for (i = 0; i < TID_TABLE_SIZE; i++)
+        {
+            for (k = 0; k < NUM_DEST; k++)
+            {
+                if (model[priority][k].inProgress && model[priority][k].tidIndex == i)
+                {
+                    Done(priority, k);
+                }
+            }
+        }
+    }
+}
+
+int main(void)
+{
+    DestModel *d;
+    int        step;
+    int        priority;
+    int        dest;
+    int        tid;
+    int        inUse;
+    int        k;
+
+    srand(1);
+    LCS_Init();
+    eep->domainTable[0].invalid = FALSE;
+    Reset(POWER_UP_RESET);
+
+    for (step = 0; step < NUM_STEPS && failures <= 10; step++)
+    {
+        priority = rand() % 2;
+        dest     = rand() % NUM_DEST;
+        d        = &model[priority][dest];
+        switch (rand() % 16)
+        {
+        case 0:
+            Reset(rand() % 8 ? SOFTWARE_RESET : POWER_UP_RESET);
+            break;
+        case 1:
+        case 2:
+            simTime += rand() % 8000;
+            break;
+        case 3:
+        case 4:
+        case 5:
+        case 6:
+        case 7:
+            if (d->inProgress)
+            {
+                TransDone(priority, d->tidIndex);
+                Done(priority, dest);
+            }
+            break;
+        default:
+            Start(priority, dest);
+            break;
+        }
+
+        for (tid = 0; tid < 16; tid++)
+        {
+            inUse = 0;
+            for (k = 0; k < NUM_DEST; k++)
+            {
+                if (model[priority][k].inProgress && model[priority][k].tid == tid)
+                {
+                    inUse = 1;
+                }
+            }
+            if ((ValidateTrans(priority, tid) == TRANS_CURRENT) != inUse)
+            {
+                Fail("ValidateTrans", priority, tid);
+            }
+        }
+    }
+
+    printf("failures %d\n", failures);
+    return failures != 0;
+}
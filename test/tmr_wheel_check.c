@@ -0,0 +1,174 @@
+//
+// tmr_wheel_check.c
+//
+// Copyright (C) 2022 Dialog Semiconductor
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in 
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Checks the timer wheel against a plain list of timers.  Timers are started, restarted and stopped at random on a
+// simulated clock that starts just short of wrapping, with both short and long (several turns of the wheel) durations.
+// Each timer must expire at the first dispatch at or after its expiration time and never before, and
+// TMR_NextDeadline() must never be later than the real next expiration nor, straight after a dispatch, already passed.
+//
+
+/*
+ * Build and run from the repository root:
+ *   gcc -I. -Ipal -DPLATFORM_ID=PLATFORM_ID_LINUX -D__monitor= test/tmr_wheel_check.c tmr.c -o tmr_wheel_check
+ *   ./tmr_wheel_check
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "echstd.h"
+#include "tmr.h"
+
+#define NUM_TIMERS	200
+#define NUM_STEPS	200000
+
+static TmrDuration simNow = 0xFFFF0000;
+
+typedef struct
+{
+	TmrWheelTimer	wheelTimer;
+	Bool			running;
+	TmrDuration		expiration;
+} CheckTimer;
+
+static CheckTimer timers[NUM_TIMERS];
+static int failures = 0;
+static int expiries = 0;
+
+// The wheel reads the simulated clock
+TmrDuration TMR_GetCurrentTime(void)
+{
+	return simNow;
+}
+
+static void Fail(const char *what, int index)
+{
+	if (failures++ < 10)
+	{
+		printf("FAIL: %s (timer %d, now 0x%08X)\n", what, index, (unsigned)simNow);
+	}
+}
+
+static void Expired(TmrWheelTimer *pTimer, void *pContext)
+{
+	CheckTimer *pCheck = (CheckTimer*)pTimer;
+	int index = (int)(pCheck - timers);
+
+	(void)pContext;
+	if (!pCheck->running)
+	{
+		Fail("stopped timer expired", index);
+	}
+	else if ((Int32)(pCheck->expiration - simNow) > 0)
+	{
+		Fail("timer expired early", index);
+	}
+	pCheck->running = false;
+	expiries++;
+}
+
+// The real time to the next expiration, or TMR_NO_DEADLINE
+static TmrDuration NextExpiration(void)
+{
+	TmrDuration next = TMR_NO_DEADLINE;
+	TmrDuration remaining;
+	int i;
+
+	for (i = 0; i < NUM_TIMERS; i++)
+	{
+		if (timers[i].running)
+		{
+			remaining = (Int32)(timers[i].expiration - simNow) > 0 ? timers[i].expiration - simNow : 0;
+			if (remaining < next)
+			{
+				next = remaining;
+			}
+		}
+	}
+	return next;
+}
+
+int main(void)
+{
+	TmrWheel wheel;
+	TmrDuration duration;
+	int step;
+	int i;
+
+	srand(1);
+	TMR_WheelInit(&wheel);
+	for (step = 0; step < NUM_STEPS; step++)
+	{
+		i = rand() % NUM_TIMERS;
+		switch (rand() % 8)
+		{
+		case 0:
+		case 1:
+		case 2:
+			// Mostly short timers, with some several turns of the wheel away
+			duration = rand() % 4 ? rand() % (TMR_WHEEL_SLOTS * 2) : rand() % (TMR_WHEEL_SLOTS * 50);
+			TMR_WheelStart(&wheel, &timers[i].wheelTimer, duration);
+			timers[i].running = true;
+			timers[i].expiration = simNow + duration;
+			break;
+		case 3:
+			TMR_WheelStop(&wheel, &timers[i].wheelTimer);
+			timers[i].running = false;
+			break;
+		case 4:
+			// Jump to the next deadline the way a scheduler that sleeps until then would
+			duration = TMR_NextDeadline(&wheel);
+			if (duration != TMR_NO_DEADLINE)
+			{
+				simNow += duration;
+			}
+			break;
+		default:
+			simNow += rand() % 3 ? rand() % 4 : rand() % (TMR_WHEEL_SLOTS * 3);
+			break;
+		}
+
+		TMR_WheelDispatch(&wheel, Expired, NULL);
+		for (i = 0; i < NUM_TIMERS; i++)
+		{
+			if (timers[i].running && (Int32)(timers[i].expiration - simNow) <= 0)
+			{
+				Fail("timer did not expire", i);
+				timers[i].running = false;
+			}
+		}
+
+		duration = TMR_NextDeadline(&wheel);
+		if (duration > NextExpiration())
+		{
+			Fail("next deadline too late", -1);
+		}
+		if (duration == 0)
+		{
+			Fail("next deadline already passed after dispatch", -1);
+		}
+	}
+
+	printf("expiries %d failures %d\n", expiries, failures);
+	return failures != 0;
+}
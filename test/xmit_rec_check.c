@@ -0,0 +1,255 @@
+//
+// xmit_rec_check.c
+//
+//
+// Copyright (C) 2022 Dialog Semiconductor
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in 
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Checks that the transport layer runs transactions to different destinations at the same time.  Acknowledged
+// messages are queued to a few destinations, some of them twice, and the transmit records are serviced with no acks
+// coming back.  A message to a destination with a transaction in progress must wait without holding up the messages
+// to other destinations behind it, and must go out in order once that transaction ends.  Non-priority messages must
+// leave XMIT_PRI_RESERVE records free for priority ones, and priority messages that wait must not hold up
+// non-priority ones.
+//
+
+/*
+ * Build and run from the repository root (lcs_tsa.c is included, so it is left out of the sources):
+ *   gcc -I. -Ipal -Itest -DPLATFORM_ID=PLATFORM_ID_LINUX -DLDV_VIRTUAL_CHANNEL \
+ *       -DAPP_OUT_Q_CNT=6 -DAPP_OUT_PRI_Q_CNT=6 -DMALLOC_SIZE=20000 \
+ *       test/xmit_rec_check.c test/check_app.c $(ls lcs*.c | grep -v -e lcs_main.c -e lcs_tsa.c) \
+ *       tmr.c tmr_platform.c vldv_host.c vldv_vlon.c vldv_linux.c pal/pal.c pal/pal_sim_driver.c \
+ *       -lpthread -o xmit_rec_check
+ *   ./xmit_rec_check
+ */
+
+#include "lcs.h"
+#include "lcs_tsa.c"
+
+#if APP_OUT_Q_CNT < 6 || APP_OUT_PRI_Q_CNT < 6
+#error "Build with -DAPP_OUT_Q_CNT=6 -DAPP_OUT_PRI_Q_CNT=6 -DMALLOC_SIZE=20000 so the queues hold enough messages"
+#endif
+
+static int failures;
+
+static void Fail(const char *whatIn, int nodeIn)
+{
+    if (failures++ < 10)
+    {
+        printf("FAIL: %s (node %d)\n", whatIn, nodeIn);
+    }
+}
+
+/* Queue an acknowledged message to subnet 1 node nodeIn, tagged with
+   seqIn so that the order can be checked. */
+static void QueueAckd(Boolean priorityIn, int nodeIn, int seqIn)
+{
+    Queue        *tsaQPtr = priorityIn ? &gp->tsaOutPriQ : &gp->tsaOutQ;
+    TSASendParam *tsaSendParamPtr;
+
+    if (QueueFull(tsaQPtr))
+    {
+        Fail("queue full", nodeIn);
+        return;
+    }
+    tsaSendParamPtr = QueueTail(tsaQPtr);
+    memset(tsaSendParamPtr, 0, sizeof(TSASendParam) + 1);
+    tsaSendParamPtr->destAddr.snode.addrMode   = SUBNET_NODE;
+    tsaSendParamPtr->destAddr.snode.subnetID   = 1;
+    tsaSendParamPtr->destAddr.snode.node       = nodeIn;
+    tsaSendParamPtr->destAddr.snode.retryCount = 3;
+    tsaSendParamPtr->destAddr.snode.txTimer    = 15;   /* 3 s, so that nothing is retried */
+    tsaSendParamPtr->dmn.domainIndex           = COMPUTE_DOMAIN_INDEX;
+    tsaSendParamPtr->service                   = ACKD;
+    tsaSendParamPtr->apduSize                  = 1;
+    tsaSendParamPtr->tag                       = (MsgTag)seqIn;
+    tsaSendParamPtr->priority                  = priorityIn;
+    EnQueue(tsaQPtr);
+}
+
+/* Service the transmit records once and throw away what was sent */
+static void Service(void)
+{
+    ServiceXmitRecs(TRANSPORT);
+    while (!QueueEmpty(&gp->nwOutQ))
+    {
+        DeQueue(&gp->nwOutQ);
+    }
+    while (!QueueEmpty(&gp->nwOutPriQ))
+    {
+        DeQueue(&gp->nwOutPriQ);
+    }
+}
+
+static TransmitRecord *FindDest(Boolean priorityIn, int nodeIn)
+{
+    uint16 i;
+
+    for (i = 0; i < gp->xmitRecCnt; i++)
+    {
+        if (gp->xmitRec[i].status == TRANSPORT_TX &&
+            gp->xmitRec[i].priority == priorityIn &&
+            gp->xmitRec[i].nwDestAddr.addr.addr2a.node == nodeIn)
+        {
+            return(&gp->xmitRec[i]);
+        }
+    }
+    return(NULL);
+}
+
+static int InProgress(void)
+{
+    uint16 i;
+    int    count = 0;
+
+    for (i = 0; i < gp->xmitRecCnt; i++)
+    {
+        count += (gp->xmitRec[i].status != UNUSED_TX);
+    }
+    return(count);
+}
+
+/* The message with tag seqIn must be in progress to nodeIn */
+static void Expect(Boolean priorityIn, int nodeIn, int seqIn)
+{
+    TransmitRecord *xmitRecPtr = FindDest(priorityIn, nodeIn);
+
+    if (xmitRecPtr == NULL)
+    {
+        Fail("no transaction", nodeIn);
+    }
+    else if (xmitRecPtr->sendParam->tag != seqIn)
+    {
+        Fail("out of order", nodeIn);
+    }
+}
+
+/* End the transaction to nodeIn as if it had been acked */
+static void End(Boolean priorityIn, int nodeIn)
+{
+    TransmitRecord *xmitRecPtr = FindDest(priorityIn, nodeIn);
+
+    if (xmitRecPtr == NULL)
+    {
+        Fail("nothing to end", nodeIn);
+        return;
+    }
+    xmitRecPtr->ackCount = xmitRecPtr->destCount;
+    TerminateTrans(xmitRecPtr);
+    while (!QueueEmpty(&gp->appInQ))
+    {
+        DeQueue(&gp->appInQ);
+    }
+}
+
+/* Two destinations in progress while a third message waits for one of them */
+static void CheckBusyDestination(void)
+{
+    QueueAckd(FALSE, 1, 1);
+    QueueAckd(FALSE, 1, 2);
+    QueueAckd(FALSE, 2, 3);
+    QueueAckd(FALSE, 1, 4);
+    Service();
+    Service();
+    Service();
+    Expect(FALSE, 1, 1);
+    Expect(FALSE, 2, 3);
+    if (InProgress() != 2 || QueueSize(&gp->tsaOutQ) != 2)
+    {
+        Fail("messages to node 1 did not wait", 1);
+    }
+
+    /* The messages to node 1 go out in turn */
+    End(FALSE, 1);
+    Service();
+    Expect(FALSE, 1, 2);
+    Expect(FALSE, 2, 3);
+    End(FALSE, 1);
+    Service();
+    Expect(FALSE, 1, 4);
+    End(FALSE, 1);
+    End(FALSE, 2);
+    if (InProgress() != 0 || !QueueEmpty(&gp->tsaOutQ))
+    {
+        Fail("left over", 0);
+    }
+}
+
+/* Non-priority messages can't take the records kept for priority ones */
+static void CheckPriorityReserve(void)
+{
+    int node;
+
+    for (node = 10; node < 10 + XMIT_TRANS_COUNT; node++)
+    {
+        QueueAckd(FALSE, node, node);
+    }
+    for (node = 0; node < XMIT_TRANS_COUNT; node++)
+    {
+        Service();
+    }
+    if (InProgress() != XMIT_TRANS_COUNT - XMIT_PRI_RESERVE)
+    {
+        Fail("non-priority messages took the reserve", 0);
+    }
+    QueueAckd(TRUE, 20, 20);
+    Service();
+    Expect(TRUE, 20, 20);
+
+    End(TRUE, 20);
+    for (node = 10; node < 10 + XMIT_TRANS_COUNT; node++)
+    {
+        Service();
+        End(FALSE, node);
+    }
+    if (InProgress() != 0 || !QueueEmpty(&gp->tsaOutQ))
+    {
+        Fail("left over", 0);
+    }
+}
+
+/* A priority message that waits doesn't hold up non-priority ones */
+static void CheckPriorityWaits(void)
+{
+    QueueAckd(TRUE, 30, 1);
+    Service();
+    QueueAckd(TRUE, 30, 2);
+    QueueAckd(FALSE, 31, 3);
+    Service();
+    Expect(TRUE, 30, 1);
+    Expect(FALSE, 31, 3);
+    End(TRUE, 30);
+    Service();
+    Expect(TRUE, 30, 2);
+    End(TRUE, 30);
+    End(FALSE, 31);
+}
+
+int main(void)
+{
+    LCS_Init();
+
+    CheckBusyDestination();
+    CheckPriorityReserve();
+    CheckPriorityWaits();
+
+    printf("records %d failures %d\n", gp->xmitRecCnt, failures);
+    return failures != 0;
+}
@@ -26,6 +26,7 @@
 //
 
 #include <assert.h>
+#include <string.h>
 
 #include "echstd.h"
 #include "tmr.h"
@@ -83,6 +84,173 @@ Bool TMR_Running(TmrTimer *pTimer)
 	return pTimer->expiration && !TMR_Expired(pTimer);
 }
 
+// Get milliseconds left before a timer expires.  Returns 0 if the timer is not running or has already expired.
+TmrDuration TMR_Remaining(TmrTimer *pTimer)
+{
+	TmrDuration remaining = 0;
+	if (pTimer->expiration)
+	{
+		Int32 delta = (Int32)(pTimer->expiration - TMR_GetCurrentTime());
+		if (delta > 0)
+		{
+			remaining = (TmrDuration)delta;
+		}
+	}
+	return remaining;
+}
+
+// Slot that a timer expiring at the given time goes in
+#define TMR_SLOT(t)		((t) & (TMR_WHEEL_SLOTS - 1))
+
+// Empty a wheel
+void TMR_WheelInit(TmrWheel *pWheel)
+{
+	memset(pWheel->slots, 0, sizeof(pWheel->slots));
+	memset(pWheel->slotMin, 0, sizeof(pWheel->slotMin));
+	pWheel->dispatched = TMR_GetCurrentTime();
+	pWheel->earliest = pWheel->dispatched;
+	pWheel->count = 0;
+}
+
+// Start a timer on a wheel.  Restarts it if it is already running.
+void TMR_WheelStart(TmrWheel *pWheel, TmrWheelTimer *pTimer, TmrDuration milliseconds)
+{
+	TmrDuration expiration;
+	TmrWheelTimer **ppSlot;
+
+	TMR_WheelStop(pWheel, pTimer);
+	TMR_Start(&pTimer->timer, milliseconds);
+	expiration = pTimer->timer.expiration;
+	if (pWheel->count == 0 || (Int32)(expiration - pWheel->dispatched) < 0)
+	{
+		// Dispatch has to look at this slot again.  It can only be behind by the ms in which the last dispatch ran.
+		pWheel->dispatched = expiration;
+	}
+	if (pWheel->count == 0 || (Int32)(expiration - pWheel->earliest) < 0)
+	{
+		pWheel->earliest = expiration;
+	}
+
+	ppSlot = &pWheel->slots[TMR_SLOT(expiration)];
+	if (*ppSlot == NULL || (Int32)(expiration - pWheel->slotMin[TMR_SLOT(expiration)]) < 0)
+	{
+		pWheel->slotMin[TMR_SLOT(expiration)] = expiration;
+	}
+	pTimer->pNext = *ppSlot;
+	pTimer->ppPrev = ppSlot;
+	if (*ppSlot != NULL)
+	{
+		(*ppSlot)->ppPrev = &pTimer->pNext;
+	}
+	*ppSlot = pTimer;
+	pWheel->count++;
+}
+
+// Take a timer off its wheel.  The slot and wheel minimums are left alone; they are still lower bounds and the next
+// dispatch after they pass makes them exact again.
+void TMR_WheelStop(TmrWheel *pWheel, TmrWheelTimer *pTimer)
+{
+	if (pTimer->ppPrev != NULL)
+	{
+		*pTimer->ppPrev = pTimer->pNext;
+		if (pTimer->pNext != NULL)
+		{
+			pTimer->pNext->ppPrev = pTimer->ppPrev;
+		}
+		pTimer->pNext = NULL;
+		pTimer->ppPrev = NULL;
+		pWheel->count--;
+	}
+	TMR_Stop(&pTimer->timer);
+}
+
+// Take all the expired timers off a wheel and call pExpiry for each.  The slots from the last dispatch up to now are
+// visited once each, however many timers are running, and the clock is read once.  The minimum of each visited slot is
+// made exact on the way, so when the earliest deadline has passed it can be found again from the slot minimums alone.
+UInt16 TMR_WheelDispatch(TmrWheel *pWheel, TmrWheelExpiry pExpiry, void *pContext)
+{
+	TmrDuration now = TMR_GetCurrentTime();
+	TmrDuration ticks = now - pWheel->dispatched + 1;
+	TmrWheelTimer *pExpired = NULL;
+	TmrWheelTimer *pTimer;
+	TmrWheelTimer *pNext;
+	TmrDuration slot;
+	Bool found;
+	UInt16 count = 0;
+	TmrDuration i;
+
+	if (pWheel->count == 0 || (Int32)ticks <= 0)
+	{
+		return 0;
+	}
+	if (ticks > TMR_WHEEL_SLOTS)
+	{
+		ticks = TMR_WHEEL_SLOTS;
+	}
+
+	// Collect the expired timers first so that the callbacks are free to start and stop timers
+	for (i = 0; i < ticks; i++)
+	{
+		slot = TMR_SLOT(pWheel->dispatched + i);
+		found = false;
+		for (pTimer = pWheel->slots[slot]; pTimer != NULL; pTimer = pNext)
+		{
+			pNext = pTimer->pNext;
+			if ((Int32)(pTimer->timer.expiration - now) <= 0)
+			{
+				TMR_WheelStop(pWheel, pTimer);
+				pTimer->pNext = pExpired;
+				pExpired = pTimer;
+			}
+			else if (!found || (Int32)(pTimer->timer.expiration - pWheel->slotMin[slot]) < 0)
+			{
+				pWheel->slotMin[slot] = pTimer->timer.expiration;
+				found = true;
+			}
+		}
+	}
+	pWheel->dispatched = now + 1;
+
+	if (pWheel->count != 0 && (Int32)(pWheel->earliest - now) <= 0)
+	{
+		// Every slot minimum is now exact or in the future, so the smallest one is the next deadline
+		found = false;
+		for (slot = 0; slot < TMR_WHEEL_SLOTS; slot++)
+		{
+			if (pWheel->slots[slot] != NULL &&
+				(!found || (Int32)(pWheel->slotMin[slot] - pWheel->earliest) < 0))
+			{
+				pWheel->earliest = pWheel->slotMin[slot];
+				found = true;
+			}
+		}
+	}
+
+	while (pExpired != NULL)
+	{
+		pTimer = pExpired;
+		pExpired = pTimer->pNext;
+		pTimer->pNext = NULL;
+		pExpiry(pTimer, pContext);
+		count++;
+	}
+	return count;
+}
+
+// Milliseconds until the next timer on a wheel expires.  This is the cached earliest deadline, so it takes the same
+// time however many timers are running.  If the timer that set it has been stopped the answer is early, which only
+// costs a dispatch that finds nothing and moves the deadline on.
+TmrDuration TMR_NextDeadline(TmrWheel *pWheel)
+{
+	TmrDuration now = TMR_GetCurrentTime();
+
+	if (pWheel->count == 0)
+	{
+		return TMR_NO_DEADLINE;
+	}
+	return (Int32)(pWheel->earliest - now) > 0 ? pWheel->earliest - now : 0;
+}
+
 // Start a stop watch
 void TMR_StartWatch(TmrWatch *pTimer)
 {
@@ -42,6 +42,34 @@ typedef struct
 	TmrDuration	start;			// Time watch started
 } TmrWatch;
 
+// Number of slots in a timer wheel.  Must be a power of 2.  Each slot is a millisecond so timers further out than this
+// wait in their slot for later turns of the wheel.
+#ifndef TMR_WHEEL_SLOTS
+#define TMR_WHEEL_SLOTS		64
+#endif
+
+// TMR_NextDeadline() of an empty wheel
+#define TMR_NO_DEADLINE		((TmrDuration)-1)
+
+typedef struct TmrWheelTimer
+{
+	TmrTimer				timer;		// TMR_Remaining() works on this
+	struct TmrWheelTimer*	pNext;		// Next timer in the same slot
+	struct TmrWheelTimer**	ppPrev;		// Whatever points at this timer.  NULL if the timer is not on a wheel.
+} TmrWheelTimer;
+
+typedef struct
+{
+	TmrWheelTimer*	slots[TMR_WHEEL_SLOTS];	// Timers by expiration time modulo TMR_WHEEL_SLOTS
+	TmrDuration		slotMin[TMR_WHEEL_SLOTS];	// No timer in the slot expires before this.  Exact once dispatched.
+	TmrDuration		earliest;				// No timer on the wheel expires before this
+	TmrDuration		dispatched;				// Timers before this time have all been dispatched
+	UInt16			count;					// Timers on the wheel
+} TmrWheel;
+
+// Called by TMR_WheelDispatch() for each expired timer.  The timer is already off the wheel and may be started again.
+typedef void (*TmrWheelExpiry)(TmrWheelTimer *pTimer, void *pContext);
+
 //
 // Basic time primitives - init TMR and return a running counter of milliseconds.  Wraps every 49 days.
 //
@@ -71,6 +99,27 @@ Bool TMR_Running(TmrTimer *pTimer);
 
 TmrDuration TMR_Remaining(TmrTimer *pTimer);
 
+//
+// Timer wheels.  Rather than each timer being polled with TMR_Expired(), the timers on a wheel are kept in slots by
+// expiration time and TMR_WheelDispatch() visits only the slots that have come due.  Use a wheel where there are
+// many timers, such as one per transaction record.
+//
+
+// Empty a wheel.  Timers must be cleared to zero, or have been stopped, before they are first started.
+void TMR_WheelInit(TmrWheel *pWheel);
+
+// Start a timer on a wheel, or restart it if it is already running
+void TMR_WheelStart(TmrWheel *pWheel, TmrWheelTimer *pTimer, TmrDuration milliseconds);
+
+// Take a timer off its wheel.  Does nothing if the timer is not running.
+void TMR_WheelStop(TmrWheel *pWheel, TmrWheelTimer *pTimer);
+
+// Take all the expired timers off a wheel and call pExpiry for each.  Returns how many expired.
+UInt16 TMR_WheelDispatch(TmrWheel *pWheel, TmrWheelExpiry pExpiry, void *pContext);
+
+// Milliseconds until the next timer on a wheel expires (0 if one already has), or TMR_NO_DEADLINE if it is empty
+TmrDuration TMR_NextDeadline(TmrWheel *pWheel);
+
 //
 // Millisecond stopwatches
 //
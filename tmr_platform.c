@@ -28,6 +28,8 @@
 
 #if	PLATFORM_IS(SIM)
 #include "windows.h"
+#elif PLATFORM_IS(LINUX)
+#include <time.h>
 #else
 #include "timers.h"
 #endif
@@ -35,7 +37,7 @@
 void TMR_Init()
 {
 // Initialize timer 
-#if !PLATFORM_IS(SIM)
+#if !PLATFORM_IS_HOST
     TMR_SetupTA1();
 #endif  
 }
@@ -44,6 +46,12 @@ __monitor TmrDuration TMR_GetCurrentTime()
 {
 #if PLATFORM_IS(SIM)
 	return GetTickCount();
+#elif PLATFORM_IS(LINUX)
+	// Monotonic so that setting the system clock doesn't disturb running timers
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (TmrDuration)(now.tv_sec*1000 + now.tv_nsec/1000000);
 #else
     return msec;
 #endif
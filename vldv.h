@@ -97,6 +97,16 @@ LDVCode LDV_EXTERNAL_FN vldv_open(const char* pName, pShort handle);
 LDVCode LDV_EXTERNAL_FN vldv_close(short handle);
 LDVCode LDV_EXTERNAL_FN vldv_read(short handle, pVoid msg_p, short len);
 LDVCode LDV_EXTERNAL_FN vldv_write(short handle, pVoid msg_p, short len);
+// Blocks until a frame arrives on any open handle or the timeout (in ms) elapses.
+LDVCode LDV_EXTERNAL_FN vldv_wait(unsigned long timeout);
+
+// Helpers for backends without a MIP (see vldv_host.c)
+#define VLDV_SICB_MAX_SIZE	(255 + 2)
+#define VLDV_NID_LEN		6
+// Forms the response to the local NM request pReq, the way the MIP would, and returns its size.  0 if pReq is not valid.
+int vldv_local_nm(const Byte* pReq, const Byte* pNid, Byte* pResp);
+// Forms the incoming L2 frame for an LPDU (header byte, NPDU) received from the channel.
+LDVCode vldv_l2_frame(const Byte* pLpdu, int lpduLen, Byte* pSicb, short len);
 
 C_API_END
 
@@ -0,0 +1,116 @@
+//
+// vldv_host.c
+//
+// Copyright (C) 2022 Dialog Semiconductor
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in 
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+/*
+ *	vldv_host.c
+ *
+ *  Helpers for LDV backends that carry frames without a MIP (vldv_linux.c, vldv_vlon.c).
+ *  Such a backend answers local network management itself and presents the frames it
+ *  receives the way the MIP would.
+ */
+
+#include <string.h>
+
+#include "echstd.h"
+#include "vldv.h"
+
+#define SICB_SIZE(p)		((p)[1] + 2)
+
+// Bytes an incoming L2 frame has around the LPDU: zero crossing in front, CRC and two register bytes behind
+#define L2_RX_PREFIX		1
+#define L2_RX_SUFFIX		4
+
+// Local network management as sent by the link layer (see LKReset() and LKFetchXcvr())
+#define LNM_CODE			14		// Index of the message code in the SICB data
+#define LNM_READ_MEMORY		0x6D	// NM_opcode_base|NM_READ_MEMORY
+#define LNM_QUERY_XCVR		0x54	// ND_opcode_base|ND_QUERY_XCVR
+#define LNM_READ_ONLY		1		// READ_ONLY_RELATIVE
+#define LNM_XCVR_LEN		7		// NUM_COMM_PARAMS
+
+int vldv_local_nm(const Byte* pReq, const Byte* pNid, Byte* pResp)
+{
+	const Byte* req = &pReq[2];
+	Byte* resp = &pResp[2];
+	Byte code;
+	int dataLen = 0;
+	int offset;
+	int i;
+
+	if (pReq[1] <= LNM_CODE)
+	{
+		return 0;
+	}
+	code = req[LNM_CODE];
+
+	memcpy(resp, req, LNM_CODE);
+	if (code == LNM_READ_MEMORY && req[LNM_CODE+1] == LNM_READ_ONLY)
+	{
+		offset = (req[LNM_CODE+2] << 8) | req[LNM_CODE+3];
+		dataLen = req[LNM_CODE+4];
+		if (LNM_CODE+1+dataLen > VLDV_SICB_MAX_SIZE-2)
+		{
+			dataLen = 0;
+		}
+		for (i=0; i<dataLen; i++)
+		{
+			// Only the Neuron ID is known
+			resp[LNM_CODE+1+i] = offset+i < VLDV_NID_LEN ? pNid[offset+i] : 0;
+		}
+		resp[LNM_CODE] = 0x20|(code&0x1F);
+	}
+	else if (code == LNM_QUERY_XCVR)
+	{
+		dataLen = LNM_XCVR_LEN;
+		memset(&resp[LNM_CODE+1], 0, dataLen);
+		resp[LNM_CODE] = 0x30|(code&0x0F);
+	}
+	else if ((code&0xF0) == 0x50)
+	{
+		resp[LNM_CODE] = 0x10|(code&0x0F);
+	}
+	else
+	{
+		resp[LNM_CODE] = code&0x1F;
+	}
+	resp[2] = (Byte)(1 + dataLen);
+
+	pResp[0] = nicbRESPONSE;
+	pResp[1] = (Byte)(LNM_CODE + 1 + dataLen);
+	return SICB_SIZE(pResp);
+}
+
+LDVCode vldv_l2_frame(const Byte* pLpdu, int lpduLen, Byte* pSicb, short len)
+{
+	if (2 + L2_RX_PREFIX + lpduLen + L2_RX_SUFFIX > len ||
+		2 + L2_RX_PREFIX + lpduLen + L2_RX_SUFFIX > VLDV_SICB_MAX_SIZE)
+	{
+		return LDV_INVALID_BUF_LEN;
+	}
+	// The transport has already checked the frame, so the CRC and the register bytes are left zero.
+	pSicb[0] = nicbINCOMING_L2M2;
+	pSicb[1] = (Byte)(L2_RX_PREFIX + lpduLen + L2_RX_SUFFIX);
+	pSicb[2] = 0;
+	memcpy(&pSicb[2+L2_RX_PREFIX], pLpdu, lpduLen);
+	memset(&pSicb[2+L2_RX_PREFIX+lpduLen], 0, L2_RX_SUFFIX);
+	return LDV_OK;
+}
@@ -0,0 +1,431 @@
+//
+// vldv_linux.c
+//
+// Copyright (C) 2022 Dialog Semiconductor
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in 
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+/*
+ *	vldv_linux.c
+ *
+ *  Maps LDV calls to datagram sockets for the Linux host port (PLATFORM_ID_LINUX)
+ *
+ *  Each interface named in vldv_open() is bound to the endpoint given by the
+ *  environment variable LDV_<name>, for example LDV_PLC:
+ *
+ *      udp:<group>:<port>              UDP multicast group shared by all nodes on the channel
+ *      udp:<host>:<port>[:<localport>] UDP to a single peer or bridge
+ *      unix:<path>                     Unix-domain datagram socket of a local channel daemon
+ *
+ *  If the variable is not set, interface N uses udp:239.255.76.1:<2540+N>.
+ *
+ *  Each datagram carries one LPDU (header byte, NPDU) behind a 4 byte sender
+ *  id, which lets a node ignore its own frames looped back by the channel.
+ *  An interface announces itself with an empty datagram when it is opened.
+ *  There is no MIP, so local network management is answered here: reading the
+ *  read-only data returns the Neuron ID from LDV_NID (12 hex digits, defaults
+ *  to one based on the host id) and the transceiver query returns zeros.
+ *
+ *  vldv_wait() blocks in epoll_wait() on the sockets of all open interfaces.
+ */
+
+#include "echstd.h"
+
+#if PLATFORM_IS(LINUX) && !defined(LDV_VIRTUAL_CHANNEL)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "vldv.h"
+#include "lcs_platform.h"
+
+#ifndef MAX_HANDLES
+#define MAX_HANDLES 10
+#endif
+
+#define LDV_DEFAULT_GROUP	"239.255.76.1"
+#define LDV_DEFAULT_PORT	2540
+
+#define SICB_SIZE(p)		((p)[1] + 2)
+
+typedef struct
+{
+	Bool		inUse;
+	int			fd;
+	int			epoll;				// Epoll set of the thread that opened it
+	uint32_t	senderId;
+	struct sockaddr_storage peer;	// Where frames are sent
+	socklen_t	peerLen;
+	int			respLen;			// Size of the local NM response waiting to be read, 0 if none
+	Byte		resp[VLDV_SICB_MAX_SIZE];
+} LinuxLdv;
+
+static LinuxLdv ldvs[MAX_HANDLES];
+
+// With a thread per stack each stack opens its interfaces on its own thread, and vldv_wait() only waits for those.
+static LCS_THREAD_LOCAL int ldvEpoll = -1;
+
+#ifdef LCS_THREAD_PER_STACK
+static LcsLock ldvLock = LCS_LOCK_INIT;
+#endif
+
+static LinuxLdv* getLinuxLdv(short handle)
+{
+	if (handle >= 0 && handle < MAX_HANDLES && ldvs[handle].inUse)
+	{
+		return &ldvs[handle];
+	}
+	return NULL;
+}
+
+static int openUdp(LinuxLdv* p, char* spec)
+{
+	char* host = spec;
+	char* port = strchr(host, ':');
+	char* localPort;
+	struct sockaddr_in local;
+	struct sockaddr_in* peer = (struct sockaddr_in*)&p->peer;
+	int on = 1;
+	int fd;
+
+	if (port == NULL)
+	{
+		return -1;
+	}
+	*port++ = 0;
+	localPort = strchr(port, ':');
+	if (localPort != NULL)
+	{
+		*localPort++ = 0;
+	}
+
+	memset(peer, 0, sizeof(*peer));
+	peer->sin_family = AF_INET;
+	peer->sin_port = htons((uint16_t)atoi(port));
+	if (inet_pton(AF_INET, host, &peer->sin_addr) != 1)
+	{
+		return -1;
+	}
+	p->peerLen = sizeof(*peer);
+
+	memset(&local, 0, sizeof(local));
+	local.sin_family = AF_INET;
+	local.sin_addr.s_addr = htonl(INADDR_ANY);
+	local.sin_port = localPort != NULL ? htons((uint16_t)atoi(localPort)) : peer->sin_port;
+
+	fd = socket(AF_INET, SOCK_DGRAM|SOCK_NONBLOCK|SOCK_CLOEXEC, 0);
+	if (fd < 0)
+	{
+		return -1;
+	}
+	// Several nodes on one host share the channel's port
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+	if (bind(fd, (struct sockaddr*)&local, sizeof(local)) != 0)
+	{
+		close(fd);
+		return -1;
+	}
+	if (IN_MULTICAST(ntohl(peer->sin_addr.s_addr)))
+	{
+		struct ip_mreq mreq;
+
+		mreq.imr_multiaddr = peer->sin_addr;
+		mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+		if (setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) != 0)
+		{
+			close(fd);
+			return -1;
+		}
+	}
+	return fd;
+}
+
+static int openUnix(LinuxLdv* p, const char* path)
+{
+	struct sockaddr_un* peer = (struct sockaddr_un*)&p->peer;
+	sa_family_t local = AF_UNIX;
+	int fd;
+
+	if (strlen(path) >= sizeof(peer->sun_path))
+	{
+		return -1;
+	}
+	memset(peer, 0, sizeof(*peer));
+	peer->sun_family = AF_UNIX;
+	strcpy(peer->sun_path, path);
+	p->peerLen = sizeof(*peer);
+
+	fd = socket(AF_UNIX, SOCK_DGRAM|SOCK_NONBLOCK|SOCK_CLOEXEC, 0);
+	if (fd < 0)
+	{
+		return -1;
+	}
+	// Autobind to an abstract address so that the daemon can send back to us
+	if (bind(fd, (struct sockaddr*)&local, sizeof(local)) != 0)
+	{
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static void getNeuronId(Byte* nid)
+{
+	const char* s = getenv("LDV_NID");
+	long id;
+	int i;
+
+	if (s != NULL && strlen(s) == 2*VLDV_NID_LEN)
+	{
+		for (i=0; i<VLDV_NID_LEN; i++)
+		{
+			char hex[3] = {s[2*i], s[2*i+1], 0};
+			nid[i] = (Byte)strtoul(hex, NULL, 16);
+		}
+	}
+	else
+	{
+		id = gethostid();
+		nid[0] = 0;
+		nid[1] = 0;
+		for (i=0; i<4; i++)
+		{
+			nid[2+i] = (Byte)(id >> (24 - 8*i));
+		}
+	}
+}
+
+LDVCode vldv_open(const char* pName, pShort handle)
+{
+	LDVCode rtn = LDV_NO_RESOURCES;
+	char var[64];
+	char spec[128];
+	const char* s;
+	int i;
+
+	LCS_LOCK(ldvLock)
+	for (i=0; i<MAX_HANDLES; i++)
+	{
+		if (!ldvs[i].inUse)
+		{
+			LinuxLdv* p = &ldvs[i];
+			struct epoll_event ev;
+
+			snprintf(var, sizeof(var), "LDV_%s", pName);
+			s = getenv(var);
+			if (s != NULL)
+			{
+				snprintf(spec, sizeof(spec), "%s", s);
+			}
+			else
+			{
+				snprintf(spec, sizeof(spec), "udp:%s:%d", LDV_DEFAULT_GROUP, LDV_DEFAULT_PORT+i);
+			}
+
+			memset(p, 0, sizeof(*p));
+			if (strncmp(spec, "udp:", 4) == 0)
+			{
+				p->fd = openUdp(p, spec+4);
+			}
+			else if (strncmp(spec, "unix:", 5) == 0)
+			{
+				p->fd = openUnix(p, spec+5);
+			}
+			else
+			{
+				p->fd = -1;
+			}
+			if (p->fd < 0)
+			{
+				printf("vldv_open: can't open %s on %s\n", pName, spec);
+				rtn = LDV_OPEN_FAILURE;
+				break;
+			}
+
+			if (ldvEpoll < 0)
+			{
+				ldvEpoll = epoll_create1(EPOLL_CLOEXEC);
+			}
+			memset(&ev, 0, sizeof(ev));
+			ev.events = EPOLLIN;
+			ev.data.u32 = i;
+			if (ldvEpoll < 0 || epoll_ctl(ldvEpoll, EPOLL_CTL_ADD, p->fd, &ev) != 0)
+			{
+				close(p->fd);
+				rtn = LDV_INITIALIZATION_FAILED;
+				break;
+			}
+			p->epoll = ldvEpoll;
+
+			p->senderId = (uint32_t)getpid() << 8 ^ (uint32_t)time(NULL) << 20 ^ (uint32_t)i ^ (uint32_t)gethostid();
+			p->inUse = true;
+			*handle = i;
+
+			// Announce ourselves with an empty frame so that a channel daemon knows where to send.
+			sendto(p->fd, &p->senderId, sizeof(p->senderId), 0, (struct sockaddr*)&p->peer, p->peerLen);
+			rtn = LDV_OK;
+			break;
+		}
+	}
+	LCS_UNLOCK(ldvLock)
+	return rtn;
+}
+
+LDVCode vldv_close(short handle)
+{
+	LDVCode rtn = LDV_NOT_OPEN;
+	LinuxLdv* p;
+
+	// The handle table is shared by the stack threads
+	LCS_LOCK(ldvLock)
+	p = getLinuxLdv(handle);
+	if (p != NULL)
+	{
+		epoll_ctl(p->epoll, EPOLL_CTL_DEL, p->fd, NULL);
+		close(p->fd);
+		p->inUse = false;
+		rtn = LDV_OK;
+	}
+	LCS_UNLOCK(ldvLock)
+	return rtn;
+}
+
+LDVCode vldv_read(short handle, pVoid msg_p, short len)
+{
+	LDVCode rtn = LDV_NOT_OPEN;
+	LinuxLdv* p = getLinuxLdv(handle);
+	Byte dgram[sizeof(uint32_t) + VLDV_SICB_MAX_SIZE];
+	uint32_t senderId;
+	ssize_t n;
+	int lpduLen;
+
+	if (p != NULL && p->respLen)
+	{
+		rtn = LDV_INVALID_BUF_LEN;
+		if (p->respLen <= len)
+		{
+			memcpy(msg_p, p->resp, p->respLen);
+			p->respLen = 0;
+			rtn = LDV_OK;
+		}
+	}
+	else if (p != NULL)
+	{
+		rtn = LDV_NO_MSG_AVAIL;
+		while ((n = recv(p->fd, dgram, sizeof(dgram), 0)) >= 0)
+		{
+			memcpy(&senderId, dgram, sizeof(senderId));
+			lpduLen = (int)n - (int)sizeof(senderId);
+			if (lpduLen <= 0 || senderId == p->senderId)
+			{
+				// Runt or our own frame.
+				continue;
+			}
+			rtn = vldv_l2_frame(&dgram[sizeof(senderId)], lpduLen, (Byte*)msg_p, len);
+			break;
+		}
+		if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+		{
+			rtn = LDV_DEVICE_ERR;
+		}
+	}
+	return rtn;
+}
+
+LDVCode vldv_write(short handle, pVoid msg_p, short len)
+{
+	LDVCode rtn = LDV_NOT_OPEN;
+	LinuxLdv* p = getLinuxLdv(handle);
+	Byte* pSicb = (Byte*)msg_p;
+	Byte dgram[sizeof(uint32_t) + VLDV_SICB_MAX_SIZE];
+
+	if (p != NULL)
+	{
+		rtn = LDV_INVALID_BUF_LEN;
+		if (len >= 2 && SICB_SIZE(pSicb) <= len)
+		{
+			rtn = LDV_OK;
+			if (*pSicb>>4 == 0x01)
+			{
+				memcpy(dgram, &p->senderId, sizeof(p->senderId));
+				memcpy(&dgram[sizeof(p->senderId)], pSicb+2, pSicb[1]);
+				if (sendto(p->fd, dgram, sizeof(p->senderId) + pSicb[1], 0,
+						   (struct sockaddr*)&p->peer, p->peerLen) < 0)
+				{
+					rtn = errno == EAGAIN || errno == EWOULDBLOCK ? LDV_NO_BUFF_AVAIL : LDV_DEVICE_ERR;
+				}
+			}
+			else if (*pSicb == nicbLOCALNM)
+			{
+				if (p->respLen)
+				{
+					rtn = LDV_NO_BUFF_AVAIL;
+				}
+				else
+				{
+					Byte nid[VLDV_NID_LEN];
+
+					getNeuronId(nid);
+					p->respLen = vldv_local_nm(pSicb, nid, p->resp);
+				}
+			}
+			// Other commands (mode, phase) are for the transceiver, which we don't have.
+		}
+	}
+	return rtn;
+}
+
+LDVCode vldv_wait(unsigned long timeout)
+{
+	LDVCode rtn = LDV_NO_MSG_AVAIL;
+	struct epoll_event events[MAX_HANDLES];
+	int i;
+
+	for (i=0; i<MAX_HANDLES; i++)
+	{
+		if (ldvs[i].inUse && ldvs[i].epoll == ldvEpoll && ldvs[i].respLen)
+		{
+			return LDV_OK;
+		}
+	}
+
+	if (ldvEpoll < 0)
+	{
+		usleep(timeout*1000);
+	}
+	else if (epoll_wait(ldvEpoll, events, MAX_HANDLES, timeout > INT_MAX ? -1 : (int)timeout) > 0)
+	{
+		rtn = LDV_OK;
+	}
+	return rtn;
+}
+
+#endif	// PLATFORM_IS(LINUX) && !defined(LDV_VIRTUAL_CHANNEL)
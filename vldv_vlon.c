@@ -0,0 +1,481 @@
+//
+// vldv_vlon.c
+//
+// Copyright (C) 2022 Dialog Semiconductor
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in 
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+/*
+ *	vldv_vlon.c
+ *
+ *  In-process virtual LON channel (see vldv_vlon.h).  Build with LDV_VIRTUAL_CHANNEL defined, in place of the
+ *  platform's LDV backend, and with NUM_STACKS set to the number of nodes to simulate.
+ *
+ *  Each channel keeps the last VLON_RING_SIZE frames in a ring.  A frame written to the channel is stored once and
+ *  every other handle on the channel reads it in turn through its own read position, so a frame costs the same
+ *  whether there are two nodes or hundreds.  A receiver that falls a whole ring behind loses the oldest frames,
+ *  as a node with full input buffers would.
+ *
+ *  With a bit rate, each frame occupies the channel for its length in bits.  A frame written while the channel is
+ *  busy waits for it to end and then for one of VLON_RANDOM_SLOTS randomizing slots, each collisionWindow ms long.  Frames
+ *  that start within collisionWindow ms of each other collide and are delivered as CRC errors.  Loss is decided
+ *  per receiver.  Time is the stack's millisecond timer.
+ *
+ *  With LCS_THREAD_PER_STACK the stacks share the channels from their own threads.  A lock covers all the state
+ *  here and vldv_wait() only looks at the handles opened by the calling thread.
+ *
+ *  Local network management is answered here.  The n-th handle opened on a channel gets the Neuron ID
+ *  00 fd 00 00 <n+1>, so the stacks of a simulation have unique IDs.
+ */
+
+#include "echstd.h"
+
+#ifdef LDV_VIRTUAL_CHANNEL
+
+#include <stdlib.h>
+#include <string.h>
+#if PLATFORM_IS(SIM)
+#include "windows.h"
+#else
+#include <unistd.h>
+#endif
+
+#include "vldv.h"
+#include "vldv_vlon.h"
+#include "tmr.h"
+#include "lcs_platform.h"
+
+#define VLON_MAX_CHANNELS	4
+#ifndef VLON_MAX_HANDLES
+#define VLON_MAX_HANDLES	1024
+#endif
+#define VLON_RING_SIZE		256
+#define VLON_RANDOM_SLOTS	16
+#define VLON_LOOKBACK		32			// Frames looked at for carrier sense and collisions
+#define VLON_NAME_LEN		16
+
+#ifdef LCS_THREAD_PER_STACK
+// Other threads write frames while we sleep, so look again this often (ms)
+#define VLON_WAIT_SLICE		1
+#else
+#define VLON_WAIT_SLICE		0xFFFFFFFFUL
+#endif
+
+#define SICB_SIZE(p)		((p)[1] + 2)
+
+// TRUE if time a is before time b, allowing for wrap around
+#define VLON_BEFORE(a, b)	((long)((a) - (b)) < 0)
+
+typedef struct
+{
+	TmrDuration	start;				// When the frame went on the channel
+	TmrDuration	end;				// When it left the channel
+	TmrDuration	deliverAt;			// When receivers see it
+	short		src;				// Handle of the sender
+	Bool		collided;
+	int			len;				// LPDU length
+	Byte		lpdu[VLDV_SICB_MAX_SIZE];
+} VlonFrame;
+
+typedef struct
+{
+	char		name[VLON_NAME_LEN];	// Empty if the channel is free
+	VlonParams	params;
+	VlonStats	stats;
+	UInt32		seq;				// Sequence number of the next frame written
+	int			members;			// Handles opened on the channel so far
+	VlonFrame	ring[VLON_RING_SIZE];
+} VlonChannel;
+
+typedef struct
+{
+	VlonChannel* pChannel;			// NULL if the handle is free
+	const int*	pOwner;				// vlonOwner of the thread that opened it
+	UInt32		next;				// Sequence number of the next frame to read
+	Byte		nid[VLDV_NID_LEN];
+	int			respLen;			// Size of the local NM response waiting to be read, 0 if none
+	Byte		resp[VLDV_SICB_MAX_SIZE];
+} VlonHandle;
+
+static VlonChannel vlonChannels[VLON_MAX_CHANNELS];
+static VlonHandle vlonHandles[VLON_MAX_HANDLES];
+
+// Its address tells threads apart
+static LCS_THREAD_LOCAL int vlonOwner;
+
+#ifdef LCS_THREAD_PER_STACK
+static LcsLock vlonLock = LCS_LOCK_INIT;
+#endif
+
+static VlonChannel* findChannel(const char* pName, Bool create)
+{
+	VlonChannel* pFree = NULL;
+	int i;
+
+	for (i=0; i<VLON_MAX_CHANNELS; i++)
+	{
+		if (strncmp(vlonChannels[i].name, pName, VLON_NAME_LEN-1) == 0 && vlonChannels[i].name[0])
+		{
+			return &vlonChannels[i];
+		}
+		if (pFree == NULL && vlonChannels[i].name[0] == 0)
+		{
+			pFree = &vlonChannels[i];
+		}
+	}
+	if (create && pFree != NULL && pName[0])
+	{
+		strncpy(pFree->name, pName, VLON_NAME_LEN-1);
+	}
+	else
+	{
+		pFree = NULL;
+	}
+	return pFree;
+}
+
+static VlonHandle* getVlonHandle(short handle)
+{
+	if (handle >= 0 && handle < VLON_MAX_HANDLES && vlonHandles[handle].pChannel != NULL)
+	{
+		return &vlonHandles[handle];
+	}
+	return NULL;
+}
+
+// Put an LPDU on the channel
+static void transmit(VlonChannel* c, short src, const Byte* pLpdu, int len)
+{
+	const VlonParams* prm = &c->params;
+	TmrDuration now = TMR_GetCurrentTime();
+	TmrDuration start = now;
+	TmrDuration airtime = 0;
+	TmrDuration window = prm->collisionWindow;
+	VlonFrame* f;
+	VlonFrame* g;
+	UInt32 i;
+	Bool busy = true;
+
+	if (prm->bitRate)
+	{
+		// Add the CRC
+		airtime = ((len + 2)*8*1000 + prm->bitRate - 1)/prm->bitRate;
+	}
+	// Every access starts in a randomizing slot.  A frame that started more than a collision window before us
+	// is heard, so wait for it to end and then for another slot.  Nodes waiting on the same frame pick their
+	// slots after the same end, which is where collisions come from.
+	if (window)
+	{
+		start += (rand() % VLON_RANDOM_SLOTS)*window;
+	}
+	while (busy)
+	{
+		busy = false;
+		for (i=1; i<=VLON_LOOKBACK && i<=c->seq; i++)
+		{
+			g = &c->ring[(c->seq - i) % VLON_RING_SIZE];
+			if (!VLON_BEFORE(start, g->start + window) && VLON_BEFORE(start, g->end))
+			{
+				start = g->end + (window ? (rand() % VLON_RANDOM_SLOTS)*window : 0);
+				busy = true;
+			}
+		}
+	}
+
+	f = &c->ring[c->seq % VLON_RING_SIZE];
+	f->start = start;
+	f->end = start + airtime;
+	f->deliverAt = f->end + prm->latency;
+	f->src = src;
+	f->collided = false;
+	f->len = len;
+	memcpy(f->lpdu, pLpdu, len);
+
+	if (window)
+	{
+		for (i=1; i<=VLON_LOOKBACK && i<=c->seq; i++)
+		{
+			g = &c->ring[(c->seq - i) % VLON_RING_SIZE];
+			if (VLON_BEFORE(g->start, start + window) && VLON_BEFORE(start, g->start + window))
+			{
+				if (!g->collided)
+				{
+					g->collided = true;
+					c->stats.collided++;
+				}
+				if (!f->collided)
+				{
+					f->collided = true;
+					c->stats.collided++;
+				}
+			}
+		}
+	}
+
+	c->seq++;
+	c->stats.sent++;
+}
+
+void VLON_Configure(const char* pName, const VlonParams* pParams)
+{
+	VlonChannel* c;
+
+	LCS_LOCK(vlonLock)
+	c = findChannel(pName, true);
+	if (c != NULL)
+	{
+		c->params = *pParams;
+	}
+	LCS_UNLOCK(vlonLock)
+}
+
+void VLON_GetStats(const char* pName, VlonStats* pStats)
+{
+	VlonChannel* c;
+
+	memset(pStats, 0, sizeof(*pStats));
+	LCS_LOCK(vlonLock)
+	c = findChannel(pName, false);
+	if (c != NULL)
+	{
+		*pStats = c->stats;
+	}
+	LCS_UNLOCK(vlonLock)
+}
+
+LDVCode vldv_open(const char* pName, pShort handle)
+{
+	LDVCode rtn = LDV_NO_RESOURCES;
+	VlonChannel* c;
+	VlonHandle* p;
+	int i;
+
+	LCS_LOCK(vlonLock)
+	c = findChannel(pName, true);
+	for (i=0; c != NULL && i<VLON_MAX_HANDLES; i++)
+	{
+		p = &vlonHandles[i];
+		if (p->pChannel == NULL)
+		{
+			memset(p, 0, sizeof(*p));
+			p->pChannel = c;
+			p->pOwner = &vlonOwner;
+			p->next = c->seq;
+			c->members++;
+			p->nid[0] = 0x00;
+			p->nid[1] = 0xfd;
+			p->nid[4] = (Byte)(c->members >> 8);
+			p->nid[5] = (Byte)c->members;
+			*handle = i;
+			rtn = LDV_OK;
+			break;
+		}
+	}
+	LCS_UNLOCK(vlonLock)
+	return rtn;
+}
+
+LDVCode vldv_close(short handle)
+{
+	LDVCode rtn = LDV_NOT_OPEN;
+	VlonHandle* p;
+
+	LCS_LOCK(vlonLock)
+	p = getVlonHandle(handle);
+	if (p != NULL)
+	{
+		p->pChannel = NULL;
+		rtn = LDV_OK;
+	}
+	LCS_UNLOCK(vlonLock)
+	return rtn;
+}
+
+LDVCode vldv_read(short handle, pVoid msg_p, short len)
+{
+	LDVCode rtn = LDV_NOT_OPEN;
+	VlonHandle* p;
+	Byte* pSicb = (Byte*)msg_p;
+	VlonChannel* c;
+	VlonFrame* f;
+	TmrDuration now;
+
+	LCS_LOCK(vlonLock)
+	p = getVlonHandle(handle);
+	if (p != NULL && p->respLen)
+	{
+		rtn = LDV_INVALID_BUF_LEN;
+		if (p->respLen <= len)
+		{
+			memcpy(msg_p, p->resp, p->respLen);
+			p->respLen = 0;
+			rtn = LDV_OK;
+		}
+	}
+	else if (p != NULL)
+	{
+		rtn = LDV_NO_MSG_AVAIL;
+		c = p->pChannel;
+		now = TMR_GetCurrentTime();
+		if (c->seq - p->next > VLON_RING_SIZE)
+		{
+			c->stats.overrun += c->seq - p->next - VLON_RING_SIZE;
+			p->next = c->seq - VLON_RING_SIZE;
+		}
+		while (p->next != c->seq)
+		{
+			f = &c->ring[p->next % VLON_RING_SIZE];
+			if (VLON_BEFORE(now, f->deliverAt))
+			{
+				break;
+			}
+			p->next++;
+			if (f->src == handle)
+			{
+				continue;
+			}
+			if (c->params.lossPercent && (UInt16)(rand() % 100) < c->params.lossPercent)
+			{
+				c->stats.lost++;
+				continue;
+			}
+			if (f->collided)
+			{
+				pSicb[0] = nicbERROR;
+				pSicb[1] = 0;
+				rtn = LDV_OK;
+			}
+			else
+			{
+				rtn = vldv_l2_frame(f->lpdu, f->len, pSicb, len);
+				if (rtn == LDV_OK)
+				{
+					c->stats.delivered++;
+				}
+			}
+			break;
+		}
+	}
+	LCS_UNLOCK(vlonLock)
+	return rtn;
+}
+
+LDVCode vldv_write(short handle, pVoid msg_p, short len)
+{
+	LDVCode rtn = LDV_NOT_OPEN;
+	VlonHandle* p;
+	Byte* pSicb = (Byte*)msg_p;
+
+	LCS_LOCK(vlonLock)
+	p = getVlonHandle(handle);
+	if (p != NULL)
+	{
+		rtn = LDV_INVALID_BUF_LEN;
+		if (len >= 2 && SICB_SIZE(pSicb) <= len)
+		{
+			rtn = LDV_OK;
+			if (*pSicb>>4 == 0x01)
+			{
+				transmit(p->pChannel, handle, pSicb+2, pSicb[1]);
+			}
+			else if (*pSicb == nicbLOCALNM)
+			{
+				if (p->respLen)
+				{
+					rtn = LDV_NO_BUFF_AVAIL;
+				}
+				else
+				{
+					p->respLen = vldv_local_nm(pSicb, p->nid, p->resp);
+				}
+			}
+			// Other commands (mode, phase) are for the transceiver, which we don't have.
+		}
+	}
+	LCS_UNLOCK(vlonLock)
+	return rtn;
+}
+
+// Returns LDV_OK if one of the calling thread's handles has something to read.  Otherwise lowers *pWait to when the
+// first frame it hasn't read is due.
+static LDVCode pending(TmrDuration now, unsigned long* pWait)
+{
+	VlonHandle* p;
+	VlonFrame* f;
+	int i;
+
+	for (i=0; i<VLON_MAX_HANDLES; i++)
+	{
+		p = &vlonHandles[i];
+		if (p->pChannel != NULL && p->pOwner == &vlonOwner)
+		{
+			if (p->respLen || p->pChannel->seq - p->next > VLON_RING_SIZE)
+			{
+				return LDV_OK;
+			}
+			if (p->next != p->pChannel->seq)
+			{
+				f = &p->pChannel->ring[p->next % VLON_RING_SIZE];
+				if (!VLON_BEFORE(now, f->deliverAt))
+				{
+					return LDV_OK;
+				}
+				if (f->deliverAt - now < *pWait)
+				{
+					*pWait = f->deliverAt - now;
+				}
+			}
+		}
+	}
+	return LDV_NO_MSG_AVAIL;
+}
+
+LDVCode vldv_wait(unsigned long timeout)
+{
+	LDVCode rtn;
+	TmrDuration start = TMR_GetCurrentTime();
+	TmrDuration now = start;
+	unsigned long wait;
+
+	// The senders are all in this process, so sleep until the first frame a handle hasn't read is due.
+	while (1)
+	{
+		wait = timeout - (now - start);
+		LCS_LOCK(vlonLock)
+		rtn = pending(now, &wait);
+		LCS_UNLOCK(vlonLock)
+		if (rtn == LDV_OK || now - start >= timeout)
+		{
+			break;
+		}
+		if (wait > VLON_WAIT_SLICE)
+		{
+			wait = VLON_WAIT_SLICE;
+		}
+#if PLATFORM_IS(SIM)
+		Sleep(wait);
+#else
+		usleep(wait*1000);
+#endif
+		now = TMR_GetCurrentTime();
+	}
+	return rtn;
+}
+
+#endif	// LDV_VIRTUAL_CHANNEL
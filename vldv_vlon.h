@@ -0,0 +1,64 @@
+//
+// vldv_vlon.h
+//
+// Copyright (C) 2022 Dialog Semiconductor
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in 
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+/*
+ *	vldv_vlon.h
+ *
+ *  In-process virtual LON channel.  Implements the LDV interface (vldv.h) for
+ *  builds with LDV_VIRTUAL_CHANNEL defined, so that NUM_STACKS stacks in one
+ *  process can talk to each other without hardware.
+ */
+
+#ifndef __VLDV_VLON_H
+#define __VLDV_VLON_H
+
+#include "EchelonStandardDefinitions.h"
+
+// Channel characteristics.  All zero (the default) is an ideal channel: no loss, no delay, no collisions.
+typedef struct
+{
+	UInt16	lossPercent;		// Chance (0-100) that a given receiver misses a frame
+	UInt16	latency;			// Delay in ms from the end of a frame to its delivery
+	UInt32	bitRate;			// Bits per second.  Frames take time on the channel and queue behind each other.  0 for no limit.
+	UInt16	collisionWindow;	// Frames starting within this many ms of each other collide.  0 for no collisions.
+} VlonParams;
+
+typedef struct
+{
+	UInt32	sent;				// Frames put on the channel
+	UInt32	delivered;			// Frames read by receivers (one per receiver)
+	UInt32	lost;				// Frames dropped by lossPercent (one per receiver)
+	UInt32	collided;			// Frames corrupted by a collision
+	UInt32	overrun;			// Frames overwritten before a receiver read them (one per receiver)
+} VlonStats;
+
+C_API_START
+
+// Each interface name passed to vldv_open() (e.g. "RF", "PLC") is a separate channel.  Configure before or after the
+// stacks open it.
+void VLON_Configure(const char* pName, const VlonParams* pParams);
+void VLON_GetStats(const char* pName, VlonStats* pStats);
+
+C_API_END
+
+#endif	// __VLDV_VLON_H